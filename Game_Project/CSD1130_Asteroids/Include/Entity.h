@@ -18,6 +18,7 @@ prior written consent of DigiPen Institute of Technology is prohibited.
 #include "AEMath.h"
 #include "Collision.h"
 #include <unordered_map>
+#include <vector>
 #include <string> 
 
 struct BGObject
@@ -94,8 +95,8 @@ struct FadeObject
 
 */
 const unsigned int	GAME_OBJ_NUM_MAX = 32;			// The total number of different objects (Shapes)
-const unsigned int	GAME_OBJ_INST_NUM_MAX = 2048;			// The total number of different game object instances
-const unsigned int  BULLET_ID_MAX = 100;
+const unsigned int	GAME_OBJ_INST_NUM_MAX = 8192;			// The total number of different game object instances
+const unsigned int  BULLET_ID_MAX = 100;				// bullet ids each player cycles through, id = player * BULLET_ID_MAX + n
 
 /******************************************************************************/
 /*!
@@ -150,8 +151,8 @@ struct GameData
 	GameObjInst			sGameObjInstList[GAME_OBJ_INST_NUM_MAX];	// Each element in this array represents a unique game object instance (sprite)
 	unsigned long		sGameObjInstNum;							// The number of used game object instances
 
-	// pointer to the ship object
-	GameObjInst* spShip[4];										// Pointer to the "Ship" game object instance
+	// pointer to the ship object, indexed by player id and grown as players show up
+	std::vector<GameObjInst*> spShip;							// Pointer to the "Ship" game object instance
 
 	uint32_t bulletIDCount{0};
 
@@ -173,11 +174,15 @@ struct GameData
 	TextObj textList[4];
 	TextObj highScoreTextList[5];
 	TextObj playerTextScores[4];
-	uint32_t playerScores[4];
+	std::vector<uint32_t> playerScores;						// same size as spShip
 	std::vector<PlayerScore> highScores; // Adjust if score type differs
 	int currID{};
+	// newest snapshot tick seen, older ones that arrive late are dropped
+	uint32_t lastSnapshotTick{};
 
 	std::unordered_map<int, GameObjInst*> asteroidMap;
+	// bullet id (see BULLET_ID_MAX) -> instance, bullets no longer sit at fixed indices
+	std::unordered_map<int, GameObjInst*> bulletMap;
 };
 
 
@@ -57,10 +57,6 @@ void GameStateAsteroidsProcessMessage();
 ***************************************************************************/
 void UpdateGOCollisionBoxes();
 /*!*************************************************************************
-\brief Checks the collision between game objects
-***************************************************************************/
-void CheckGOCollision();
-/*!*************************************************************************
 \brief Updates the game object instances
 ***************************************************************************/
 void UpdateGO();
@@ -94,6 +90,29 @@ void NewAsteroidWave();
 \brief Resets the ship when its hit
 ***************************************************************************/
 void  ResetShip();
+/*!*************************************************************************
+\brief Removes an asteroid the server destroyed
+
+\param[in] asteroidID - the server's id for the asteroid
+***************************************************************************/
+void DestroyServerAsteroid(int asteroidID);
+/*!*************************************************************************
+\brief Gets a player's ship, creating it the first time the id shows up
+
+\param[in] id - the player's id from the server
+
+\return the ship instance
+***************************************************************************/
+GameObjInst *GetShip(int id);
+/*!*************************************************************************
+\brief Moves another player's ship by one of its input frames, the same way
+our own ship moves for that key
+
+\param[in] ship - the ship to move
+
+\param[in] input - 1 forward, 2 backward, 3 left, 4 right
+***************************************************************************/
+void ApplyRemoteInput(GameObjInst *ship, int input);
 
 
 
@@ -0,0 +1,147 @@
+/*******************************************************************************
+ * Redundant input history
+ *
+ * The client numbers every fixed step and sends its last INPUT_HISTORY_LEN
+ * inputs in each SHIP_MOVE, so one lost packet doesnt lose an input, the next
+ * packet carries it again. The server keeps the newest frame it has applied
+ * and skips anything at or below it.
+ *
+ * Wire format inside SHIP_MOVE: [newest frame u32][count u8][input u8 * count]
+ * inputs go oldest first, so input i belongs to frame newest - count + 1 + i.
+ *
+ * The same file lives in the server and the client.
+ ******************************************************************************/
+
+#ifndef INPUT_HISTORY_H
+#define INPUT_HISTORY_H
+
+#include <cstdint>
+#include "Packet.h"
+
+#define INPUT_HISTORY_LEN 8
+
+// client side, ring of the last few fixed step inputs
+class InputHistory
+{
+public:
+	void Reset()
+	{
+		_newest = 0;
+		_count = 0;
+	}
+
+	void Push(uint32_t frame, uint8_t input)
+	{
+		_newest = frame;
+		_inputs[frame % INPUT_HISTORY_LEN] = input;
+		if (_count < INPUT_HISTORY_LEN) ++_count;
+	}
+
+	// true while anything in the ring is still a real input, so the
+	// frames after a key is let go also get sent a few times
+	bool HasActivity() const
+	{
+		for (uint8_t i = 0; i < _count; ++i)
+		{
+			if (_inputs[(_newest - i) % INPUT_HISTORY_LEN] != 0) return true;
+		}
+		return false;
+	}
+
+	void Write(Packet& packet) const
+	{
+		packet << _newest << _count;
+		for (uint8_t i = 0; i < _count; ++i)
+		{
+			uint32_t frame = _newest - _count + 1 + i;
+			packet << _inputs[frame % INPUT_HISTORY_LEN];
+		}
+	}
+
+	uint32_t Newest() const { return _newest; }
+
+private:
+	uint32_t _newest = 0;
+	uint8_t _count = 0;
+	uint8_t _inputs[INPUT_HISTORY_LEN]{};
+};
+
+// one decoded history off the wire
+struct InputHistoryMsg
+{
+	uint32_t newest = 0;
+	uint8_t count = 0;
+	uint8_t inputs[INPUT_HISTORY_LEN]{};
+};
+
+inline bool ReadInputHistory(Packet& packet, InputHistoryMsg& msg)
+{
+	packet >> msg.newest >> msg.count;
+	if (msg.count == 0 || msg.count > INPUT_HISTORY_LEN || msg.count > msg.newest) return false;
+
+	for (uint8_t i = 0; i < msg.count; ++i)
+	{
+		packet >> msg.inputs[i];
+	}
+	return true;
+}
+
+struct InputReceiverStats
+{
+	uint64_t applied = 0;    // frames handed to the game
+	uint64_t recovered = 0;  // of those, frames whose own packet never made it
+	uint64_t duplicates = 0; // frames we already had
+	uint64_t stale = 0;      // whole packets older than what we applied
+};
+
+// server side, one per client
+class InputReceiver
+{
+public:
+	// a new player in the slot, nothing of the last one's counts carries over
+	void Reset()
+	{
+		_lastFrame = 0;
+		_stats = {};
+	}
+
+	// calls fn(frame, input) for every frame newer than the last one applied, oldest first
+	// returns false if the whole packet was old news
+	template <typename TFn>
+	bool Accept(const InputHistoryMsg& msg, TFn&& fn)
+	{
+		if (msg.newest <= _lastFrame)
+		{
+			++_stats.stale;
+			_stats.duplicates += msg.count;
+			return false;
+		}
+
+		uint32_t first = msg.newest - msg.count + 1;
+		for (uint8_t i = 0; i < msg.count; ++i)
+		{
+			uint32_t frame = first + i;
+			if (frame <= _lastFrame)
+			{
+				++_stats.duplicates;
+				continue;
+			}
+
+			// only the newest frame in a packet is its own, the rest are there as backup
+			if (frame != msg.newest) ++_stats.recovered;
+			++_stats.applied;
+			fn(frame, msg.inputs[i]);
+		}
+		_lastFrame = msg.newest;
+		return true;
+	}
+
+	uint32_t LastFrame() const { return _lastFrame; }
+	const InputReceiverStats& GetStats() const { return _stats; }
+
+private:
+	uint32_t _lastFrame = 0;
+	InputReceiverStats _stats;
+};
+
+#endif
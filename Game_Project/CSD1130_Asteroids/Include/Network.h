@@ -8,6 +8,7 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <Packet.h>
+#include <Fec.h>
 #pragma comment(lib, "Ws2_32.lib")
 #endif
 
@@ -16,6 +17,8 @@
 #include <atomic>
 #include <queue>
 #include <mutex>
+#include <deque>
+#include <chrono>
 
 #define WINSOCK_SUBVERSION  2
 #define RETURN_CODE_1       1
@@ -23,6 +26,20 @@
 #define RETURN_CODE_3       3
 #define RETURN_CODE_4       4
 
+#define TIME_SYNC_SAMPLES        16   // how many ping results we keep around
+#define TIME_SYNC_BURST          8    // pings sent quickly right after connecting
+#define TIME_SYNC_BURST_MS       100
+#define TIME_SYNC_INTERVAL_MS    2000
+#define KEEPALIVE_INTERVAL_MS    1000 // well under the server's idle timeout
+
+// one ntp style exchange, all in ms
+struct ClockSample
+{
+	double localTime; // our clock when the reply came back (t3)
+	double offset;    // server clock - our clock
+	double rtt;       // round trip minus server processing
+};
+
 
 class NetworkClient
 {
@@ -39,13 +56,16 @@ public:
 
 	int Init();
 	void Shutdown();
-	void SetShutdownPCK(int currID);
+	void SetShutdownPCK(int currID, uint32_t token);
 	void SendMessages(SOCKET clientSocket);
 	void SendSingularMessage(SOCKET clientSocket, Packet msg);
 	void ReceiveMessages(SOCKET udpSocket);
+	void HandleDatagram(const char* buffer, int len);
 	Packet GetIncomingMessage();
 	void CreateMessage(Packet msg);
 	uint64_t GetTimeDiff();
+	uint64_t GetServerTime();
+	bool IsClockSynced();
 
 private:
 	SOCKET udpSocket;
@@ -63,8 +83,31 @@ private:
 
 	std::chrono::steady_clock::time_point gameStartTime;
 
+	void SendTimeSync(SOCKET clientSocket);
+	void ProcessTimeSync(Packet& reply);
+	void UpdateClockEstimate();
+
+	// estimate of the server clock relative to ours
+	std::mutex clockMutex;
+	std::deque<ClockSample> clockSamples;
+	double clockOffset{ 0.0 };     // ms
+	double clockDrift{ 0.0 };      // ms of offset change per ms of our clock
+	double clockBaseTime{ 0.0 };   // our clock at the time clockOffset was measured
+	bool clockSynced{ false };
+	int timeSyncSent{ 0 };
+	std::chrono::steady_clock::time_point lastTimeSync;
+
 	Packet shutdownPck;
 
+	// session handed to us in REPLY_PLAYER_JOIN, -1 until we have joined
+	std::atomic_int sessionID{ -1 };
+	std::atomic_uint32_t sessionToken{ 0 };
+	std::chrono::steady_clock::time_point lastKeepAlive;
+
+	// rebuilds protected messages the server sent with parity, stats go back on KEEPALIVE
+	std::mutex fecMutex;
+	FecDecoder fecDecoder;
+
 	// use mutex to share a queue between game loop and threads
 	/*
 	
@@ -25,9 +25,24 @@ enum CMDID : unsigned char {
 	NEW_HIGHSCORE,
 	GAME_START,
 	GAME_OVER,
+	TIME_SYNC, // ntp style ping, client t0 -> server t1/t2 -> client t3
+	KEEPALIVE, // [id][token], keeps an idle session from timing out
+	FEC_DATA, // a protected datagram, see Fec.h
+	FEC_PARITY, // xor of the last group of FEC_DATA
+	ENTITY_ENTER, // [count]([kind][id][state])..., came into the client's area of interest
+	ENTITY_LEAVE, // [count]([kind][id])..., went out of it
+	LOCKSTEP_FRAME, // [tick][checksum][last][count](op)..., what went into a tick, see Lockstep.h
+	LOCKSTEP_CHECKSUM, // [id][tick][checksum], a peer's state after that tick
 	PACKET_ERROR
 };
 
+// what an ENTITY_ENTER/ENTITY_LEAVE entry is about. a ship's state is the usual
+// [pos][vel][dir][score], an asteroid's is [pos][vel][dir]
+enum ENTITY_KIND : unsigned char {
+	ENTITY_SHIP = 0,
+	ENTITY_ASTEROID
+};
+
 struct Packet
 {
 	char body[MAX_BODY_LEN];
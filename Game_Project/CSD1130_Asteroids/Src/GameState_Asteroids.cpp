@@ -15,9 +15,12 @@ prior written consent of DigiPen Institute of Technology is prohibited.
  /******************************************************************************/
 
 #include <Network.h>
+#include <InputHistory.h>
+#include <Lockstep.h>
 #include "main.h"
 #include "ProcessReceive.h"
 #include <sstream>
+#include <algorithm>
 #include <iostream>
 /******************************************************************************/
 /*!
@@ -52,6 +55,7 @@ const float			POWERUP_ACCEL = 50.0f;
 const float         POWERUP_TIME = 5.0f;
 const float         WAVE_TIME = 4.0f;
 const float			FIXED_DELTA_TIME = 0.01667f; // Fixed time step for 60 FPS
+const float			SHIP_CORRECTION_DIST = 30.0f; // how far the server can disagree before our ship gets snapped
 
 // -----------------------------------------------------------------------------
 enum TYPE
@@ -87,8 +91,9 @@ const unsigned long FLAG_ACTIVE = 0x00000001;
 // functions to create/destroy a game object instance
 GameObjInst *gameObjInstCreate(unsigned long type, AEVec2 *scale,
 	AEVec2 *pPos, AEVec2 *pVel, float dir);
-GameObjInst *bulletObjInstCreate(AEVec2 *pPos, AEVec2 *pVel, float dir, uint32_t id = 99999);
+GameObjInst *bulletObjInstCreate(AEVec2 *pPos, AEVec2 *pVel, float dir, int id = -1);
 void				gameObjInstDestroy(GameObjInst *pInst);
+void				bulletObjInstDestroy(GameObjInst *pInst);
 
 // To help render game object instances that holds mesh textures
 void RenderMeshObj(GameObjInst *GO);
@@ -118,7 +123,9 @@ namespace
 
 	double accumulatedTime = 0.0;
 
-
+	// every fixed step gets a number, the last few inputs ride along in each SHIP_MOVE
+	uint32_t inputFrame = 0;
+	InputHistory inputHistory;
 }
 
 /******************************************************************************/
@@ -140,12 +147,9 @@ void GameStateAsteroidsLoad(void)
 	// No game object instances (sprites) at this point
 	gameData.sGameObjInstNum = 0;
 
-	// The ship object instance hasn't been created yet, so this "spShip" pointer is initialized to 0
-	for (int i = 0; i < 4; ++i)
-	{
-		gameData.spShip[i] = nullptr;
-
-	}
+	// The ship object instances haven't been created yet, they get made as players show up
+	gameData.spShip.clear();
+	gameData.playerScores.clear();
 
 	// Load the textures
 	asteroidTexture = AEGfxTextureLoad("../Resources/Textures/asteroid.png");
@@ -343,21 +347,13 @@ void GameStateAsteroidsInit(void)
 	// create the main ship
 	// i think sending info of ship will be done in update
 	AEVec2 scale;
-	AEVec2 pos, vel;
-	AEVec2Set(&scale, SHIP_SCALE_X, SHIP_SCALE_Y);
-	AEVec2Set(&pos, 0, 0);
-	AEVec2Set(&vel, 0, 0);
-
-	// instantiate all 4 first
-	// but we're only gonna be using the ones that are being used by clients
-	for (int i = 0; i < 4; ++i)
-	{
-		gameData.spShip[i] = gameObjInstCreate(TYPE_SHIP, &scale, &pos, &vel, 0.0f);
-		AE_ASSERT(gameData.spShip[i]);
-		gameData.spShip[i]->posPrev.x = gameData.spShip[i]->posCurr.x;
-		gameData.spShip[i]->posPrev.y = gameData.spShip[i]->posCurr.y;
-		gameData.spShip[i]->active = false;
-	}
+	// ships get made when the server tells us about a player, this is just ours
+	// so input has something to move before the join reply comes back
+	gameData.spShip.clear();
+	gameData.playerScores.clear();
+	gameData.asteroidMap.clear();
+	gameData.bulletMap.clear();
+	GetShip(gameData.currID);
 
 
 	// no creating anything new i think
@@ -368,12 +364,14 @@ void GameStateAsteroidsInit(void)
 
 	// reset the score and the number of ships
 	//gameData.sScore = 0;
-	for (int i = 0; i < 4; ++i)
+	for (uint32_t& score : gameData.playerScores)
 	{
-		gameData.playerScores[i] = 0;
+		score = 0;
 	}
 
 	accumulatedTime = 0.0;
+	// inputFrame keeps counting across restarts, the server only takes frames newer than the last
+	inputHistory.Reset();
 
 	gameOver = false;
 	gameData.onValueChange = true; // To reprint the console if player choose to restart
@@ -386,13 +384,10 @@ void GameStateAsteroidsInit(void)
 /******************************************************************************/
 void GameStateAsteroidsUpdate(void)
 {
-	static float timer = 0.0f;
 	int playerInput = 0;
 	accumulatedTime += AEFrameRateControllerGetFrameTime();
 	while (accumulatedTime >= FIXED_DELTA_TIME)
 	{
-		timer += (float)AEFrameRateControllerGetFrameTime();
-
 		// =========================================================
 		// update according to input
 		// =========================================================
@@ -404,7 +399,7 @@ void GameStateAsteroidsUpdate(void)
 			AEVec2Set(&dir, cosf(gameData.spShip[gameData.currID]->dirCurr), sinf(gameData.spShip[gameData.currID]->dirCurr));
 			AEVec2Normalize(&dir, &dir);
 
-			AEVec2Scale(&dir, &dir, SHIP_ACCEL_FORWARD * (float)(AEFrameRateControllerGetFrameTime()) * 0.99f);
+			AEVec2Scale(&dir, &dir, SHIP_ACCEL_FORWARD * FIXED_DELTA_TIME * 0.99f);
 			AEVec2Add(&gameData.spShip[gameData.currID]->velCurr, &gameData.spShip[gameData.currID]->velCurr, &dir);
 
 			gameData.spShip[gameData.currID]->pObject->pTexture = shipFireTexture;
@@ -419,7 +414,7 @@ void GameStateAsteroidsUpdate(void)
 			AEVec2 dir;
 			AEVec2Set(&dir, cosf(gameData.spShip[gameData.currID]->dirCurr), sinf(gameData.spShip[gameData.currID]->dirCurr));
 			AEVec2Normalize(&dir, &dir);
-			AEVec2Scale(&dir, &dir, -SHIP_ACCEL_BACKWARD * (float)(AEFrameRateControllerGetFrameTime()) * 0.99f);
+			AEVec2Scale(&dir, &dir, -SHIP_ACCEL_BACKWARD * FIXED_DELTA_TIME * 0.99f);
 			AEVec2Add(&gameData.spShip[gameData.currID]->velCurr, &gameData.spShip[gameData.currID]->velCurr, &dir);
 			gameData.spShip[gameData.currID]->pObject->pTexture = shipFireTexture;
 
@@ -429,7 +424,7 @@ void GameStateAsteroidsUpdate(void)
 		if (AEInputCheckCurr(AEVK_LEFT))
 		{
 			// Rotate the ship, wrap the angle
-			gameData.spShip[gameData.currID]->dirCurr += SHIP_ROT_SPEED * (float)(AEFrameRateControllerGetFrameTime());
+			gameData.spShip[gameData.currID]->dirCurr += SHIP_ROT_SPEED * FIXED_DELTA_TIME;
 			gameData.spShip[gameData.currID]->dirCurr = AEWrap(gameData.spShip[gameData.currID]->dirCurr, -PI, PI);
 
 			playerInput = 3;
@@ -438,7 +433,7 @@ void GameStateAsteroidsUpdate(void)
 		if (AEInputCheckCurr(AEVK_RIGHT))
 		{
 			// Rotate the ship, wrap the angle
-			gameData.spShip[gameData.currID]->dirCurr -= SHIP_ROT_SPEED * (float)(AEFrameRateControllerGetFrameTime());
+			gameData.spShip[gameData.currID]->dirCurr -= SHIP_ROT_SPEED * FIXED_DELTA_TIME;
 			gameData.spShip[gameData.currID]->dirCurr = AEWrap(gameData.spShip[gameData.currID]->dirCurr, -PI, PI);
 
 			playerInput = 4;
@@ -468,9 +463,10 @@ void GameStateAsteroidsUpdate(void)
 			vel.y = BULLET_SPEED * sinf(gameData.spShip[gameData.currID]->dirCurr);
 			AEVec2Set(&scale, BULLET_SCALE_X, BULLET_SCALE_Y);
 			GameObjInst *bulletObj = bulletObjInstCreate(&pos, &vel, gameData.spShip[gameData.currID]->dirCurr);
+			if (bulletObj)
 			{
 				Packet pck(CMDID::BULLET_CREATED);
-				pck << gameData.currID << NetworkClient::Instance().GetTimeDiff() << bulletObj->serverID << pos.x << pos.y << vel.x << vel.y << gameData.spShip[gameData.currID]->dirCurr;
+				pck << gameData.currID << NetworkClient::Instance().GetServerTime() << bulletObj->serverID << pos.x << pos.y << vel.x << vel.y << gameData.spShip[gameData.currID]->dirCurr;
 				NetworkClient::Instance().CreateMessage(pck);
 			}
 
@@ -478,7 +474,7 @@ void GameStateAsteroidsUpdate(void)
 		//if (AEInputCheckTriggered(AEVK_TAB))
 		//{
 		//	Packet pck(CLIENT_REQ_HIGHSCORE);
-		//	pck << gameData.currID << NetworkClient::Instance().GetTimeDiff();
+		//	pck << gameData.currID << NetworkClient::Instance().GetServerTime();
 
 		//	// Send packet to server
 		//	NetworkClient::Instance().CreateMessage(pck);
@@ -514,8 +510,7 @@ void GameStateAsteroidsUpdate(void)
 		// ======================================================================
 		// check for dynamic-dynamic collisions
 		// ======================================================================
-		// Loop through GO lists and check collisions between objects
-		CheckGOCollision();
+		// the server resolves these now and sends BULLET_COLLIDE/SHIP_COLLIDE
 
 		// Update the GOs (i.e movement, etc)
 		UpdateGO();
@@ -547,11 +542,17 @@ void GameStateAsteroidsUpdate(void)
 
 
 
-		if (playerInput != 0)
+		// nothing worth resending in the ring means we went quiet, start a fresh run
+		if (!inputHistory.HasActivity()) inputHistory.Reset();
+		inputHistory.Push(++inputFrame, static_cast<uint8_t>(playerInput));
+
+		// keeps sending for a few steps after the key is let go so the release gets through too
+		if (inputHistory.HasActivity())
 		{
 			Packet pck(CMDID::SHIP_MOVE);
-			pck << gameData.currID << NetworkClient::Instance().GetTimeDiff() << playerInput <<
-				gameData.spShip[gameData.currID]->posCurr.x << gameData.spShip[gameData.currID]->posCurr.y <<
+			pck << gameData.currID << NetworkClient::Instance().GetServerTime();
+			inputHistory.Write(pck);
+			pck << gameData.spShip[gameData.currID]->posCurr.x << gameData.spShip[gameData.currID]->posCurr.y <<
 				gameData.spShip[gameData.currID]->velCurr.x << gameData.spShip[gameData.currID]->velCurr.y <<
 				gameData.spShip[gameData.currID]->dirCurr << gameData.playerScores[gameData.currID];
 			NetworkClient::Instance().CreateMessage(pck);
@@ -567,14 +568,6 @@ void GameStateAsteroidsUpdate(void)
 			//	"Dir:" << gameData.spShip->dirCurr;
 		}
 
-		if (timer >= 2.0f)
-		{
-			timer = 0.0f;
-			Packet pck(CMDID::SHIP_SCORE);
-			pck << gameData.currID << gameData.playerScores[gameData.currID];
-			NetworkClient::Instance().CreateMessage(pck);
-		}
-
 		accumulatedTime -= FIXED_DELTA_TIME;
 	}
 
@@ -679,9 +672,19 @@ void GameStateAsteroidsDraw(void)
 		}
 	}
 
-	for (int i = 0; i < 4; ++i)
+	// only 4 lines on screen, so show the best 4 of whoever is playing
+	std::vector<int> shown;
+	for (int i = 0; i < (int)gameData.spShip.size(); ++i)
 	{
-		snprintf(strBuffer, sizeof(strBuffer), "%s %d", gameData.playerTextScores[i].str.c_str(), gameData.playerScores[i]);
+		if (gameData.spShip[i] && gameData.spShip[i]->active) shown.push_back(i);
+	}
+	size_t numShown = std::min(shown.size(), (size_t)4);
+	std::partial_sort(shown.begin(), shown.begin() + numShown, shown.end(),
+		[](int a, int b) { return gameData.playerScores[a] > gameData.playerScores[b]; });
+
+	for (size_t i = 0; i < numShown; ++i)
+	{
+		snprintf(strBuffer, sizeof(strBuffer), "Player %d: %d", shown[i], gameData.playerScores[shown[i]]);
 
 		// Render the text object after assigning the string val
 		RenderText(&gameData.playerTextScores[i], fontSize, strBuffer);
@@ -793,7 +796,7 @@ GameObjInst *gameObjInstCreate(unsigned long type,
 	AE_ASSERT_PARM(type < gameData.sGameObjNum);
 
 	// loop through the object instance list to find a non-used object instance
-	for (unsigned long i = 400; i < GAME_OBJ_INST_NUM_MAX; i++)
+	for (unsigned long i = 0; i < GAME_OBJ_INST_NUM_MAX; i++)
 	{
 		GameObjInst *pInst = gameData.sGameObjInstList + i;
 
@@ -820,38 +823,108 @@ GameObjInst *gameObjInstCreate(unsigned long type,
 	return 0;
 }
 
-GameObjInst *bulletObjInstCreate(AEVec2 *pPos, AEVec2 *pVel, float dir, uint32_t id)
+GameObjInst *bulletObjInstCreate(AEVec2 *pPos, AEVec2 *pVel, float dir, int id)
 {
-	GameObjInst *pInst;
-	if (id == 99999)
+	if (id < 0)
 	{
-		pInst = gameData.sGameObjInstList + 4 + (gameData.currID * BULLET_ID_MAX) + gameData.bulletIDCount;
-		pInst->serverID = 4 + (gameData.currID * BULLET_ID_MAX) + gameData.bulletIDCount;
+		// our own bullet, ids are unique per player so they dont clash with anyone else's
+		id = gameData.currID * BULLET_ID_MAX + gameData.bulletIDCount;
 		if (++gameData.bulletIDCount >= BULLET_ID_MAX)
 		{
 			gameData.bulletIDCount = 0;
 		}
 	}
-	else // valid ID
+
+	// the id came back around, the old bullet is gone by now
+	auto it = gameData.bulletMap.find(id);
+	if (it != gameData.bulletMap.end())
 	{
-		pInst = gameData.sGameObjInstList + id;
-		pInst->serverID = id;
+		bulletObjInstDestroy(it->second);
 	}
-	pInst->pObject = gameData.sGameObjList + TYPE_BULLET;
-	pInst->flag = FLAG_ACTIVE;
-	pInst->active = true;
+
 	AEVec2 scale;
 	AEVec2Set(&scale, BULLET_SCALE_X, BULLET_SCALE_Y);
-	pInst->scale = scale;
+	GameObjInst *pInst = gameObjInstCreate(TYPE_BULLET, &scale, pPos, pVel, dir);
+	if (!pInst) return nullptr;
 
-	pInst->posCurr = *pPos;
-	pInst->posPrev = pInst->posCurr;
-	pInst->velCurr = *pVel;
-	pInst->dirCurr = dir;
+	pInst->serverID = id;
+	gameData.bulletMap[id] = pInst;
 
 	return pInst;
 }
 
+/// <summary>
+/// Destroys a bullet and forgets its id
+/// </summary>
+/// <param name="pInst">The bullet to destroy</param>
+void bulletObjInstDestroy(GameObjInst *pInst)
+{
+	auto it = gameData.bulletMap.find(pInst->serverID);
+	if (it != gameData.bulletMap.end() && it->second == pInst)
+	{
+		gameData.bulletMap.erase(it);
+	}
+	gameObjInstDestroy(pInst);
+}
+
+/// <summary>
+/// Gets the ship for a player id, making it the first time that player shows up
+/// </summary>
+/// <param name="id">The player's id from the server</param>
+/// <returns>The ship instance</returns>
+GameObjInst *GetShip(int id)
+{
+	if (id >= (int)gameData.spShip.size())
+	{
+		gameData.spShip.resize(id + 1, nullptr);
+		gameData.playerScores.resize(id + 1, 0);
+	}
+
+	if (!gameData.spShip[id])
+	{
+		AEVec2 scale, pos, vel;
+		AEVec2Set(&scale, SHIP_SCALE_X, SHIP_SCALE_Y);
+		AEVec2Zero(&pos);
+		AEVec2Zero(&vel);
+
+		GameObjInst *ship = gameObjInstCreate(TYPE_SHIP, &scale, &pos, &vel, 0.0f);
+		AE_ASSERT(ship);
+		ship->active = false;
+		gameData.spShip[id] = ship;
+	}
+	return gameData.spShip[id];
+}
+
+/// <summary>
+/// Moves another player's ship by one input frame, same math as our own ship in the update
+/// </summary>
+/// <param name="ship">The ship to move</param>
+/// <param name="input">1 forward, 2 backward, 3 left, 4 right</param>
+void ApplyRemoteInput(GameObjInst *ship, int input)
+{
+	AEVec2 dir;
+	AEVec2Set(&dir, cosf(ship->dirCurr), sinf(ship->dirCurr));
+	switch (input)
+	{
+	case 1:
+		AEVec2Scale(&dir, &dir, SHIP_ACCEL_FORWARD * FIXED_DELTA_TIME * 0.99f);
+		AEVec2Add(&ship->velCurr, &ship->velCurr, &dir);
+		break;
+	case 2:
+		AEVec2Scale(&dir, &dir, -SHIP_ACCEL_BACKWARD * FIXED_DELTA_TIME * 0.99f);
+		AEVec2Add(&ship->velCurr, &ship->velCurr, &dir);
+		break;
+	case 3:
+		ship->dirCurr = AEWrap(ship->dirCurr + SHIP_ROT_SPEED * FIXED_DELTA_TIME, -PI, PI);
+		break;
+	case 4:
+		ship->dirCurr = AEWrap(ship->dirCurr - SHIP_ROT_SPEED * FIXED_DELTA_TIME, -PI, PI);
+		break;
+	default:
+		break;
+	}
+}
+
 /******************************************************************************/
 /*!
 	Destroy game object instance
@@ -889,8 +962,9 @@ void UpdateGO()
 		if ((pInst->flag & FLAG_ACTIVE) == 0)
 			continue;
 
-		pInst->posCurr.x += (float)(AEFrameRateControllerGetFrameTime()) * pInst->velCurr.x;
-		pInst->posCurr.y += (float)(AEFrameRateControllerGetFrameTime()) * pInst->velCurr.y;
+		// called once per fixed step, so move by the step and not the frame time
+		pInst->posCurr.x += FIXED_DELTA_TIME * pInst->velCurr.x;
+		pInst->posCurr.y += FIXED_DELTA_TIME * pInst->velCurr.y;
 
 		// check if the object is a ship
 		switch (pInst->pObject->type)
@@ -918,120 +992,13 @@ void UpdateGO()
 			if (pInst->posCurr.x < AEGfxGetWinMinX() || pInst->posCurr.x > AEGfxGetWinMaxX() || pInst->posCurr.y < AEGfxGetWinMinY() || pInst->posCurr.y > AEGfxGetWinMaxY())
 			{
 				// Out of bounds
-				gameObjInstDestroy(pInst);
+				bulletObjInstDestroy(pInst);
 			}
 			break;
 		}
 	}
 }
 
-/// <summary>
-/// For checking collisions between GOs
-/// </summary>
-void CheckGOCollision()
-{
-	//return; // no collision for now
-	for (uint32_t i = 0; i < GAME_OBJ_INST_NUM_MAX; i++)
-	{
-		GameObjInst *pInst_1 = gameData.sGameObjInstList + i;
-
-		// skip non-active object
-		if ((pInst_1->flag & FLAG_ACTIVE) == 0)
-			continue;
-
-		if (pInst_1->active == false) continue;
-
-		// If its an asteroid, then start checking for collision against ship or bullet
-		if (pInst_1->pObject->type == TYPE_ASTEROID)
-		{
-			for (uint32_t j = 0; j < GAME_OBJ_INST_NUM_MAX; j++)
-			{
-				GameObjInst *pInst_2 = gameData.sGameObjInstList + j;
-				if ((pInst_2->flag & FLAG_ACTIVE) == 0) continue;
-				if ((pInst_2->pObject->type == TYPE_ASTEROID)) continue;
-				float firstTimeOfCollision = 0;
-
-				if (pInst_2->active == false) continue;
-
-				switch (pInst_2->pObject->type)
-				{
-				case TYPE_BULLET:
-					if (pInst_2->serverID < (4 + (gameData.currID * (int)BULLET_ID_MAX)) || pInst_2->serverID > (4 + ((gameData.currID + 1) * (int)BULLET_ID_MAX)))
-						break;
-					if (CollisionIntersection_RectRect(pInst_1->boundingBox, pInst_1->velCurr, pInst_2->boundingBox, pInst_2->velCurr, firstTimeOfCollision))
-					{
-						// Destroy both the bullet and asteroid after
-						gameObjInstDestroy(pInst_1);
-						gameObjInstDestroy(pInst_2);
-
-						if (!gameOver)
-						{
-							// increment score
-							gameData.playerScores[gameData.currID] += 100;
-							gameData.onValueChange = true;
-						/*	if (gameData.sScore >= 5000)
-								gameOver = true;*/
-						}
-
-						{
-							Packet Asteroidpck(CMDID::ASTEROID_DESTROYED);
-							Asteroidpck << pInst_1->serverID;
-							NetworkClient::Instance().CreateMessage(Asteroidpck);
-
-							Packet pck(CMDID::BULLET_COLLIDE);
-
-							pck << gameData.currID << NetworkClient::Instance().GetTimeDiff() << j << i << gameData.playerScores[gameData.currID];
-							//  "Time:" << timestamp << ' ' <<
-							//	"BulletID:" << j << ' ' <<
-							//	"AsteroidID:" << i << ' ' <<
-							//	"PlayerScore:" << gameData.sScore;
-							NetworkClient::Instance().CreateMessage(pck);
-						}
-
-					}
-					break;
-
-				case TYPE_SHIP:
-					// If its colliding with the ship
-					if (CollisionIntersection_RectRect(pInst_1->boundingBox, pInst_1->velCurr, pInst_2->boundingBox, pInst_2->velCurr, firstTimeOfCollision))
-					{
-
-						// Destroy the asteroid and update the ship live
-						gameObjInstDestroy(pInst_1);
-
-						Packet Asteroidpck(CMDID::ASTEROID_DESTROYED);
-						Asteroidpck << pInst_1->serverID;
-						NetworkClient::Instance().CreateMessage(Asteroidpck);
-
-
-						if (pInst_2->serverID == gameData.currID)
-						{
-							ResetShip();
-
-							{
-								Packet pck(CMDID::SHIP_COLLIDE);
-								pck << pInst_2->serverID << NetworkClient::Instance().GetTimeDiff() << i;
-								//	"Time:" << timestamp << ' ' <<
-								//	"AsteroidID:" << i;
-								NetworkClient::Instance().CreateMessage(pck);
-
-								Packet pck2(CMDID::SHIP_MOVE);
-								pck2 << pInst_2->serverID << NetworkClient::Instance().GetTimeDiff() << 0 <<
-									gameData.spShip[pInst_2->serverID]->posCurr.x << gameData.spShip[pInst_2->serverID]->posCurr.y <<
-									gameData.spShip[pInst_2->serverID]->velCurr.x << gameData.spShip[pInst_2->serverID]->velCurr.y <<
-									gameData.spShip[pInst_2->serverID]->dirCurr << gameData.playerScores[pInst_2->serverID];
-								NetworkClient::Instance().CreateMessage(pck2);
-							}
-						}
-
-					}
-					break;
-				}
-			}
-		}
-	}
-}
-
 /// <summary>
 /// Update the AABB for game object instances
 /// </summary>
@@ -1122,6 +1089,19 @@ GameObjInst *CreateAsteroid(AEVec2 _pos, AEVec2 _vel, AEVec2 _scale, float dir)
 //	CreateAsteroid(pos, vel, scale);
 //}
 
+/// <summary>
+/// Removes an asteroid the server says got destroyed
+/// </summary>
+/// <param name="asteroidID">The server's id for the asteroid</param>
+void DestroyServerAsteroid(int asteroidID)
+{
+	auto it = gameData.asteroidMap.find(asteroidID);
+	if (it == gameData.asteroidMap.end()) return;
+
+	gameObjInstDestroy(it->second);
+	gameData.asteroidMap.erase(it);
+}
+
 /// <summary>
 /// Reset the ship when it gets hit by an asteroid
 /// </summary>
@@ -1168,9 +1148,15 @@ void ProcessPacketMessages(Packet &msg, GameData &data)
 	case REPLY_PLAYER_JOIN:
 	{
 		msg >> clientID;
+		uint32_t sessionToken;
+		msg >> sessionToken;
+		if (clientID < 0) break;
+		GetShip(clientID);
 		gameData.spShip[clientID]->active = true;
 		gameData.spShip[clientID]->serverID = clientID;
 		gameData.currID = clientID;
+		// the room we joined counts its ticks from wherever it is, not from our last one
+		gameData.lastSnapshotTick = 0;
 		std::string str = "Player " + std::to_string(clientID);
 		gameData.textList[0].str = str;
 
@@ -1187,166 +1173,216 @@ void ProcessPacketMessages(Packet &msg, GameData &data)
 			msg >> gameData.playerScores[clientID];
 		}
 
-		int totalAsteroids;
-		msg >> totalAsteroids;
+		// everything else in the world comes with the next STATE_UPDATE
+		NetworkClient::Instance().SetShutdownPCK(clientID, sessionToken);
+		break;
 
-		if (totalAsteroids > 0)
+	}
+	case STATE_UPDATE:
+	{
+		// a snapshot of the world, the server sends these at a fixed rate. big worlds
+		// come in a few chunks with the same tick, one from an older tick is stale
+		uint32_t tick;
+		uint64_t serverTime;
+		msg >> tick >> serverTime;
+		if (tick < gameData.lastSnapshotTick) break;
+		gameData.lastSnapshotTick = tick;
+
+		int numOfShips = 0;
+		msg >> numOfShips;
+		for (int i = 0; i < numOfShips; ++i)
 		{
-			for (int i = 0; i < totalAsteroids; ++i)
+			AEVec2 pos, vel;
+			float dirCur;
+			msg >> clientID >> pos.x >> pos.y >> vel.x >> vel.y >> dirCur;
+			if (clientID < 0) break;
+
+			GameObjInst *ship = GetShip(clientID);
+			msg >> gameData.playerScores[clientID];
+			gameData.onValueChange = true;
+			ship->serverID = clientID;
+			ship->active = true;
+
+			// our own ship is predicted locally, only snap it back if the server
+			// ended up somewhere else (got hit, or we drifted apart)
+			if (clientID == gameData.currID && AEVec2Distance(&ship->posCurr, &pos) < SHIP_CORRECTION_DIST) continue;
+			ship->posCurr = pos;
+			ship->posPrev = pos;
+			ship->velCurr = vel;
+			ship->dirCurr = dirCur;
+		}
+
+		int numOfAsteroids = 0;
+		msg >> numOfAsteroids;
+		for (int i = 0; i < numOfAsteroids; ++i)
+		{
+			int asteroidID;
+			AEVec2 pos, vel;
+			float dirCur;
+			msg >> asteroidID >> pos.x >> pos.y >> vel.x >> vel.y >> dirCur;
+
+			if (gameData.asteroidMap.count(asteroidID) > 0)
 			{
-				AEVec2 pos;
-				AEVec2 vel;
+				gameData.asteroidMap[asteroidID]->posCurr = pos;
+				gameData.asteroidMap[asteroidID]->velCurr = vel;
+				gameData.asteroidMap[asteroidID]->dirCurr = dirCur;
+			}
+			else
+			{
+				// it hasn't been created yet, new waves and anything we just joined into
 				AEVec2 scale;
 				scale.x = 20.0f;
 				scale.y = 20.0f;
-				float dirCur;
-				int id;
-				msg >> id >> pos.x >> pos.y >> vel.x >> vel.y >> dirCur;
-
-
 				GameObjInst *asteroid = CreateAsteroid(pos, vel, scale, dirCur);
 				asteroid->active = true;
-				asteroid->serverID = id;
+				asteroid->serverID = asteroidID;
+				gameData.asteroidMap[asteroidID] = asteroid;
 			}
 		}
-
-		NetworkClient::Instance().SetShutdownPCK(clientID);
 		break;
-
 	}
-	case NEW_PLAYER_JOIN:
+	case ENTITY_ENTER:
 	{
-		// get how many player ids to pull
+		// the server only tells us about things near our ship when area of interest is on
 		int num;
-		msg >> num; // get the num of players
-		for (size_t i = 0; i < num; ++i)
+		msg >> num;
+		for (int i = 0; i < num; ++i)
 		{
-			msg >> clientID;
-			//if (clientID == gameData.currID)
-			//{
-			//	
-			//	continue;
-			//}
-			msg >> (float)gameData.spShip[clientID]->posCurr.x;
-			msg >> (float)gameData.spShip[clientID]->posCurr.y;
-			msg >> (float)gameData.spShip[clientID]->velCurr.x;
-			msg >> (float)gameData.spShip[clientID]->velCurr.x;
-			msg >> gameData.spShip[clientID]->dirCurr;
-			msg >> gameData.playerScores[clientID];
-			gameData.spShip[clientID]->serverID = clientID;
-			gameData.spShip[clientID]->active = true;
-		}
-
-		break;
+			uint8_t kind;
+			int id;
+			AEVec2 pos, vel;
+			float dirCur;
+			msg >> kind >> id >> pos.x >> pos.y >> vel.x >> vel.y >> dirCur;
+			if (id < 0) break;
 
-	}
-	case STATE_UPDATE:
-	{
-		int numOfShips;
-		msg >> numOfShips;
-		for (int i = 0; i < numOfShips; ++i)
-		{
-			msg >> clientID;
-
-			// i cant continue cause i need to update readPos
-			//if (clientID == gameData.currID)
-			//{
-			//	// nvm i can just update read pos fk it
-			//	msg.readPos += 20; // 5 floats * 4 = 20 bytes to skip
-			//	continue;
-			//}
-			msg >> (float)gameData.spShip[clientID]->posCurr.x;
-			msg >> (float)gameData.spShip[clientID]->posCurr.y;
-			msg >> (float)gameData.spShip[clientID]->velCurr.x;
-			msg >> (float)gameData.spShip[clientID]->velCurr.x;
-			msg >> gameData.spShip[clientID]->dirCurr;
+			if (kind == ENTITY_SHIP)
+			{
+				GameObjInst *ship = GetShip(id);
+				msg >> gameData.playerScores[id];
+				gameData.onValueChange = true;
+				ship->serverID = id;
+				ship->active = true;
+				// our own ship is predicted locally, same as STATE_UPDATE
+				if (id == gameData.currID && AEVec2Distance(&ship->posCurr, &pos) < SHIP_CORRECTION_DIST) continue;
+				ship->posCurr = pos;
+				ship->posPrev = pos;
+				ship->velCurr = vel;
+				ship->dirCurr = dirCur;
+			}
+			else if (gameData.asteroidMap.count(id) > 0)
+			{
+				gameData.asteroidMap[id]->posCurr = pos;
+				gameData.asteroidMap[id]->velCurr = vel;
+				gameData.asteroidMap[id]->dirCurr = dirCur;
+			}
+			else
+			{
+				AEVec2 scale;
+				scale.x = 20.0f;
+				scale.y = 20.0f;
+				GameObjInst *asteroid = CreateAsteroid(pos, vel, scale, dirCur);
+				asteroid->active = true;
+				asteroid->serverID = id;
+				gameData.asteroidMap[id] = asteroid;
+			}
 		}
-
-		//for (int i = 0; i < 4; ++i)
-		//{
-		//	if (!gameData.spShip[i]->active) continue;
-
-		//	//ClientInfo& client = serverData.totalClients[i];
-
-		//	std::cout << "Ship " << i << "\n"
-		//		<< "Curr Pos : " << gameData.spShip[i]->posCurr.x << ", " << gameData.spShip[i]->posCurr.y << "\n"
-		//		<< "Curr Vel : " << gameData.spShip[i]->velCurr.x << ", " << gameData.spShip[i]->velCurr.y << "\n";
-
-		//}
-
-
 		break;
 	}
-	// switch cases
-	case ASTEROID_CREATED: // temporary
+	case LOCKSTEP_FRAME:
 	{
-
-		int numOfAsteroids;
-		msg >> numOfAsteroids;
-		for (int i = 0; i < numOfAsteroids; ++i)
+		// lockstep mode, what went into one server tick. we dont run the server's sim
+		// so the checksum is for peers that do, the ops just keep what we draw in line
+		// until the next snapshot
+		uint32_t tick, checksum;
+		uint8_t last;
+		uint16_t count = 0;
+		msg >> tick >> checksum >> last >> count;
+		if (tick < gameData.lastSnapshotTick) break;
+
+		for (int i = 0; i < count; ++i)
 		{
-			AEVec2 pos;
-			AEVec2 vel;
-			AEVec2 scale;
-			scale.x = 20.0f;
-			scale.y = 20.0f;
-			float dirCur;
-			int id;
-			msg >> id >> pos.x >> pos.y >> vel.x >> vel.y >> dirCur;
+			LockstepOp op;
+			if (!ReadLockstepOp(msg, op)) break;
+			if (op.id < 0) continue;
+
+			switch (op.op)
+			{
+			case LOCKSTEP_INPUT:
+				// ours is already moved by our own update
+				if (op.id != gameData.currID && op.id < (int)gameData.spShip.size() && gameData.spShip[op.id])
+				{
+					ApplyRemoteInput(gameData.spShip[op.id], op.flag);
+				}
+				break;
+			case LOCKSTEP_SHIP:
+			{
+				GameObjInst *ship = GetShip(op.id);
+				gameData.playerScores[op.id] = op.extra;
+				gameData.onValueChange = true;
+				ship->serverID = op.id;
+				ship->active = op.flag != 0;
 
+				AEVec2 pos;
+				AEVec2Set(&pos, op.v[0], op.v[1]);
+				if (op.id == gameData.currID && AEVec2Distance(&ship->posCurr, &pos) < SHIP_CORRECTION_DIST) break;
+				ship->posCurr = pos;
+				ship->posPrev = pos;
+				AEVec2Set(&ship->velCurr, op.v[2], op.v[3]);
+				ship->dirCurr = op.v[4];
+				break;
+			}
+			case LOCKSTEP_ASTEROID:
+			{
+				if (gameData.asteroidMap.count(op.id) > 0) break;
 
-			GameObjInst *asteroid = CreateAsteroid(pos, vel, scale, dirCur);
-			asteroid->active = true;
-			asteroid->serverID = id;
-			gameData.asteroidMap[id] = asteroid;
+				AEVec2 pos, vel, scale;
+				AEVec2Set(&pos, op.v[0], op.v[1]);
+				AEVec2Set(&vel, op.v[2], op.v[3]);
+				AEVec2Set(&scale, op.v[5], op.v[6]);
+				GameObjInst *asteroid = CreateAsteroid(pos, vel, scale, op.v[4]);
+				asteroid->active = true;
+				asteroid->serverID = op.id;
+				gameData.asteroidMap[op.id] = asteroid;
+				break;
+			}
+			case LOCKSTEP_REMOVE_ASTEROID:
+				DestroyServerAsteroid(op.id);
+				break;
+			default:
+				// bullets still come from the shooter's forwarded BULLET_CREATED
+				break;
+			}
 		}
-		//ProcessNewAsteroid(msg, data);
 		break;
 	}
-	case ASTEROID_UPDATE:
+	case ENTITY_LEAVE:
 	{
-		int numOfAsteroids;
-		msg >> numOfAsteroids;
-		for (int i = 0; i < numOfAsteroids; ++i)
+		int num;
+		msg >> num;
+		for (int i = 0; i < num; ++i)
 		{
-			int asteroidID;
-			msg >> asteroidID;
-			AEVec2 pos;
-			AEVec2 vel;
-			AEVec2 scale;
-			scale.x = 20.0f;
-			scale.y = 20.0f;
-			float dirCur;
-			msg >> pos.x >> pos.y >> vel.x >> vel.y >> dirCur;
+			uint8_t kind;
+			int id;
+			msg >> kind >> id;
 
-			if (gameData.asteroidMap.count(asteroidID) > 0)
+			if (kind == ENTITY_ASTEROID)
 			{
-
-				// exist
-				gameData.asteroidMap[asteroidID]->posCurr = pos;
-				gameData.asteroidMap[asteroidID]->velCurr = vel;
-				gameData.asteroidMap[asteroidID]->dirCurr = dirCur;
-
+				// out of range, not destroyed, it comes back with an enter
+				DestroyServerAsteroid(id);
 			}
-			else
+			else if (id >= 0 && id < (int)gameData.spShip.size() && gameData.spShip[id] && id != gameData.currID)
 			{
-				// it hasn't been created yet
-				// usually for new clients
-				GameObjInst *asteroid = CreateAsteroid(pos, vel, scale, dirCur);
-				asteroid->active = true;
-				asteroid->serverID = asteroidID;
-				gameData.asteroidMap[asteroidID] = asteroid;
+				gameData.spShip[id]->active = false;
 			}
 		}
-
 		break;
 	}
 	case BULLET_CREATED:
 	{
-		// "Time:" << NetworkClient::Instance().GetTimeDiff() << ' ' <<
+		// "Time:" << NetworkClient::Instance().GetServerTime() << ' ' <<
 		// "ID:" << bulletID <<
 		uint64_t timeDiff;
-		uint32_t bulletID;
+		int bulletID;
 		msg >> clientID;
 
 		msg >> timeDiff >> bulletID;
@@ -1365,44 +1401,33 @@ void ProcessPacketMessages(Packet &msg, GameData &data)
 		// Calculate timeDiff
 	}
 	break;
-	case SHIP_MOVE:
-		//  "Time:" << timestamp << ' ' <<
-		//	"ShipNum:" << gameData.currID << ' ' <<
-		//	"Pos:" << gameData.spShip->posCurr.x << ' ' << gameData.spShip->posCurr.y << ' ' <<
-		//	"Vel:" << gameData.spShip->velCurr.x << ' ' << gameData.spShip->velCurr.y << ' ' <<
-		//	"Dir:" << gameData.spShip->dirCurr;
-	{
-
-		msg >> clientID;
-		if (clientID == gameData.currID) break;
-		uint64_t timeDiff;
-		int playerInput;
-		msg >> timeDiff >> playerInput;
-		msg >> gameData.spShip[clientID]->posCurr.x >> gameData.spShip[clientID]->posCurr.y >>
-			gameData.spShip[clientID]->velCurr.x >> gameData.spShip[clientID]->velCurr.y >>
-			gameData.spShip[clientID]->dirCurr >> gameData.playerScores[clientID];
-
-		gameData.spShip[clientID]->posPrev = gameData.spShip[clientID]->posCurr;
-	}
-	break;
 	case BULLET_COLLIDE:
 		//  "Time:" << timestamp << ' ' <<
 		//	"BulletID:" << j << ' ' <<
 		//	"AsteroidID:" << i << ' ' <<
 		//	"PlayerScore:" << gameData.sScore;
 	{
+		// decided by the server, we just remove what it says got hit
 		uint64_t timeDiff;
-		uint32_t bulletID, asteroidID;
+		int bulletID, asteroidID, score;
 		msg >> clientID;
 
-		msg >> timeDiff >> bulletID >> asteroidID;
+		msg >> timeDiff >> bulletID >> asteroidID >> score;
 
 		// if destroy happen before create (???)
+		auto bullet = gameData.bulletMap.find(bulletID);
+		if (bullet != gameData.bulletMap.end())
+		{
+			bulletObjInstDestroy(bullet->second);
+		}
+		DestroyServerAsteroid(asteroidID);
 
-		GameObjInst *pInst = gameData.sGameObjInstList + bulletID;
-		pInst->active = false;
-		pInst = gameData.sGameObjInstList + asteroidID;
-		pInst->active = false;
+		if (clientID >= 0)
+		{
+			GetShip(clientID);
+			gameData.playerScores[clientID] = score;
+			gameData.onValueChange = true;
+		}
 	}
 	break;
 	case SHIP_COLLIDE:
@@ -1410,13 +1435,13 @@ void ProcessPacketMessages(Packet &msg, GameData &data)
 		//	"AsteroidID:" << i;
 	{
 		uint64_t timeDiff;
-		uint32_t asteroidID;
+		int asteroidID;
 		msg >> clientID;
 
 		msg >> timeDiff >> asteroidID;
 
-		GameObjInst *pInst = gameData.sGameObjInstList + asteroidID;
-		pInst->active = false;
+		DestroyServerAsteroid(asteroidID);
+		if (clientID == gameData.currID) ResetShip();
 	}
 	break;
 	case SHIP_SCORE:
@@ -1424,10 +1449,20 @@ void ProcessPacketMessages(Packet &msg, GameData &data)
 		msg >> clientID;
 		uint32_t score;
 		msg >> score;
+		if (clientID < 0) break;
 
+		GetShip(clientID);
 		gameData.playerScores[clientID] = score;
 	}
 	break;
+	case PLAYER_DC:
+	{
+		// someone left or the server timed them out, free up their ship
+		msg >> clientID;
+		if (clientID < 0 || clientID >= (int)gameData.spShip.size() || !gameData.spShip[clientID]) break;
+		gameData.spShip[clientID]->active = false;
+	}
+	break;
 	case CLIENT_REQ_HIGHSCORE:
 	{
 		uint16_t numScores;
@@ -1501,6 +1536,30 @@ void ProcessPacketMessages(Packet &msg, GameData &data)
 		break;
 	}
 	break;
+	case GAME_START:
+	{
+		// a new match in the same room, the server reset everything in place. whatever
+		// is left of the last one goes, the next snapshot brings the new world
+		uint32_t matchNumber;
+		msg >> matchNumber;
+		for (auto& asteroid : gameData.asteroidMap)
+		{
+			gameObjInstDestroy(asteroid.second);
+		}
+		gameData.asteroidMap.clear();
+		for (auto& bullet : gameData.bulletMap)
+		{
+			gameObjInstDestroy(bullet.second);
+		}
+		gameData.bulletMap.clear();
+		for (uint32_t& score : gameData.playerScores)
+		{
+			score = 0;
+		}
+		gameOver = false;
+		gameData.onValueChange = true;
+	}
+		break;
 	case GAME_OVER:
 	{
 		gameOver = true;
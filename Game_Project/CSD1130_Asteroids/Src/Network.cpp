@@ -172,10 +172,13 @@ void NetworkClient::Shutdown()
 	}
 }
 
-void NetworkClient::SetShutdownPCK(int currID)
+void NetworkClient::SetShutdownPCK(int currID, uint32_t token)
 {
+	sessionToken = token;
+	sessionID = currID;
+
 	shutdownPck = Packet(CMDID::PLAYER_DC);
-	shutdownPck << currID;
+	shutdownPck << currID << token;
 }
 
 //Reading and sending the message
@@ -184,6 +187,30 @@ void NetworkClient::SendMessages(SOCKET clientSocket)
 
 	while (connected)
 	{
+		// keep the clock estimate fresh, faster right after joining so it converges quickly
+		auto now = std::chrono::steady_clock::now();
+		auto syncInterval = std::chrono::milliseconds(timeSyncSent < TIME_SYNC_BURST ? TIME_SYNC_BURST_MS : TIME_SYNC_INTERVAL_MS);
+		if (now - lastTimeSync >= syncInterval)
+		{
+			lastTimeSync = now;
+			SendTimeSync(clientSocket);
+		}
+
+		// let the server know we're still here even if we have nothing else to say
+		if (sessionID >= 0 && now - lastKeepAlive >= std::chrono::milliseconds(KEEPALIVE_INTERVAL_MS))
+		{
+			lastKeepAlive = now;
+			uint32_t fecReceived, fecLost;
+			{
+				std::lock_guard<std::mutex> lock(fecMutex);
+				fecDecoder.TakeStats(fecReceived, fecLost);
+			}
+
+			Packet keepAlive(KEEPALIVE);
+			keepAlive << (int)sessionID << (uint32_t)sessionToken << fecReceived << fecLost;
+			SendSingularMessage(clientSocket, keepAlive);
+		}
+
 		Packet outMsg;
 		{
 			std::lock_guard<std::mutex> lock(outMutex);
@@ -245,9 +272,6 @@ void NetworkClient::ReceiveMessages(SOCKET _udpSocket)
 	UNREFERENCED_PARAMETER(_udpSocket);
 	sockaddr_in senderAddr;
 	int senderAddrSize = sizeof(senderAddr);
-	
-	// -- TODO -- Basically take this my client's gameStart time -= what frame time the server says we start at
-	// Which means that we can use the currTime to get my curr frame time to help sync
 
 	while (connected)
 	{
@@ -258,32 +282,68 @@ void NetworkClient::ReceiveMessages(SOCKET _udpSocket)
 
 		if (receivedBytes != SOCKET_ERROR)
 		{
-			int offset = 0;
-			//buffer[receivedBytes] = '\0';
-			char msgID = buffer[0];
-			offset++;
-			
-			// if theres any other header stuff u need to take out cna do it here
-
-			// get the file length
-			uint32_t msgLength;
-			memcpy(&msgLength, buffer + offset, sizeof(msgLength));
-			msgLength = ntohl(msgLength);
-			offset += sizeof(msgLength);
+			HandleDatagram(buffer, receivedBytes);
+		}
 
-			// create the packet for game to process
-			Packet newPacket(static_cast<CMDID>(msgID));
-			newPacket.writePos = msgLength;
-			memcpy(newPacket.body, buffer + offset, msgLength);
+		//Sleep(SLEEP_TIME);
+	}
+}
 
+// one raw datagram off the socket, or one that came out of the fec wrapper
+void NetworkClient::HandleDatagram(const char* buffer, int len)
+{
+	int offset = 0;
+	//buffer[receivedBytes] = '\0';
+	char msgID = buffer[0];
+	offset++;
+
+	// if theres any other header stuff u need to take out cna do it here
+
+	// get the file length
+	uint32_t msgLength;
+	memcpy(&msgLength, buffer + offset, sizeof(msgLength));
+	msgLength = ntohl(msgLength);
+	offset += sizeof(msgLength);
+	if (len < offset || msgLength > (uint32_t)(len - offset) || msgLength > MAX_BODY_LEN) return;
+
+	// unwrap protected messages, whatever comes out (or gets rebuilt) goes through here again
+	if (msgID == FEC_DATA || msgID == FEC_PARITY)
+	{
+		std::vector<std::vector<char>> unwrapped;
+		{
+			std::lock_guard<std::mutex> lock(fecMutex);
+			auto collect = [&unwrapped](const char* data, int dataLen)
+				{
+					unwrapped.emplace_back(data, data + dataLen);
+				};
+			if (msgID == FEC_DATA)
+				fecDecoder.OnData(buffer + offset, (int)msgLength, collect);
+			else
+				fecDecoder.OnParity(buffer + offset, (int)msgLength, collect);
+		}
 
-			{
-			std::lock_guard<std::mutex> lock(inMutex);
-			incomingMessages.push(newPacket);
-			}
+		for (const std::vector<char>& inner : unwrapped)
+		{
+			HandleDatagram(inner.data(), (int)inner.size());
 		}
+		return;
+	}
 
-		//Sleep(SLEEP_TIME);
+	// create the packet for game to process
+	Packet newPacket(static_cast<CMDID>(msgID));
+	newPacket.writePos = msgLength;
+	memcpy(newPacket.body, buffer + offset, msgLength);
+
+	// handled here instead of the game loop so t3 isnt delayed by a frame
+	if (newPacket.id == TIME_SYNC)
+	{
+		ProcessTimeSync(newPacket);
+		return;
+	}
+
+	{
+	std::lock_guard<std::mutex> lock(inMutex);
+	incomingMessages.push(newPacket);
 	}
 }
 
@@ -294,6 +354,93 @@ uint64_t NetworkClient::GetTimeDiff()
 	return timeDiff;
 }
 
+// the server's clock in ms, this is what gets stamped on outgoing messages
+uint64_t NetworkClient::GetServerTime()
+{
+	std::lock_guard<std::mutex> lock(clockMutex);
+	double localTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gameStartTime).count();
+	double serverTime = localTime + clockOffset + clockDrift * (localTime - clockBaseTime);
+	return serverTime > 0.0 ? static_cast<uint64_t>(serverTime) : 0;
+}
+
+bool NetworkClient::IsClockSynced()
+{
+	std::lock_guard<std::mutex> lock(clockMutex);
+	return clockSynced;
+}
+
+void NetworkClient::SendTimeSync(SOCKET clientSocket)
+{
+	Packet syncRequest(TIME_SYNC);
+	double localTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gameStartTime).count();
+	// sent with sub ms precision as microseconds
+	syncRequest << static_cast<uint64_t>(localTime * 1000.0);
+	SendSingularMessage(clientSocket, syncRequest);
+	++timeSyncSent;
+}
+
+void NetworkClient::ProcessTimeSync(Packet& reply)
+{
+	double t3 = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gameStartTime).count();
+
+	uint64_t sendTime, serverRecv, serverSend;
+	reply >> sendTime >> serverRecv >> serverSend;
+
+	double t0 = sendTime / 1000.0;
+	double t1 = static_cast<double>(serverRecv);
+	double t2 = static_cast<double>(serverSend);
+
+	ClockSample sample;
+	sample.localTime = t3;
+	sample.offset = ((t1 - t0) + (t2 - t3)) * 0.5;
+	sample.rtt = (t3 - t0) - (t2 - t1);
+	if (sample.rtt < 0.0) sample.rtt = 0.0;
+
+	std::lock_guard<std::mutex> lock(clockMutex);
+	clockSamples.push_back(sample);
+	if (clockSamples.size() > TIME_SYNC_SAMPLES)
+	{
+		clockSamples.pop_front();
+	}
+	UpdateClockEstimate();
+}
+
+// call with clockMutex held
+void NetworkClient::UpdateClockEstimate()
+{
+	// the sample with the smallest rtt has the least queueing in it so its offset is the best
+	const ClockSample* best = &clockSamples.front();
+	for (const ClockSample& sample : clockSamples)
+	{
+		if (sample.rtt < best->rtt) best = &sample;
+	}
+
+	// drift is the slope of offset over time, only use the samples with a clean rtt
+	// so jitter doesnt get mistaken for drift
+	double rttLimit = best->rtt * 1.5 + 2.0;
+	double n = 0.0, sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+	for (const ClockSample& sample : clockSamples)
+	{
+		if (sample.rtt > rttLimit) continue;
+		double x = sample.localTime - best->localTime;
+		n += 1.0;
+		sumX += x;
+		sumY += sample.offset;
+		sumXX += x * x;
+		sumXY += x * sample.offset;
+	}
+
+	double denom = n * sumXX - sumX * sumX;
+	if (n >= 4.0 && denom > 1.0)
+	{
+		clockDrift = (n * sumXY - sumX * sumY) / denom;
+	}
+
+	clockOffset = best->offset;
+	clockBaseTime = best->localTime;
+	clockSynced = true;
+}
+
 Packet NetworkClient::GetIncomingMessage()
 {
 	Packet outMsg{};
@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * Shared bits for the benchmark programs in this folder
+ *
+ * Every program here builds on its own from one .cpp and the server's headers,
+ * same as the replayer:
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project CollisionBench.cpp -o collisionbench
+ * or an empty console project with ../Server_Project on the include path and
+ * ws2_32.lib linked.
+ *
+ * Worlds are filled from a fixed seed so two runs (or two machines) time the
+ * exact same entities. Times are the best of a few runs, the others are mostly
+ * the machine doing something else.
+ ******************************************************************************/
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#include <cstdint>
+// winsock has these, Packet.h expects them
+inline uint64_t htonll(uint64_t v)
+{
+	return htonl(1) == 1 ? v : (static_cast<uint64_t>(htonl(static_cast<uint32_t>(v))) << 32) | htonl(static_cast<uint32_t>(v >> 32));
+}
+inline uint64_t ntohll(uint64_t v) { return htonll(v); }
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include "Random.h"
+#include "Simulation.h"
+
+const uint64_t BENCH_SEED = 0x5eed;
+const float BENCH_DT = 1.0f / 60.0f;
+
+// results go in here so the optimizer cant throw away the work being timed
+static volatile int benchSink = 0;
+
+// best of runs, each run calls fn reps times. microseconds per call
+template <typename TFn>
+inline double BestMicros(int runs, int reps, TFn&& fn)
+{
+	double best = 1e30;
+	for (int r = 0; r < runs; ++r)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < reps; ++i) fn();
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / reps;
+		best = std::min(best, us);
+	}
+	return best;
+}
+
+// an asteroid somewhere on screen going the usual speed in a random direction
+inline Asteroid BenchAsteroid(Pcg32& rng)
+{
+	Asteroid asteroid{};
+	asteroid.xPos = rng.NextFloat(-X_SIZE, X_SIZE);
+	asteroid.yPos = rng.NextFloat(-Y_SIZE, Y_SIZE);
+	float angle = rng.NextFloat(-SIM_PI, SIM_PI);
+	asteroid.vel_x = std::cos(angle) * ASTEROID_ACCEL;
+	asteroid.vel_y = std::sin(angle) * ASTEROID_ACCEL;
+	asteroid.dirCur = angle;
+	asteroid.xScale = 20.0f;
+	asteroid.yScale = 20.0f;
+	asteroid.active = true;
+	return asteroid;
+}
+
+inline Bullet BenchBullet(Pcg32& rng, int owner)
+{
+	Bullet bullet{};
+	bullet.ownerID = owner;
+	bullet.active = true;
+	bullet.xPos = rng.NextFloat(-X_SIZE, X_SIZE);
+	bullet.yPos = rng.NextFloat(-Y_SIZE, Y_SIZE);
+	float angle = rng.NextFloat(-SIM_PI, SIM_PI);
+	bullet.vel_x = std::cos(angle) * BULLET_SPEED;
+	bullet.vel_y = std::sin(angle) * BULLET_SPEED;
+	return bullet;
+}
+
+// a room the way the worker would have it, with capacity for more than is in it.
+// ships are connected and scattered, bullets belong to them round robin
+inline void FillWorld(ServerData& data, Pcg32& rng, int playerCapacity, int asteroidCapacity,
+	int ships, int asteroids, int bullets)
+{
+	data.totalClients.Reserve(playerCapacity);
+	data.ships.Resize(playerCapacity);
+	data.asteroids.Reset(asteroidCapacity);
+	data.bullets.Clear();
+	data.tick = 0;
+
+	for (int i = 0; i < ships; ++i)
+	{
+		int slot = data.totalClients.Grow();
+		if (slot == NO_SLOT) break;
+		data.totalClients[slot].connected = true;
+		data.totalClients[slot].inSim = true;
+		data.ships.xPos[slot] = rng.NextFloat(-X_SIZE, X_SIZE);
+		data.ships.yPos[slot] = rng.NextFloat(-Y_SIZE, Y_SIZE);
+		data.ships.dir[slot] = rng.NextFloat(-SIM_PI, SIM_PI);
+	}
+	for (int i = 0; i < asteroids; ++i) data.asteroids.Add(BenchAsteroid(rng), 0);
+	// numbered the way clients do it, so a player owns every BULLET_IDS_PER_PLAYER in a row
+	for (int i = 0; i < bullets; ++i) data.bullets.Add(i, BenchBullet(rng, i / BULLET_IDS_PER_PLAYER));
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*******************************************************************************
+ * Capacity scaling benchmark
+ *
+ * Player and asteroid capacities are runtime settings (maxPlayers and
+ * maxAsteroids in serverSettings.txt), and a tick is supposed to cost what is
+ * actually in the room, not what the room could hold. This runs the server's
+ * SimStep two ways:
+ *
+ *   capacity  the same 32 ships, 1000 asteroids and 200 bullets in rooms sized
+ *             from 64/1024 up to 4096/65535, tick time should stay flat
+ *   active    a room at the biggest capacity with more and more in it, tick
+ *             time should follow the count
+ *
+ * Every timing is the average over a run of ticks from a freshly filled world
+ * (same seed each time), best of a few runs.
+ *
+ *   capacitybench
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project CapacityBench.cpp -o capacitybench
+ ******************************************************************************/
+
+#include "BenchCommon.h"
+
+const int BENCH_TICKS = 30;
+const int BENCH_RUNS = 5;
+
+struct RoomSize
+{
+	int playerCapacity, asteroidCapacity;
+	int ships, asteroids, bullets;
+};
+
+// us per tick
+static double TimeTicks(const RoomSize& size, JobSystem& jobs)
+{
+	double best = 1e30;
+	for (int run = 0; run < BENCH_RUNS; ++run)
+	{
+		ServerData data;
+		Pcg32 rng;
+		rng.Seed(BENCH_SEED);
+		FillWorld(data, rng, size.playerCapacity, size.asteroidCapacity, size.ships, size.asteroids, size.bullets);
+
+		SimEvents events;
+		auto start = std::chrono::steady_clock::now();
+		for (int t = 0; t < BENCH_TICKS; ++t)
+		{
+			events.Clear();
+			SimStep(data, BENCH_DT, events, jobs);
+		}
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / BENCH_TICKS;
+		best = std::min(best, us);
+	}
+	return best;
+}
+
+int main()
+{
+	JobSystem jobs;
+	jobs.Start(1);
+
+	std::printf("same room, growing capacity\n");
+	std::printf("%10s %10s %12s\n", "players", "asteroids", "us/tick");
+	const RoomSize capacities[] = {
+		{ 64, 1024, 32, 1000, 200 },
+		{ 256, 4096, 32, 1000, 200 },
+		{ 1024, 16384, 32, 1000, 200 },
+		{ 4096, SLOT_MAP_MAX_SLOTS, 32, 1000, 200 },
+	};
+	for (const RoomSize& size : capacities)
+	{
+		std::printf("%10d %10d %12.1f\n", size.playerCapacity, size.asteroidCapacity, TimeTicks(size, jobs));
+	}
+
+	std::printf("\nbiggest room, growing contents\n");
+	std::printf("%10s %10s %10s %12s\n", "ships", "asteroids", "bullets", "us/tick");
+	const RoomSize contents[] = {
+		{ 4096, SLOT_MAP_MAX_SLOTS, 8, 100, 20 },
+		{ 4096, SLOT_MAP_MAX_SLOTS, 32, 1000, 200 },
+		{ 4096, SLOT_MAP_MAX_SLOTS, 128, 4000, 800 },
+		{ 4096, SLOT_MAP_MAX_SLOTS, 512, 16000, 3200 },
+	};
+	for (const RoomSize& size : contents)
+	{
+		std::printf("%10d %10d %10d %12.1f\n", size.ships, size.asteroids, size.bullets, TimeTicks(size, jobs));
+	}
+	return 0;
+}
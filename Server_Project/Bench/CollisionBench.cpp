@@ -0,0 +1,114 @@
+/*******************************************************************************
+ * Collision broad phase benchmark
+ *
+ * Fills a room with n asteroids and n bullets (plus a few ships) and finds what
+ * every bullet and ship hits this step two ways: the sim's own grid
+ * (BuildAsteroidGrid + FindBulletHit/FindShipHit) and brute force against
+ * every asteroid with the same swept tests. Both have to agree on every single
+ * hit before any time is printed, otherwise it says which one and stops.
+ *
+ *   collisionbench [n ...]     defaults to 100 1000 10000
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project CollisionBench.cpp -o collisionbench
+ ******************************************************************************/
+
+#include <cstdlib>
+#include <vector>
+#include "BenchCommon.h"
+
+const int BENCH_SHIPS = 16;
+
+// lowest asteroid the bullet hits, what FindBulletHit should come up with
+static int BruteBulletHit(const ServerData& data, int b, float dt)
+{
+	SweptBox bulletBox = BulletBox(data.bullets, b);
+	for (int id = 0; id < data.asteroids.Count(); ++id)
+	{
+		if (SweptBoxHit(AsteroidBox(data.asteroids, id), bulletBox, dt)) return id;
+	}
+	return -1;
+}
+
+static int BruteShipHit(const ServerData& data, int s, float dt)
+{
+	SweptCircle shipCircle = ShipCircle(data.ships, s);
+	for (int id = 0; id < data.asteroids.Count(); ++id)
+	{
+		if (SweptCircleHit(AsteroidCircle(data.asteroids, id), shipCircle, dt)) return id;
+	}
+	return -1;
+}
+
+// false on the first hit the two disagree on
+static bool Check(ServerData& data, float dt, int& hits)
+{
+	BuildAsteroidGrid(data, dt);
+	hits = 0;
+	for (int b = 0; b < data.bullets.Count(); ++b)
+	{
+		int grid = FindBulletHit(data, b, dt);
+		int brute = BruteBulletHit(data, b, dt);
+		if (grid != brute)
+		{
+			std::printf("  bullet %d: grid says %d, brute force says %d\n", b, grid, brute);
+			return false;
+		}
+		if (grid >= 0) ++hits;
+	}
+	for (int s = 0; s < data.totalClients.Slots(); ++s)
+	{
+		int grid = FindShipHit(data, s, dt);
+		int brute = BruteShipHit(data, s, dt);
+		if (grid != brute)
+		{
+			std::printf("  ship %d: grid says %d, brute force says %d\n", s, grid, brute);
+			return false;
+		}
+		if (grid >= 0) ++hits;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<int> sizes;
+	for (int i = 1; i < argc; ++i) sizes.push_back(std::atoi(argv[i]));
+	if (sizes.empty()) sizes = { 100, 1000, 10000 };
+
+	std::printf("%8s %8s %14s %14s %10s\n", "entities", "hits", "grid us/tick", "brute us/tick", "speedup");
+	for (int n : sizes)
+	{
+		if (n <= 0) continue;
+
+		ServerData data;
+		Pcg32 rng;
+		rng.Seed(BENCH_SEED);
+		FillWorld(data, rng, BENCH_SHIPS, n, BENCH_SHIPS, n, n);
+
+		int hits = 0;
+		if (!Check(data, BENCH_DT, hits))
+		{
+			std::printf("grid and brute force disagree at %d entities\n", n);
+			return 1;
+		}
+
+		// aim for roughly the same amount of work per size so small ones arent all noise
+		const int gridReps = std::max(1, 200000 / n);
+		const int bruteReps = std::max(1, 20000000 / (n * n));
+
+		double gridUs = BestMicros(5, gridReps, [&]
+			{
+				BuildAsteroidGrid(data, BENCH_DT);
+				for (int b = 0; b < data.bullets.Count(); ++b) benchSink += FindBulletHit(data, b, BENCH_DT);
+				for (int s = 0; s < BENCH_SHIPS; ++s) benchSink += FindShipHit(data, s, BENCH_DT);
+			});
+		double bruteUs = BestMicros(3, bruteReps, [&]
+			{
+				for (int b = 0; b < data.bullets.Count(); ++b) benchSink += BruteBulletHit(data, b, BENCH_DT);
+				for (int s = 0; s < BENCH_SHIPS; ++s) benchSink += BruteShipHit(data, s, BENCH_DT);
+			});
+
+		std::printf("%8d %8d %14.1f %14.1f %9.1fx\n", n, hits, gridUs, bruteUs, bruteUs / gridUs);
+	}
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * Tick scaling across cores
+ *
+ * Runs SimStep on one big room with the job system started at 1, 2, 4... up to
+ * the cores the machine says it has, and prints the tick time and the speedup
+ * over the first thread count for each. The world after the run is checksummed
+ * the same way lockstep does it, every thread count has to land on exactly the
+ * same state as the first or the numbers dont count.
+ *
+ * Numbers only mean something with as many real cores as the biggest thread
+ * count, past that the helpers just take turns on the same core.
+ *
+ *   jobbench [--threads n ...] [--ships n] [--asteroids n] [--bullets n]
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project JobBench.cpp -o jobbench
+ ******************************************************************************/
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchCommon.h"
+
+const int BENCH_TICKS = 30;
+const int BENCH_RUNS = 5;
+
+struct JobBenchOptions
+{
+	std::vector<int> threads;
+	int ships = 512;
+	int asteroids = 20000;
+	int bullets = 8000;
+};
+
+static bool ParseOptions(int argc, char** argv, JobBenchOptions& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--threads" && hasValue) options.threads.push_back(std::atoi(argv[++i]));
+		else if (arg == "--ships" && hasValue) options.ships = std::atoi(argv[++i]);
+		else if (arg == "--asteroids" && hasValue) options.asteroids = std::atoi(argv[++i]);
+		else if (arg == "--bullets" && hasValue) options.bullets = std::atoi(argv[++i]);
+		else return false;
+	}
+	if (options.threads.empty())
+	{
+		int cores = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int n = 1; n < cores; n *= 2) options.threads.push_back(n);
+		options.threads.push_back(cores);
+	}
+	return options.asteroids <= SLOT_MAP_MAX_SLOTS;
+}
+
+// us per tick, checksum is the world after the last run
+static double TimeTicks(const JobBenchOptions& options, JobSystem& jobs, uint32_t& checksum)
+{
+	double best = 1e30;
+	for (int run = 0; run < BENCH_RUNS; ++run)
+	{
+		ServerData data;
+		Pcg32 rng;
+		rng.Seed(BENCH_SEED);
+		FillWorld(data, rng, options.ships, options.asteroids, options.ships, options.asteroids, options.bullets);
+
+		SimEvents events;
+		auto start = std::chrono::steady_clock::now();
+		for (int t = 0; t < BENCH_TICKS; ++t)
+		{
+			events.Clear();
+			SimStep(data, BENCH_DT, events, jobs);
+		}
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / BENCH_TICKS;
+		best = std::min(best, us);
+		checksum = StateChecksum(data, 0);
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	JobBenchOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		std::printf("usage: jobbench [--threads n ...] [--ships n] [--asteroids n] [--bullets n]\n");
+		return 1;
+	}
+
+	std::printf("%d ships, %d asteroids, %d bullets, %u cores reported\n",
+		options.ships, options.asteroids, options.bullets, std::thread::hardware_concurrency());
+	std::printf("%8s %12s %10s %12s\n", "threads", "us/tick", "speedup", "checksum");
+
+	double first = 0.0;
+	uint32_t expected = 0;
+	for (size_t i = 0; i < options.threads.size(); ++i)
+	{
+		JobSystem jobs;
+		jobs.Start(options.threads[i]);
+
+		uint32_t checksum = 0;
+		double us = TimeTicks(options, jobs, checksum);
+		if (i == 0)
+		{
+			first = us;
+			expected = checksum;
+		}
+		std::printf("%8d %12.1f %9.2fx %12x\n", options.threads[i], us, first / us, checksum);
+		if (checksum != expected)
+		{
+			std::printf("%d threads ended up somewhere else than %d\n", options.threads[i], options.threads[0]);
+			return 1;
+		}
+	}
+	return 0;
+}
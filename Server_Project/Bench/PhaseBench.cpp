@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * Where a tick goes
+ *
+ * Times SimStep as a whole and then the asteroid phases on their own, on the
+ * same worlds: evaluating every asteroid from its keyframe (IntegrateAsteroids)
+ * and building the broad phase grid from the results. The share column is how
+ * much of the tick the per asteroid evaluation is, the part a lazily evaluated
+ * store would save.
+ *
+ * A broad phase built from keyframes could stay valid for a few ticks, but only
+ * while no asteroid wraps, dies or spawns, each of those changes a keyframe or
+ * moves the packed indices. The changed column counts the ticks where one did.
+ *
+ *   phasebench [asteroids ...]     defaults to 100 1000 8000 32000
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project PhaseBench.cpp -o phasebench
+ ******************************************************************************/
+
+#include <cstdlib>
+#include <vector>
+#include "BenchCommon.h"
+
+const int BENCH_TICKS = 30;
+const int BENCH_RUNS = 5;
+const int BENCH_SHIPS = 64;
+
+int main(int argc, char** argv)
+{
+	std::vector<int> sizes;
+	for (int i = 1; i < argc; ++i) sizes.push_back(std::atoi(argv[i]));
+	if (sizes.empty()) sizes = { 100, 1000, 8000, 32000 };
+
+	JobSystem jobs;
+	jobs.Start(1);
+
+	std::printf("%10s %8s %12s %14s %12s %8s %10s\n", "asteroids", "bullets", "tick us", "integrate us", "grid us", "share", "changed");
+	for (int n : sizes)
+	{
+		if (n <= 0 || n > SLOT_MAP_MAX_SLOTS) continue;
+		const int bullets = n / 5;
+
+		// whole ticks from a fresh world each run, so hits and wraps happen like they would
+		double tickUs = 1e30;
+		for (int run = 0; run < BENCH_RUNS; ++run)
+		{
+			ServerData data;
+			Pcg32 rng;
+			rng.Seed(BENCH_SEED);
+			FillWorld(data, rng, BENCH_SHIPS, n, BENCH_SHIPS, n, bullets);
+
+			SimEvents events;
+			auto start = std::chrono::steady_clock::now();
+			for (int t = 0; t < BENCH_TICKS; ++t)
+			{
+				events.Clear();
+				SimStep(data, BENCH_DT, events, jobs);
+			}
+			double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / BENCH_TICKS;
+			tickUs = std::min(tickUs, us);
+		}
+
+		// same ticks again untimed, counting the ones where some asteroid got a new keyframe
+		// or went away
+		int changed = 0;
+		{
+			ServerData data;
+			Pcg32 rng;
+			rng.Seed(BENCH_SEED);
+			FillWorld(data, rng, BENCH_SHIPS, n, BENCH_SHIPS, n, bullets);
+
+			SimEvents events;
+			for (int t = 0; t < BENCH_TICKS; ++t)
+			{
+				const int before = data.asteroids.Count();
+				events.Clear();
+				SimStep(data, BENCH_DT, events, jobs);
+
+				bool rekeyed = false;
+				for (int i = 0; i < data.asteroids.Count() && !rekeyed; ++i) rekeyed = data.asteroids.keyTick[i] == data.tick;
+				if (rekeyed || data.asteroids.Count() != before) ++changed;
+			}
+		}
+
+		ServerData data;
+		Pcg32 rng;
+		rng.Seed(BENCH_SEED);
+		FillWorld(data, rng, BENCH_SHIPS, n, BENCH_SHIPS, n, bullets);
+
+		uint32_t tick = 0;
+		const int reps = std::max(1, 1000000 / n);
+		double integrateUs = BestMicros(BENCH_RUNS, reps, [&]
+			{
+				IntegrateAsteroids(data.asteroids, 0, data.asteroids.Count(), ++tick, BENCH_DT);
+			});
+		double gridUs = BestMicros(BENCH_RUNS, reps, [&] { BuildAsteroidGrid(data, BENCH_DT); });
+
+		std::printf("%10d %8d %12.1f %14.1f %12.1f %7.1f%% %7d/%d\n", n, bullets, tickUs, integrateUs, gridUs,
+			100.0 * integrateUs / tickUs, changed, BENCH_TICKS);
+	}
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*******************************************************************************
+ * Entity storage benchmark
+ *
+ * The per tick loops over asteroids and bullets, run on the structure of
+ * arrays stores from EntityStore.h and on the layout they replaced: a fixed
+ * array of Asteroid structs (time_point, flags and all) with an active flag,
+ * and bullets in an unordered_map keyed by id. The old side is a copy of the
+ * old loops, kept here so it can still be compared after the server moved on.
+ *
+ * Three things get timed for n asteroids and n bullets:
+ *   integrate  moving everything one tick, wrap and off screen checks included
+ *   serialize  packing every asteroid into ASTEROID_UPDATE sized packets
+ *   bullets    moving the bullets, map nodes against packed arrays
+ *
+ * Both sides start from the same seed and the moved positions are compared
+ * after the first tick, so the two layouts are doing the same work.
+ *
+ *   storebench [n ...]     defaults to 1000 10000 50000
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project StoreBench.cpp -o storebench
+ ******************************************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+#include "BenchCommon.h"
+
+// how the server stored them before EntityStore.h
+struct OldAsteroid
+{
+	std::chrono::steady_clock::time_point creationTime;
+	int ID;
+	float xPos;
+	float yPos;
+	float xScale;
+	float yScale;
+	float vel_x;
+	float vel_y;
+	float vel_server_x;
+	float vel_server_y;
+	float dirCur;
+	bool active;
+	TARGETTYPE targetType = TARGET_TYPE_ASTEROID;
+};
+
+struct OldWorld
+{
+	std::vector<OldAsteroid> asteroids;
+	std::unordered_map<int, Bullet> bullets;
+};
+
+static void OldIntegrate(OldWorld& world, float dt)
+{
+	for (OldAsteroid& asteroid : world.asteroids)
+	{
+		if (!asteroid.active) continue;
+		asteroid.xPos = SimWrap(asteroid.xPos + asteroid.vel_x * dt, -X_SIZE - asteroid.xScale, X_SIZE + asteroid.xScale);
+		asteroid.yPos = SimWrap(asteroid.yPos + asteroid.vel_y * dt, -Y_SIZE - asteroid.yScale, Y_SIZE + asteroid.yScale);
+	}
+}
+
+static void OldMoveBullets(OldWorld& world, float dt)
+{
+	for (auto it = world.bullets.begin(); it != world.bullets.end();)
+	{
+		Bullet& bullet = it->second;
+		bullet.xPos += bullet.vel_x * dt;
+		bullet.yPos += bullet.vel_y * dt;
+		if (bullet.xPos >= -X_SIZE && bullet.xPos <= X_SIZE && bullet.yPos >= -Y_SIZE && bullet.yPos <= Y_SIZE)
+			++it;
+		else
+			it = world.bullets.erase(it);
+	}
+}
+
+// [count]([id][x][y][velx][vely][dir])... per packet, as many as fit
+const int ASTEROID_ENTRY_LEN = sizeof(int) + 5 * sizeof(float);
+const int ASTEROIDS_PER_PACKET = (MAX_BODY_LEN - sizeof(int)) / ASTEROID_ENTRY_LEN;
+
+static int OldSerialize(const OldWorld& world)
+{
+	int written = 0;
+	size_t i = 0;
+	while (i < world.asteroids.size())
+	{
+		Packet pck(ASTEROID_UPDATE);
+		int count = 0;
+		pck << count;
+		for (; i < world.asteroids.size() && count < ASTEROIDS_PER_PACKET; ++i)
+		{
+			const OldAsteroid& asteroid = world.asteroids[i];
+			if (!asteroid.active) continue;
+			pck << asteroid.ID << asteroid.xPos << asteroid.yPos << asteroid.vel_x << asteroid.vel_y << asteroid.dirCur;
+			++count;
+		}
+		written += (int)pck.writePos;
+	}
+	return written;
+}
+
+static int NewSerialize(const AsteroidStore& asteroids)
+{
+	int written = 0;
+	int i = 0;
+	while (i < asteroids.Count())
+	{
+		Packet pck(ASTEROID_UPDATE);
+		int count = std::min(asteroids.Count() - i, ASTEROIDS_PER_PACKET);
+		pck << count;
+		for (int end = i + count; i < end; ++i)
+		{
+			pck << (int)asteroids.HandleAt(i) << asteroids.xPos[i] << asteroids.yPos[i]
+				<< asteroids.velX[i] << asteroids.velY[i] << asteroids.dir[i];
+		}
+		written += (int)pck.writePos;
+	}
+	return written;
+}
+
+// bullets well inside the screen, so going back and forth a tick never loses one
+static Bullet InsideBullet(Pcg32& rng)
+{
+	Bullet bullet = BenchBullet(rng, 0);
+	bullet.xPos *= 0.9f;
+	bullet.yPos *= 0.9f;
+	return bullet;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<int> sizes;
+	for (int i = 1; i < argc; ++i) sizes.push_back(std::atoi(argv[i]));
+	if (sizes.empty()) sizes = { 1000, 10000, 50000 };
+
+	std::printf("%8s %22s %22s %22s\n", "n", "integrate us old/new", "serialize us old/new", "bullets us old/new");
+	for (int n : sizes)
+	{
+		if (n <= 0 || n > SLOT_MAP_MAX_SLOTS) continue;
+
+		ServerData data;
+		data.asteroids.Reset(n);
+		OldWorld old;
+		old.asteroids.resize(n);
+
+		Pcg32 rng;
+		rng.Seed(BENCH_SEED);
+		for (int i = 0; i < n; ++i)
+		{
+			Asteroid asteroid = BenchAsteroid(rng);
+			OldAsteroid& copy = old.asteroids[i];
+			copy.creationTime = std::chrono::steady_clock::now();
+			copy.ID = (int)data.asteroids.Add(asteroid, 0);
+			copy.xPos = asteroid.xPos;
+			copy.yPos = asteroid.yPos;
+			copy.xScale = asteroid.xScale;
+			copy.yScale = asteroid.yScale;
+			copy.vel_x = asteroid.vel_x;
+			copy.vel_y = asteroid.vel_y;
+			copy.dirCur = asteroid.dirCur;
+			copy.active = true;
+
+			Bullet bullet = InsideBullet(rng);
+			bullet.ownerID = i / BULLET_IDS_PER_PLAYER;
+			data.bullets.Add(i, bullet);
+			old.bullets[i] = bullet;
+		}
+
+		// one tick each and the same place, or the comparison means nothing
+		OldIntegrate(old, BENCH_DT);
+		IntegrateAsteroids(data.asteroids, 0, n, 1, BENCH_DT);
+		for (int i = 0; i < n; ++i)
+		{
+			if (std::fabs(old.asteroids[i].xPos - data.asteroids.xPos[i]) > 0.01f ||
+				std::fabs(old.asteroids[i].yPos - data.asteroids.yPos[i]) > 0.01f)
+			{
+				std::printf("asteroid %d ended up in different places\n", i);
+				return 1;
+			}
+		}
+
+		const int reps = std::max(1, 2000000 / n);
+		uint32_t tick = 1;
+		double oldInt = BestMicros(5, reps, [&] { OldIntegrate(old, BENCH_DT); });
+		double newInt = BestMicros(5, reps, [&] { IntegrateAsteroids(data.asteroids, 0, n, ++tick, BENCH_DT); });
+
+		double oldSer = BestMicros(5, reps / 4 + 1, [&] { benchSink += OldSerialize(old); });
+		double newSer = BestMicros(5, reps / 4 + 1, [&] { benchSink += NewSerialize(data.asteroids); });
+
+		// forward then back, the bullets stay put overall
+		float step = BENCH_DT;
+		double oldBul = BestMicros(5, reps, [&] { OldMoveBullets(old, step); step = -step; });
+		step = BENCH_DT;
+		double newBul = BestMicros(5, reps, [&] { IntegrateBullets(data.bullets, step); step = -step; });
+		if ((int)old.bullets.size() != n || data.bullets.Count() != n)
+		{
+			std::printf("lost bullets, %zu old %d new\n", old.bullets.size(), data.bullets.Count());
+			return 1;
+		}
+
+		std::printf("%8d %10.1f / %-9.1f %10.1f / %-9.1f %10.1f / %-9.1f\n", n,
+			oldInt, newInt, oldSer, newSer, oldBul, newBul);
+	}
+	return 0;
+}
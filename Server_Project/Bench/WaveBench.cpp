@@ -0,0 +1,136 @@
+/*******************************************************************************
+ * Wave generation microbenchmark
+ *
+ * What one random number and one 8 asteroid wave cost, the way the server used
+ * to make them (a std::random_device and a fresh std::mt19937 for every
+ * number) against the room's Pcg32 from Random.h, and what the room actually
+ * pays when a wave is due now that they are made ahead into a WaveRing.
+ *
+ * Before timing it checks that a seed really does give the same waves twice,
+ * that is what waveSeed in serverSettings.txt relies on.
+ *
+ *   wavebench
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project WaveBench.cpp -o wavebench
+ ******************************************************************************/
+
+#include <cfloat> // Vec2.h uses DBL_EPSILON without including it
+#include <cstring>
+#include <random>
+#include "BenchCommon.h"
+#include "Wave.h"
+
+// the old generateRandomFloat, word for word
+static float OldRandomFloat(float min, float max)
+{
+	std::random_device rd;
+	std::mt19937 gen(rd());
+	std::uniform_real_distribution<> dis(min, max);
+	return (float)dis(gen);
+}
+
+static Asteroid OldRandomiseAsteroid(float min_xPos, float max_xPos, float min_yPos, float max_yPos)
+{
+	Asteroid asteroid{};
+	asteroid.xPos = OldRandomFloat(min_xPos, max_xPos);
+	asteroid.yPos = OldRandomFloat(min_yPos, max_yPos);
+	float randAng = OldRandomFloat(0, 360);
+	Carmicah::Vec2f dir(cosf(randAng), sinf(randAng));
+	dir = dir.normalize();
+	dir *= ASTEROID_ACCEL;
+	asteroid.vel_x = dir.x;
+	asteroid.vel_y = dir.y;
+	asteroid.dirCur = randAng;
+	asteroid.xScale = 20.0f;
+	asteroid.yScale = 20.0f;
+	asteroid.active = true;
+	return asteroid;
+}
+
+static void OldMakeWave(Wave& wave)
+{
+	int n = 0;
+	for (int i = 0; i < 2; ++i)
+	{
+		wave.asteroids[n++] = OldRandomiseAsteroid(-X_SIZE, X_SIZE, -Y_SIZE, -Y_SIZE);
+		wave.asteroids[n++] = OldRandomiseAsteroid(-X_SIZE, X_SIZE, Y_SIZE, Y_SIZE);
+		wave.asteroids[n++] = OldRandomiseAsteroid(-X_SIZE, -X_SIZE, -Y_SIZE, Y_SIZE);
+		wave.asteroids[n++] = OldRandomiseAsteroid(X_SIZE, X_SIZE, -Y_SIZE, Y_SIZE);
+	}
+}
+
+static bool SameWave(const Wave& a, const Wave& b)
+{
+	for (int i = 0; i < WAVE_SIZE; ++i)
+	{
+		const Asteroid& x = a.asteroids[i];
+		const Asteroid& y = b.asteroids[i];
+		if (x.xPos != y.xPos || x.yPos != y.yPos || x.vel_x != y.vel_x || x.vel_y != y.vel_y || x.dirCur != y.dirCur)
+			return false;
+	}
+	return true;
+}
+
+int main()
+{
+	// same seed, same waves, however many come before
+	Pcg32 first, second;
+	first.Seed(BENCH_SEED, 3);
+	second.Seed(BENCH_SEED, 3);
+	for (int i = 0; i < 100; ++i)
+	{
+		Wave a, b;
+		MakeWave(first, a);
+		MakeWave(second, b);
+		if (!SameWave(a, b))
+		{
+			std::printf("wave %d came out different from the same seed\n", i);
+			return 1;
+		}
+	}
+
+	Pcg32 rng;
+	rng.Seed(BENCH_SEED);
+	std::mt19937 kept(static_cast<uint32_t>(BENCH_SEED));
+	std::uniform_real_distribution<> keptDis(0.0, 1.0);
+	Wave wave;
+	WaveRing ring;
+	float sinkF = 0.0f;
+
+	double oldNumber = BestMicros(5, 2000, [&] { sinkF += OldRandomFloat(0.0f, 1.0f); });
+	double keptNumber = BestMicros(5, 200000, [&] { sinkF += (float)keptDis(kept); });
+	double pcgNumber = BestMicros(5, 200000, [&] { sinkF += rng.NextFloat(0.0f, 1.0f); });
+
+	double oldWave = BestMicros(5, 200, [&] { OldMakeWave(wave); sinkF += wave.asteroids[0].xPos; });
+	double pcgWave = BestMicros(5, 20000, [&] { MakeWave(rng, wave); sinkF += wave.asteroids[0].xPos; });
+	// a wave coming due only copies one out of the ring. the refill happens in the spare
+	// part of an update so it is left out, the clock reads are in, so this is an upper bound
+	double ringTake = 1e30;
+	for (int run = 0; run < 5; ++run)
+	{
+		double total = 0.0;
+		const int batches = 20000;
+		for (int b = 0; b < batches; ++b)
+		{
+			while (ring.Fill(rng)) {}
+			auto start = std::chrono::steady_clock::now();
+			while (!ring.Empty())
+			{
+				std::memcpy(&wave, &ring.Front(), sizeof(wave));
+				ring.Pop();
+				sinkF += wave.asteroids[0].xPos;
+			}
+			total += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		}
+		ringTake = std::min(ringTake, total / (batches * WAVE_RING_SIZE));
+	}
+	benchSink += (int)sinkF;
+
+	std::printf("%-40s %10.3f us\n", "random_device + mt19937 per number", oldNumber);
+	std::printf("%-40s %10.3f us\n", "one mt19937 kept around, per number", keptNumber);
+	std::printf("%-40s %10.3f us\n", "Pcg32 per number", pcgNumber);
+	std::printf("%-40s %10.3f us\n", "wave, old way (24 numbers)", oldWave);
+	std::printf("%-40s %10.3f us\n", "wave, Pcg32", pcgWave);
+	std::printf("%-40s %10.3f us\n", "wave due, taken from the ring", ringTake);
+	return 0;
+}
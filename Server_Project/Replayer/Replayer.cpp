@@ -0,0 +1,257 @@
+/*******************************************************************************
+ * Headless match replayer
+ *
+ * Runs a match journal (see Journal.h, journalDir in serverSettings.txt) back
+ * through the server's own SimStep as fast as it will go, no sockets and no
+ * sleeping between ticks. Every tick's checksum is held up against the one the
+ * server wrote, so a change to the sim that moves anything shows up as a
+ * desync at the first tick it makes a difference on, and the per-tick times
+ * make a recorded busy match into a repeatable benchmark.
+ *
+ *   replayer <journal> [--threads n] [--from tick] [--until tick] [--repeat n]
+ *
+ * --from starts at the last keyframe at or before tick, runs up to tick
+ * untimed, and times from there. --repeat runs the same stretch n times and
+ * times all of them together, for steadier numbers on short journals.
+ *
+ * Builds on its own, nothing from the server but the headers:
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project Replayer.cpp -o replayer
+ * or add it to an empty console project with ../Server_Project on the include
+ * path and ws2_32.lib linked.
+ ******************************************************************************/
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#include <cstdint>
+// winsock has these, Packet.h expects them
+inline uint64_t htonll(uint64_t v)
+{
+	return htonl(1) == 1 ? v : (static_cast<uint64_t>(htonl(static_cast<uint32_t>(v))) << 32) | htonl(static_cast<uint32_t>(v >> 32));
+}
+inline uint64_t ntohll(uint64_t v) { return htonll(v); }
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "Journal.h"
+#include "Simulation.h"
+
+struct JournalRecord
+{
+	char kind = 0;
+	uint32_t tick = 0;
+	size_t offset = 0; // of whatever comes after the kind byte
+};
+
+struct ReplayOptions
+{
+	std::string path;
+	int threads = 1;
+	uint32_t from = 0;
+	uint32_t until = UINT32_MAX;
+	int repeat = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, ReplayOptions& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--threads" && hasValue) options.threads = std::atoi(argv[++i]);
+		else if (arg == "--from" && hasValue) options.from = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (arg == "--until" && hasValue) options.until = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (arg == "--repeat" && hasValue) options.repeat = std::atoi(argv[++i]);
+		else if (arg[0] != '-' && options.path.empty()) options.path = arg;
+		else return false;
+	}
+	if (options.threads < 1) options.threads = 1;
+	if (options.repeat < 1) options.repeat = 1;
+	return !options.path.empty();
+}
+
+static void FreshData(ServerData& data, const JournalHeader& header)
+{
+	data.totalClients.Reserve(static_cast<int>(header.maxPlayers));
+	data.ships.Resize(static_cast<int>(header.maxPlayers));
+	data.asteroids.Reset(static_cast<int>(header.maxAsteroids));
+	data.gameRunning = true;
+}
+
+// where every keyframe and frame starts, one pass over the file
+static bool IndexJournal(JournalIn in, const char* begin, const JournalHeader& header, std::vector<JournalRecord>& records)
+{
+	std::vector<LockstepOp> ops;
+	while (!in.Done())
+	{
+		JournalRecord record;
+		if (!in.Get(record.kind)) return false;
+		record.offset = static_cast<size_t>(in.pos - begin);
+
+		if (record.kind == JOURNAL_FRAME)
+		{
+			uint32_t checksum;
+			if (!GetFrame(in, record.tick, ops, checksum)) return false;
+		}
+		else if (record.kind == JOURNAL_KEYFRAME)
+		{
+			// only way past one is to read it, the sizes are all inside
+			ServerData scratch;
+			FreshData(scratch, header);
+			uint32_t checksum;
+			if (!GetKeyframe(in, scratch, checksum)) return false;
+			record.tick = scratch.tick;
+		}
+		else return false;
+
+		records.push_back(record);
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	ReplayOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		std::cerr << "usage: replayer <journal> [--threads n] [--from tick] [--until tick] [--repeat n]" << std::endl;
+		return 1;
+	}
+
+	std::ifstream file(options.path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Couldnt open " << options.path << std::endl;
+		return 1;
+	}
+	std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	JournalIn in{ bytes.data(), bytes.data() + bytes.size() };
+	JournalHeader header;
+	if (!GetJournalHeader(in, header))
+	{
+		std::cerr << options.path << " isnt a journal this replayer can read" << std::endl;
+		return 1;
+	}
+
+	std::vector<JournalRecord> records;
+	if (!IndexJournal(in, bytes.data(), header, records))
+	{
+		// a server that got killed mid write leaves a torn record at the end, the rest is fine
+		std::cerr << "Journal ends in a partial record, replaying what is there" << std::endl;
+	}
+
+	size_t start = records.size();
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		if (records[i].kind == JOURNAL_KEYFRAME && (start == records.size() || records[i].tick <= options.from)) start = i;
+	}
+	if (start == records.size())
+	{
+		std::cerr << "No keyframe to start from" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Room " << header.room << ", wave seed " << header.seed << ", " << header.tickRate << " ticks/s, "
+		<< records.size() << " records, starting at keyframe " << records[start].tick << std::endl;
+
+	JobSystem jobs;
+	jobs.Start(options.threads);
+
+	// same float the server worked out, or the first tick is already off
+	const double tickLength = 1.0 / header.tickRate;
+	const float dt = static_cast<float>(tickLength);
+
+	std::vector<double> tickMs;
+	std::vector<LockstepOp> ops;
+	SimEvents events;
+	uint32_t firstDesync = 0, desyncs = 0, badOps = 0;
+
+	for (int pass = 0; pass < options.repeat; ++pass)
+	{
+		ServerData data;
+		FreshData(data, header);
+
+		uint32_t checksum = 0;
+		JournalIn keyframe{ bytes.data() + records[start].offset, bytes.data() + bytes.size() };
+		GetKeyframe(keyframe, data, checksum);
+
+		for (size_t r = start + 1; r < records.size(); ++r)
+		{
+			const JournalRecord& record = records[r];
+			if (record.tick > options.until) break;
+			if (record.kind != JOURNAL_FRAME) continue;
+
+			uint32_t tick, expected;
+			JournalIn frame{ bytes.data() + record.offset, bytes.data() + bytes.size() };
+			GetFrame(frame, tick, ops, expected);
+
+			auto begin = std::chrono::steady_clock::now();
+			for (const LockstepOp& op : ops)
+			{
+				if (!ApplyLockstepOp(data, op)) ++badOps;
+			}
+			events.Clear();
+			SimStep(data, dt, events, jobs);
+			checksum = StateChecksum(data, checksum);
+			auto end = std::chrono::steady_clock::now();
+
+			if (data.tick != tick)
+			{
+				std::cerr << "Frame for tick " << tick << " came after tick " << data.tick - 1 << ", journal has a gap" << std::endl;
+				return 1;
+			}
+			if (checksum != expected)
+			{
+				if (desyncs == 0) firstDesync = tick;
+				++desyncs;
+				// carry on from what the server had, so the count is ticks the state was off on,
+				// not just every tick after the first
+				checksum = expected;
+			}
+			if (tick > options.from)
+			{
+				tickMs.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+			}
+		}
+	}
+
+	if (tickMs.empty())
+	{
+		std::cerr << "No ticks after " << options.from << " to time" << std::endl;
+		return 1;
+	}
+
+	double total = 0.0;
+	for (double ms : tickMs) total += ms;
+	std::vector<double> sorted = tickMs;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&sorted](double p) { return sorted[static_cast<size_t>(p * (sorted.size() - 1))]; };
+
+	const double avg = total / tickMs.size();
+	std::cout << tickMs.size() << " ticks on " << jobs.Threads() << " threads" << std::endl;
+	std::cout << "avg " << avg << " ms, p50 " << percentile(0.5) << " ms, p99 " << percentile(0.99)
+		<< " ms, max " << sorted.back() << " ms" << std::endl;
+	std::cout << 1000.0 / avg << " ticks/s, " << (1000.0 / avg) / header.tickRate << "x real time" << std::endl;
+
+	if (badOps > 0) std::cout << badOps << " ops didnt apply cleanly" << std::endl;
+	if (desyncs > 0)
+	{
+		std::cout << "DESYNC on " << desyncs << " ticks, first at tick " << firstDesync << std::endl;
+		return 2;
+	}
+	std::cout << "Checksums match" << std::endl;
+	return 0;
+}
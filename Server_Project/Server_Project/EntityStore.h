@@ -0,0 +1,234 @@
+/*******************************************************************************
+ * Structure of arrays entity storage
+ *
+ * One store per kind of entity, every field in its own contiguous array so the
+ * simulation loops walk straight through memory (and the compiler can
+ * vectorize them) instead of hopping between structs or map nodes.
+ *
+ * The structs in Game.h are still used to hand a single entity around, like a
+ * freshly spawned asteroid, they just dont live in ServerData anymore.
+ ******************************************************************************/
+
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <cstdint>
+#include <vector>
+#include "Game.h"
+#include "SlotMap.h"
+
+// moves the last element into i and drops the last, what every packed store does on remove
+template <typename T>
+inline void SwapPop(std::vector<T>& v, int i)
+{
+	v[i] = v.back();
+	v.pop_back();
+}
+
+// indexed by player slot, only the slots in the sim (ClientInfo::inSim) mean anything
+struct ShipStore
+{
+	std::vector<float> xPos, yPos;
+	std::vector<float> velX, velY;
+	std::vector<float> dir;
+	std::vector<int> score;
+
+	void Resize(int capacity)
+	{
+		xPos.assign(capacity, 0.0f);
+		yPos.assign(capacity, 0.0f);
+		velX.assign(capacity, 0.0f);
+		velY.assign(capacity, 0.0f);
+		dir.assign(capacity, 0.0f);
+		score.assign(capacity, 0);
+	}
+
+	int Capacity() const { return static_cast<int>(xPos.size()); }
+
+	// back to the middle, standing still, score untouched
+	void ResetMotion(int i)
+	{
+		xPos[i] = 0.0f;
+		yPos[i] = 0.0f;
+		velX[i] = 0.0f;
+		velY[i] = 0.0f;
+		dir[i] = 0.0f;
+	}
+};
+
+// packed, [0, Count()) are all live. the handle from ids is the asteroid's id on the
+// wire, killing one in the sim only flags it and RemoveDead packs the arrays after
+// so indices stay put for the rest of the tick.
+// asteroids fly straight at a constant speed, so where one is comes from where it was
+// at its last keyframe (spawn or last wrap) plus velocity * ticks since. xPos/yPos are
+// that worked out for the current tick, nothing adds onto them so they dont drift
+struct AsteroidStore
+{
+	SlotMap ids;
+	std::vector<float> xPos, yPos;
+	std::vector<float> velX, velY;
+	std::vector<float> keyX, keyY;
+	std::vector<uint32_t> keyTick;
+	std::vector<float> xScale, yScale;
+	std::vector<float> dir;
+	std::vector<uint8_t> dead;
+
+	int spawned = 0; // total handed out this game, slots get reused so this isnt Count()
+
+	void Reset(int capacity)
+	{
+		ids.Reset(capacity);
+		xPos.clear();
+		yPos.clear();
+		velX.clear();
+		velY.clear();
+		keyX.clear();
+		keyY.clear();
+		keyTick.clear();
+		xScale.clear();
+		yScale.clear();
+		dir.clear();
+		dead.clear();
+		spawned = 0;
+	}
+
+	int Count() const { return ids.Size(); }
+	int Capacity() const { return ids.MaxSlots(); }
+	SlotMap::Handle HandleAt(int i) const { return ids.HandleAt(i); }
+
+	// where asteroid i is ticks after its keyframe, fractions included
+	float XAt(int i, float ticks, float tickDt) const { return keyX[i] + velX[i] * ticks * tickDt; }
+	float YAt(int i, float ticks, float tickDt) const { return keyY[i] + velY[i] * ticks * tickDt; }
+
+	// new starting point, for when something other than velocity moves it (a wrap)
+	void Rekey(int i, float x, float y, uint32_t tick)
+	{
+		xPos[i] = keyX[i] = x;
+		yPos[i] = keyY[i] = y;
+		keyTick[i] = tick;
+	}
+
+	// returns the new id, or SlotMap::INVALID when there is no room.
+	// tick is the one it spawns on, its keyframe
+	SlotMap::Handle Add(const Asteroid& asteroid, uint32_t tick)
+	{
+		SlotMap::Handle handle = ids.Insert();
+		if (handle == SlotMap::INVALID) return handle;
+
+		xPos.push_back(asteroid.xPos);
+		yPos.push_back(asteroid.yPos);
+		velX.push_back(asteroid.vel_x);
+		velY.push_back(asteroid.vel_y);
+		keyX.push_back(asteroid.xPos);
+		keyY.push_back(asteroid.yPos);
+		keyTick.push_back(tick);
+		xScale.push_back(asteroid.xScale);
+		yScale.push_back(asteroid.yScale);
+		dir.push_back(asteroid.dirCur);
+		dead.push_back(0);
+		++spawned;
+		return handle;
+	}
+
+	void Kill(int i) { dead[i] = 1; }
+
+	void RemoveDead()
+	{
+		for (int i = Count() - 1; i >= 0; --i)
+		{
+			if (dead[i]) RemoveAt(i);
+		}
+	}
+
+	void RemoveAt(int i)
+	{
+		ids.EraseAt(i);
+		SwapPop(xPos, i);
+		SwapPop(yPos, i);
+		SwapPop(velX, i);
+		SwapPop(velY, i);
+		SwapPop(keyX, i);
+		SwapPop(keyY, i);
+		SwapPop(keyTick, i);
+		SwapPop(xScale, i);
+		SwapPop(yScale, i);
+		SwapPop(dir, i);
+		SwapPop(dead, i);
+	}
+};
+
+// the client's BULLET_ID_MAX, a player's bullets are numbered player * this + n
+const int BULLET_IDS_PER_PLAYER = 100;
+
+// packed like asteroids. netID is the id the shooting client gave the bullet,
+// thats what goes back out in BULLET_COLLIDE so the clients can find their copy.
+// a client can only use the ids in its own player's range, so they index a flat
+// table that never grows past the player count's worth of ids
+struct BulletStore
+{
+	SlotMap ids;
+	std::vector<SlotMap::Handle> byNetID; // by netID, INVALID when that id isnt in flight
+	std::vector<int> netID;
+	std::vector<int> ownerID;
+	std::vector<float> xPos, yPos;
+	std::vector<float> velX, velY;
+
+	int Count() const { return ids.Size(); }
+
+	// is the id in owner's range
+	static bool OwnsNetID(int owner, int bulletNetID)
+	{
+		return owner >= 0 && bulletNetID >= 0 && bulletNetID / BULLET_IDS_PER_PLAYER == owner;
+	}
+
+	// clients recycle their bullet ids, a reused id replaces the old bullet.
+	// INVALID for an id outside the owner's range as well as for a full store
+	SlotMap::Handle Add(int bulletNetID, const Bullet& bullet)
+	{
+		if (!OwnsNetID(bullet.ownerID, bulletNetID)) return SlotMap::INVALID;
+		if (bulletNetID >= static_cast<int>(byNetID.size())) byNetID.resize(bulletNetID + 1, SlotMap::INVALID);
+
+		int old = ids.Find(byNetID[bulletNetID]);
+		if (old >= 0) RemoveAt(old);
+
+		SlotMap::Handle handle = ids.Insert();
+		if (handle == SlotMap::INVALID) return handle;
+
+		byNetID[bulletNetID] = handle;
+		netID.push_back(bulletNetID);
+		ownerID.push_back(bullet.ownerID);
+		xPos.push_back(bullet.xPos);
+		yPos.push_back(bullet.yPos);
+		velX.push_back(bullet.vel_x);
+		velY.push_back(bullet.vel_y);
+		return handle;
+	}
+
+	void RemoveAt(int i)
+	{
+		byNetID[netID[i]] = SlotMap::INVALID;
+		ids.EraseAt(i);
+		SwapPop(netID, i);
+		SwapPop(ownerID, i);
+		SwapPop(xPos, i);
+		SwapPop(yPos, i);
+		SwapPop(velX, i);
+		SwapPop(velY, i);
+	}
+
+	void RemoveOwner(int owner)
+	{
+		for (int i = Count() - 1; i >= 0; --i)
+		{
+			if (ownerID[i] == owner) RemoveAt(i);
+		}
+	}
+
+	// every bullet gone, the slot map keeps its capacity
+	void Clear()
+	{
+		for (int i = Count() - 1; i >= 0; --i) RemoveAt(i);
+	}
+};
+
+#endif
@@ -0,0 +1,342 @@
+/*******************************************************************************
+ * XOR parity forward error correction
+ *
+ * Every N protected datagrams get one extra parity datagram that is the XOR of
+ * all of them (zero padded to the longest). If exactly one datagram of a group
+ * goes missing the receiver can rebuild it from the others plus the parity,
+ * instead of waiting a whole round trip for a resend.
+ *
+ * Wire format, both wrapped in the usual [cmd u8][len u32] header:
+ *   FEC_DATA   [group u16][index u8][original datagram]
+ *   FEC_PARITY [group u16][count u8][lenXor u16][xor of the originals]
+ *
+ * The same file lives in the server and the client. Plain C++, no sockets.
+ ******************************************************************************/
+
+#ifndef FEC_H
+#define FEC_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Packet.h"
+
+#define FEC_MIN_GROUP       2
+#define FEC_MAX_GROUP       16
+#define FEC_HEADER_LEN      5  // [cmd][len]
+#define FEC_DATA_LEN        3  // [group][index]
+#define FEC_PARITY_LEN      5  // [group][count][lenXor]
+#define FEC_WINDOW          32 // groups the decoder keeps around
+#define FEC_TARGET_RESIDUAL 0.01 // acceptable chance of a group losing 2+ packets
+
+// anything bigger than this cant be wrapped. keeps both the FEC_DATA and the FEC_PARITY
+// body within MAX_BODY_LEN, a receiver drops anything longer
+#define FEC_MAX_INNER_LEN   (MAX_BODY_LEN - FEC_PARITY_LEN)
+// the longest message body that still gets wrapped
+#define FEC_MAX_BODY_LEN    (FEC_MAX_INNER_LEN - FEC_HEADER_LEN)
+
+inline void FecWriteU16(char* out, uint16_t v)
+{
+	out[0] = static_cast<char>(v >> 8);
+	out[1] = static_cast<char>(v & 0xFF);
+}
+
+inline uint16_t FecReadU16(const char* in)
+{
+	return static_cast<uint16_t>((static_cast<uint8_t>(in[0]) << 8) | static_cast<uint8_t>(in[1]));
+}
+
+// same [cmd][len] header the rest of the code builds with htonl
+inline int FecWriteHeader(char* out, CMDID cmd, uint32_t bodyLen)
+{
+	out[0] = static_cast<char>(cmd);
+	out[1] = static_cast<char>(bodyLen >> 24);
+	out[2] = static_cast<char>((bodyLen >> 16) & 0xFF);
+	out[3] = static_cast<char>((bodyLen >> 8) & 0xFF);
+	out[4] = static_cast<char>(bodyLen & 0xFF);
+	return FEC_HEADER_LEN;
+}
+
+// biggest group that still keeps the chance of 2+ losses (unrecoverable) under target
+inline int FecGroupSizeForLoss(double lossRate)
+{
+	if (lossRate <= 0.0) return FEC_MAX_GROUP;
+
+	for (int n = FEC_MAX_GROUP; n > FEC_MIN_GROUP; n /= 2)
+	{
+		// n data + 1 parity, recoverable if at most one of them is lost
+		double ok = std::pow(1.0 - lossRate, n + 1) + (n + 1) * lossRate * std::pow(1.0 - lossRate, n);
+		if (1.0 - ok <= FEC_TARGET_RESIDUAL) return n;
+	}
+	return FEC_MIN_GROUP;
+}
+
+// one per receiver on the sending side, only touched by the sending thread
+// except ReportLoss which can come from the receive thread
+class FecEncoder
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// wraps one datagram into out as FEC_DATA, returns the wrapped length
+	// or 0 if it is too big to protect
+	int Wrap(const char* data, int len, char* out)
+	{
+		if (len > FEC_MAX_INNER_LEN) return 0;
+
+		if (_count == 0)
+		{
+			_openedAt = Clock::now();
+			_lenXor = 0;
+			_parityLen = 0;
+			std::memset(_parity, 0, sizeof(_parity));
+		}
+
+		for (int i = 0; i < len; ++i)
+		{
+			_parity[i] ^= data[i];
+		}
+		if (len > _parityLen) _parityLen = len;
+		_lenXor ^= static_cast<uint16_t>(len);
+
+		int offset = FecWriteHeader(out, FEC_DATA, static_cast<uint32_t>(FEC_DATA_LEN + len));
+		FecWriteU16(out + offset, _group);
+		out[offset + 2] = static_cast<char>(_count);
+		offset += FEC_DATA_LEN;
+		std::memcpy(out + offset, data, len);
+
+		++_count;
+		return offset + len;
+	}
+
+	bool GroupFull() const { return _count >= _groupSize; }
+	bool GroupOpen() const { return _count > 0; }
+
+	double GroupAgeMs() const
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - _openedAt).count();
+	}
+
+	// finishes the open group, writes its parity into out and returns the length
+	int Close(char* out)
+	{
+		if (_count == 0) return 0;
+
+		int offset = FecWriteHeader(out, FEC_PARITY, static_cast<uint32_t>(FEC_PARITY_LEN + _parityLen));
+		FecWriteU16(out + offset, _group);
+		out[offset + 2] = static_cast<char>(_count);
+		FecWriteU16(out + offset + 3, _lenXor);
+		offset += FEC_PARITY_LEN;
+		std::memcpy(out + offset, _parity, _parityLen);
+
+		++_group;
+		_count = 0;
+		return offset + _parityLen;
+	}
+
+	// receiver told us how many fec packets it saw and how many went missing
+	void ReportLoss(uint32_t received, uint32_t lost)
+	{
+		uint32_t total = received + lost;
+		if (total == 0) return;
+
+		double rate = static_cast<double>(lost) / total;
+		_lossEstimate = _lossEstimate * 0.75 + rate * 0.25;
+		_groupSize = FecGroupSizeForLoss(_lossEstimate);
+	}
+
+	int GroupSize() const { return _groupSize; }
+	double LossEstimate() const { return _lossEstimate; }
+
+private:
+	uint16_t _group = 0;
+	int _count = 0;
+	std::atomic_int _groupSize{ FEC_MAX_GROUP };
+	double _lossEstimate = 0.0;
+
+	char _parity[FEC_MAX_INNER_LEN]{};
+	int _parityLen = 0;
+	uint16_t _lenXor = 0;
+	Clock::time_point _openedAt;
+};
+
+// receiving side, hands out every datagram once whether it arrived or got rebuilt
+class FecDecoder
+{
+public:
+	// body of a FEC_DATA packet, fn(data, len) gets the unwrapped datagram
+	template <typename TFn>
+	void OnData(const char* body, int bodyLen, TFn&& fn)
+	{
+		if (bodyLen <= FEC_DATA_LEN) return;
+
+		uint16_t groupID = FecReadU16(body);
+		int index = static_cast<uint8_t>(body[2]);
+		if (index >= FEC_MAX_GROUP) return;
+
+		const char* data = body + FEC_DATA_LEN;
+		int len = bodyLen - FEC_DATA_LEN;
+
+		Group& group = GetGroup(groupID);
+		if (group.received & (1u << index)) return; // dupe or already rebuilt
+
+		group.received |= (1u << index);
+		++group.arrived;
+		if (group.counted)
+		{
+			// showed up after we already booked it as lost
+			++_statReceived;
+			if (_statLost > 0) --_statLost;
+		}
+		group.data[index].assign(data, data + len);
+		fn(data, len);
+
+		TryRecover(group, fn);
+	}
+
+	// body of a FEC_PARITY packet, fn gets called if it lets us rebuild something
+	template <typename TFn>
+	void OnParity(const char* body, int bodyLen, TFn&& fn)
+	{
+		if (bodyLen < FEC_PARITY_LEN) return;
+
+		uint16_t groupID = FecReadU16(body);
+		Group& group = GetGroup(groupID);
+		if (group.hasParity) return;
+
+		group.hasParity = true;
+		++group.arrived;
+		group.count = static_cast<uint8_t>(body[2]);
+		group.lenXor = FecReadU16(body + 3);
+		group.parity.assign(body + FEC_PARITY_LEN, body + bodyLen);
+
+		// parity goes out last so by now the group is as complete as it will usually get
+		Count(group);
+		TryRecover(group, fn);
+	}
+
+	// packets seen and packets lost on the wire since the last call
+	void TakeStats(uint32_t& received, uint32_t& lost)
+	{
+		received = _statReceived;
+		lost = _statLost;
+		_statReceived = 0;
+		_statLost = 0;
+	}
+
+	uint32_t Recovered() const { return _recovered; }
+
+private:
+	struct Group
+	{
+		bool used = false;
+		uint16_t id = 0;
+		uint32_t received = 0; // bit per data index
+		int arrived = 0;       // data + parity that came off the wire
+		int count = -1;        // data packets in the group, known once parity shows up
+		bool hasParity = false;
+		bool counted = false;  // already added to the loss stats
+		uint16_t lenXor = 0;
+		std::vector<char> parity;
+		std::vector<char> data[FEC_MAX_GROUP];
+	};
+
+	Group& GetGroup(uint16_t groupID)
+	{
+		Group& group = _groups[groupID % FEC_WINDOW];
+		if (!group.used || group.id != groupID)
+		{
+			Retire(group);
+			group.used = true;
+			group.id = groupID;
+			group.received = 0;
+			group.arrived = 0;
+			group.count = -1;
+			group.hasParity = false;
+			group.counted = false;
+			group.parity.clear();
+			for (std::vector<char>& d : group.data) d.clear();
+		}
+		return group;
+	}
+
+	void Count(Group& group)
+	{
+		if (group.counted) return;
+
+		// without parity we dont know the size, the highest index seen is the best guess
+		int expected = group.arrived;
+		if (group.count >= 0)
+		{
+			expected = group.count + 1;
+		}
+		else
+		{
+			for (int i = FEC_MAX_GROUP - 1; i >= 0; --i)
+			{
+				if (group.received & (1u << i))
+				{
+					expected = i + 2; // +1 for the index, +1 for the parity we never got
+					break;
+				}
+			}
+		}
+
+		_statReceived += group.arrived;
+		if (expected > group.arrived) _statLost += expected - group.arrived;
+		group.counted = true;
+	}
+
+	// a group falling out of the window gets counted if its parity never came
+	void Retire(Group& group)
+	{
+		if (!group.used) return;
+
+		Count(group);
+		group.used = false;
+	}
+
+	template <typename TFn>
+	void TryRecover(Group& group, TFn&& fn)
+	{
+		if (!group.hasParity || group.count <= 0 || group.count > FEC_MAX_GROUP) return;
+
+		int missing = -1;
+		for (int i = 0; i < group.count; ++i)
+		{
+			if (group.received & (1u << i)) continue;
+			if (missing >= 0) return; // more than one gone, nothing we can do
+			missing = i;
+		}
+		if (missing < 0) return;
+
+		std::vector<char> rebuilt(group.parity);
+		uint16_t len = group.lenXor;
+		for (int i = 0; i < group.count; ++i)
+		{
+			if (i == missing) continue;
+			const std::vector<char>& d = group.data[i];
+			for (size_t j = 0; j < d.size() && j < rebuilt.size(); ++j)
+			{
+				rebuilt[j] ^= d[j];
+			}
+			len ^= static_cast<uint16_t>(d.size());
+		}
+		if (len > rebuilt.size()) return; // parity doesnt add up, drop it
+
+		group.received |= (1u << missing);
+		group.data[missing].assign(rebuilt.begin(), rebuilt.begin() + len);
+		++_recovered;
+		fn(group.data[missing].data(), static_cast<int>(len));
+	}
+
+	Group _groups[FEC_WINDOW];
+	uint32_t _statReceived = 0;
+	uint32_t _statLost = 0;
+	uint32_t _recovered = 0;
+};
+
+#endif
@@ -21,7 +21,6 @@ struct Ship
 };
 struct Asteroid
 {
-	std::chrono::steady_clock::time_point creationTime;
 	int ID;
 	float xPos;
 	float yPos;
@@ -0,0 +1,131 @@
+/*******************************************************************************
+ * Room inbox
+ *
+ * The room's worker is the only thread that touches the world (ships,
+ * asteroids, bullets, pending inputs, lockstep/rewind state). Anything another
+ * thread wants done to it, a packet that came in or a player leaving, goes in
+ * here as a SimCommand and the worker applies it at the start of its next
+ * update, before the tick. So the sim needs no lock at all and the receive
+ * thread never waits on a tick that is running.
+ *
+ * The queue is a fixed ring with a sequence number per cell (Vyukov's bounded
+ * queue, cut down to one consumer). A push is one compare-exchange on the tail
+ * that only retries when another thread pushed at the same moment, which with
+ * one receive thread is never. A full ring turns the push away instead of
+ * waiting, the caller decides what that means. Nothing is allocated after the
+ * room opens.
+ ******************************************************************************/
+
+#ifndef INBOX_H
+#define INBOX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// commands a room can have waiting, has to be a power of two.
+// a few seconds of every player's inputs, a full one means the worker is stuck anyway
+#define ROOM_INBOX_SIZE 4096
+
+enum SIM_COMMAND : uint8_t
+{
+	SIM_CMD_INPUT = 0, // an input frame for id's ship
+	SIM_CMD_BULLET,    // id fired bullet extra, see ProcessBulletFired
+	SIM_CMD_JOIN,      // id just joined, flag is 1 if they got their old ship back
+	SIM_CMD_LEAVE,     // id left, their bullets go
+	SIM_CMD_RESPAWN,   // id's ship back to the middle
+	SIM_CMD_CHECKSUM   // lockstep peer id says it had checksum after tick
+};
+
+struct SimCommand
+{
+	uint8_t type = SIM_CMD_INPUT;
+	uint8_t flag = 0;  // the input for INPUT, kept ship for JOIN
+	int id = 0;        // player slot
+	int extra = 0;     // bullet id for BULLET
+	uint32_t tick = 0;
+	uint32_t checksum = 0;
+	uint64_t time = 0; // when a BULLET was fired, on the server clock
+	float x = 0.0f, y = 0.0f, dir = 0.0f; // where the shooter says the muzzle was
+};
+
+// many threads push, one pops
+template <typename T, size_t N>
+class Inbox
+{
+	static_assert((N & (N - 1)) == 0, "inbox size has to be a power of two");
+
+public:
+	Inbox()
+	{
+		for (size_t i = 0; i < N; ++i) _cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	Inbox(const Inbox&) = delete;
+	Inbox& operator=(const Inbox&) = delete;
+
+	// false when full, nothing was queued then
+	bool Push(const T& value)
+	{
+		size_t pos = _tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = _cells[pos & (N - 1)];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+			if (diff == 0)
+			{
+				if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell.value = value;
+					// the consumer only reads the cell once it sees this
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				// the consumer hasnt got to this cell since the last lap
+				return false;
+			}
+			else
+			{
+				pos = _tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// consumer only, false when nothing is waiting
+	bool Pop(T& value)
+	{
+		Cell& cell = _cells[_head & (N - 1)];
+		if (cell.sequence.load(std::memory_order_acquire) != _head + 1) return false;
+
+		value = cell.value;
+		// free for the push one lap from now
+		cell.sequence.store(_head + N, std::memory_order_release);
+		++_head;
+		return true;
+	}
+
+	// consumer only, throws away whatever is waiting
+	void Clear()
+	{
+		T discard;
+		while (Pop(discard)) {}
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence{ 0 };
+		T value;
+	};
+
+	Cell _cells[N];
+	// producers and the consumer on their own cache lines so they dont fight over one
+	alignas(64) std::atomic<size_t> _tail{ 0 };
+	alignas(64) size_t _head = 0;
+};
+
+#endif
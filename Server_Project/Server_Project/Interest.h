@@ -0,0 +1,145 @@
+/*******************************************************************************
+ * Area of interest
+ *
+ * With interestRadius set, a client is only told about the ships and asteroids
+ * near its own ship. After every batch of ticks the server looks around each
+ * ship, works out what came into and went out of that client's set, and sends
+ * ENTITY_ENTER / ENTITY_LEAVE. Snapshots then only carry the ships and asteroids
+ * in the client's set. A client gets an asteroid when it comes into range and
+ * drops it when it leaves.
+ *
+ * Hysteresis: things come in at the radius but only leave past
+ * radius * INTEREST_LEAVE_SCALE, so something sitting on the edge doesnt go in
+ * and out every tick.
+ ******************************************************************************/
+
+#ifndef INTEREST_H
+#define INTEREST_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "EntityStore.h"
+#include "SpatialHash.h"
+
+#define INTEREST_LEAVE_SCALE 1.25f
+
+// what one client currently knows about, only the room's worker touches it like the rest of the sim
+struct InterestSet
+{
+	std::vector<uint8_t> ships;            // by player slot, 1 when the client has it
+	std::vector<SlotMap::Handle> asteroids; // sorted
+
+	void Clear()
+	{
+		ships.clear();
+		asteroids.clear();
+	}
+
+	bool SeesShip(int id) const
+	{
+		return id >= 0 && id < static_cast<int>(ships.size()) && ships[id];
+	}
+
+	bool SeesAsteroid(SlotMap::Handle handle) const
+	{
+		return std::binary_search(asteroids.begin(), asteroids.end(), handle);
+	}
+
+	// the slot got a new player, the next pass sends them as an enter instead of
+	// carrying on from whoever had the slot before
+	void ForgetShip(int id)
+	{
+		if (id >= 0 && id < static_cast<int>(ships.size())) ships[id] = 0;
+	}
+};
+
+// one pass worth of differences for one client, reused for every client so the
+// vectors stop allocating once they have grown
+struct InterestChange
+{
+	std::vector<int> shipsIn;                  // player slots
+	std::vector<int> shipsOut;
+	std::vector<int> asteroidsIn;              // dense indices, the packet needs their state
+	std::vector<SlotMap::Handle> asteroidsOut; // handles, they might be gone already
+
+	// the new set gets built here then swapped into the client's
+	std::vector<uint8_t> nowShips;
+	std::vector<SlotMap::Handle> nowAsteroids;
+
+	void Clear()
+	{
+		shipsIn.clear();
+		shipsOut.clear();
+		asteroidsIn.clear();
+		asteroidsOut.clear();
+	}
+
+	bool Empty() const
+	{
+		return shipsIn.empty() && shipsOut.empty() && asteroidsIn.empty() && asteroidsOut.empty();
+	}
+};
+
+// both grids hold positions as they are right now (not swept), the ship grid only
+// holds connected ships. self is the client's own slot, it always sees its own ship
+inline void ComputeInterest(InterestSet& set, int self, float radius,
+	const ShipStore& ships, SpatialHash& shipGrid, int shipSlots,
+	const AsteroidStore& asteroids, SpatialHash& asteroidGrid, InterestChange& change)
+{
+	const float x = ships.xPos[self];
+	const float y = ships.yPos[self];
+	const float leave = radius * INTEREST_LEAVE_SCALE;
+	const float enter2 = radius * radius;
+	const float leave2 = leave * leave;
+
+	auto keep = [&](float ox, float oy, bool had)
+	{
+		float dx = ox - x;
+		float dy = oy - y;
+		float d2 = dx * dx + dy * dy;
+		return d2 <= enter2 || (had && d2 <= leave2);
+	};
+
+	// ships, a flag per slot so in/out falls out of comparing old and new
+	std::vector<uint8_t>& nowShips = change.nowShips;
+	nowShips.assign(shipSlots, 0);
+	nowShips[self] = 1;
+	shipGrid.Query(x - leave, y - leave, x + leave, y + leave, [&](int id)
+		{
+			if (id != self && keep(ships.xPos[id], ships.yPos[id], set.SeesShip(id))) nowShips[id] = 1;
+		});
+
+	for (int i = 0; i < shipSlots; ++i)
+	{
+		bool had = set.SeesShip(i);
+		if (nowShips[i] && !had) change.shipsIn.push_back(i);
+		else if (!nowShips[i] && had) change.shipsOut.push_back(i);
+	}
+	set.ships.swap(nowShips);
+
+	// asteroids, sorted handles so the leave list is a set difference
+	std::vector<SlotMap::Handle>& nowAsteroids = change.nowAsteroids;
+	nowAsteroids.clear();
+	asteroidGrid.Query(x - leave, y - leave, x + leave, y + leave, [&](int i)
+		{
+			SlotMap::Handle handle = asteroids.HandleAt(i);
+			bool had = set.SeesAsteroid(handle);
+			if (!keep(asteroids.xPos[i], asteroids.yPos[i], had)) return;
+
+			nowAsteroids.push_back(handle);
+			if (!had) change.asteroidsIn.push_back(i);
+		});
+	std::sort(nowAsteroids.begin(), nowAsteroids.end());
+
+	for (SlotMap::Handle handle : set.asteroids)
+	{
+		if (std::binary_search(nowAsteroids.begin(), nowAsteroids.end(), handle)) continue;
+		// destroyed ones already went out as a collide, no need to send a leave too
+		if (asteroids.ids.Find(handle) < 0) continue;
+		change.asteroidsOut.push_back(handle);
+	}
+	set.asteroids.swap(nowAsteroids);
+}
+
+#endif
@@ -0,0 +1,193 @@
+/*******************************************************************************
+ * Fork-join job system for the simulation
+ *
+ * A few helper threads that sit on a condition variable until someone calls
+ * ParallelFor. The range gets handed out in chunks of grain from one atomic
+ * counter, the helpers and the calling thread all pull chunks until it runs
+ * dry, then the caller waits for the chunks still running and returns. So a
+ * phase is finished for everyone when ParallelFor returns, the next phase can
+ * depend on it.
+ *
+ * Nothing is allocated per call. The batch lives on the caller's stack and the
+ * function goes through a plain pointer, so a lambda with captures costs no
+ * more than calling it. Several room workers can be inside ParallelFor at once,
+ * each batch goes into a fixed table of active ones and the helpers take from
+ * whichever still has work.
+ *
+ * A range no bigger than one chunk (or a system with no helpers) just runs on
+ * the caller, small rooms dont pay for any of this.
+ ******************************************************************************/
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define JOB_MAX_BATCHES 64
+
+class JobSystem
+{
+public:
+	JobSystem() = default;
+	~JobSystem() { Stop(); }
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// threads counts the caller, 1 (or 0) means no helpers and everything runs inline
+	void Start(int threads)
+	{
+		Stop();
+		_stay = true;
+		for (int i = 1; i < threads; ++i)
+		{
+			_helpers.emplace_back(&JobSystem::Work, this);
+		}
+	}
+
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stay = false;
+		}
+		_wake.notify_all();
+		for (std::thread& helper : _helpers) helper.join();
+		_helpers.clear();
+	}
+
+	int Threads() const { return static_cast<int>(_helpers.size()) + 1; }
+
+	// fn(begin, end) over [0, count) in chunks of grain, returns once every chunk is done
+	template <typename TFn>
+	void ParallelFor(int count, int grain, TFn&& fn)
+	{
+		if (count <= 0) return;
+		if (grain < 1) grain = 1;
+		if (_helpers.empty() || count <= grain)
+		{
+			fn(0, count);
+			return;
+		}
+
+		Batch batch;
+		batch.run = [](void* ctx, int begin, int end) { (*static_cast<TFn*>(ctx))(begin, end); };
+		batch.ctx = &fn;
+		batch.count = count;
+		batch.grain = grain;
+		batch.remaining.store(count, std::memory_order_relaxed);
+
+		if (!Push(&batch))
+		{
+			// table is full, cant share this one
+			fn(0, count);
+			return;
+		}
+		_wake.notify_all();
+
+		// help out instead of waiting around
+		RunChunks(batch);
+		while (batch.remaining.load(std::memory_order_acquire) > 0)
+		{
+			std::this_thread::yield();
+		}
+
+		// helpers that picked it up before it ran dry might still be looking at it
+		Remove(&batch);
+		while (batch.users.load(std::memory_order_acquire) > 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+private:
+	struct Batch
+	{
+		void (*run)(void*, int, int) = nullptr;
+		void* ctx = nullptr;
+		int count = 0;
+		int grain = 1;
+		std::atomic_int next{ 0 };
+		std::atomic_int remaining{ 0 };
+		std::atomic_int users{ 0 };
+	};
+
+	static void RunChunks(Batch& batch)
+	{
+		for (;;)
+		{
+			int begin = batch.next.fetch_add(batch.grain, std::memory_order_relaxed);
+			if (begin >= batch.count) return;
+
+			int end = begin + batch.grain < batch.count ? begin + batch.grain : batch.count;
+			batch.run(batch.ctx, begin, end);
+			batch.remaining.fetch_sub(end - begin, std::memory_order_release);
+		}
+	}
+
+	bool Push(Batch* batch)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (Batch*& slot : _batches)
+		{
+			if (slot) continue;
+			slot = batch;
+			++_active;
+			return true;
+		}
+		return false;
+	}
+
+	void Remove(Batch* batch)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (Batch*& slot : _batches)
+		{
+			if (slot != batch) continue;
+			slot = nullptr;
+			--_active;
+			return;
+		}
+	}
+
+	// a batch that still has chunks to hand out, marked as in use. call with _mutex held
+	Batch* Take()
+	{
+		for (Batch* batch : _batches)
+		{
+			if (!batch || batch->next.load(std::memory_order_relaxed) >= batch->count) continue;
+			batch->users.fetch_add(1, std::memory_order_acquire);
+			return batch;
+		}
+		return nullptr;
+	}
+
+	void Work()
+	{
+		for (;;)
+		{
+			Batch* batch = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_wake.wait(lock, [&]() { return !_stay || (_active > 0 && (batch = Take()) != nullptr); });
+				if (!batch) return;
+			}
+
+			RunChunks(*batch);
+			batch->users.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	std::vector<std::thread> _helpers;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	Batch* _batches[JOB_MAX_BATCHES] = {};
+	int _active = 0;
+	bool _stay = false;
+};
+
+#endif
@@ -0,0 +1,363 @@
+/*******************************************************************************
+ * Match journal
+ *
+ * With journalDir set, every room writes what went into each of its ticks to
+ * a file, one file per match. It is the same ops lockstep peers get (see
+ * Lockstep.h) plus the checksum of the state after the tick, so the replayer
+ * can run the match again with nothing but SimStep and tell straight away if
+ * it came out different.
+ *
+ * Every journalKeyframeTicks ticks the whole sim state goes in as a keyframe,
+ * slot maps included so handles keep coming out the same. The replayer starts
+ * from the keyframe at or before the tick it is asked for instead of from the
+ * start of the match.
+ *
+ * Layout, all values in host byte order (the journal is for the machine that
+ * wrote it, or another little endian one):
+ *   header    "ASTJ" [version u32][tickRate f32][maxPlayers u32][maxAsteroids u32]
+ *             [room u32][wave seed u64][keyframe ticks u32]
+ *   keyframe  'K' [tick u32][checksum u32] ships, asteroids, bullets (see WriteKeyframe)
+ *   frame     'F' [tick u32][op count u32] ops [checksum u32]
+ * ops are packed the same way as on the wire. a match always starts with a keyframe.
+ ******************************************************************************/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Lockstep.h"
+#include "Network.h"
+
+#define JOURNAL_VERSION 1
+#define JOURNAL_KEYFRAME 'K'
+#define JOURNAL_FRAME 'F'
+
+struct JournalOut
+{
+	std::vector<char> bytes;
+
+	template <typename T>
+	void Put(const T& value)
+	{
+		const char* raw = reinterpret_cast<const char*>(&value);
+		bytes.insert(bytes.end(), raw, raw + sizeof(T));
+	}
+};
+
+struct JournalIn
+{
+	const char* pos = nullptr;
+	const char* end = nullptr;
+
+	bool Done() const { return pos >= end; }
+
+	template <typename T>
+	bool Get(T& value)
+	{
+		if (end - pos < static_cast<std::ptrdiff_t>(sizeof(T))) return false;
+		std::memcpy(&value, pos, sizeof(T));
+		pos += sizeof(T);
+		return true;
+	}
+};
+
+struct JournalHeader
+{
+	float tickRate = 60.0f;
+	uint32_t maxPlayers = 0;
+	uint32_t maxAsteroids = 0;
+	uint32_t room = 0;
+	uint64_t seed = 0;
+	uint32_t keyframeTicks = 0;
+};
+
+inline void PutJournalHeader(JournalOut& out, const JournalHeader& header)
+{
+	out.bytes.insert(out.bytes.end(), { 'A', 'S', 'T', 'J' });
+	out.Put(static_cast<uint32_t>(JOURNAL_VERSION));
+	out.Put(header.tickRate);
+	out.Put(header.maxPlayers);
+	out.Put(header.maxAsteroids);
+	out.Put(header.room);
+	out.Put(header.seed);
+	out.Put(header.keyframeTicks);
+}
+
+inline bool GetJournalHeader(JournalIn& in, JournalHeader& header)
+{
+	char magic[4];
+	uint32_t version;
+	if (!in.Get(magic) || std::memcmp(magic, "ASTJ", 4) != 0) return false;
+	if (!in.Get(version) || version != JOURNAL_VERSION) return false;
+	return in.Get(header.tickRate) && in.Get(header.maxPlayers) && in.Get(header.maxAsteroids)
+		&& in.Get(header.room) && in.Get(header.seed) && in.Get(header.keyframeTicks);
+}
+
+// same fields as WriteLockstepOp, nothing for the ones an op doesnt use
+inline void PutJournalOp(JournalOut& out, const LockstepOp& op)
+{
+	out.Put(op.op);
+	out.Put(op.id);
+	switch (op.op)
+	{
+	case LOCKSTEP_INPUT:
+		out.Put(op.flag);
+		break;
+	case LOCKSTEP_SHIP:
+		out.Put(op.flag);
+		for (int i = 0; i < 5; ++i) out.Put(op.v[i]);
+		out.Put(op.extra);
+		break;
+	case LOCKSTEP_BULLET:
+		out.Put(op.extra);
+		for (int i = 0; i < 4; ++i) out.Put(op.v[i]);
+		break;
+	case LOCKSTEP_ASTEROID:
+		for (int i = 0; i < 7; ++i) out.Put(op.v[i]);
+		break;
+	default:
+		break;
+	}
+}
+
+inline bool GetJournalOp(JournalIn& in, LockstepOp& op)
+{
+	if (!in.Get(op.op) || !in.Get(op.id)) return false;
+	switch (op.op)
+	{
+	case LOCKSTEP_INPUT:
+		return in.Get(op.flag);
+	case LOCKSTEP_SHIP:
+		if (!in.Get(op.flag)) return false;
+		for (int i = 0; i < 5; ++i)
+		{
+			if (!in.Get(op.v[i])) return false;
+		}
+		return in.Get(op.extra);
+	case LOCKSTEP_BULLET:
+		if (!in.Get(op.extra)) return false;
+		for (int i = 0; i < 4; ++i)
+		{
+			if (!in.Get(op.v[i])) return false;
+		}
+		return true;
+	case LOCKSTEP_ASTEROID:
+		for (int i = 0; i < 7; ++i)
+		{
+			if (!in.Get(op.v[i])) return false;
+		}
+		return true;
+	case LOCKSTEP_DROP_BULLETS:
+	case LOCKSTEP_REMOVE_ASTEROID:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// the whole sim state at the end of a tick, from the room's worker.
+// ships [slots u32] then per slot [in sim u8][x][y][vx][vy][dir][score i32]
+// asteroids [slot map][spawned u32] then per dense index
+//   [x][y][vx][vy][key x][key y][key tick u32][scale x][scale y][dir]
+// bullets [slot map] then per dense index [net id i32][owner i32][x][y][vx][vy]
+inline void PutKeyframe(JournalOut& out, const ServerData& data, uint32_t checksum)
+{
+	out.Put(static_cast<char>(JOURNAL_KEYFRAME));
+	out.Put(data.tick);
+	out.Put(checksum);
+
+	const ShipStore& ships = data.ships;
+	const int slots = data.totalClients.Slots();
+	out.Put(static_cast<uint32_t>(slots));
+	for (int i = 0; i < slots; ++i)
+	{
+		out.Put(static_cast<uint8_t>(data.totalClients[i].inSim ? 1 : 0));
+		out.Put(ships.xPos[i]);
+		out.Put(ships.yPos[i]);
+		out.Put(ships.velX[i]);
+		out.Put(ships.velY[i]);
+		out.Put(ships.dir[i]);
+		out.Put(ships.score[i]);
+	}
+
+	const AsteroidStore& asteroids = data.asteroids;
+	asteroids.ids.Save(out);
+	out.Put(static_cast<uint32_t>(asteroids.spawned));
+	for (int i = 0; i < asteroids.Count(); ++i)
+	{
+		out.Put(asteroids.xPos[i]);
+		out.Put(asteroids.yPos[i]);
+		out.Put(asteroids.velX[i]);
+		out.Put(asteroids.velY[i]);
+		out.Put(asteroids.keyX[i]);
+		out.Put(asteroids.keyY[i]);
+		out.Put(asteroids.keyTick[i]);
+		out.Put(asteroids.xScale[i]);
+		out.Put(asteroids.yScale[i]);
+		out.Put(asteroids.dir[i]);
+	}
+
+	const BulletStore& bullets = data.bullets;
+	bullets.ids.Save(out);
+	for (int i = 0; i < bullets.Count(); ++i)
+	{
+		out.Put(bullets.netID[i]);
+		out.Put(bullets.ownerID[i]);
+		out.Put(bullets.xPos[i]);
+		out.Put(bullets.yPos[i]);
+		out.Put(bullets.velX[i]);
+		out.Put(bullets.velY[i]);
+	}
+}
+
+// the other half of PutKeyframe, after the 'K'. data has to be sized for the match already
+inline bool GetKeyframe(JournalIn& in, ServerData& data, uint32_t& checksum)
+{
+	uint32_t slots;
+	if (!in.Get(data.tick) || !in.Get(checksum) || !in.Get(slots)) return false;
+	if (slots > static_cast<uint32_t>(data.totalClients.Capacity())) return false;
+
+	ShipStore& ships = data.ships;
+	while (data.totalClients.Slots() < static_cast<int>(slots)) data.totalClients.Grow();
+	for (int i = 0; i < static_cast<int>(slots); ++i)
+	{
+		uint8_t inSim;
+		if (!in.Get(inSim)) return false;
+		data.totalClients[i].inSim = inSim != 0;
+		data.totalClients[i].pendingInputs.clear();
+		if (!in.Get(ships.xPos[i]) || !in.Get(ships.yPos[i]) || !in.Get(ships.velX[i]) || !in.Get(ships.velY[i])
+			|| !in.Get(ships.dir[i]) || !in.Get(ships.score[i])) return false;
+	}
+
+	AsteroidStore& asteroids = data.asteroids;
+	uint32_t spawned;
+	if (!asteroids.ids.Load(in) || !in.Get(spawned)) return false;
+	asteroids.spawned = static_cast<int>(spawned);
+	const int asteroidCount = asteroids.Count();
+	for (std::vector<float>* field : { &asteroids.xPos, &asteroids.yPos, &asteroids.velX, &asteroids.velY,
+		&asteroids.keyX, &asteroids.keyY, &asteroids.xScale, &asteroids.yScale, &asteroids.dir })
+	{
+		field->resize(asteroidCount);
+	}
+	asteroids.keyTick.resize(asteroidCount);
+	asteroids.dead.assign(asteroidCount, 0);
+	for (int i = 0; i < asteroidCount; ++i)
+	{
+		if (!in.Get(asteroids.xPos[i]) || !in.Get(asteroids.yPos[i]) || !in.Get(asteroids.velX[i])
+			|| !in.Get(asteroids.velY[i]) || !in.Get(asteroids.keyX[i]) || !in.Get(asteroids.keyY[i])
+			|| !in.Get(asteroids.keyTick[i]) || !in.Get(asteroids.xScale[i]) || !in.Get(asteroids.yScale[i])
+			|| !in.Get(asteroids.dir[i])) return false;
+	}
+
+	BulletStore& bullets = data.bullets;
+	if (!bullets.ids.Load(in)) return false;
+	const int bulletCount = bullets.Count();
+	bullets.netID.resize(bulletCount);
+	bullets.ownerID.resize(bulletCount);
+	for (std::vector<float>* field : { &bullets.xPos, &bullets.yPos, &bullets.velX, &bullets.velY })
+	{
+		field->resize(bulletCount);
+	}
+	bullets.byNetID.clear();
+	for (int i = 0; i < bulletCount; ++i)
+	{
+		if (!in.Get(bullets.netID[i]) || !in.Get(bullets.ownerID[i]) || !in.Get(bullets.xPos[i])
+			|| !in.Get(bullets.yPos[i]) || !in.Get(bullets.velX[i]) || !in.Get(bullets.velY[i])) return false;
+
+		const int id = bullets.netID[i];
+		if (!BulletStore::OwnsNetID(bullets.ownerID[i], id)) return false;
+		if (id >= static_cast<int>(bullets.byNetID.size())) bullets.byNetID.resize(id + 1, SlotMap::INVALID);
+		bullets.byNetID[id] = bullets.ids.HandleAt(i);
+	}
+	return true;
+}
+
+inline void PutFrame(JournalOut& out, uint32_t tick, const LockstepOp* ops, size_t count, uint32_t checksum)
+{
+	out.Put(static_cast<char>(JOURNAL_FRAME));
+	out.Put(tick);
+	out.Put(static_cast<uint32_t>(count));
+	for (size_t i = 0; i < count; ++i) PutJournalOp(out, ops[i]);
+	out.Put(checksum);
+}
+
+// after the 'F'
+inline bool GetFrame(JournalIn& in, uint32_t& tick, std::vector<LockstepOp>& ops, uint32_t& checksum)
+{
+	uint32_t count;
+	if (!in.Get(tick) || !in.Get(count)) return false;
+	ops.resize(count);
+	for (LockstepOp& op : ops)
+	{
+		if (!GetJournalOp(in, op)) return false;
+	}
+	return in.Get(checksum);
+}
+
+// one room's journal, only its worker writes to it. records build up in memory and
+// go to the file at every keyframe and when the match ends, not every tick
+class JournalWriter
+{
+public:
+	~JournalWriter() { Close(); }
+
+	bool IsOpen() const { return _file.is_open(); }
+
+	bool Open(const std::string& path, const JournalHeader& header)
+	{
+		Close();
+		_file.open(path, std::ios::binary | std::ios::trunc);
+		if (!_file) return false;
+
+		_header = header;
+		PutJournalHeader(_out, header);
+		return true;
+	}
+
+	void Close()
+	{
+		if (!_file.is_open()) return;
+		Flush();
+		_file.close();
+	}
+
+	// ops from first on, the ones before it are already in the opening keyframe
+	void Frame(uint32_t tick, const std::vector<LockstepOp>& ops, size_t first, uint32_t checksum)
+	{
+		if (!_file.is_open()) return;
+		if (first > ops.size()) first = ops.size();
+		PutFrame(_out, tick, ops.data() + first, ops.size() - first, checksum);
+	}
+
+	// straight after a tick
+	void Keyframe(const ServerData& data, uint32_t checksum)
+	{
+		if (!_file.is_open()) return;
+		PutKeyframe(_out, data, checksum);
+		Flush();
+	}
+
+	bool KeyframeDue(uint32_t tick) const
+	{
+		return _header.keyframeTicks > 0 && tick % _header.keyframeTicks == 0;
+	}
+
+private:
+	void Flush()
+	{
+		_file.write(_out.bytes.data(), static_cast<std::streamsize>(_out.bytes.size()));
+		_file.flush();
+		_out.bytes.clear();
+	}
+
+	std::ofstream _file;
+	JournalOut _out;
+	JournalHeader _header;
+};
+
+#endif
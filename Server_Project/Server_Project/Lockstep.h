@@ -0,0 +1,185 @@
+/*******************************************************************************
+ * Deterministic lockstep
+ *
+ * With lockstep on, the server stops sending where everything is and sends
+ * what went into each tick instead. The sim is a pure function of its inputs,
+ * so a peer that starts from the same state and applies the same ops before
+ * every SimStep ends up with the same world, however many asteroids there are.
+ *
+ * An op is anything that changes the world outside of SimStep: input frames,
+ * a ship joining/leaving/respawning, a bullet being fired, a wave asteroid, an
+ * asteroid a rewound shot took out. The server records them as they happen and
+ * sends them as one LOCKSTEP_FRAME per tick, along with a rolling checksum of
+ * its state after the tick. A peer compares that against its own straight away,
+ * and can send its checksum back in LOCKSTEP_CHECKSUM so the server logs the
+ * desync and sends a fresh snapshot.
+ *
+ * Wire format of a frame chunk:
+ *   [tick u32][checksum u32][last u8][count u16] then count ops
+ * an op is [op u8][id i32] then
+ *   INPUT           [input u8]
+ *   SHIP            [connected u8][x][y][vx][vy][dir][score i32]
+ *   BULLET          [netID i32][x][y][vx][vy]      (id is the owner)
+ *   DROP_BULLETS                                   (id is the owner)
+ *   ASTEROID        [x][y][vx][vy][dir][sx][sy]    (id is the handle it got)
+ *   REMOVE_ASTEROID                                (id is the handle)
+ * a tick with too many ops for one packet goes in several chunks, last marks
+ * the final one. the ops apply in order, then SimStep.
+ ******************************************************************************/
+
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Packet.h"
+
+// how many recent tick checksums the server keeps to check peer reports against
+#define LOCKSTEP_CHECKSUM_HISTORY 256
+
+enum LOCKSTEP_OP : uint8_t
+{
+	LOCKSTEP_INPUT = 0,
+	LOCKSTEP_SHIP,
+	LOCKSTEP_BULLET,
+	LOCKSTEP_DROP_BULLETS,
+	LOCKSTEP_ASTEROID,
+	LOCKSTEP_REMOVE_ASTEROID
+};
+
+struct LockstepOp
+{
+	uint8_t op = LOCKSTEP_INPUT;
+	int id = 0;
+	uint8_t flag = 0; // input, or connected for SHIP
+	int extra = 0;    // score for SHIP, net id for BULLET
+	float v[7] = {};  // x, y, vx, vy then dir/scale, whatever the op has
+
+	// bytes this op takes on the wire
+	size_t Size() const
+	{
+		switch (op)
+		{
+		case LOCKSTEP_INPUT: return 6;
+		case LOCKSTEP_SHIP: return 6 + 5 * 4 + 4;
+		case LOCKSTEP_BULLET: return 5 + 4 + 4 * 4;
+		case LOCKSTEP_ASTEROID: return 5 + 7 * 4;
+		default: return 5;
+		}
+	}
+};
+
+inline void WriteLockstepOp(Packet& packet, const LockstepOp& op)
+{
+	packet << op.op << op.id;
+	switch (op.op)
+	{
+	case LOCKSTEP_INPUT:
+		packet << op.flag;
+		break;
+	case LOCKSTEP_SHIP:
+		packet << op.flag;
+		for (int i = 0; i < 5; ++i) packet << op.v[i];
+		packet << op.extra;
+		break;
+	case LOCKSTEP_BULLET:
+		packet << op.extra;
+		for (int i = 0; i < 4; ++i) packet << op.v[i];
+		break;
+	case LOCKSTEP_ASTEROID:
+		for (int i = 0; i < 7; ++i) packet << op.v[i];
+		break;
+	default:
+		break;
+	}
+}
+
+// false on an op we dont know, the rest of the packet cant be trusted then
+inline bool ReadLockstepOp(Packet& packet, LockstepOp& op)
+{
+	packet >> op.op >> op.id;
+	switch (op.op)
+	{
+	case LOCKSTEP_INPUT:
+		packet >> op.flag;
+		return true;
+	case LOCKSTEP_SHIP:
+		packet >> op.flag;
+		for (int i = 0; i < 5; ++i) packet >> op.v[i];
+		packet >> op.extra;
+		return true;
+	case LOCKSTEP_BULLET:
+		packet >> op.extra;
+		for (int i = 0; i < 4; ++i) packet >> op.v[i];
+		return true;
+	case LOCKSTEP_ASTEROID:
+		for (int i = 0; i < 7; ++i) packet >> op.v[i];
+		return true;
+	case LOCKSTEP_DROP_BULLETS:
+	case LOCKSTEP_REMOVE_ASTEROID:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// FNV-1a, over the raw bits so -0.0 and 0.0 or two NaNs dont hide a difference
+struct StateHash
+{
+	uint32_t value = 2166136261u;
+
+	void Add(uint32_t v)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			value ^= (v >> (i * 8)) & 0xFF;
+			value *= 16777619u;
+		}
+	}
+
+	void Add(float f)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		Add(bits);
+	}
+};
+
+// what the server keeps per room while lockstep is on, room's worker only
+struct LockstepState
+{
+	// ops since the last tick, they go out with the next one
+	std::vector<LockstepOp> pending;
+	// the ClientInfo::inSim flags peers have been told about, by player slot
+	std::vector<uint8_t> connected;
+	// rolls on from the previous tick, so once a peer is off every later one is too
+	uint32_t checksum = 0;
+	uint32_t checksumTicks[LOCKSTEP_CHECKSUM_HISTORY] = {};
+	uint32_t checksums[LOCKSTEP_CHECKSUM_HISTORY] = {};
+
+	void Reset()
+	{
+		pending.clear();
+		connected.clear();
+		checksum = 0;
+		std::memset(checksumTicks, 0, sizeof(checksumTicks));
+		std::memset(checksums, 0, sizeof(checksums));
+	}
+
+	void Remember(uint32_t tick, uint32_t value)
+	{
+		checksumTicks[tick % LOCKSTEP_CHECKSUM_HISTORY] = tick;
+		checksums[tick % LOCKSTEP_CHECKSUM_HISTORY] = value;
+	}
+
+	// false when the tick is too old (or not run yet) to check
+	bool Lookup(uint32_t tick, uint32_t& value) const
+	{
+		if (checksumTicks[tick % LOCKSTEP_CHECKSUM_HISTORY] != tick || tick == 0) return false;
+		value = checksums[tick % LOCKSTEP_CHECKSUM_HISTORY];
+		return true;
+	}
+};
+
+#endif
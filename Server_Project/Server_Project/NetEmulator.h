@@ -0,0 +1,391 @@
+/*******************************************************************************
+ * In-process network conditions emulator
+ *
+ * Sits between the socket and the game code. Every datagram is submitted to a
+ * direction (UP = client -> server, DOWN = server -> client) and only comes
+ * back out of Deliver() once its emulated delivery time has passed.
+ * Supports latency, jitter, reordering, duplication, burst loss (Gilbert-Elliott)
+ * and a bandwidth cap per direction. Plain C++ so it also runs on Linux.
+ ******************************************************************************/
+
+#ifndef NET_EMULATOR_H
+#define NET_EMULATOR_H
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+enum NETDIR : unsigned char
+{
+	NET_DIR_UP = 0,   // client -> server
+	NET_DIR_DOWN,     // server -> client
+	NET_DIR_NUM
+};
+
+struct NetConditions
+{
+	float latencyMs = 0.0f;      // one way delay
+	float jitterMs = 0.0f;       // +- random on top of latency
+	float lossRate = 0.0f;       // loss while the link is in the good state
+	float burstEnterRate = 0.0f; // chance per packet to go into the bad state
+	float burstExitRate = 1.0f;  // chance per packet to leave the bad state
+	float burstLossRate = 1.0f;  // loss while in the bad state
+	float duplicateRate = 0.0f;
+	float reorderRate = 0.0f;    // chance to hold a packet back by reorderDelayMs
+	float reorderDelayMs = 0.0f;
+	float bandwidthKbps = 0.0f;  // 0 is uncapped
+};
+
+// rough numbers, good enough to compare against each other
+inline bool GetNetPreset(const std::string& name, NetConditions& out)
+{
+	NetConditions c;
+	if (name == "perfect")
+	{
+	}
+	else if (name == "lan")
+	{
+		c.latencyMs = 1.0f;
+		c.jitterMs = 0.5f;
+	}
+	else if (name == "wifi")
+	{
+		c.latencyMs = 15.0f;
+		c.jitterMs = 10.0f;
+		c.lossRate = 0.005f;
+		c.burstEnterRate = 0.002f;
+		c.burstExitRate = 0.3f;
+		c.reorderRate = 0.01f;
+		c.reorderDelayMs = 5.0f;
+	}
+	else if (name == "wifi_congested")
+	{
+		c.latencyMs = 40.0f;
+		c.jitterMs = 35.0f;
+		c.lossRate = 0.02f;
+		c.burstEnterRate = 0.01f;
+		c.burstExitRate = 0.2f;
+		c.duplicateRate = 0.005f;
+		c.reorderRate = 0.03f;
+		c.reorderDelayMs = 20.0f;
+		c.bandwidthKbps = 2000.0f;
+	}
+	else if (name == "mobile_4g")
+	{
+		c.latencyMs = 50.0f;
+		c.jitterMs = 20.0f;
+		c.lossRate = 0.01f;
+		c.burstEnterRate = 0.005f;
+		c.burstExitRate = 0.25f;
+		c.reorderRate = 0.02f;
+		c.reorderDelayMs = 15.0f;
+		c.bandwidthKbps = 5000.0f;
+	}
+	else if (name == "mobile_3g")
+	{
+		c.latencyMs = 120.0f;
+		c.jitterMs = 60.0f;
+		c.lossRate = 0.03f;
+		c.burstEnterRate = 0.02f;
+		c.burstExitRate = 0.15f;
+		c.duplicateRate = 0.01f;
+		c.reorderRate = 0.05f;
+		c.reorderDelayMs = 40.0f;
+		c.bandwidthKbps = 750.0f;
+	}
+	else
+	{
+		return false;
+	}
+
+	out = c;
+	return true;
+}
+
+// one line of a scenario script
+struct NetScenarioStep
+{
+	double atSeconds = 0.0;
+	bool dirs[NET_DIR_NUM]{};
+	std::string key;
+	std::string value;
+};
+
+/*
+	Scenario scripts are plain text, one step per line:
+
+		<seconds> <up|down|both> <key> <value>
+
+	keys: preset latency jitter loss burst_enter burst_exit burst_loss
+	      duplicate reorder reorder_delay bandwidth
+	Steps apply once the emulator has been running for <seconds>.
+*/
+inline bool LoadNetScenario(const std::string& fileName, std::vector<NetScenarioStep>& steps)
+{
+	std::ifstream file(fileName);
+	if (!file.is_open())
+	{
+		std::cerr << "Unable to open net scenario " << fileName << std::endl;
+		return false;
+	}
+
+	std::string line;
+	int lineNum = 0;
+	while (std::getline(file, line))
+	{
+		++lineNum;
+		if (line.empty() || line[0] == '#') continue;
+
+		std::istringstream iss(line);
+		NetScenarioStep step;
+		std::string dir;
+		if (!(iss >> step.atSeconds >> dir >> step.key >> step.value))
+		{
+			std::cerr << fileName << ":" << lineNum << " bad scenario line" << std::endl;
+			continue;
+		}
+
+		step.dirs[NET_DIR_UP] = (dir == "up" || dir == "both");
+		step.dirs[NET_DIR_DOWN] = (dir == "down" || dir == "both");
+		steps.push_back(step);
+	}
+
+	std::cout << "Loaded " << steps.size() << " net scenario steps from " << fileName << std::endl;
+	return true;
+}
+
+inline bool ApplyNetSetting(NetConditions& c, const std::string& key, const std::string& value)
+{
+	if (key == "preset") return GetNetPreset(value, c);
+
+	float v;
+	std::istringstream iss(value);
+	if (!(iss >> v)) return false;
+
+	if (key == "latency") c.latencyMs = v;
+	else if (key == "jitter") c.jitterMs = v;
+	else if (key == "loss") c.lossRate = v;
+	else if (key == "burst_enter") c.burstEnterRate = v;
+	else if (key == "burst_exit") c.burstExitRate = v;
+	else if (key == "burst_loss") c.burstLossRate = v;
+	else if (key == "duplicate") c.duplicateRate = v;
+	else if (key == "reorder") c.reorderRate = v;
+	else if (key == "reorder_delay") c.reorderDelayMs = v;
+	else if (key == "bandwidth") c.bandwidthKbps = v;
+	else return false;
+
+	return true;
+}
+
+struct NetEmulatorStats
+{
+	uint64_t submitted = 0;
+	uint64_t delivered = 0;
+	uint64_t dropped = 0;
+	uint64_t duplicated = 0;
+	uint64_t reordered = 0;
+};
+
+template <typename TAddr>
+class NetEmulator
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	void Start(const std::vector<NetScenarioStep>& steps, unsigned int seed)
+	{
+		_steps = steps;
+		_nextStep = 0;
+		_startTime = Clock::now();
+		for (Channel& ch : _channels)
+		{
+			ch.rng.seed(seed++);
+		}
+		_enabled = true;
+		ApplySteps(_startTime);
+	}
+
+	bool Enabled() const { return _enabled; }
+
+	// queue a datagram, it may be dropped or duplicated here
+	void Submit(NETDIR dir, const char* data, int len, const TAddr& addr)
+	{
+		Clock::time_point now = Clock::now();
+		ApplySteps(now);
+
+		Channel& ch = _channels[dir];
+		std::lock_guard<std::mutex> lock(ch.mutex);
+		++ch.stats.submitted;
+
+		const NetConditions& c = ch.conditions;
+
+		// gilbert-elliott: flip between good and bad state, each with its own loss
+		if (ch.inBurst)
+		{
+			if (Roll(ch) < c.burstExitRate) ch.inBurst = false;
+		}
+		else if (Roll(ch) < c.burstEnterRate)
+		{
+			ch.inBurst = true;
+		}
+
+		float loss = ch.inBurst ? c.burstLossRate : c.lossRate;
+		if (Roll(ch) < loss)
+		{
+			++ch.stats.dropped;
+			return;
+		}
+
+		int copies = 1;
+		if (Roll(ch) < c.duplicateRate)
+		{
+			++copies;
+			++ch.stats.duplicated;
+		}
+
+		// bandwidth cap, packets queue up behind each other on the wire
+		Clock::time_point sendAt = now;
+		if (c.bandwidthKbps > 0.0f)
+		{
+			if (ch.wireFreeAt > sendAt) sendAt = ch.wireFreeAt;
+			double wireMs = (len * 8.0) / c.bandwidthKbps;
+			sendAt += ToDuration(wireMs);
+			ch.wireFreeAt = sendAt;
+		}
+
+		for (int i = 0; i < copies; ++i)
+		{
+			double delayMs = c.latencyMs;
+			if (c.jitterMs > 0.0f)
+			{
+				delayMs += (Roll(ch) * 2.0f - 1.0f) * c.jitterMs;
+			}
+			if (Roll(ch) < c.reorderRate)
+			{
+				delayMs += c.reorderDelayMs;
+				++ch.stats.reordered;
+			}
+			if (delayMs < 0.0) delayMs = 0.0;
+
+			PendingDatagram pending;
+			pending.deliverAt = sendAt + ToDuration(delayMs);
+			pending.order = ch.nextOrder++;
+			pending.data.assign(data, data + len);
+			pending.addr = addr;
+			ch.pending.push(std::move(pending));
+		}
+	}
+
+	// hand every datagram that is due to fn(addr, data, len)
+	template <typename TFn>
+	void Deliver(NETDIR dir, TFn&& fn)
+	{
+		Clock::time_point now = Clock::now();
+		ApplySteps(now);
+
+		Channel& ch = _channels[dir];
+		std::vector<PendingDatagram> due;
+		{
+			std::lock_guard<std::mutex> lock(ch.mutex);
+			while (!ch.pending.empty() && ch.pending.top().deliverAt <= now)
+			{
+				due.push_back(ch.pending.top());
+				ch.pending.pop();
+			}
+			ch.stats.delivered += due.size();
+		}
+
+		for (PendingDatagram& d : due)
+		{
+			fn(d.addr, d.data.data(), static_cast<int>(d.data.size()));
+		}
+	}
+
+	bool HasPending(NETDIR dir)
+	{
+		std::lock_guard<std::mutex> lock(_channels[dir].mutex);
+		return !_channels[dir].pending.empty();
+	}
+
+	NetEmulatorStats GetStats(NETDIR dir)
+	{
+		std::lock_guard<std::mutex> lock(_channels[dir].mutex);
+		return _channels[dir].stats;
+	}
+
+private:
+	struct PendingDatagram
+	{
+		Clock::time_point deliverAt;
+		uint64_t order = 0;
+		std::vector<char> data;
+		TAddr addr{};
+
+		// min heap on delivery time, fifo when equal
+		bool operator<(const PendingDatagram& rhs) const
+		{
+			if (deliverAt != rhs.deliverAt) return deliverAt > rhs.deliverAt;
+			return order > rhs.order;
+		}
+	};
+
+	struct Channel
+	{
+		std::mutex mutex;
+		NetConditions conditions;
+		std::mt19937 rng;
+		bool inBurst = false;
+		Clock::time_point wireFreeAt{};
+		uint64_t nextOrder = 0;
+		std::priority_queue<PendingDatagram> pending;
+		NetEmulatorStats stats;
+	};
+
+	static Clock::duration ToDuration(double ms)
+	{
+		return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+	}
+
+	static float Roll(Channel& ch)
+	{
+		return std::uniform_real_distribution<float>(0.0f, 1.0f)(ch.rng);
+	}
+
+	void ApplySteps(Clock::time_point now)
+	{
+		std::lock_guard<std::mutex> lock(_stepMutex);
+		double elapsed = std::chrono::duration<double>(now - _startTime).count();
+		while (_nextStep < _steps.size() && _steps[_nextStep].atSeconds <= elapsed)
+		{
+			const NetScenarioStep& step = _steps[_nextStep++];
+			for (int d = 0; d < NET_DIR_NUM; ++d)
+			{
+				if (!step.dirs[d]) continue;
+
+				std::lock_guard<std::mutex> chLock(_channels[d].mutex);
+				if (!ApplyNetSetting(_channels[d].conditions, step.key, step.value))
+				{
+					std::cerr << "Unknown net scenario key/value: " << step.key << " " << step.value << std::endl;
+				}
+			}
+			std::cout << "[net] t=" << step.atSeconds << "s " << step.key << " " << step.value << std::endl;
+		}
+	}
+
+	bool _enabled = false;
+	Channel _channels[NET_DIR_NUM];
+
+	std::mutex _stepMutex;
+	std::vector<NetScenarioStep> _steps;
+	size_t _nextStep = 0;
+	Clock::time_point _startTime;
+};
+
+#endif
@@ -1,44 +1,138 @@
 #ifndef NETWORK_H
 #define NETWORK_H
-#include "Game.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "EntityStore.h"
+#include "Fec.h"
+#include "InputHistory.h"
+#include "Interest.h"
+#include "Lockstep.h"
+#include "Outbox.h"
+#include "RewindHistory.h"
+#include "SpatialHash.h"
 
-#define MAX_CONNECTION 4
-#define MAX_ASTEROIDS 8
+#define NO_SLOT -1
 
 struct ClientInfo
 {
 	int sessionID{}; // represent the player's ID
-	std::string ip;
-	uint16_t port;
-
-	Ship playerShip;
 
 	// idk if i'll need this for doing packet loss shit
 	//uint32_t seqNum{};
 	std::unordered_map<int, bool> ackReceived;
 	uint32_t retryCount{};
 
-	bool connected{ false };
+	// handed out in REPLY_PLAYER_JOIN, has to match on KEEPALIVE and PLAYER_DC
+	uint32_t sessionToken{};
+	// last time any packet came in from this client, used for the idle timeout
+	std::chrono::steady_clock::time_point lastHeard;
+	// ip:port, where everything for this client goes. set by a join under clientMutex
+	uint64_t addrKey{};
+
+	// parity groups for the messages we cant afford to lose, only used when fec is on
+	FecEncoder fec;
+	// drops input frames we already got from an earlier SHIP_MOVE, guarded by clientMutex
+	InputReceiver inputs;
+	// input frames waiting for a tick to run them in, room's worker only
+	std::deque<uint8_t> queuedInputs;
+	// how many frames this client can still run, earned at one per INPUT_STEP. room's worker only
+	float inputCredit = 0.0f;
+	// input frames the next sim tick applies, room's worker only
+	std::vector<uint8_t> pendingInputs;
+	// what this client has been sent an ENTITY_ENTER for, room's worker only
+	InterestSet interest;
+	// waiting for the room's next flush, guarded by the room's lockMutex
+	Outbox outbox;
+
+	// whether packets go to and come from this slot. set by the receive thread under
+	// clientMutex, the worker only uses it for who to send to
+	std::atomic_bool connected{ false };
+	// whether the ship is in the world, what the sim, lockstep and the journal go by.
+	// only JoinShip and SIM_CMD_LEAVE change it, so it cant flip halfway through a tick.
+	// room's worker only
+	bool inSim = false;
 };
 
-struct ServerData
+// player slots up to serverSettings.maxPlayers. a slot only gets allocated the first
+// time it's needed and stays around for the next player, so Slots() is the most
+// players that were on at once and loops over it dont pay for the configured max
+class ClientPool
 {
-	// max is 4
-	ClientInfo totalClients[MAX_CONNECTION];
-	std::unordered_map<std::string, int> playerMap;
+public:
+	// once at startup, before any thread touches the pool
+	void Reserve(int capacity)
+	{
+		_clients.clear();
+		_clients.resize(capacity);
+		_slots.store(0);
+	}
+
+	int Capacity() const { return static_cast<int>(_clients.size()); }
+	int Slots() const { return _slots.load(std::memory_order_acquire); }
+
+	ClientInfo& operator[](int i) { return *_clients[i]; }
+	const ClientInfo& operator[](int i) const { return *_clients[i]; }
+
+	// opens up one more slot, NO_SLOT when at capacity. call with clientMutex held
+	int Grow()
+	{
+		int i = _slots.load(std::memory_order_relaxed);
+		if (i >= Capacity()) return NO_SLOT;
 
-	// store a vector of all asteroids or smth
-	//std::vector<Asteroid> asteroids;
-	Asteroid totalAsteroids[MAX_ASTEROIDS];
+		_clients[i] = std::make_unique<ClientInfo>();
+		// published after the slot exists so other threads looping to Slots() never see a null
+		_slots.store(i + 1, std::memory_order_release);
+		return i;
+	}
 
-	int activeAsteroids = 0;
-	int numOfAsteroids = 0;
+private:
+	// the vector never resizes after Reserve, so the pointers can be read while it grows
+	std::vector<std::unique_ptr<ClientInfo>> _clients;
+	std::atomic_int _slots{ 0 };
+};
+
+struct ServerData
+{
+	// sized from serverSettings.maxPlayers
+	ClientPool totalClients;
+	// ip:port packed into one number -> slot
+	std::unordered_map<uint64_t, int> playerMap;
+	// slots someone left, reused before the pool grows
+	std::vector<int> freeSlots;
+	// guards slot handout/reclaim, receive thread joins and main thread times out
+	std::mutex clientMutex;
+
+	// ships are indexed by player slot, same as totalClients
+	ShipStore ships;
+	AsteroidStore asteroids;
+	BulletStore bullets;
 	// power ups
 
 	// idk what else u want
 	bool gameRunning;
-	std::unordered_map<int, Bullet> activeBullets;
-	int nextBulletID = 0;
+
+	// everything from here down (and ships, asteroids, bullets, pendingInputs, interest)
+	// belongs to the room's worker. other threads post a SimCommand, see Inbox.h
+	uint32_t tick = 0;
+	// asteroids bucketed by cell, rebuilt every tick
+	SpatialHash asteroidGrid;
+	// what each bullet/ship hit this tick, filled in by the narrow phase jobs
+	std::vector<int> bulletHitScratch;
+	std::vector<int> shipHitScratch;
+	// the last maxRewindMs of ticks, for replaying shots from when they were fired
+	RewindHistory history;
+	// where things are right now, rebuilt for each interest pass
+	SpatialHash interestShips;
+	SpatialHash interestAsteroids;
+	// ops and checksums for lockstep peers, only used with serverSettings.lockstep
+	LockstepState lockstep;
 };
 
 #endif
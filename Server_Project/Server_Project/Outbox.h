@@ -0,0 +1,147 @@
+/*******************************************************************************
+ * Per client outbound queues
+ *
+ * Everything the server has to tell a client waits in that client's outbox
+ * until the room's next flush sends it. A message going to several clients is
+ * encoded once into a Payload and every outbox it goes to gets a reference to
+ * it, so fanning out to a full room is a refcount bump per client, not a copy.
+ *
+ * Each outbox holds at most outboxSize messages. Past that the oldest
+ * movement message in it goes first (snapshots and relayed moves, a newer one
+ * is already behind it), and if there is none the new message is dropped when
+ * it is movement itself. Anything else is never dropped: it goes in over the
+ * limit and is counted, a client that needs that many is about to time out
+ * anyway. So one client that is flooded only ever loses its own stale
+ * movement, everyone else's queues are untouched.
+ *
+ * Outboxes are guarded by their room's lockMutex. Producers on any thread push,
+ * the room's worker takes a whole outbox at a time and sends it without the
+ * lock. Whatever the socket wouldnt take goes back in front.
+ ******************************************************************************/
+
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include "Packet.h"
+
+// a message as it goes on the wire, [id][len][body]. shared by every outbox it was queued to
+struct Payload
+{
+	int len = 0;
+	char bytes[MAX_STR_LEN];
+
+	char ID() const { return bytes[0]; }
+};
+
+typedef std::shared_ptr<const Payload> PayloadRef;
+
+inline PayloadRef MakePayload(const Packet& packet)
+{
+	auto payload = std::make_shared<Payload>();
+	payload->bytes[0] = packet.id;
+	payload->len = 1;
+	uint32_t bodyLength = htonl(static_cast<uint32_t>(packet.writePos));
+	std::memcpy(payload->bytes + payload->len, &bodyLength, sizeof(bodyLength));
+	payload->len += sizeof(bodyLength);
+	std::memcpy(payload->bytes + payload->len, packet.body, packet.writePos);
+	payload->len += static_cast<int>(packet.writePos);
+	return payload;
+}
+
+// superseded by the next one of its kind, fine to drop when a client falls behind
+inline bool IsMovement(char msgID)
+{
+	switch (msgID)
+	{
+	case STATE_UPDATE:
+	case SHIP_MOVE:
+	case ASTEROID_UPDATE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+struct OutboxStats
+{
+	uint32_t dropped = 0;   // movement thrown away to stay under the limit
+	uint32_t overLimit = 0; // reliable messages that went in past it
+	size_t peak = 0;        // deepest the outbox got
+};
+
+class Outbox
+{
+public:
+	size_t Count() const { return _queue.size(); }
+	bool Empty() const { return _queue.empty(); }
+
+	void Push(const PayloadRef& payload, size_t limit)
+	{
+		const bool movement = IsMovement(payload->ID());
+		if (_queue.size() >= limit && !DropOldestMovement())
+		{
+			if (movement)
+			{
+				++_stats.dropped;
+				return;
+			}
+			++_stats.overLimit;
+		}
+
+		_queue.push_back(payload);
+		if (_queue.size() > _stats.peak) _stats.peak = _queue.size();
+	}
+
+	// everything waiting, in the order it was queued
+	void Take(std::deque<PayloadRef>& out)
+	{
+		out.clear();
+		std::swap(out, _queue);
+	}
+
+	// what a flush couldnt send, back in front of anything queued since
+	void PutBack(std::deque<PayloadRef>& unsent, size_t limit)
+	{
+		_queue.insert(_queue.begin(), unsent.begin(), unsent.end());
+		unsent.clear();
+		while (_queue.size() > limit && DropOldestMovement()) {}
+	}
+
+	void Clear()
+	{
+		_queue.clear();
+	}
+
+	// since the last call
+	OutboxStats TakeStats()
+	{
+		OutboxStats stats = _stats;
+		_stats = OutboxStats{};
+		_stats.peak = _queue.size();
+		return stats;
+	}
+
+private:
+	bool DropOldestMovement()
+	{
+		for (auto it = _queue.begin(); it != _queue.end(); ++it)
+		{
+			if (IsMovement((*it)->ID()))
+			{
+				_queue.erase(it);
+				++_stats.dropped;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::deque<PayloadRef> _queue;
+	OutboxStats _stats;
+};
+
+#endif
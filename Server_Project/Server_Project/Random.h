@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * Small seedable random numbers for the simulation
+ *
+ * PCG32 (O'Neill, pcg-random.org): 64 bits of state, one multiply and a shift
+ * per number. Every room keeps its own so the worker that owns the room never
+ * shares it with another thread, and the seed it started from is printed so a
+ * match's waves can be played again with waveSeed in serverSettings.txt.
+ *
+ * The stream picks one of 2^63 independent sequences, rooms use their id so two
+ * rooms given the same seed still get different waves.
+ ******************************************************************************/
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+class Pcg32
+{
+public:
+	Pcg32() { Seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+
+	void Seed(uint64_t seed, uint64_t stream = 0)
+	{
+		_state = 0;
+		_inc = (stream << 1) | 1;
+		Next();
+		_state += seed;
+		Next();
+	}
+
+	uint32_t Next()
+	{
+		uint64_t old = _state;
+		_state = old * 6364136223846793005ULL + _inc;
+		uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+		uint32_t rot = static_cast<uint32_t>(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+	}
+
+	// [0, 1), the top 24 bits so every value is exactly a float
+	float NextFloat()
+	{
+		return (Next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// [min, max)
+	float NextFloat(float min, float max)
+	{
+		return min + (max - min) * NextFloat();
+	}
+
+private:
+	uint64_t _state = 0;
+	uint64_t _inc = 1;
+};
+
+#endif
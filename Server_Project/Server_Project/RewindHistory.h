@@ -0,0 +1,246 @@
+/*******************************************************************************
+ * Rewind history for lag compensation
+ *
+ * A ring of the last few ticks of ship and asteroid state. A client fires with
+ * its synced server clock timestamp, but the shot only reaches us about half a
+ * round trip later. By then the asteroids have moved on and the client's own
+ * bullet is well ahead of where a freshly spawned one would be.
+ *
+ * ProcessBulletFired rewinds to the frame the shot was fired in. It checks the
+ * claimed muzzle position against where the ship really was, then walks the
+ * bullet forward through the frames to now. An asteroid it went through on the
+ * way is a hit, exactly as the shooter saw it. If it hit nothing, the server
+ * bullet starts where it has got to by now.
+ *
+ * How far back a shot can go is capped by serverSettings.maxRewindMs, so a slow
+ * (or lying) client cant shoot into the distant past. Asteroids are stored by
+ * slot map slot so a handle can be looked up in any frame without searching.
+ *
+ * Each frame also gets a uniform grid of its asteroids, by slot, so a trace only
+ * looks at the ones near the bullet. Its built the first time a shot passes
+ * through the frame rather than in Record, ticks nobody shoots in dont pay for
+ * it and every later shot through the same frame reuses it.
+ ******************************************************************************/
+
+#ifndef REWIND_HISTORY_H
+#define REWIND_HISTORY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "EntityStore.h"
+#include "SpatialHash.h"
+
+const float REWIND_CELL_SIZE = 64.0f; // same as the sim's broad phase
+
+struct RewindFrame
+{
+	uint32_t tick = 0;
+	uint64_t time = 0; // server clock ms when the tick finished
+
+	// by player slot
+	std::vector<float> shipX, shipY, shipDir;
+	std::vector<uint8_t> shipLive;
+
+	// by slot map slot (handle & 0xFFFF), handle is INVALID when the slot was empty
+	std::vector<SlotMap::Handle> asteroidHandle;
+	std::vector<float> asteroidX, asteroidY;
+	std::vector<float> asteroidVelX, asteroidVelY;
+	std::vector<float> asteroidHalfW, asteroidHalfH;
+
+	// slots by where they were, see RewindHistory::WithGrid
+	SpatialHash asteroidGrid;
+	float gridPadX = 0.0f, gridPadY = 0.0f; // biggest asteroid padding, queries grow by this
+	bool gridBuilt = false;
+};
+
+class RewindHistory
+{
+public:
+	// frames to keep, enough to cover the rewind window at the tick rate
+	void Reset(int frames)
+	{
+		_frames.assign(frames > 1 ? frames : 2, RewindFrame());
+		_next = 0;
+		_count = 0;
+	}
+
+	void Clear()
+	{
+		_next = 0;
+		_count = 0;
+	}
+
+	int Count() const { return _count; }
+
+	// oldest is 0, newest is Count() - 1
+	const RewindFrame& operator[](int i) const
+	{
+		int capacity = static_cast<int>(_frames.size());
+		return _frames[(_next - _count + i + capacity) % capacity];
+	}
+
+	// copies the state at the end of a tick over the oldest frame, the vectors
+	// keep their memory so this stops allocating after the first lap
+	template <typename TLive>
+	void Record(uint32_t tick, uint64_t time, const ShipStore& ships, int shipSlots, TLive&& shipLive,
+		const AsteroidStore& asteroids)
+	{
+		if (_frames.empty()) return;
+
+		RewindFrame& frame = _frames[_next];
+		frame.tick = tick;
+		frame.time = time;
+
+		frame.shipX.assign(ships.xPos.begin(), ships.xPos.begin() + shipSlots);
+		frame.shipY.assign(ships.yPos.begin(), ships.yPos.begin() + shipSlots);
+		frame.shipDir.assign(ships.dir.begin(), ships.dir.begin() + shipSlots);
+		frame.shipLive.resize(shipSlots);
+		for (int i = 0; i < shipSlots; ++i) frame.shipLive[i] = shipLive(i) ? 1 : 0;
+
+		int slots = 0;
+		for (int i = 0; i < asteroids.Count(); ++i)
+		{
+			int slot = static_cast<int>(asteroids.HandleAt(i) & 0xFFFF);
+			if (slot >= slots) slots = slot + 1;
+		}
+		frame.asteroidHandle.assign(slots, SlotMap::INVALID);
+		frame.asteroidX.resize(slots);
+		frame.asteroidY.resize(slots);
+		frame.asteroidVelX.resize(slots);
+		frame.asteroidVelY.resize(slots);
+		frame.asteroidHalfW.resize(slots);
+		frame.asteroidHalfH.resize(slots);
+		for (int i = 0; i < asteroids.Count(); ++i)
+		{
+			SlotMap::Handle handle = asteroids.HandleAt(i);
+			int slot = static_cast<int>(handle & 0xFFFF);
+			frame.asteroidHandle[slot] = handle;
+			frame.asteroidX[slot] = asteroids.xPos[i];
+			frame.asteroidY[slot] = asteroids.yPos[i];
+			frame.asteroidVelX[slot] = asteroids.velX[i];
+			frame.asteroidVelY[slot] = asteroids.velY[i];
+			frame.asteroidHalfW[slot] = asteroids.xScale[i] * 0.5f;
+			frame.asteroidHalfH[slot] = asteroids.yScale[i] * 0.5f;
+		}
+
+		frame.gridBuilt = false;
+
+		_next = (_next + 1) % static_cast<int>(_frames.size());
+		if (_count < static_cast<int>(_frames.size())) ++_count;
+	}
+
+	// frame i with its asteroid grid built, that happens on first use. each asteroid only goes
+	// in the cell its centre is in, a query has to grow by gridPadX/Y to find everything it touches
+	const RewindFrame& WithGrid(int i)
+	{
+		int capacity = static_cast<int>(_frames.size());
+		RewindFrame& frame = _frames[(_next - _count + i + capacity) % capacity];
+		if (frame.gridBuilt) return frame;
+
+		const int slots = static_cast<int>(frame.asteroidHandle.size());
+		float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+		frame.gridPadX = 0.0f;
+		frame.gridPadY = 0.0f;
+		for (int s = 0; s < slots; ++s)
+		{
+			if (frame.asteroidHandle[s] == SlotMap::INVALID) continue;
+			minX = std::min(minX, frame.asteroidX[s]);
+			minY = std::min(minY, frame.asteroidY[s]);
+			maxX = std::max(maxX, frame.asteroidX[s]);
+			maxY = std::max(maxY, frame.asteroidY[s]);
+			// asteroids barely move in a tick, padding by the size covers their sweep too
+			frame.gridPadX = std::max(frame.gridPadX, frame.asteroidHalfW[s] * 2.0f);
+			frame.gridPadY = std::max(frame.gridPadY, frame.asteroidHalfH[s] * 2.0f);
+		}
+
+		// covers where the asteroids were, queries off the edge clamp onto the border cells
+		SpatialHash& grid = frame.asteroidGrid;
+		grid.Reset(minX, minY, maxX + REWIND_CELL_SIZE, maxY + REWIND_CELL_SIZE, REWIND_CELL_SIZE);
+		for (int s = 0; s < slots; ++s)
+		{
+			if (frame.asteroidHandle[s] == SlotMap::INVALID) continue;
+			grid.Insert(s, frame.asteroidX[s], frame.asteroidY[s], frame.asteroidX[s], frame.asteroidY[s]);
+		}
+		grid.Build();
+		frame.gridBuilt = true;
+		return frame;
+	}
+
+	// index of the newest frame at or before time, the oldest one if time is
+	// further back than we keep, -1 when empty
+	int FindAt(uint64_t time) const
+	{
+		if (_count == 0) return -1;
+
+		// newest first, a shot is almost always only a few frames old
+		for (int i = _count - 1; i > 0; --i)
+		{
+			if ((*this)[i].time <= time) return i;
+		}
+		return 0;
+	}
+
+private:
+	std::vector<RewindFrame> _frames;
+	int _next = 0;
+	int _count = 0;
+};
+
+// where a rewound shot ended up
+struct RewindShot
+{
+	SlotMap::Handle asteroid = SlotMap::INVALID; // what it hit, INVALID for nothing
+	float x = 0.0f, y = 0.0f;                    // where it is now if it didnt hit anything
+};
+
+// walks a bullet fired at fireTime (inside frame first) forward to the newest frame. every step
+// between two frames is tested with the same swept boxes the sim uses, against
+// where the asteroids were in the later frame. only the asteroids the frame's grid
+// has near the bullet's path get the slab test
+inline RewindShot TraceRewoundShot(RewindHistory& history, int first, uint64_t fireTime, float x, float y,
+	float velX, float velY, float bulletHalfW, float bulletHalfH)
+{
+	RewindShot shot;
+	for (int f = first + 1; f < history.Count(); ++f)
+	{
+		const RewindFrame& frame = history.WithGrid(f);
+		uint64_t from = std::max(history[f - 1].time, fireTime);
+		float dt = frame.time > from ? (frame.time - from) * 0.001f : 0.0f;
+		x += velX * dt;
+		y += velY * dt;
+		if (dt <= 0.0f) continue;
+
+		SweptBox bullet{ x, y, bulletHalfW, bulletHalfH, velX, velY };
+		float minX, minY, maxX, maxY;
+		SweptBounds(bullet, dt, minX, minY, maxX, maxY);
+
+		const SlotMap::Handle* handles = frame.asteroidHandle.data();
+		int hitSlot = -1;
+		frame.asteroidGrid.QueryShared(minX - frame.gridPadX, minY - frame.gridPadY, maxX + frame.gridPadX,
+			maxY + frame.gridPadY, [&](int s)
+			{
+				SweptBox asteroid{ frame.asteroidX[s], frame.asteroidY[s], frame.asteroidHalfW[s], frame.asteroidHalfH[s],
+					frame.asteroidVelX[s], frame.asteroidVelY[s] };
+				if (!SweptBoxHit(asteroid, bullet, dt)) return;
+
+				// lowest handle wins so the answer doesnt depend on slot or cell order
+				if (hitSlot < 0 || handles[s] < handles[hitSlot]) hitSlot = s;
+			});
+
+		if (hitSlot >= 0)
+		{
+			shot.asteroid = handles[hitSlot];
+			shot.x = x;
+			shot.y = y;
+			return shot;
+		}
+	}
+
+	shot.x = x;
+	shot.y = y;
+	return shot;
+}
+
+#endif
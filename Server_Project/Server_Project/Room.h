@@ -0,0 +1,251 @@
+/*******************************************************************************
+ * Rooms
+ *
+ * One server process hosts several matches at once. Every room is a whole match
+ * on its own: players, world, tick, outboxes and timers. The only things
+ * rooms share are the socket and the high score file.
+ *
+ * Rooms are updated by a pool of worker threads, one per core. A room always
+ * belongs to the same worker (room id % worker count), so its update never runs
+ * on two threads at once and the timers below need no locking. A worker sleeps
+ * until one of its rooms has something due, see WakeSignal.h.
+ *
+ * The receive thread finds a datagram's room through the session table
+ * (ip:port -> room). Join fills the table in and disconnect clears it.
+ *
+ * A room is never closed. Its match goes lobby -> running -> ended, and after
+ * the results have been up a while it resets in place and runs again with
+ * whoever is still in it, or goes back to lobby if they all left.
+ ******************************************************************************/
+
+#ifndef ROOM_H
+#define ROOM_H
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "Inbox.h"
+#include "Journal.h"
+#include "Network.h"
+#include "Packet.h"
+#include "Random.h"
+#include "Simulation.h"
+#include "Wave.h"
+#include "WorldView.h"
+
+// where a room's match is. the worker moves it on, every step happens exactly once
+enum MATCH_STATE : uint8_t
+{
+	MATCH_LOBBY = 0, // open and empty, the first join starts a match
+	MATCH_RUNNING,   // ticking, waves coming in
+	MATCH_ENDED,     // scores are saved and sent, results up until the rematch
+	MATCH_RESETTING  // the world going back to the start, whoever is in stays in
+};
+
+// where UpdateMatch moves a match on to, the same state when it stays. lobby only
+// leaves on a join and resetting never stays, see MatchAfterReset
+inline MATCH_STATE NextMatchState(MATCH_STATE state, bool anyoneConnected, bool worldCleared, bool rematchDue)
+{
+	switch (state)
+	{
+	case MATCH_RUNNING:
+		// everyone left, whoever comes next gets a match of their own
+		if (!anyoneConnected) return MATCH_RESETTING;
+		if (worldCleared) return MATCH_ENDED;
+		return state;
+	case MATCH_ENDED:
+		return !anyoneConnected || rematchDue ? MATCH_RESETTING : state;
+	default:
+		return state;
+	}
+}
+
+// straight on from a reset, the same players go again or the room waits for new ones
+inline MATCH_STATE MatchAfterReset(bool anyoneConnected)
+{
+	return anyoneConnected ? MATCH_RUNNING : MATCH_LOBBY;
+}
+
+struct Room
+{
+	int id = 0;
+	ServerData data;
+
+	// waves come from this, seed is what it started from so the match can be replayed
+	Pcg32 rng;
+	uint64_t seed = 0;
+	// waves made ahead of time off rng, only the room's worker touches it
+	WaveRing waves;
+
+	// call before the room's first wave, or once it has been reset
+	void Seed(uint64_t newSeed)
+	{
+		seed = newSeed;
+		rng.Seed(seed, static_cast<uint64_t>(id));
+		waves.Clear();
+		std::cout << "Room " << id << " wave seed " << seed << std::endl;
+	}
+
+	// guards every player's outbox (ClientInfo::outbox), see Outbox.h
+	std::mutex lockMutex;
+	// something is waiting in an outbox and since when, guarded by lockMutex.
+	// the worker flushes once it has waited serverSettings.flushWindowMs
+	bool outboxPending = false;
+	std::chrono::steady_clock::time_point pendingSince;
+
+	// changes to the world from other threads, the worker applies them before its tick
+	Inbox<SimCommand, ROOM_INBOX_SIZE> inbox;
+	// pushes turned away since the worker last looked
+	std::atomic_uint32_t inboxFull{ 0 };
+	// the world as of the worker's last tick, for the receive thread and the encoders
+	TripleBuffer<WorldView> view;
+
+	// only touched by the worker that owns the room
+	SimEvents simEvents;
+	InterestChange interestChange;
+	std::vector<LockstepOp> lockstepOps;
+	// this match's journal, opened on its first tick when journalDir is set. ops recorded
+	// before the opening keyframe are already in it, journalSkip of them get left out
+	JournalWriter journal;
+	size_t journalSkip = 0;
+	// the journal couldnt be opened, this match goes without one. ResetMatch clears it
+	bool journalFailed = false;
+	double accumulatedTime = 0.0;
+	std::chrono::steady_clock::time_point lastUpdate;
+	std::chrono::steady_clock::time_point lastPrintTime;
+	std::chrono::steady_clock::time_point lastWaveTime;
+	std::chrono::steady_clock::time_point lastIdleCheck;
+	std::chrono::steady_clock::time_point lastSnapshotTime;
+	// when the match went to MATCH_ENDED, the rematch is serverSettings.rematchDelay after
+	std::chrono::steady_clock::time_point matchEndTime;
+
+	// only the worker writes it, the receive thread reads it to place joins
+	std::atomic<uint8_t> matchState{ MATCH_LOBBY };
+	// matches this room has started, for the logs
+	uint32_t matchNumber = 0;
+	// lockstep only, someone joined or fell out of sync and needs a whole snapshot
+	std::atomic_bool keyframeWanted{ false };
+
+	// someone new could join right now
+	bool HasSpace()
+	{
+		// no one new between a match ending and the rematch starting
+		uint8_t state = matchState.load();
+		if (state != MATCH_LOBBY && state != MATCH_RUNNING) return false;
+
+		std::lock_guard<std::mutex> lock(data.clientMutex);
+		return !data.freeSlots.empty() || data.totalClients.Slots() < data.totalClients.Capacity();
+	}
+};
+
+// rooms are only ever added, a room that finished gets reset and reused instead
+// of closed, so a Room& stays valid for the life of the server
+class RoomManager
+{
+public:
+	// once at startup, before any thread touches the rooms
+	// waveSeed 0 gives every room a seed of its own from random_device
+	void Reserve(int maxRooms, int maxPlayers, int maxAsteroids, int historyFrames, uint64_t waveSeed)
+	{
+		_rooms.clear();
+		_rooms.resize(maxRooms);
+		_count.store(0);
+		_maxPlayers = maxPlayers;
+		_maxAsteroids = maxAsteroids;
+		_historyFrames = historyFrames;
+		_waveSeed = waveSeed;
+	}
+
+	// the seed a room starts (or restarts) from
+	uint64_t NextSeed()
+	{
+		if (_waveSeed != 0) return _waveSeed;
+
+		std::random_device rd;
+		return (static_cast<uint64_t>(rd()) << 32) | rd();
+	}
+
+	int Capacity() const { return static_cast<int>(_rooms.size()); }
+	int Count() const { return _count.load(std::memory_order_acquire); }
+
+	Room& operator[](int i) { return *_rooms[i]; }
+
+	// the first room with a free slot, opening a new one when they are all full.
+	// nullptr when every room is full and no more can be opened. receive thread only
+	Room* PickForJoin()
+	{
+		for (int i = 0; i < Count(); ++i)
+		{
+			if (_rooms[i]->HasSpace()) return _rooms[i].get();
+		}
+		return Open();
+	}
+
+	// the room this address is playing in, nullptr if it hasnt joined one
+	Room* Find(uint64_t addrKey)
+	{
+		std::lock_guard<std::mutex> lock(_sessionMutex);
+		auto it = _sessions.find(addrKey);
+		return it == _sessions.end() ? nullptr : _rooms[it->second].get();
+	}
+
+	// call with the room's clientMutex held, so the table always agrees with its playerMap
+	void Bind(uint64_t addrKey, int roomID)
+	{
+		std::lock_guard<std::mutex> lock(_sessionMutex);
+		_sessions[addrKey] = roomID;
+	}
+
+	void Unbind(uint64_t addrKey)
+	{
+		std::lock_guard<std::mutex> lock(_sessionMutex);
+		_sessions.erase(addrKey);
+	}
+
+private:
+	Room* Open()
+	{
+		int i = _count.load(std::memory_order_relaxed);
+		if (i >= Capacity()) return nullptr;
+
+		auto room = std::make_unique<Room>();
+		room->id = i;
+		// slots grow on demand up to these, nothing is allocated per player until they join
+		room->data.totalClients.Reserve(_maxPlayers);
+		room->data.ships.Resize(_maxPlayers);
+		room->data.asteroids.Reset(_maxAsteroids);
+		room->data.history.Reset(_historyFrames);
+		room->data.gameRunning = false;
+		room->Seed(NextSeed());
+
+		auto now = std::chrono::steady_clock::now();
+		room->lastUpdate = now;
+		room->lastPrintTime = now;
+		room->lastWaveTime = now;
+		room->lastIdleCheck = now;
+		room->lastSnapshotTime = now;
+
+		_rooms[i] = std::move(room);
+		// published after the room exists so the workers looping to Count() never see a null
+		_count.store(i + 1, std::memory_order_release);
+		return _rooms[i].get();
+	}
+
+	// never resizes after Reserve, so the workers can read it while rooms open
+	std::vector<std::unique_ptr<Room>> _rooms;
+	std::atomic_int _count{ 0 };
+	int _maxPlayers = 0;
+	int _maxAsteroids = 0;
+	int _historyFrames = 0;
+	uint64_t _waveSeed = 0;
+
+	std::mutex _sessionMutex;
+	std::unordered_map<uint64_t, int> _sessions;
+};
+
+#endif
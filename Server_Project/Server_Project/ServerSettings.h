@@ -0,0 +1,175 @@
+#ifndef SERVER_SETTINGS_H
+#define SERVER_SETTINGS_H
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <filesystem>
+
+const std::string SERVER_SETTINGS_FILENAME = "serverSettings.txt";
+
+// runtime knobs for the server, read from serverSettings.txt
+// every field has a default so the file is optional
+struct ServerSettings
+{
+	// path to a network conditions script, empty means no emulation
+	std::string netScenario;
+	// seed for the emulator's rng, 0 means pick one from the clock
+	unsigned int netSeed = 0;
+	// seed for asteroid waves, 0 gives every room its own. set it to a seed a room
+	// printed to get the same waves again
+	uint64_t waveSeed = 0;
+	// seconds without any datagram before a client's slot is freed
+	float clientTimeout = 5.0f;
+	// send xor parity alongside asteroid waves/destroys and game over
+	bool fecEnabled = false;
+	// a group that hasnt filled up gets its parity sent after this long
+	float fecMaxDelayMs = 30.0f;
+	// simulation ticks per second, independent of how often we send
+	float tickRate = 60.0f;
+	// how many players and asteroids one match can hold
+	int maxPlayers = 4;
+	int maxAsteroids = 8;
+	// how many matches the process hosts at once, a new one opens when the others are full
+	int maxRooms = 8;
+	// threads the rooms are updated on, 0 means one per core
+	int roomThreads = 0;
+	// threads one big room's tick gets split over, 0 means one per core, 1 keeps it on the room's thread
+	int simThreads = 0;
+	// clients only hear about ships and asteroids this close to their ship, 0 sends everything
+	float interestRadius = 0.0f;
+	// furthest back a shot gets replayed from when it was fired, 0 spawns it where the ship is now
+	float maxRewindMs = 200.0f;
+	// world snapshots sent to every client per second
+	float snapshotRate = 20.0f;
+	// send each tick's inputs instead of snapshots, peers run the sim themselves
+	bool lockstep = false;
+	// folder every match's inputs get written to for the replayer, empty means no journal
+	std::string journalDir;
+	// ticks between whole state keyframes in a journal, where a replay can start from
+	int journalKeyframeTicks = 600;
+	// messages one client can have waiting before its oldest movement gets dropped
+	int outboxSize = 64;
+	// how long the first message queued for a client waits for more to go out with it, 0 sends right away
+	float flushWindowMs = 0.0f;
+	// seconds the results stay up after a match ends before the same players go again
+	float rematchDelay = 5.0f;
+};
+
+// one "key value" pair per line, # starts a comment
+inline bool ApplyServerSetting(ServerSettings& settings, const std::string& key, std::istringstream& value)
+{
+	if (key == "netScenario") value >> settings.netScenario;
+	else if (key == "netSeed") value >> settings.netSeed;
+	else if (key == "waveSeed") value >> settings.waveSeed;
+	else if (key == "clientTimeout") value >> settings.clientTimeout;
+	else if (key == "fecEnabled") value >> settings.fecEnabled;
+	else if (key == "fecMaxDelayMs") value >> settings.fecMaxDelayMs;
+	else if (key == "tickRate") value >> settings.tickRate;
+	else if (key == "maxPlayers") value >> settings.maxPlayers;
+	else if (key == "maxAsteroids") value >> settings.maxAsteroids;
+	else if (key == "maxRooms") value >> settings.maxRooms;
+	else if (key == "roomThreads") value >> settings.roomThreads;
+	else if (key == "simThreads") value >> settings.simThreads;
+	else if (key == "interestRadius") value >> settings.interestRadius;
+	else if (key == "maxRewindMs") value >> settings.maxRewindMs;
+	else if (key == "snapshotRate") value >> settings.snapshotRate;
+	else if (key == "lockstep") value >> settings.lockstep;
+	else if (key == "journalDir") value >> settings.journalDir;
+	else if (key == "journalKeyframeTicks") value >> settings.journalKeyframeTicks;
+	else if (key == "outboxSize") value >> settings.outboxSize;
+	else if (key == "flushWindowMs") value >> settings.flushWindowMs;
+	else if (key == "rematchDelay") value >> settings.rematchDelay;
+	else return false;
+
+	return true;
+}
+
+inline ServerSettings LoadServerSettings()
+{
+	ServerSettings settings;
+
+	std::filesystem::path settingsPath = std::filesystem::current_path() / SERVER_SETTINGS_FILENAME;
+	std::ifstream settingsFile(settingsPath);
+	if (!settingsFile.is_open())
+	{
+		std::cout << "No " << SERVER_SETTINGS_FILENAME << " found, using default settings." << std::endl;
+		return settings;
+	}
+
+	std::string line;
+	while (std::getline(settingsFile, line))
+	{
+		if (line.empty() || line[0] == '#') continue;
+
+		std::istringstream iss(line);
+		std::string key;
+		if (!(iss >> key)) continue;
+
+		if (!ApplyServerSetting(settings, key, iss))
+		{
+			std::cerr << "Unknown server setting: " << key << std::endl;
+		}
+	}
+
+	if (settings.tickRate <= 0.0f)
+	{
+		std::cerr << "tickRate has to be above 0, using 60" << std::endl;
+		settings.tickRate = 60.0f;
+	}
+	if (settings.maxPlayers <= 0)
+	{
+		std::cerr << "maxPlayers has to be above 0, using 4" << std::endl;
+		settings.maxPlayers = 4;
+	}
+	// a wave is 8 at a time so anything smaller would never spawn
+	if (settings.maxAsteroids < 8)
+	{
+		std::cerr << "maxAsteroids has to be at least 8, using 8" << std::endl;
+		settings.maxAsteroids = 8;
+	}
+	if (settings.maxRooms <= 0)
+	{
+		std::cerr << "maxRooms has to be above 0, using 1" << std::endl;
+		settings.maxRooms = 1;
+	}
+	if (settings.interestRadius < 0.0f)
+	{
+		std::cerr << "interestRadius cant be negative, turning it off" << std::endl;
+		settings.interestRadius = 0.0f;
+	}
+	if (settings.maxRewindMs < 0.0f)
+	{
+		std::cerr << "maxRewindMs cant be negative, turning rewind off" << std::endl;
+		settings.maxRewindMs = 0.0f;
+	}
+	if (settings.snapshotRate <= 0.0f)
+	{
+		std::cerr << "snapshotRate has to be above 0, using 20" << std::endl;
+		settings.snapshotRate = 20.0f;
+	}
+	if (settings.journalKeyframeTicks <= 0)
+	{
+		std::cerr << "journalKeyframeTicks has to be above 0, using 600" << std::endl;
+		settings.journalKeyframeTicks = 600;
+	}
+	if (settings.outboxSize <= 0)
+	{
+		std::cerr << "outboxSize has to be above 0, using 64" << std::endl;
+		settings.outboxSize = 64;
+	}
+	if (settings.flushWindowMs < 0.0f)
+	{
+		std::cerr << "flushWindowMs cant be negative, sending right away" << std::endl;
+		settings.flushWindowMs = 0.0f;
+	}
+	if (settings.rematchDelay < 0.0f)
+	{
+		std::cerr << "rematchDelay cant be negative, using 0" << std::endl;
+		settings.rematchDelay = 0.0f;
+	}
+
+	return settings;
+}
+
+#endif
@@ -0,0 +1,521 @@
+/*******************************************************************************
+ * Server side fixed step simulation
+ *
+ * Moves ships (from the input frames clients send), asteroids and bullets and
+ * resolves bullet/asteroid and ship/asteroid hits. The server is the only one
+ * that decides collisions and scores, clients just draw what they're told.
+ * The numbers here mirror the client's GameState_Asteroids.cpp so both sides
+ * move things the same way between updates.
+ ******************************************************************************/
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "EntityStore.h"
+#include "JobSystem.h"
+#include "Network.h"
+
+// world is the client's 1280x720 window centered on 0,0
+#define X_SIZE 640
+#define Y_SIZE 360
+#define ASTEROID_SCORE 100
+
+const float ASTEROID_ACCEL = 100.0f;
+const float SHIP_SCALE = 45.0f;
+const float BULLET_SCALE_X = 20.0f;
+const float BULLET_SCALE_Y = 3.0f;
+const float SHIP_ACCEL_FORWARD = 100.0f;
+const float SHIP_ACCEL_BACKWARD = 100.0f;
+const float SHIP_ROT_SPEED = 2.0f * 3.14159265f;
+const float BULLET_SPEED = 400.0f;
+const float SIM_PI = 3.14159265f;
+// a bit bigger than the biggest asteroid so most only land in 1-4 cells
+const float SIM_CELL_SIZE = 64.0f;
+// entities per job, below this a loop isnt worth splitting. collision tests cost a
+// lot more per entity than integrating so they split sooner
+const int SIM_JOB_GRAIN = 1024;
+const int SIM_JOB_GRAIN_COLLIDE = 128;
+
+// every input frame from a client is one of its fixed steps, whatever our tick rate is
+const float INPUT_STEP = 0.01667f;
+
+// what the client packs as playerInput
+enum SHIP_INPUT : uint8_t
+{
+	SHIP_INPUT_NONE = 0,
+	SHIP_INPUT_FORWARD,
+	SHIP_INPUT_BACKWARD,
+	SHIP_INPUT_LEFT,
+	SHIP_INPUT_RIGHT
+};
+
+struct SimBulletHit
+{
+	int shipID;
+	int bulletID;
+	int asteroidID;
+	int score;
+};
+
+struct SimShipHit
+{
+	int shipID;
+	int asteroidID;
+};
+
+// what happened during a tick, the server turns these into packets
+struct SimEvents
+{
+	std::vector<SimBulletHit> bulletHits;
+	std::vector<SimShipHit> shipHits;
+
+	void Clear()
+	{
+		bulletHits.clear();
+		shipHits.clear();
+	}
+};
+
+// same as AEWrap
+inline float SimWrap(float x, float x0, float x1)
+{
+	float range = x1 - x0;
+	if (x < x0) return x + range;
+	if (x > x1) return x - range;
+	return x;
+}
+
+inline SweptBox AsteroidBox(const AsteroidStore& asteroids, int i)
+{
+	return { asteroids.xPos[i], asteroids.yPos[i], asteroids.xScale[i] * 0.5f, asteroids.yScale[i] * 0.5f,
+		asteroids.velX[i], asteroids.velY[i] };
+}
+
+inline SweptCircle AsteroidCircle(const AsteroidStore& asteroids, int i)
+{
+	return { asteroids.xPos[i], asteroids.yPos[i], std::max(asteroids.xScale[i], asteroids.yScale[i]) * 0.5f,
+		asteroids.velX[i], asteroids.velY[i] };
+}
+
+inline SweptBox BulletBox(const BulletStore& bullets, int i)
+{
+	return { bullets.xPos[i], bullets.yPos[i], BULLET_SCALE_X * 0.5f, BULLET_SCALE_Y * 0.5f, bullets.velX[i], bullets.velY[i] };
+}
+
+inline SweptCircle ShipCircle(const ShipStore& ships, int i)
+{
+	return { ships.xPos[i], ships.yPos[i], SHIP_SCALE * 0.5f, ships.velX[i], ships.velY[i] };
+}
+
+// puts every live asteroid into the grid by the box it swept this tick
+inline void BuildAsteroidGrid(ServerData& data, float dt)
+{
+	SpatialHash& grid = data.asteroidGrid;
+	if (!grid.Ready())
+	{
+		// same margin the wrap uses so asteroids half off screen still land in a cell
+		grid.Reset(-X_SIZE - SIM_CELL_SIZE, -Y_SIZE - SIM_CELL_SIZE,
+			X_SIZE + SIM_CELL_SIZE, Y_SIZE + SIM_CELL_SIZE, SIM_CELL_SIZE);
+	}
+
+	const AsteroidStore& asteroids = data.asteroids;
+	grid.Clear();
+	for (int i = 0; i < asteroids.Count(); ++i)
+	{
+		float minX, minY, maxX, maxY;
+		SweptBounds(AsteroidBox(asteroids, i), dt, minX, minY, maxX, maxY);
+		grid.Insert(i, minX, minY, maxX, maxY);
+	}
+	grid.Build();
+}
+
+// same grid layout as above but with plain positions, what the interest pass
+// looks around each ship with. only ships in the sim go in
+inline void BuildInterestGrids(ServerData& data)
+{
+	SpatialHash* grids[] = { &data.interestShips, &data.interestAsteroids };
+	for (SpatialHash* grid : grids)
+	{
+		if (!grid->Ready())
+		{
+			grid->Reset(-X_SIZE - SIM_CELL_SIZE, -Y_SIZE - SIM_CELL_SIZE,
+				X_SIZE + SIM_CELL_SIZE, Y_SIZE + SIM_CELL_SIZE, SIM_CELL_SIZE);
+		}
+		grid->Clear();
+	}
+
+	const ShipStore& ships = data.ships;
+	for (int i = 0; i < data.totalClients.Slots(); ++i)
+	{
+		if (!data.totalClients[i].inSim) continue;
+		data.interestShips.Insert(i, ships.xPos[i], ships.yPos[i], ships.xPos[i], ships.yPos[i]);
+	}
+
+	const AsteroidStore& asteroids = data.asteroids;
+	for (int i = 0; i < asteroids.Count(); ++i)
+	{
+		data.interestAsteroids.Insert(i, asteroids.xPos[i], asteroids.yPos[i], asteroids.xPos[i], asteroids.yPos[i]);
+	}
+
+	data.interestShips.Build();
+	data.interestAsteroids.Build();
+}
+
+// one input frame, same math as the client's update
+inline void ApplyShipInput(ShipStore& ships, int i, uint8_t input)
+{
+	switch (input)
+	{
+	case SHIP_INPUT_FORWARD:
+	case SHIP_INPUT_BACKWARD:
+	{
+		float accel = (input == SHIP_INPUT_FORWARD) ? SHIP_ACCEL_FORWARD : -SHIP_ACCEL_BACKWARD;
+		ships.velX[i] += std::cos(ships.dir[i]) * accel * INPUT_STEP * 0.99f;
+		ships.velY[i] += std::sin(ships.dir[i]) * accel * INPUT_STEP * 0.99f;
+		break;
+	}
+	case SHIP_INPUT_LEFT:
+		ships.dir[i] = SimWrap(ships.dir[i] + SHIP_ROT_SPEED * INPUT_STEP, -SIM_PI, SIM_PI);
+		break;
+	case SHIP_INPUT_RIGHT:
+		ships.dir[i] = SimWrap(ships.dir[i] - SHIP_ROT_SPEED * INPUT_STEP, -SIM_PI, SIM_PI);
+		break;
+	default:
+		break;
+	}
+}
+
+// the integrate loops run over every slot with no branches on the flags, moving
+// an empty slot is cheaper than breaking up the loop and lets it vectorize.
+// ships only go up to the slots the client pool has opened, not the capacity
+inline void IntegrateShips(ShipStore& ships, int count, float dt)
+{
+	float* x = ships.xPos.data();
+	float* y = ships.yPos.data();
+	const float* vx = ships.velX.data();
+	const float* vy = ships.velY.data();
+	const int n = count;
+	for (int i = 0; i < n; ++i)
+	{
+		x[i] = SimWrap(x[i] + vx[i] * dt, -X_SIZE - SHIP_SCALE, X_SIZE + SHIP_SCALE);
+		y[i] = SimWrap(y[i] + vy[i] * dt, -Y_SIZE - SHIP_SCALE, Y_SIZE + SHIP_SCALE);
+	}
+}
+
+// positions at tick from each asteroid's keyframe, no adding onto last tick's. the
+// collision pass needs them all every tick anyway, this just keeps them exact.
+// going off an edge is the only thing that makes a new keyframe
+inline void IntegrateAsteroids(AsteroidStore& asteroids, int begin, int end, uint32_t tick, float dt)
+{
+	float* x = asteroids.xPos.data();
+	float* y = asteroids.yPos.data();
+	const float* kx = asteroids.keyX.data();
+	const float* ky = asteroids.keyY.data();
+	const uint32_t* kt = asteroids.keyTick.data();
+	const float* vx = asteroids.velX.data();
+	const float* vy = asteroids.velY.data();
+	for (int i = begin; i < end; ++i)
+	{
+		float t = static_cast<float>(tick - kt[i]) * dt;
+		x[i] = kx[i] + vx[i] * t;
+		y[i] = ky[i] + vy[i] * t;
+	}
+
+	// wraps are rare, a separate pass keeps the loop above branch free
+	const float* sx = asteroids.xScale.data();
+	const float* sy = asteroids.yScale.data();
+	for (int i = begin; i < end; ++i)
+	{
+		float wx = SimWrap(x[i], -X_SIZE - sx[i], X_SIZE + sx[i]);
+		float wy = SimWrap(y[i], -Y_SIZE - sy[i], Y_SIZE + sy[i]);
+		if (wx != x[i] || wy != y[i]) asteroids.Rekey(i, wx, wy, tick);
+	}
+}
+
+// moves every bullet then drops the ones that left the screen
+inline void IntegrateBullets(BulletStore& bullets, float dt)
+{
+	float* x = bullets.xPos.data();
+	float* y = bullets.yPos.data();
+	const float* vx = bullets.velX.data();
+	const float* vy = bullets.velY.data();
+	const int n = bullets.Count();
+	for (int i = 0; i < n; ++i)
+	{
+		x[i] += vx[i] * dt;
+		y[i] += vy[i] * dt;
+	}
+
+	for (int i = n - 1; i >= 0; --i)
+	{
+		if (x[i] < -X_SIZE || x[i] > X_SIZE || y[i] < -Y_SIZE || y[i] > Y_SIZE) bullets.RemoveAt(i);
+	}
+}
+
+// lowest asteroid the bullet hits this step, -1 for none. only reads, so any number
+// of these can run at once
+inline int FindBulletHit(const ServerData& data, int b, float dt)
+{
+	const AsteroidStore& asteroids = data.asteroids;
+	SweptBox bulletBox = BulletBox(data.bullets, b);
+
+	float minX, minY, maxX, maxY;
+	SweptBounds(bulletBox, dt, minX, minY, maxX, maxY);
+
+	int hitID = -1;
+	data.asteroidGrid.QueryShared(minX, minY, maxX, maxY, [&](int id)
+		{
+			if (hitID >= 0 && id >= hitID) return;
+			if (!asteroids.dead[id] && SweptBoxHit(AsteroidBox(asteroids, id), bulletBox, dt)) hitID = id;
+		});
+	return hitID;
+}
+
+inline int FindShipHit(const ServerData& data, int s, float dt)
+{
+	const AsteroidStore& asteroids = data.asteroids;
+	SweptCircle shipCircle = ShipCircle(data.ships, s);
+
+	float minX, minY, maxX, maxY;
+	SweptBounds({ shipCircle.x, shipCircle.y, shipCircle.radius, shipCircle.radius, shipCircle.vx, shipCircle.vy },
+		dt, minX, minY, maxX, maxY);
+
+	int hitID = -1;
+	data.asteroidGrid.QueryShared(minX, minY, maxX, maxY, [&](int id)
+		{
+			if (hitID >= 0 && id >= hitID) return;
+			if (!asteroids.dead[id] && SweptCircleHit(AsteroidCircle(asteroids, id), shipCircle, dt)) hitID = id;
+		});
+	return hitID;
+}
+
+// one tick of the world, room's worker only. phases run one after the other,
+// the loops inside integrate and narrow phase are split across jobs. jobs only help
+// once a room is big enough, see SIM_JOB_GRAIN
+inline void SimStep(ServerData& data, float dt, SimEvents& events, JobSystem& jobs)
+{
+	ShipStore& ships = data.ships;
+	AsteroidStore& asteroids = data.asteroids;
+	BulletStore& bullets = data.bullets;
+
+	const int shipSlots = data.totalClients.Slots();
+
+	// ships, inputs first so this tick's movement uses them
+	for (int i = 0; i < shipSlots; ++i)
+	{
+		ClientInfo& client = data.totalClients[i];
+		if (!client.inSim) continue;
+
+		for (uint8_t input : client.pendingInputs)
+		{
+			ApplyShipInput(ships, i, input);
+		}
+		client.pendingInputs.clear();
+	}
+
+	// integrate, every entity only touches itself
+	IntegrateShips(ships, shipSlots, dt);
+	// this step finishes tick + 1
+	const uint32_t nextTick = data.tick + 1;
+	jobs.ParallelFor(asteroids.Count(), SIM_JOB_GRAIN, [&](int begin, int end)
+		{
+			IntegrateAsteroids(asteroids, begin, end, nextTick, dt);
+		});
+	IntegrateBullets(bullets, dt);
+
+	// broad phase, the grid build is a counting sort and stays on this thread
+	BuildAsteroidGrid(data, dt);
+
+	// narrow phase, every bullet and ship finds what it hits on its own
+	std::vector<int>& bulletHits = data.bulletHitScratch;
+	bulletHits.resize(bullets.Count());
+	jobs.ParallelFor(bullets.Count(), SIM_JOB_GRAIN_COLLIDE, [&](int begin, int end)
+		{
+			for (int b = begin; b < end; ++b) bulletHits[b] = FindBulletHit(data, b, dt);
+		});
+
+	std::vector<int>& shipHits = data.shipHitScratch;
+	shipHits.assign(shipSlots, -1);
+	jobs.ParallelFor(shipSlots, SIM_JOB_GRAIN_COLLIDE, [&](int begin, int end)
+		{
+			for (int s = begin; s < end; ++s)
+			{
+				if (data.totalClients[s].inSim) shipHits[s] = FindShipHit(data, s, dt);
+			}
+		});
+
+	// resolve, in the same order as always so the result doesnt depend on how the
+	// jobs were split. lowest index wins when there are several. if something earlier
+	// already took an asteroid, look again for the next one
+	for (int b = bullets.Count() - 1; b >= 0; --b)
+	{
+		int hitID = bulletHits[b];
+		if (hitID >= 0 && asteroids.dead[hitID]) hitID = FindBulletHit(data, b, dt);
+		if (hitID < 0) continue;
+
+		asteroids.Kill(hitID);
+
+		int owner = bullets.ownerID[b];
+		SimBulletHit hit{ owner, bullets.netID[b], (int)asteroids.HandleAt(hitID), 0 };
+		if (owner >= 0 && owner < shipSlots)
+		{
+			ships.score[owner] += ASTEROID_SCORE;
+			hit.score = ships.score[owner];
+		}
+		events.bulletHits.push_back(hit);
+
+		// going backwards so the one swapped in has already been checked
+		bullets.RemoveAt(b);
+	}
+
+	for (int s = 0; s < shipSlots; ++s)
+	{
+		if (!data.totalClients[s].inSim) continue;
+
+		int hitID = shipHits[s];
+		if (hitID >= 0 && asteroids.dead[hitID]) hitID = FindShipHit(data, s, dt);
+		if (hitID < 0) continue;
+
+		asteroids.Kill(hitID);
+		ships.ResetMotion(s);
+		events.shipHits.push_back({ s, (int)asteroids.HandleAt(hitID) });
+	}
+
+	// grid indices are done with, safe to pack now
+	asteroids.RemoveDead();
+
+	++data.tick;
+}
+
+// a ship as it is right now, for telling lockstep peers about anything that changed it
+// outside of a tick (joining, leaving, respawning, a rewound hit's score)
+inline LockstepOp ShipLockstepOp(const ServerData& data, int id)
+{
+	const ShipStore& ships = data.ships;
+	LockstepOp op;
+	op.op = LOCKSTEP_SHIP;
+	op.id = id;
+	op.flag = data.totalClients[id].inSim ? 1 : 0;
+	op.v[0] = ships.xPos[id];
+	op.v[1] = ships.yPos[id];
+	op.v[2] = ships.velX[id];
+	op.v[3] = ships.velY[id];
+	op.v[4] = ships.dir[id];
+	op.extra = ships.score[id];
+	return op;
+}
+
+// what a peer (or a replay) does with an op before its SimStep, the same change the
+// server made when it recorded it. false when the result doesnt line up, thats a desync
+inline bool ApplyLockstepOp(ServerData& data, const LockstepOp& op)
+{
+	switch (op.op)
+	{
+	case LOCKSTEP_INPUT:
+		if (op.id < 0 || op.id >= data.totalClients.Slots()) return false;
+		data.totalClients[op.id].pendingInputs.push_back(op.flag);
+		return true;
+	case LOCKSTEP_SHIP:
+	{
+		if (op.id < 0) return false;
+		while (op.id >= data.totalClients.Slots())
+		{
+			if (data.totalClients.Grow() == NO_SLOT) return false;
+		}
+		ShipStore& ships = data.ships;
+		data.totalClients[op.id].inSim = op.flag != 0;
+		ships.xPos[op.id] = op.v[0];
+		ships.yPos[op.id] = op.v[1];
+		ships.velX[op.id] = op.v[2];
+		ships.velY[op.id] = op.v[3];
+		ships.dir[op.id] = op.v[4];
+		ships.score[op.id] = op.extra;
+		return true;
+	}
+	case LOCKSTEP_BULLET:
+	{
+		Bullet bullet{};
+		bullet.ownerID = op.id;
+		bullet.active = true;
+		bullet.xPos = op.v[0];
+		bullet.yPos = op.v[1];
+		bullet.vel_x = op.v[2];
+		bullet.vel_y = op.v[3];
+		return data.bullets.Add(op.extra, bullet) != SlotMap::INVALID;
+	}
+	case LOCKSTEP_DROP_BULLETS:
+		data.bullets.RemoveOwner(op.id);
+		return true;
+	case LOCKSTEP_ASTEROID:
+	{
+		Asteroid asteroid{};
+		asteroid.xPos = op.v[0];
+		asteroid.yPos = op.v[1];
+		asteroid.vel_x = op.v[2];
+		asteroid.vel_y = op.v[3];
+		asteroid.dirCur = op.v[4];
+		asteroid.xScale = op.v[5];
+		asteroid.yScale = op.v[6];
+		asteroid.active = true;
+		// same adds and removes in the same order hand out the same handle
+		return data.asteroids.Add(asteroid, data.tick) == static_cast<SlotMap::Handle>(op.id);
+	}
+	case LOCKSTEP_REMOVE_ASTEROID:
+	{
+		int i = data.asteroids.ids.Find(static_cast<SlotMap::Handle>(op.id));
+		if (i < 0) return false;
+		data.asteroids.RemoveAt(i);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+// everything a tick can change, rolled on from the last tick's checksum. one pass
+// over the arrays, cheap next to the collision pass
+inline uint32_t StateChecksum(const ServerData& data, uint32_t previous)
+{
+	StateHash hash;
+	hash.Add(previous);
+	hash.Add(data.tick);
+
+	const ShipStore& ships = data.ships;
+	for (int i = 0; i < data.totalClients.Slots(); ++i)
+	{
+		if (!data.totalClients[i].inSim) continue;
+		hash.Add(static_cast<uint32_t>(i));
+		hash.Add(ships.xPos[i]);
+		hash.Add(ships.yPos[i]);
+		hash.Add(ships.velX[i]);
+		hash.Add(ships.velY[i]);
+		hash.Add(ships.dir[i]);
+		hash.Add(static_cast<uint32_t>(ships.score[i]));
+	}
+
+	const AsteroidStore& asteroids = data.asteroids;
+	hash.Add(static_cast<uint32_t>(asteroids.Count()));
+	for (int i = 0; i < asteroids.Count(); ++i)
+	{
+		hash.Add(asteroids.HandleAt(i));
+		hash.Add(asteroids.xPos[i]);
+		hash.Add(asteroids.yPos[i]);
+	}
+
+	const BulletStore& bullets = data.bullets;
+	hash.Add(static_cast<uint32_t>(bullets.Count()));
+	for (int i = 0; i < bullets.Count(); ++i)
+	{
+		hash.Add(static_cast<uint32_t>(bullets.netID[i]));
+		hash.Add(bullets.xPos[i]);
+		hash.Add(bullets.yPos[i]);
+	}
+
+	return hash.value;
+}
+
+#endif
@@ -0,0 +1,180 @@
+/*******************************************************************************
+ * Generational slot map
+ *
+ * Hands out 32 bit handles for things that live in a packed array. The handle
+ * stays the same while the thing moves around inside the array, and once it is
+ * erased the slot gets reused with a new generation so an old handle (say from
+ * a packet that was in flight) just fails the lookup instead of hitting
+ * whatever took the slot.
+ *
+ * This only tracks handle <-> dense index, the stores in EntityStore.h keep the
+ * actual data in their own arrays and mirror the swap when something is erased.
+ *
+ * Handle layout: [0][generation 15 bits][slot 16 bits], generation starts at 1
+ * so 0 is never a valid handle and every handle fits in a positive int for the
+ * wire.
+ ******************************************************************************/
+
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+#include <cstdint>
+#include <vector>
+
+#define SLOT_MAP_MAX_SLOTS 0xFFFF
+#define SLOT_MAP_MAX_GEN   0x7FFF
+
+class SlotMap
+{
+public:
+	using Handle = uint32_t;
+	static constexpr Handle INVALID = 0;
+
+	// drops everything, old handles all go stale
+	void Reset(int maxSlots)
+	{
+		for (Slot& slot : _slots)
+		{
+			if (slot.dense >= 0) BumpGeneration(slot);
+			slot.dense = -1;
+		}
+		_dense.clear();
+		_free.clear();
+		for (int i = static_cast<int>(_slots.size()) - 1; i >= 0; --i) _free.push_back(i);
+		_maxSlots = maxSlots > SLOT_MAP_MAX_SLOTS ? SLOT_MAP_MAX_SLOTS : maxSlots;
+	}
+
+	int Size() const { return static_cast<int>(_dense.size()); }
+	int MaxSlots() const { return _maxSlots; }
+	bool Full() const { return Size() >= _maxSlots; }
+
+	// new handle at dense index Size() - 1, or INVALID when full
+	Handle Insert()
+	{
+		if (Full()) return INVALID;
+
+		int slotIndex;
+		if (!_free.empty())
+		{
+			slotIndex = _free.back();
+			_free.pop_back();
+		}
+		else
+		{
+			slotIndex = static_cast<int>(_slots.size());
+			_slots.push_back({});
+		}
+
+		Slot& slot = _slots[slotIndex];
+		slot.dense = Size();
+		_dense.push_back(slotIndex);
+		return MakeHandle(slotIndex, slot.generation);
+	}
+
+	// dense index for a handle, -1 if it was erased or never existed
+	int Find(Handle handle) const
+	{
+		uint32_t slotIndex = handle & 0xFFFF;
+		if (handle == INVALID || slotIndex >= _slots.size()) return -1;
+
+		const Slot& slot = _slots[slotIndex];
+		if (slot.dense < 0 || slot.generation != (handle >> 16)) return -1;
+		return slot.dense;
+	}
+
+	Handle HandleAt(int dense) const
+	{
+		int slotIndex = _dense[dense];
+		return MakeHandle(slotIndex, _slots[slotIndex].generation);
+	}
+
+	// removes dense index i by moving the last one into it, same as the stores do with their arrays
+	void EraseAt(int i)
+	{
+		int slotIndex = _dense[i];
+		int last = Size() - 1;
+
+		_dense[i] = _dense[last];
+		_slots[_dense[i]].dense = i;
+		_dense.pop_back();
+
+		Slot& slot = _slots[slotIndex];
+		slot.dense = -1;
+		BumpGeneration(slot);
+		_free.push_back(slotIndex);
+	}
+
+	// everything including the free list and generations, so a loaded copy hands out
+	// the same handles this one would. TOut needs Put(uint32_t), TIn Get(uint32_t&)
+	template <typename TOut>
+	void Save(TOut& out) const
+	{
+		out.Put(static_cast<uint32_t>(_maxSlots));
+		out.Put(static_cast<uint32_t>(_slots.size()));
+		for (const Slot& slot : _slots)
+		{
+			out.Put(static_cast<uint32_t>(slot.dense));
+			out.Put(slot.generation);
+		}
+		out.Put(static_cast<uint32_t>(_dense.size()));
+		for (int slotIndex : _dense) out.Put(static_cast<uint32_t>(slotIndex));
+		out.Put(static_cast<uint32_t>(_free.size()));
+		for (int slotIndex : _free) out.Put(static_cast<uint32_t>(slotIndex));
+	}
+
+	template <typename TIn>
+	bool Load(TIn& in)
+	{
+		uint32_t maxSlots, count, value;
+		if (!in.Get(maxSlots) || !in.Get(count) || count > SLOT_MAP_MAX_SLOTS + 1) return false;
+		_maxSlots = static_cast<int>(maxSlots);
+
+		_slots.resize(count);
+		for (Slot& slot : _slots)
+		{
+			if (!in.Get(value) || !in.Get(slot.generation)) return false;
+			slot.dense = static_cast<int>(value);
+		}
+
+		if (!in.Get(count) || count > _slots.size()) return false;
+		_dense.resize(count);
+		for (int& slotIndex : _dense)
+		{
+			if (!in.Get(value) || value >= _slots.size()) return false;
+			slotIndex = static_cast<int>(value);
+		}
+
+		if (!in.Get(count) || count > _slots.size()) return false;
+		_free.resize(count);
+		for (int& slotIndex : _free)
+		{
+			if (!in.Get(value) || value >= _slots.size()) return false;
+			slotIndex = static_cast<int>(value);
+		}
+		return true;
+	}
+
+private:
+	struct Slot
+	{
+		int dense = -1;        // where it lives in the packed arrays, -1 when free
+		uint32_t generation = 1;
+	};
+
+	static Handle MakeHandle(int slotIndex, uint32_t generation)
+	{
+		return (generation << 16) | static_cast<uint32_t>(slotIndex);
+	}
+
+	static void BumpGeneration(Slot& slot)
+	{
+		slot.generation = slot.generation >= SLOT_MAP_MAX_GEN ? 1 : slot.generation + 1;
+	}
+
+	std::vector<Slot> _slots;
+	std::vector<int> _dense; // dense index -> slot
+	std::vector<int> _free;
+	int _maxSlots = SLOT_MAP_MAX_SLOTS;
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*******************************************************************************
+ * STATE_UPDATE chunks
+ *
+ * A snapshot is where every ship and asteroid a client can see is at a tick,
+ * read from a published WorldView. It goes out as one or more STATE_UPDATE
+ * chunks with the same tick, each complete on its own so a client can apply
+ * whichever ones arrive:
+ *   [tick][time][ship count][ships][asteroid count][asteroids]
+ * ships are [id + ship state] and asteroids [handle + x,y + vel x,y + dir].
+ *
+ * Ships go first, as many as fit, then as many asteroids as fit after them.
+ * SendSnapshot gathers once for everyone, or per client with interest on, and
+ * packs what it gathered.
+ ******************************************************************************/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "Interest.h"
+#include "Packet.h"
+#include "WorldView.h"
+
+#define SNAPSHOT_HEADER_LEN 20
+#define SNAPSHOT_SHIP_LEN 28
+#define SNAPSHOT_ASTEROID_LEN 24
+
+// [pos x,y][vel x,y][dir][score] from a published view, zeros for a slot the view doesnt have yet
+inline void WriteShipState(const WorldView& view, Packet& packet, int shipID)
+{
+	if (shipID < 0 || shipID >= view.slots)
+	{
+		packet << 0.0f << 0.0f << 0.0f << 0.0f << 0.0f << 0;
+		return;
+	}
+	packet << view.shipX[shipID] << view.shipY[shipID];
+	packet << view.shipVelX[shipID] << view.shipVelY[shipID];
+	packet << view.shipDir[shipID] << view.score[shipID];
+}
+
+// what goes in a snapshot, ship slots and asteroid indices into the view
+struct SnapshotContents
+{
+	std::vector<int> shipIDs;
+	std::vector<int> asteroidIndices;
+};
+
+// everything in the sim, or only what interest says the client has when there is one
+inline void GatherSnapshot(const WorldView& view, const InterestSet* interest, SnapshotContents& contents)
+{
+	contents.shipIDs.clear();
+	contents.asteroidIndices.clear();
+	for (int i = 0; i < view.slots; ++i)
+	{
+		if (!view.inSim[i]) continue;
+		if (interest && !interest->SeesShip(i)) continue;
+		contents.shipIDs.push_back(i);
+	}
+
+	if (!interest)
+	{
+		for (int i = 0; i < view.AsteroidCount(); ++i) contents.asteroidIndices.push_back(i);
+		return;
+	}
+	for (SlotMap::Handle handle : interest->asteroids)
+	{
+		int i = view.FindAsteroid(handle);
+		if (i >= 0) contents.asteroidIndices.push_back(i);
+	}
+}
+
+// appends the chunks to chunks, always at least one so an empty world still ticks.
+// asteroids are moved on by lead seconds, ships only move on ticks
+inline void PackSnapshot(const WorldView& view, const SnapshotContents& contents, uint64_t serverTime, float lead,
+	std::vector<Packet>& chunks)
+{
+	const std::vector<int>& shipIDs = contents.shipIDs;
+	const std::vector<int>& asteroidIndices = contents.asteroidIndices;
+	size_t ship = 0;
+	size_t asteroid = 0;
+	do
+	{
+		Packet pck(STATE_UPDATE);
+		pck << view.tick << serverTime;
+
+		int shipCount = (int)std::min(shipIDs.size() - ship,
+			(size_t)((MAX_BODY_LEN - SNAPSHOT_HEADER_LEN) / SNAPSHOT_SHIP_LEN));
+		pck << shipCount;
+		for (int n = 0; n < shipCount; ++n, ++ship)
+		{
+			pck << shipIDs[ship];
+			WriteShipState(view, pck, shipIDs[ship]);
+		}
+
+		int asteroidSpace = (int)(MAX_BODY_LEN - pck.writePos - sizeof(int)) / SNAPSHOT_ASTEROID_LEN;
+		int asteroidCount = (int)std::min(asteroidIndices.size() - asteroid, (size_t)std::max(asteroidSpace, 0));
+		pck << asteroidCount;
+		for (int n = 0; n < asteroidCount; ++n, ++asteroid)
+		{
+			int i = asteroidIndices[asteroid];
+			pck << (int)view.asteroidHandle[i];
+			pck << view.asteroidX[i] + view.asteroidVelX[i] * lead;
+			pck << view.asteroidY[i] + view.asteroidVelY[i] * lead;
+			pck << view.asteroidVelX[i] << view.asteroidVelY[i];
+			pck << view.asteroidDir[i];
+		}
+
+		chunks.push_back(pck);
+	} while (ship < shipIDs.size() || asteroid < asteroidIndices.size());
+}
+
+#endif
@@ -0,0 +1,244 @@
+/*******************************************************************************
+ * Uniform grid broad phase + swept narrow phase
+ *
+ * The world gets cut into fixed size cells. Every tick the simulation clears
+ * the grid, drops each asteroid into the cells its (swept) box touches and
+ * then only tests bullets and ships against whatever sits in the cells they
+ * touch, instead of against every asteroid.
+ *
+ * Build is a counting sort into one flat array so nothing gets allocated once
+ * the vectors have grown to the entity count.
+ *
+ * The narrow phase tests over the whole step (both things moving in a straight
+ * line), so a fast bullet cant skip through a small asteroid between ticks.
+ ******************************************************************************/
+
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+class SpatialHash
+{
+public:
+	void Reset(float minX, float minY, float maxX, float maxY, float cellSize)
+	{
+		_minX = minX;
+		_minY = minY;
+		_invCell = 1.0f / cellSize;
+		_cols = std::max(1, static_cast<int>(std::ceil((maxX - minX) * _invCell)));
+		_rows = std::max(1, static_cast<int>(std::ceil((maxY - minY) * _invCell)));
+		_cellStart.assign(static_cast<size_t>(_cols) * _rows + 1, 0);
+		Clear();
+	}
+
+	bool Ready() const { return _cols > 0; }
+
+	// start of a rebuild, keeps the memory
+	void Clear()
+	{
+		_pending.clear();
+		_items.clear();
+		_built = false;
+	}
+
+	// id has to be small and non negative, its used to index the dedup stamps
+	void Insert(int id, float minX, float minY, float maxX, float maxY)
+	{
+		int x0, y0, x1, y1;
+		CellRange(minX, minY, maxX, maxY, x0, y0, x1, y1);
+		for (int y = y0; y <= y1; ++y)
+		{
+			for (int x = x0; x <= x1; ++x)
+			{
+				_pending.push_back({ y * _cols + x, id });
+			}
+		}
+		if (id >= static_cast<int>(_stamps.size())) _stamps.resize(id + 1, 0);
+	}
+
+	// sorts everything that was inserted by cell
+	void Build()
+	{
+		std::fill(_cellStart.begin(), _cellStart.end(), 0);
+		for (const Entry& e : _pending) ++_cellStart[e.cell + 1];
+		for (size_t c = 1; c < _cellStart.size(); ++c) _cellStart[c] += _cellStart[c - 1];
+
+		_items.resize(_pending.size());
+		_cursor.assign(_cellStart.begin(), _cellStart.end() - 1);
+		for (const Entry& e : _pending) _items[_cursor[e.cell]++] = e.id;
+		_built = true;
+	}
+
+	// fn(id) once for every id that shares a cell with the box
+	template <typename TFn>
+	void Query(float minX, float minY, float maxX, float maxY, TFn&& fn)
+	{
+		if (!_built) return;
+
+		// new stamp per query so an id sitting in several cells only comes out once
+		if (++_queryStamp == 0)
+		{
+			std::fill(_stamps.begin(), _stamps.end(), 0);
+			_queryStamp = 1;
+		}
+
+		int x0, y0, x1, y1;
+		CellRange(minX, minY, maxX, maxY, x0, y0, x1, y1);
+		for (int y = y0; y <= y1; ++y)
+		{
+			for (int x = x0; x <= x1; ++x)
+			{
+				int cell = y * _cols + x;
+				for (int i = _cellStart[cell]; i < _cellStart[cell + 1]; ++i)
+				{
+					int id = _items[i];
+					if (_stamps[id] == _queryStamp) continue;
+					_stamps[id] = _queryStamp;
+					fn(id);
+				}
+			}
+		}
+	}
+
+	// same as Query but without the dedup, so an id in several cells comes out once per
+	// cell. nothing gets written, several threads can run these on one grid at once
+	template <typename TFn>
+	void QueryShared(float minX, float minY, float maxX, float maxY, TFn&& fn) const
+	{
+		if (!_built) return;
+
+		int x0, y0, x1, y1;
+		CellRange(minX, minY, maxX, maxY, x0, y0, x1, y1);
+		for (int y = y0; y <= y1; ++y)
+		{
+			for (int x = x0; x <= x1; ++x)
+			{
+				int cell = y * _cols + x;
+				for (int i = _cellStart[cell]; i < _cellStart[cell + 1]; ++i)
+				{
+					fn(_items[i]);
+				}
+			}
+		}
+	}
+
+private:
+	struct Entry
+	{
+		int cell;
+		int id;
+	};
+
+	// anything outside the grid gets clamped onto the border cells
+	void CellRange(float minX, float minY, float maxX, float maxY, int& x0, int& y0, int& x1, int& y1) const
+	{
+		x0 = ClampCell(static_cast<int>(std::floor((minX - _minX) * _invCell)), _cols);
+		y0 = ClampCell(static_cast<int>(std::floor((minY - _minY) * _invCell)), _rows);
+		x1 = ClampCell(static_cast<int>(std::floor((maxX - _minX) * _invCell)), _cols);
+		y1 = ClampCell(static_cast<int>(std::floor((maxY - _minY) * _invCell)), _rows);
+	}
+
+	static int ClampCell(int c, int count)
+	{
+		return c < 0 ? 0 : (c >= count ? count - 1 : c);
+	}
+
+	float _minX = 0.0f;
+	float _minY = 0.0f;
+	float _invCell = 1.0f;
+	int _cols = 0;
+	int _rows = 0;
+	bool _built = false;
+
+	std::vector<Entry> _pending;
+	std::vector<int> _cellStart; // cells + 1, items of cell c are [start[c], start[c+1])
+	std::vector<int> _cursor;
+	std::vector<int> _items;
+	std::vector<uint32_t> _stamps;
+	uint32_t _queryStamp = 0;
+};
+
+// position is where the thing ended up this step, vel is what it moved with
+struct SweptBox
+{
+	float x, y;
+	float halfW, halfH;
+	float vx, vy;
+};
+
+struct SweptCircle
+{
+	float x, y;
+	float radius;
+	float vx, vy;
+};
+
+// box covering where it was at the start of the step and where it is now
+inline void SweptBounds(const SweptBox& b, float dt, float& minX, float& minY, float& maxX, float& maxY)
+{
+	float startX = b.x - b.vx * dt;
+	float startY = b.y - b.vy * dt;
+	minX = std::min(startX, b.x) - b.halfW;
+	maxX = std::max(startX, b.x) + b.halfW;
+	minY = std::min(startY, b.y) - b.halfH;
+	maxY = std::max(startY, b.y) + b.halfH;
+}
+
+// did the two boxes touch at any point during the last dt
+inline bool SweptBoxHit(const SweptBox& a, const SweptBox& b, float dt)
+{
+	// work in a's frame, b moves by the difference
+	float dx = (b.x - b.vx * dt) - (a.x - a.vx * dt);
+	float dy = (b.y - b.vy * dt) - (a.y - a.vy * dt);
+	float vx = (b.vx - a.vx) * dt;
+	float vy = (b.vy - a.vy) * dt;
+	float hx = a.halfW + b.halfW;
+	float hy = a.halfH + b.halfH;
+
+	float tEnter = 0.0f;
+	float tExit = 1.0f;
+
+	// slab test per axis, t in [0,1] over the step
+	auto slab = [&](float d, float v, float h)
+	{
+		if (v == 0.0f) return std::fabs(d) <= h;
+
+		float t0 = (-h - d) / v;
+		float t1 = (h - d) / v;
+		if (t0 > t1) std::swap(t0, t1);
+		tEnter = std::max(tEnter, t0);
+		tExit = std::min(tExit, t1);
+		return tEnter <= tExit;
+	};
+
+	return slab(dx, vx, hx) && slab(dy, vy, hy);
+}
+
+inline bool SweptCircleHit(const SweptCircle& a, const SweptCircle& b, float dt)
+{
+	float dx = (b.x - b.vx * dt) - (a.x - a.vx * dt);
+	float dy = (b.y - b.vy * dt) - (a.y - a.vy * dt);
+	float vx = (b.vx - a.vx) * dt;
+	float vy = (b.vy - a.vy) * dt;
+	float r = a.radius + b.radius;
+
+	// |d + v t| = r, already touching at the start counts
+	float c = dx * dx + dy * dy - r * r;
+	if (c <= 0.0f) return true;
+
+	float aa = vx * vx + vy * vy;
+	float bb = dx * vx + dy * vy;
+	if (aa == 0.0f || bb >= 0.0f) return false; // not moving closer
+
+	float disc = bb * bb - aa * c;
+	if (disc < 0.0f) return false;
+
+	float t = (-bb - std::sqrt(disc)) / aa;
+	return t <= 1.0f;
+}
+
+#endif
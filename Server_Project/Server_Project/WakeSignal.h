@@ -0,0 +1,51 @@
+/*******************************************************************************
+ * Worker wake up
+ *
+ * A room worker sleeps until the earliest thing one of its rooms has due (the
+ * next tick, snapshot, idle check...) instead of waking every millisecond to
+ * look. Anything another thread hands a room that shouldnt wait that long, a
+ * message queued for a client or a command for the world, notifies the
+ * worker's signal and it gets up straight away.
+ *
+ * A notify that comes in while the worker is busy is remembered, so the next
+ * wait returns at once and nothing queued in between is missed. Several
+ * notifies before the worker gets to it are one wake up.
+ ******************************************************************************/
+
+#ifndef WAKE_SIGNAL_H
+#define WAKE_SIGNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+class WakeSignal
+{
+public:
+	// any thread
+	void Notify()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_signalled) return;
+			_signalled = true;
+		}
+		_cv.notify_one();
+	}
+
+	// the owning worker, true if it was woken before deadline
+	bool WaitUntil(std::chrono::steady_clock::time_point deadline)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		bool woken = _cv.wait_until(lock, deadline, [this] { return _signalled; });
+		_signalled = false;
+		return woken;
+	}
+
+private:
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	bool _signalled = false;
+};
+
+#endif
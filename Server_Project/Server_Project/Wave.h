@@ -0,0 +1,106 @@
+/*******************************************************************************
+ * Asteroid waves
+ *
+ * A wave is 8 asteroids, two coming in from each edge of the screen. Making
+ * one is all random numbers and trig, so the room's worker makes them ahead of
+ * time in the spare part of an update and keeps a few ready in a ring. When a
+ * wave is due the room only copies one out of the ring: no trig, no allocation,
+ * nothing printed.
+ *
+ * Waves still come off the room's rng in the order they always did, so a seed
+ * gives the same waves however far ahead they were made. Reseeding the room
+ * throws away whatever was made from the old seed.
+ ******************************************************************************/
+
+#ifndef WAVE_H
+#define WAVE_H
+
+#include <cmath>
+#include "Game.h"
+#include "Random.h"
+#include "Simulation.h"
+#include "Vec2.h"
+
+#define WAVE_SIZE 8
+// waves made ahead per room, one is plenty at one wave every 10s but a few cover a slow update
+#define WAVE_RING_SIZE 4
+
+struct Wave
+{
+	Asteroid asteroids[WAVE_SIZE];
+};
+
+// somewhere along the edge given by the ranges, heading off at a random angle
+inline Asteroid RandomiseAsteroid(Pcg32& rng, float min_xPos, float max_xPos, float min_yPos, float max_yPos)
+{
+	Asteroid asteroid{};
+	asteroid.xPos = rng.NextFloat(min_xPos, max_xPos);
+	asteroid.yPos = rng.NextFloat(min_yPos, max_yPos);
+	float randAng = rng.NextFloat(0, 360);
+
+	// normalized even though it already is, so a seed still gives the exact waves it used to
+	Carmicah::Vec2f dir(cosf(randAng), sinf(randAng));
+	dir = dir.normalize();
+	dir *= ASTEROID_ACCEL;
+	asteroid.vel_x = dir.x;
+	asteroid.vel_y = dir.y;
+	asteroid.dirCur = randAng;
+	asteroid.xScale = 20.0f;
+	asteroid.yScale = 20.0f;
+	asteroid.active = true;
+	asteroid.ID = -1; // gets its handle when it spawns
+	return asteroid;
+}
+
+inline void MakeWave(Pcg32& rng, Wave& wave)
+{
+	int n = 0;
+	for (int i = 0; i < 2; ++i)
+	{
+		// bottom, top, left, right
+		wave.asteroids[n++] = RandomiseAsteroid(rng, -X_SIZE, X_SIZE, -Y_SIZE, -Y_SIZE);
+		wave.asteroids[n++] = RandomiseAsteroid(rng, -X_SIZE, X_SIZE, Y_SIZE, Y_SIZE);
+		wave.asteroids[n++] = RandomiseAsteroid(rng, -X_SIZE, -X_SIZE, -Y_SIZE, Y_SIZE);
+		wave.asteroids[n++] = RandomiseAsteroid(rng, X_SIZE, X_SIZE, -Y_SIZE, Y_SIZE);
+	}
+}
+
+// fixed size, lives inside the room, only the room's worker touches it
+class WaveRing
+{
+public:
+	int Count() const { return _count; }
+	bool Empty() const { return _count == 0; }
+	bool Full() const { return _count == WAVE_RING_SIZE; }
+
+	// makes the next wave straight into the ring, false when it is already full
+	bool Fill(Pcg32& rng)
+	{
+		if (Full()) return false;
+		MakeWave(rng, _waves[(_head + _count) % WAVE_RING_SIZE]);
+		++_count;
+		return true;
+	}
+
+	const Wave& Front() const { return _waves[_head]; }
+
+	void Pop()
+	{
+		if (Empty()) return;
+		_head = (_head + 1) % WAVE_RING_SIZE;
+		--_count;
+	}
+
+	void Clear()
+	{
+		_head = 0;
+		_count = 0;
+	}
+
+private:
+	Wave _waves[WAVE_RING_SIZE];
+	int _head = 0;
+	int _count = 0;
+};
+
+#endif
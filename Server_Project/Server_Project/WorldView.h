@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * Published world state
+ *
+ * The room's worker owns the live world and changes it all the time: ticks,
+ * but also waves and posted commands in between them. Anything that wants to
+ * read the world without being the worker, or wants the world exactly as it
+ * was at the end of a tick, reads a WorldView instead. The worker copies the
+ * parts readers care about into one after its ticks and publishes it.
+ *
+ * The views live in a triple buffer: the worker always has one to write, the
+ * reader always has one to read, and the third is the latest published one
+ * waiting to be picked up. Publishing and picking up are one atomic exchange
+ * each, so neither side ever waits on the other and a reader never sees half
+ * of a tick. The worker reads what it last published directly, the buffer it
+ * published is never written again until it comes back as the back buffer.
+ *
+ * Capture reuses the vectors, once a room has been at its biggest nothing is
+ * allocated per tick.
+ ******************************************************************************/
+
+#ifndef WORLD_VIEW_H
+#define WORLD_VIEW_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "Network.h"
+
+struct WorldView
+{
+	uint32_t tick = 0;
+	bool gameRunning = false;
+
+	// by player slot, [0, slots)
+	int slots = 0;
+	std::vector<uint8_t> inSim;
+	std::vector<float> shipX, shipY;
+	std::vector<float> shipVelX, shipVelY;
+	std::vector<float> shipDir;
+	std::vector<int> score;
+
+	// packed in the same order as the AsteroidStore they came from, positions at tick
+	std::vector<SlotMap::Handle> asteroidHandle;
+	std::vector<float> asteroidX, asteroidY;
+	std::vector<float> asteroidVelX, asteroidVelY;
+	std::vector<float> asteroidDir;
+	// handle's slot -> index above, -1 for none. the live slot map moves on after a publish
+	std::vector<int> asteroidBySlot;
+	int asteroidsSpawned = 0;
+
+	int AsteroidCount() const { return static_cast<int>(asteroidHandle.size()); }
+
+	// index of the asteroid with this handle, -1 if it wasnt alive at tick
+	int FindAsteroid(SlotMap::Handle handle) const
+	{
+		uint32_t slot = handle & 0xFFFF;
+		if (slot >= asteroidBySlot.size()) return -1;
+		int i = asteroidBySlot[slot];
+		return i >= 0 && asteroidHandle[i] == handle ? i : -1;
+	}
+
+	// room's worker only
+	void Capture(const ServerData& data)
+	{
+		tick = data.tick;
+		gameRunning = data.gameRunning;
+
+		const ShipStore& ships = data.ships;
+		slots = data.totalClients.Slots();
+		inSim.resize(slots);
+		for (int i = 0; i < slots; ++i) inSim[i] = data.totalClients[i].inSim ? 1 : 0;
+		shipX.assign(ships.xPos.begin(), ships.xPos.begin() + slots);
+		shipY.assign(ships.yPos.begin(), ships.yPos.begin() + slots);
+		shipVelX.assign(ships.velX.begin(), ships.velX.begin() + slots);
+		shipVelY.assign(ships.velY.begin(), ships.velY.begin() + slots);
+		shipDir.assign(ships.dir.begin(), ships.dir.begin() + slots);
+		score.assign(ships.score.begin(), ships.score.begin() + slots);
+
+		const AsteroidStore& asteroids = data.asteroids;
+		const int count = asteroids.Count();
+		asteroidHandle.resize(count);
+		asteroidBySlot.assign(asteroids.Capacity(), -1);
+		for (int i = 0; i < count; ++i)
+		{
+			asteroidHandle[i] = asteroids.HandleAt(i);
+			asteroidBySlot[asteroidHandle[i] & 0xFFFF] = i;
+		}
+		asteroidX.assign(asteroids.xPos.begin(), asteroids.xPos.end());
+		asteroidY.assign(asteroids.yPos.begin(), asteroids.yPos.end());
+		asteroidVelX.assign(asteroids.velX.begin(), asteroids.velX.end());
+		asteroidVelY.assign(asteroids.velY.begin(), asteroids.velY.end());
+		asteroidDir.assign(asteroids.dir.begin(), asteroids.dir.end());
+		asteroidsSpawned = asteroids.spawned;
+	}
+};
+
+// one writer, one reader on another thread, see the top of the file
+template <typename T>
+class TripleBuffer
+{
+public:
+	// writer only, fill this in then Publish
+	T& Back() { return _buffers[_back]; }
+
+	// writer only, the view it published last
+	const T& Published() const { return _buffers[_published]; }
+
+	void Publish()
+	{
+		_published = _back;
+		_back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// reader only, the newest published view. stays valid until the reader calls this again
+	const T& Read()
+	{
+		if (_middle.load(std::memory_order_relaxed) & FRESH)
+		{
+			_front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+		}
+		return _buffers[_front];
+	}
+
+private:
+	static const uint8_t INDEX = 0x3;
+	static const uint8_t FRESH = 0x4;
+
+	T _buffers[3];
+	uint8_t _back = 0;
+	uint8_t _published = 2;
+	std::atomic<uint8_t> _middle{ 1 };
+	uint8_t _front = 2;
+};
+
+#endif
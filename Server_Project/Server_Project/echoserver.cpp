@@ -34,18 +34,26 @@ prior written consent of DigiPen Institute of Technology is prohibited.
 #include <random>
 #include <mutex>
 #include <queue>
+#include <thread>
 #include "Vec2.h"
  // Tell the Visual Studio linker to include the following library in linking.
  // Alternatively, we could add this file to the linker command-line parameters,
  // but including it in the source code simplifies the configuration.
 #pragma comment(lib, "ws2_32.lib")
 #include <cstdio>
+#include <ctime>
 #include <iostream>			   // cout, cerr
 #include <string>			     // string
 #include "Packet.h"
 #include "Network.h"
 #include "taskqueue.h"
 #include "highscores.h"
+#include "ServerSettings.h"
+#include "NetEmulator.h"
+#include "Simulation.h"
+#include "Room.h"
+#include "WakeSignal.h"
+#include "Snapshot.h"
 
 //#define WINSOCK_VERSION     2
 #define WINSOCK_SUBVERSION  2
@@ -68,133 +76,148 @@ prior written consent of DigiPen Institute of Technology is prohibited.
 #define TIMEOUT_MS 500
 #define PRINTOUT_MS 1500
 #define MAX_RETRIES 5
-#define PACKET_LOSS_RATE 0.02
-#define SIMULATE_PACKET_LOSS false
 // these scores defines may need to be commented out
 #define REQ_SUBMIT_SCORE ((unsigned char)0x6)
 #define RSP_SUBMIT_SCORE ((unsigned char)0x7)
 #define REQ_GET_SCORES ((unsigned char)0x8)
 #define RSP_GET_SCORES ((unsigned char)0x9)
 #define SLEEP_TIME 0
-const float			FIXED_DELTA_TIME = 0.01667f; // Fixed time step for 60 FPS
-#define X_SIZE 640
-#define Y_SIZE 360
-const float         ASTEROID_ACCEL = 100.0f;
-#define ASTEROID_SCORE 100;
+#define MAX_TICKS_PER_UPDATE 5 // sim ticks FixedUpdate will run back to back before giving up on catching up
+#define INPUT_BURST 3 // input frames a client can run ahead of real time to catch up after a late packet
+#define MAX_QUEUED_INPUTS 12 // input frames a client can have waiting for their tick, past that the oldest go
+// how far a shooter's muzzle can be from where the server had its ship and still be used
+#define REWIND_CLAIM_TOLERANCE 30.0f
+// [count][kind + id + ship state], the biggest ENTITY_ENTER entry. small enough for fec to wrap
+#define ENTITIES_PER_PACKET ((FEC_MAX_BODY_LEN - 4) / 29)
 
 
 // Add these new handler functions:
 void HandleSubmitScore(char *buffer, SOCKET clientSocket);
-void ProcessPlayerDisconnect(const char *buffer, int recvLen);
-void ProcessPlayerJoin(const sockaddr_in &clientAddr, const char *buffer, int recvLen);
+void ProcessPlayerDisconnect(Room& room, const char *buffer, int recvLen);
+void ProcessPlayerJoin(Room& room, const sockaddr_in &clientAddr, const char *buffer, int recvLen);
 void HandleGetScores(SOCKET clientSocket);
-void FixedUpdate();
+void FixedUpdate(Room& room);
 void UDPSendingHandler();
 void UDPReceiveHandler(SOCKET udpListenerSocket);
-void ProcessShipMovement(const sockaddr_in& clientAddr, const char* buffer, int recvLen);
-void ForwardPacket(const sockaddr_in& clientAddr, const char* buffer, int recvLen);
-void ProcessBulletFired(const sockaddr_in &clientAddr, const char *buffer, int recvLen);
+void ProcessShipMovement(Room& room, const sockaddr_in& clientAddr, const char* buffer, int recvLen);
+void ForwardPacket(Room& room, const sockaddr_in& clientAddr, const char* buffer, int recvLen);
+void ProcessBulletFired(Room& room, const sockaddr_in &clientAddr, const char *buffer, int recvLen);
 void ProcessBulletCollision(uint32_t bulletID, uint32_t targetID, uint8_t targetType);
 void ProcessAsteroidCreated(const sockaddr_in &clientAddr, const char *buffer, int recvLen);
 void ProcessAsteroidDestroyed(const char *buffer, int recvLen);
 void ProcessShipCollision(const char *buffer, int recvLen);
 
-void HandleHighscoreRequest(const sockaddr_in &clientAddr);
+void HandleHighscoreRequest(Room& room, const sockaddr_in &clientAddr);
 void HandleNewHighscore(const char *buffer, int recvLen, const sockaddr_in &clientAddr);
-void BroadcastHighScores();
+void BroadcastHighScores(Room& room);
 
 void ProcessReplyPlayerJoin(const sockaddr_in &clientAddr, const char *buffer, int recvLen);
 void ProcessNewPlayerJoin(const sockaddr_in &clientAddr, const char *buffer, int recvLen);
 void ProcessGameStart(const sockaddr_in &clientAddr, const char *buffer, int recvLen);
 void ProcessPacketError(const sockaddr_in &clientAddr, const char *buffer, int recvLen);
 
-void ClientHandleHighscoreRequest(const sockaddr_in &clientAddr, const char *buffer, int recvLen);
-
-void RespawnShip(uint32_t playerID);
+void ClientHandleHighscoreRequest(Room& room, const sockaddr_in &clientAddr, const char *buffer, int recvLen);
+
+void RespawnShip(Room& room, int playerID);
+
+void ProcessDatagram(const sockaddr_in& recvAddr, const char* buffer, int recvLen);
+bool SendDatagram(const char* buffer, int len, const sockaddr_in& addr);
+void ProcessTimeSync(const sockaddr_in& clientAddr, const char* buffer, int recvLen);
+bool ReadBodyLength(const char* buffer, int recvLen, uint32_t& msgLength);
+uint64_t GetServerTime();
+void ProcessKeepAlive(Room& room, const char* buffer, int recvLen);
+void DisconnectClient(Room& room, int playerID, const char* reason);
+void CheckIdleClients(Room& room);
+uint64_t GetAddressKey(const sockaddr_in& addr);
+sockaddr_in AddressFromKey(uint64_t addrKey);
+int SenderSlot(Room& room, const sockaddr_in& addr);
+void ReleaseInputs(Room& room, double tickLength);
+bool IsFecProtected(char msgID);
+bool SendClientDatagram(Room& room, int clientIndex, const char* buffer, int len, const sockaddr_in& addr);
+void FlushFecGroups(Room& room, bool force);
+void QueueTo(Room& room, int clientIndex, const Packet& packet);
+void QueueToAll(Room& room, const Packet& packet, int except = -1);
+void FlushOutboxes(Room& room);
+bool MarkOutboxPending(Room& room);
+bool FlushDue(Room& room);
+void WakeWorker(Room& room);
+std::chrono::steady_clock::time_point RoomNextDue(Room& room);
+void PrintOutboxStats(Room& room);
+void BroadcastSimEvents(Room& room, const SimEvents& events);
+void WriteShipState(Room& room, Packet& packet, int shipID);
+void RoomWorker(int worker, int workerCount);
+void UpdateInterest(Room& room);
+void SendSnapshot(Room& room);
+bool RecordingOps();
+void RecordLockstep(Room& room, const LockstepOp& op);
+void StartJournal(Room& room);
+void BuildLockstepFrame(Room& room, std::vector<LockstepOp>& ops);
+void QueueLockstepFrame(Room& room, uint32_t tick, uint32_t checksum, const std::vector<LockstepOp>& ops);
+void ProcessLockstepChecksum(Room& room, const char* buffer, int recvLen);
+void CheckLockstepChecksum(Room& room, const SimCommand& command);
+void FireBullet(Room& room, const SimCommand& command);
+void JoinShip(Room& room, const SimCommand& command);
+void PostCommand(Room& room, const SimCommand& command);
+void DrainInbox(Room& room);
+void UpdateRoom(Room& room);
+bool AnyoneConnected(Room& room);
+void UpdateMatch(Room& room, std::chrono::steady_clock::time_point currTime);
+void SetMatchState(Room& room, MATCH_STATE state);
+void StartMatch(Room& room);
+void EndMatch(Room& room);
+void ResetMatch(Room& room);
 
 static int userCount = 0;
 
-std::mutex lockMutex;
-std::queue<MessageData> messageQueue;
-
-static ServerData serverData;
-bool gameOver = false;
+// every match this process is hosting, see Room.h
+static RoomManager rooms;
+// topScores and the high score file are shared by every room
+std::mutex highScoreMutex;
 
 SOCKET udpListenerSocket = INVALID_SOCKET;
 std::string filePath;
-std::mt19937 generator;
-std::uniform_real_distribution dis(0.0, 1.0);
-double accumulatedTime = 0.0;
+static ServerSettings serverSettings;
+std::mt19937 tokenGenerator;
+// helpers for splitting up a big room's tick, shared by every room
+static JobSystem simJobs;
+// only active when serverSettings.netScenario points at a script
+static NetEmulator<sockaddr_in> netEmulator;
+// one per room worker, set up before they start
+static std::unique_ptr<WakeSignal[]> workerWake;
+static int roomWorkerCount = 1;
+// which worker this thread is, -1 for any other thread
+static thread_local int currentWorker = -1;
+
+// how often a room does its periodic jobs, UpdateRoom does them and RoomNextDue sleeps until them
+const std::chrono::duration<double> printInterval(1.0); // every 1 s? idk for now
+const std::chrono::duration<double> waveInterval(10.0); // every 10?
+const std::chrono::duration<double> idleCheckInterval(0.25);
+
+// the clock every client syncs to, timestamps on the wire are ms on this clock
+const std::chrono::steady_clock::time_point serverStartTime = std::chrono::steady_clock::now();
 
 bool debugPrint = false;
 
-float generateRandomFloat(float min, float max) {
-	// Create a random engine (using the current time as a seed)
-	std::random_device rd;
-	std::mt19937 gen(rd());
-
-	// Create a uniform distribution in the range [min, max]
-	std::uniform_real_distribution<> dis(min, max);
-
-	// Generate a random float
-	return (float)dis(gen);
-}
-
-Asteroid RandomiseAsteroid(float min_xPos, float max_xPos, float min_yPos, float max_yPos)
+// puts a wave asteroid into the room and tells lockstep peers/the journal about it.
+// returns its handle, SlotMap::INVALID when the room is full. room's worker only
+int SpawnAsteroid(Room& room, const Asteroid& asteroid)
 {
-	Carmicah::Vec2f pos, vel, scale;
-	pos.x = generateRandomFloat(min_xPos, max_xPos);//AERandFloat() * (max_xPos - min_xPos) + min_xPos;
-	pos.y = generateRandomFloat(min_yPos, max_yPos);//AERandFloat() * (max_yPos - min_yPos) + min_yPos;
-	float randAng = generateRandomFloat(0, 360);//AERandFloat() * 360;
-
-	Carmicah::Vec2f dir(cosf(randAng), sinf(randAng));
-	//AEVec2Set(&dir, cosf(randAng), sinf(randAng));
-	dir = dir.normalize();
-	//AEVec2Normalize(&dir, &dir);
-	vel = Carmicah::Vec2f(0, 0);
-	//AEVec2Zero(&ve
-	dir *= ASTEROID_ACCEL;
-	//AEVec2Scale(&dir, &dir, ASTEROID_ACCEL);
-	//AEVec2Add(&vel, &vel, &dir);
-	vel += dir;
-
-	float randScaleX = 20.0f;// AERandFloat() * (ASTEROID_MAX_SCALE_X - ASTEROID_MIN_SCALE_X) + ASTEROID_MIN_SCALE_X;
-	float randScaleY = 20.0f; //AERandFloat() * (ASTEROID_MAX_SCALE_Y - ASTEROID_MIN_SCALE_Y) + ASTEROID_MIN_SCALE_Y;
-	//AEVec2Set(&scale, randScaleX, randScaleY);
-	scale = Carmicah::Vec2f(randScaleX, randScaleY);
-
-	Asteroid newAsteroid;
-	newAsteroid.xPos = pos.x;
-	newAsteroid.yPos = pos.y;
-	newAsteroid.dirCur = randAng;
-	newAsteroid.vel_x = vel.x;
-	newAsteroid.vel_y = vel.y;
-	newAsteroid.xScale = randScaleX;
-	newAsteroid.yScale = randScaleY;
-	newAsteroid.active = true;
-	newAsteroid.creationTime = std::chrono::steady_clock::now();
-
-	//for (int i = 0; i < MAX_ASTEROIDS; ++i)
-	//{
-	//	if (serverData.totalAsteroids[i].active == false)
-	//	{
-	//		newAsteroid.ID = i;
-	//		serverData.totalAsteroids[i] = newAsteroid;
-	//		break;
-	//	}
-	//}
-
-	newAsteroid.ID = serverData.activeAsteroids;
-	serverData.totalAsteroids[serverData.activeAsteroids] = newAsteroid;
-	std::cout << "Creating Asteroid " << newAsteroid.ID << std::endl;
-
-	serverData.activeAsteroids++;
-	serverData.numOfAsteroids++;
-
-	return newAsteroid;
-
-	// Create after randomising
-	//CreateAsteroid(pos, vel, scale);
+	// slot map handle, thats the id clients know it by
+	int id = (int)room.data.asteroids.Add(asteroid, room.data.tick);
+	if (id == (int)SlotMap::INVALID) return id;
+
+	LockstepOp op;
+	op.op = LOCKSTEP_ASTEROID;
+	op.id = id;
+	op.v[0] = asteroid.xPos;
+	op.v[1] = asteroid.yPos;
+	op.v[2] = asteroid.vel_x;
+	op.v[3] = asteroid.vel_y;
+	op.v[4] = asteroid.dirCur;
+	op.v[5] = asteroid.xScale;
+	op.v[6] = asteroid.yScale;
+	RecordLockstep(room, op);
+	return id;
 }
 
 int main()
@@ -207,8 +230,28 @@ int main()
 	std::getline(std::cin, input);
 	std::string portStringUDP = input;
 
-	unsigned seed = (unsigned int)std::chrono::system_clock::now().time_since_epoch().count();
-	generator = std::mt19937(seed);
+	serverSettings = LoadServerSettings();
+
+	tokenGenerator.seed(std::random_device{}());
+	// rooms open as players arrive, nothing is allocated for one until someone needs it
+	// enough frames of history to rewind maxRewindMs at the tick rate, plus one either side
+	int historyFrames = (int)std::ceil(serverSettings.maxRewindMs * 0.001f * serverSettings.tickRate) + 2;
+	rooms.Reserve(serverSettings.maxRooms, serverSettings.maxPlayers, serverSettings.maxAsteroids, historyFrames,
+		serverSettings.waveSeed);
+
+	if (!serverSettings.netScenario.empty())
+	{
+		std::vector<NetScenarioStep> steps;
+		if (LoadNetScenario(serverSettings.netScenario, steps))
+		{
+			unsigned seed = serverSettings.netSeed;
+			if (seed == 0)
+				seed = (unsigned int)std::chrono::system_clock::now().time_since_epoch().count();
+
+			std::cout << "Network emulation on, seed " << seed << std::endl;
+			netEmulator.Start(steps, seed);
+		}
+	}
 
 	//srand((unsigned int)time(NULL));
 
@@ -325,533 +368,1272 @@ int main()
 	//std::thread fixedUpdateThread(FixedUpdate);
 	//std::thread udpSendThread(UDPSendingHandler);
 
-	const auto interval = std::chrono::duration<double>(0.005); // every 5 ms? idk for now
-	auto lastSendTime = std::chrono::steady_clock::now();
+	// rooms are spread over the workers by id, one worker per core
+	int workerCount = serverSettings.roomThreads;
+	if (workerCount <= 0) workerCount = std::max(1, (int)std::thread::hardware_concurrency());
+	std::cout << "Hosting up to " << serverSettings.maxRooms << " rooms on " << workerCount << " threads" << std::endl;
 
-	auto lastPrintTime = std::chrono::steady_clock::now();
-	const auto printInterval = std::chrono::duration<double>(1.0); // every 1 s? idk for now
+	// the room's own worker counts as one of these, it helps with its own jobs
+	int simThreads = serverSettings.simThreads;
+	if (simThreads <= 0) simThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	simJobs.Start(simThreads);
 
-	auto lastWaveTime = std::chrono::steady_clock::now();
-	const auto waveInterval = std::chrono::duration<double>(10.0); // every 10?
+	if (!serverSettings.journalDir.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(serverSettings.journalDir, error);
+		if (error)
+		{
+			std::cerr << "Couldnt make journalDir " << serverSettings.journalDir << ", not journalling" << std::endl;
+			serverSettings.journalDir.clear();
+		}
+	}
 
-	auto startTime = std::chrono::steady_clock::now();
-	const auto gameTime = std::chrono::duration<double>(120.0);
+	roomWorkerCount = workerCount;
+	workerWake.reset(new WakeSignal[workerCount]);
 
-	serverData.gameRunning = false;
+	std::vector<std::thread> roomWorkers;
+	for (int i = 0; i < workerCount; ++i)
+	{
+		roomWorkers.emplace_back(RoomWorker, i, workerCount);
+	}
 
 	while (true)
 	{
-		auto currTime = std::chrono::steady_clock::now();
+		// push out anything the emulator has finished delaying
+		if (netEmulator.Enabled())
+		{
+			netEmulator.Deliver(NET_DIR_DOWN, [](const sockaddr_in& addr, const char* data, int len)
+				{
+					sendto(udpListenerSocket, data, len, 0, (sockaddr*)&addr, sizeof(addr));
+				});
+		}
+
+		Sleep(1);
+	}
+	// -------------------------------------------------------------------------
+	// Clean-up after Winsock.
+	//
+	// WSACleanup()
+	// -------------------------------------------------------------------------
+
+	WSACleanup();
+}
+
+// worker w owns the rooms where id % workerCount == w, new rooms get picked up
+// as they open since the loop goes to Count() every pass
+void RoomWorker(int worker, int workerCount)
+{
+	currentWorker = worker;
+	while (true)
+	{
+		// a room opening wakes us with its join reply, this is only a backstop
+		auto wakeAt = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		for (int i = worker; i < rooms.Count(); i += workerCount)
+		{
+			UpdateRoom(rooms[i]);
+			wakeAt = std::min(wakeAt, RoomNextDue(rooms[i]));
+		}
+
+		// asleep until a room has something due or another thread hands one something
+		workerWake[worker].WaitUntil(wakeAt);
+	}
+}
+
+// the soonest UpdateRoom has anything to do for this room. room's worker only
+std::chrono::steady_clock::time_point RoomNextDue(Room& room)
+{
+	auto after = [](std::chrono::steady_clock::time_point from, std::chrono::duration<double> wait)
+	{
+		return from + std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait);
+	};
+
+	auto due = std::min(after(room.lastIdleCheck, idleCheckInterval), after(room.lastPrintTime, printInterval));
+	if (room.data.gameRunning)
+	{
+		// whatever FixedUpdate has banked, the next tick is due once a whole one is
+		const double tickLength = 1.0 / serverSettings.tickRate;
+		due = std::min(due, after(room.lastUpdate, std::chrono::duration<double>(tickLength - room.accumulatedTime)));
+		due = std::min(due, after(room.lastWaveTime, waveInterval));
+		if (!serverSettings.lockstep)
+		{
+			due = std::min(due, after(room.lastSnapshotTime, std::chrono::duration<double>(1.0 / serverSettings.snapshotRate)));
+		}
+	}
+
+	if (room.matchState == MATCH_ENDED)
+	{
+		due = std::min(due, after(room.matchEndTime, std::chrono::duration<double>(serverSettings.rematchDelay)));
+	}
+
+	std::lock_guard<std::mutex> lock(room.lockMutex);
+	if (room.outboxPending)
+	{
+		due = std::min(due, after(room.pendingSince, std::chrono::duration<double>(serverSettings.flushWindowMs / 1000.0)));
+	}
+	return due;
+}
+
+// gets the room's worker up now rather than at its next tick. a no-op on the worker
+// itself, it looks at everything again before it sleeps
+void WakeWorker(Room& room)
+{
+	int worker = room.id % roomWorkerCount;
+	if (worker == currentWorker || !workerWake) return;
+	workerWake[worker].Notify();
+}
+
+// one pass over a room, only ever called from the worker that owns it
+void UpdateRoom(Room& room)
+{
+	auto currTime = std::chrono::steady_clock::now();
+
+	const auto snapshotInterval = std::chrono::duration<double>(1.0 / serverSettings.snapshotRate);
+
+	if (currTime - room.lastIdleCheck >= idleCheckInterval)
+	{
+		room.lastIdleCheck = currTime;
+		CheckIdleClients(room);
+	}
+
+	// whatever came in since the last update lands before the tick that uses it
+	DrainInbox(room);
+
+	// world ticks at serverSettings.tickRate, separate from when the outboxes go out
+	FixedUpdate(room);
+
+	// the match ending, the rematch, the room emptying out
+	UpdateMatch(room, currTime);
+
+	if (currTime - room.lastPrintTime >= printInterval)
+	{
+		room.lastPrintTime = currTime;
+		PrintOutboxStats(room);
+	}
+
+	if (currTime - room.lastWaveTime >= waveInterval)
+	{
+		room.lastWaveTime = currTime;
 
-		if (currTime - lastPrintTime >= printInterval)
+		
+		// destroyed asteroids free their slot, so this only waits on room
+		if (room.data.gameRunning && (room.data.asteroids.Count() + WAVE_SIZE) <= room.data.asteroids.Capacity())
 		{
-			lastPrintTime = currTime;
+			// only empty if updates havent had a spare moment since the room opened
+			if (room.waves.Empty()) room.waves.Fill(room.rng);
 
-			// if no more asteroids can spawn and all are destroyed
-			if (serverData.activeAsteroids >= (MAX_ASTEROIDS - 1) && serverData.numOfAsteroids <= 1)
+			// clients pick the new ones up from the next snapshot
+			for (const Asteroid& asteroid : room.waves.Front().asteroids)
 			{
-				// game over
-				Packet gameOverPkt(GAME_OVER);
-				int winnerID = 0;
-				//get the highest score player
-				for (int i = 1; i < MAX_CONNECTION; ++i)
-				{
-					if (serverData.totalClients[i].playerShip.score > serverData.totalClients[winnerID].playerShip.score)
-					{
-						winnerID = i;
-					}
-				}
+				SpawnAsteroid(room, asteroid);
+			}
+			room.waves.Pop();
 
-				gameOverPkt << winnerID;
+			if (debugPrint) std::cout << "Room " << room.id << " spawned a wave of " << WAVE_SIZE << std::endl;
+		}
+	}
 
-				LoadHighScores();
-				if (gameOver == false)
-				{
+	// one world snapshot per network tick, the sim can run faster than we send.
+	// lockstep peers work the world out themselves, they only get one when they need it
+	bool snapshotDue = serverSettings.lockstep ? room.keyframeWanted.exchange(false)
+		: currTime - room.lastSnapshotTime >= snapshotInterval;
+	if (room.data.gameRunning && snapshotDue)
+	{
+		room.lastSnapshotTime = currTime;
+		SendSnapshot(room);
+	}
 
-					std::string playerName = "Player_" + std::to_string(winnerID);
+	// whatever is waiting in every client's outbox, as soon as it was queued or
+	// once the first of it has waited flushWindowMs
+	if (FlushDue(room))
+	{
+		FlushOutboxes(room);
 
-					auto now = std::chrono::system_clock::now();
-					std::time_t now_time = std::chrono::system_clock::to_time_t(now);
+		if (serverSettings.fecEnabled)
+		{
+			FlushFecGroups(room, false);
+		}
+	}
 
-					struct tm time_info;
-					// Use localtime_s for safer date-time conversion
-					localtime_s(&time_info, &now_time);
+	// everything due this update is done, use what is left making the next wave
+	room.waves.Fill(room.rng);
+}
 
-					std::stringstream ss;
-					ss << std::put_time(&time_info, "%Y-%m-%d %H:%M:%S");
+// hands a change to the world over to the room's worker, any thread
+void PostCommand(Room& room, const SimCommand& command)
+{
+	// inputs come again in the next few SHIP_MOVEs, the rest the client retries
+	if (!room.inbox.Push(command))
+	{
+		room.inboxFull.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	// inputs only matter to the next tick, which the worker is already waiting for
+	if (command.type != SIM_CMD_INPUT) WakeWorker(room);
+}
 
-					std::string time = ss.str();
-					UpdateHighScores(playerName, serverData.totalClients[winnerID].playerShip.score, time);
-					SaveHighScores();
-					gameOver = true;
-				}
-				// send it to client
-				{
-					MessageData newMessage;
-					newMessage.commandID = gameOverPkt.id;
-					newMessage.sessionID = -1;// sending to the current client's id which is i 
-					newMessage.data = gameOverPkt;
+// everything other threads posted since the last update, in the order they posted it
+void DrainInbox(Room& room)
+{
+	SimCommand command;
+	while (room.inbox.Pop(command))
+	{
+		switch (command.type)
+		{
+		case SIM_CMD_INPUT:
+		{
+			ClientInfo& client = room.data.totalClients[command.id];
+			if (!client.inSim) break;
+			// a client sending faster than it plays only fills its own queue, never the tick
+			if (client.queuedInputs.size() >= MAX_QUEUED_INPUTS) client.queuedInputs.pop_front();
+			client.queuedInputs.push_back(command.flag);
+			break;
+		}
+		case SIM_CMD_BULLET:
+			FireBullet(room, command);
+			break;
+		case SIM_CMD_JOIN:
+			JoinShip(room, command);
+			break;
+		case SIM_CMD_LEAVE:
+		{
+			// out of the world from the next tick on, and peers hear about it with it
+			room.data.totalClients[command.id].inSim = false;
+			RecordLockstep(room, ShipLockstepOp(room.data, command.id));
+			room.data.bullets.RemoveOwner(command.id);
+			LockstepOp dropped;
+			dropped.op = LOCKSTEP_DROP_BULLETS;
+			dropped.id = command.id;
+			RecordLockstep(room, dropped);
+			break;
+		}
+		case SIM_CMD_RESPAWN:
+			RespawnShip(room, command.id);
+			break;
+		case SIM_CMD_CHECKSUM:
+			CheckLockstepChecksum(room, command);
+			break;
+		}
+	}
 
-					std::lock_guard<std::mutex> lock(lockMutex);
-					messageQueue.push(newMessage);
-				}
+	uint32_t dropped = room.inboxFull.exchange(0, std::memory_order_relaxed);
+	if (dropped > 0) std::cerr << "Room " << room.id << " inbox was full, dropped " << dropped << " commands" << std::endl;
+}
 
+// someone is playing in the room right now
+bool AnyoneConnected(Room& room)
+{
+	for (int i = 0; i < room.data.totalClients.Slots(); ++i)
+	{
+		if (room.data.totalClients[i].connected) return true;
+	}
+	return false;
+}
 
-				// Create response packet
-				Packet highscorePacket(CLIENT_REQ_HIGHSCORE);
+// moves the match on when its time. each state's work happens once, on the way in.
+// room's worker only
+void UpdateMatch(Room& room, std::chrono::steady_clock::time_point currTime)
+{
+	// JoinShip starts a match from the lobby
+	const MATCH_STATE state = static_cast<MATCH_STATE>(room.matchState.load());
+	if (state == MATCH_LOBBY) return;
+
+	// no more asteroids can spawn and all are destroyed
+	const bool worldCleared = room.data.asteroids.spawned >= (room.data.asteroids.Capacity() - 1)
+		&& room.data.asteroids.Count() <= 1;
+	const bool rematchDue = currTime - room.matchEndTime >= std::chrono::duration<double>(serverSettings.rematchDelay);
+	const MATCH_STATE next = NextMatchState(state, AnyoneConnected(room), worldCleared, rematchDue);
+	if (next != state) SetMatchState(room, next);
+}
 
-				// Pack number of scores
-				uint16_t numScores = static_cast<uint16_t>(topScores.size());
-				highscorePacket << numScores;
+void SetMatchState(Room& room, MATCH_STATE state)
+{
+	room.matchState = state;
+	switch (state)
+	{
+	case MATCH_LOBBY:
+		std::cout << "Room " << room.id << " is open again." << std::endl;
+		break;
+	case MATCH_RUNNING:
+		StartMatch(room);
+		break;
+	case MATCH_ENDED:
+		EndMatch(room);
+		break;
+	case MATCH_RESETTING:
+		ResetMatch(room);
+		SetMatchState(room, MatchAfterReset(AnyoneConnected(room)));
+		break;
+	}
+}
 
-				// Pack each score
-				for (const auto& score : topScores)
-				{
-					highscorePacket << score.playerName << score.score << score.time;
-				}
+void StartMatch(Room& room)
+{
+	++room.matchNumber;
+	room.data.gameRunning = true;
+	room.accumulatedTime = 0.0;
+	room.lastUpdate = std::chrono::steady_clock::now();
+	// first wave one interval in, same as a room that just opened
+	room.lastWaveTime = room.lastUpdate;
+	// a lockstep peer has to start from exactly our state before the frames mean anything
+	if (serverSettings.lockstep) room.keyframeWanted = true;
+
+	// clients still showing the last match's results clear them and start over
+	Packet startPkt(GAME_START);
+	startPkt << room.matchNumber;
+	QueueToAll(room, startPkt);
+
+	std::cout << "Room " << room.id << " match " << room.matchNumber << " started" << std::endl;
+}
 
-				{
-					MessageData highScoreMsg;
-					highScoreMsg.commandID = highscorePacket.id;
-					highScoreMsg.sessionID = -1;//client.sessionID; // Broadcast to all
-					highScoreMsg.data = highscorePacket;
+// everything a match does when it finishes, once: scores into the file, results out
+void EndMatch(Room& room)
+{
+	room.data.gameRunning = false;
+	room.matchEndTime = std::chrono::steady_clock::now();
+	room.view.Back().Capture(room.data);
+	room.view.Publish();
+
+	// game over
+	Packet gameOverPkt(GAME_OVER);
+	int winnerID = 0;
+	//get the highest score player
+	for (int i = 1; i < room.data.totalClients.Slots(); ++i)
+	{
+		if (room.data.ships.score[i] > room.data.ships.score[winnerID])
+		{
+			winnerID = i;
+		}
+	}
 
-					std::lock_guard<std::mutex> lock(lockMutex);
-					messageQueue.push(highScoreMsg);
-				}
+	gameOverPkt << winnerID;
+
+	// other rooms can finish at the same time
+	std::unique_lock<std::mutex> scoreLock(highScoreMutex);
+	LoadHighScores();
+
+	std::string playerName = "Player_" + std::to_string(winnerID);
+
+	auto now = std::chrono::system_clock::now();
+	std::time_t now_time = std::chrono::system_clock::to_time_t(now);
+
+	struct tm time_info;
+	// Use localtime_s for safer date-time conversion
+	localtime_s(&time_info, &now_time);
+
+	std::stringstream ss;
+	ss << std::put_time(&time_info, "%Y-%m-%d %H:%M:%S");
+
+	std::string time = ss.str();
+	UpdateHighScores(playerName, room.data.ships.score[winnerID], time);
+	SaveHighScores();
+
+	// Create response packet
+	Packet highscorePacket(CLIENT_REQ_HIGHSCORE);
+
+	// Pack number of scores
+	uint16_t numScores = static_cast<uint16_t>(topScores.size());
+	highscorePacket << numScores;
+
+	// Pack each score
+	for (const auto& score : topScores)
+	{
+		highscorePacket << score.playerName << score.score << score.time;
+	}
+	scoreLock.unlock();
+
+	// send it to client
+	QueueToAll(room, gameOverPkt);
+	QueueToAll(room, highscorePacket);
+
+	std::cout << "Room " << room.id << " match " << room.matchNumber << " over, player " << winnerID << " won" << std::endl;
+}
+
+// puts the world back the way a room opens, in place. whoever is connected keeps
+// their slot, session and token, so a rematch needs no rejoin
+void ResetMatch(Room& room)
+{
+	room.data.asteroids.Reset(room.data.asteroids.Capacity());
+	room.data.bullets.Clear();
+	for (int i = 0; i < room.data.totalClients.Slots(); ++i)
+	{
+		ClientInfo& client = room.data.totalClients[i];
+		room.data.ships.ResetMotion(i);
+		room.data.ships.score[i] = 0;
+		client.pendingInputs.clear();
+		client.queuedInputs.clear();
+		client.inputCredit = 0.0f;
+		// everything in range comes in again as an enter
+		client.interest.Clear();
+	}
+	// the tick keeps counting, clients that stay drop snapshots older than the last they saw
+	room.data.history.Clear();
+	room.data.lockstep.Reset();
+	room.data.gameRunning = false;
+	room.view.Back().Capture(room.data);
+	room.view.Publish();
+	room.journal.Close();
+	room.journalFailed = false;
+	room.accumulatedTime = 0.0;
+	room.Seed(rooms.NextSeed());
+}
+
+// false when the socket's send buffer is full, nothing went out then
+bool SendDatagram(const char* buffer, int len, const sockaddr_in& addr)
+{
+	if (netEmulator.Enabled())
+	{
+		// emulator holds on to it until main loop delivers it
+		netEmulator.Submit(NET_DIR_DOWN, buffer, len, addr);
+		return true;
+	}
+
+	if (sendto(udpListenerSocket, buffer, len, 0, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+	{
+		return WSAGetLastError() != WSAEWOULDBLOCK;
+	}
+	return true;
+}
+
+// the few messages where a loss is visible until the next wave, everything else
+// is either resent every tick anyway or not worth the extra bandwidth
+bool IsFecProtected(char msgID)
+{
+	switch (msgID)
+	{
+	case ASTEROID_DESTROYED:
+	case BULLET_COLLIDE:
+	case SHIP_COLLIDE:
+	case GAME_OVER:
+	case ENTITY_ENTER:
+	case ENTITY_LEAVE:
+	case LOCKSTEP_FRAME:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// send to one connected client, wrapping it for fec if its one of the protected messages.
+// false when the socket was full. a wrapped one counts as sent either way, its group
+// can rebuild it and putting it back would give it a second fec sequence
+bool SendClientDatagram(Room& room, int clientIndex, const char* buffer, int len, const sockaddr_in& addr)
+{
+	if (!serverSettings.fecEnabled || !IsFecProtected(buffer[0]))
+	{
+		return SendDatagram(buffer, len, addr);
+	}
+
+	FecEncoder& fec = room.data.totalClients[clientIndex].fec;
+	char wrapped[MAX_STR_LEN];
+	int wrappedLen = fec.Wrap(buffer, len, wrapped);
+	if (wrappedLen == 0)
+	{
+		// too big to protect, just send it plain
+		return SendDatagram(buffer, len, addr);
+	}
+	SendDatagram(wrapped, wrappedLen, addr);
+
+	if (fec.GroupFull())
+	{
+		char parity[MAX_STR_LEN];
+		int parityLen = fec.Close(parity);
+		SendDatagram(parity, parityLen, addr);
+	}
+	return true;
+}
+
+// close off groups that have been open too long so the last message in a quiet
+// period still gets its parity, force sends everything that is open
+void FlushFecGroups(Room& room, bool force)
+{
+	for (int i = 0; i < room.data.totalClients.Slots(); ++i)
+	{
+		ClientInfo& client = room.data.totalClients[i];
+		if (!client.connected || !client.fec.GroupOpen()) continue;
+		if (!force && client.fec.GroupAgeMs() < serverSettings.fecMaxDelayMs) continue;
+
+		sockaddr_in clientAddr;
+		{
+			// a join can be rewriting it on the receive thread
+			std::lock_guard<std::mutex> lock(room.data.clientMutex);
+			clientAddr = AddressFromKey(client.addrKey);
+		}
+
+		char parity[MAX_STR_LEN];
+		int parityLen = client.fec.Close(parity);
+		SendDatagram(parity, parityLen, clientAddr);
+	}
+}
+
+// one client, any thread. dropped if they left before it gets sent
+void QueueTo(Room& room, int clientIndex, const Packet& packet)
+{
+	PayloadRef payload = MakePayload(packet);
 
+	bool first;
+	{
+		std::lock_guard<std::mutex> lock(room.lockMutex);
+		if (clientIndex < 0 || clientIndex >= room.data.totalClients.Slots()) return;
+		room.data.totalClients[clientIndex].outbox.Push(payload, serverSettings.outboxSize);
+		first = MarkOutboxPending(room);
+	}
+	if (first) WakeWorker(room);
+}
 
+// every connected client but except (-1 for nobody), encoded once and shared. any thread
+void QueueToAll(Room& room, const Packet& packet, int except)
+{
+	PayloadRef payload = MakePayload(packet);
+
+	bool first;
+	{
+		std::lock_guard<std::mutex> lock(room.lockMutex);
+		for (int i = 0; i < room.data.totalClients.Slots(); ++i)
+		{
+			ClientInfo& client = room.data.totalClients[i];
+			if (!client.connected || i == except) continue;
+			client.outbox.Push(payload, serverSettings.outboxSize);
+		}
+		first = MarkOutboxPending(room);
+	}
+	if (first) WakeWorker(room);
+}
+
+// call with lockMutex held after queueing, true for the first message since the last flush
+bool MarkOutboxPending(Room& room)
+{
+	if (room.outboxPending) return false;
+	room.outboxPending = true;
+	room.pendingSince = std::chrono::steady_clock::now();
+	return true;
+}
+
+// the room's worker, checked after everything this update queued
+bool FlushDue(Room& room)
+{
+	const auto window = std::chrono::duration<double>(serverSettings.flushWindowMs / 1000.0);
+
+	std::lock_guard<std::mutex> lock(room.lockMutex);
+	return room.outboxPending && std::chrono::steady_clock::now() - room.pendingSince >= window;
+}
+
+// sends every client's outbox, room's worker only. the lock is only held to take an
+// outbox, not while sending it
+void FlushOutboxes(Room& room)
+{
+	{
+		// anything queued from here on marks it again and gets its own flush
+		std::lock_guard<std::mutex> lock(room.lockMutex);
+		room.outboxPending = false;
+	}
+
+	std::deque<PayloadRef> sending;
+	for (int i = 0; i < room.data.totalClients.Slots(); ++i)
+	{
+		ClientInfo& client = room.data.totalClients[i];
+		sockaddr_in clientAddr;
+		{
+			// the address together with the outbox, so a join taking the slot in between
+			// cant get the last player's messages
+			std::lock_guard<std::mutex> clientLock(room.data.clientMutex);
+			std::lock_guard<std::mutex> lock(room.lockMutex);
+			if (!client.connected)
+			{
+				// whatever was queued before they left
+				client.outbox.Clear();
+				continue;
 			}
+			if (client.outbox.Empty()) continue;
+			client.outbox.Take(sending);
+			clientAddr = AddressFromKey(client.addrKey);
+		}
+
+		while (!sending.empty())
+		{
+			const Payload& payload = *sending.front();
+			if (!SendClientDatagram(room, i, payload.bytes, payload.len, clientAddr)) break;
+			sending.pop_front();
+		}
+		if (sending.empty()) continue;
+
+		// the socket is full for everyone, the rest waits for the next flush where the
+		// outbox limit decides what is still worth sending
+		std::lock_guard<std::mutex> lock(room.lockMutex);
+		client.outbox.PutBack(sending, serverSettings.outboxSize);
+		// give the socket a millisecond to drain rather than spinning on it
+		room.outboxPending = true;
+		room.pendingSince = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+		return;
+	}
+}
+
+// once a second, only for clients something was dropped or over the limit for
+void PrintOutboxStats(Room& room)
+{
+	for (int i = 0; i < room.data.totalClients.Slots(); ++i)
+	{
+		OutboxStats stats;
+		{
+			std::lock_guard<std::mutex> lock(room.lockMutex);
+			stats = room.data.totalClients[i].outbox.TakeStats();
 		}
+		if (stats.dropped == 0 && stats.overLimit == 0) continue;
+
+		std::cout << "Room " << room.id << " player " << i << " outbox dropped " << stats.dropped
+			<< " movement, " << stats.overLimit << " over the limit, peak depth " << stats.peak << std::endl;
+	}
+}
+
+void UDPReceiveHandler(SOCKET udpListenerSocket)
+{
+
+	u_long enable = 1;
+	ioctlsocket(udpListenerSocket, FIONBIO, &enable);
+
+	while (true)
+	{
+		char buffer[MAX_STR_LEN];
+		struct sockaddr_in recvAddr;
+		int recvAddrLen = sizeof(recvAddr);
 
+		// receive from client
+		int recvLen = recvfrom(udpListenerSocket, buffer, sizeof(buffer), 0, (struct sockaddr *)&recvAddr, &recvAddrLen);
 
-		if (currTime - lastWaveTime >= waveInterval)
+		if (netEmulator.Enabled())
 		{
-			lastWaveTime = currTime;
+			netEmulator.Deliver(NET_DIR_UP, ProcessDatagram);
+		}
 
-			
-			if (serverData.gameRunning && (serverData.activeAsteroids + 8) <= MAX_ASTEROIDS )
+		if (recvLen == SOCKET_ERROR)
+		{
+			size_t errCode = WSAGetLastError();
+			if (errCode == WSAEWOULDBLOCK)
 			{
-				std::vector<Asteroid> newAsteroids;
+				// emulated packets need to come out on time, so dont nap for long
+				Sleep(netEmulator.Enabled() ? 1 : 50);
+				continue;
+			}
+		}
 
-				for (int i = 0; i < 2; ++i)
-				{
-					// Spawn from bottom of screen
-					newAsteroids.push_back(RandomiseAsteroid(-X_SIZE, X_SIZE, -Y_SIZE, -Y_SIZE));
-					// Spawn from top of screen
-					newAsteroids.push_back(RandomiseAsteroid(-X_SIZE, X_SIZE, Y_SIZE, Y_SIZE));
-					//// Spawn from Left of screen
-					newAsteroids.push_back(RandomiseAsteroid(-X_SIZE, -X_SIZE, -Y_SIZE, Y_SIZE));
-					//// Spawn from Right of screen
-					newAsteroids.push_back(RandomiseAsteroid(X_SIZE, X_SIZE, -Y_SIZE, Y_SIZE));
-				}
+		if (recvLen == 0)
+		{
+			// mutex lock
+			std::cout << "Shutdown" << std::endl;
+			break;
+		}
 
-				Packet asteroidPacket(ASTEROID_CREATED);
+		if (recvLen > 0)
+		{
+			if (netEmulator.Enabled())
+			{
+				netEmulator.Submit(NET_DIR_UP, buffer, recvLen, recvAddr);
+			}
+			else
+			{
+				ProcessDatagram(recvAddr, buffer, recvLen);
+			}
+		}
+	}
+}
 
-				asteroidPacket << (int)newAsteroids.size();
+void ProcessDatagram(const sockaddr_in& recvAddr, const char* buffer, int recvLen)
+{
+	char msgID = buffer[0];
+	uint64_t addrKey = GetAddressKey(recvAddr);
 
-				// pack all the new asteroids into the packet
-				for (int i = 0; i < newAsteroids.size(); ++i)
-				{
-					asteroidPacket << newAsteroids[i].ID;
-					asteroidPacket << newAsteroids[i].xPos;
-					asteroidPacket << newAsteroids[i].yPos;
-					asteroidPacket << newAsteroids[i].vel_x;
-					asteroidPacket << newAsteroids[i].vel_y;
-					asteroidPacket << newAsteroids[i].dirCur;
-				}
+	// clients sync their clock before they are in any room
+	if (msgID == TIME_SYNC)
+	{
+		ProcessTimeSync(recvAddr, buffer, recvLen);
+		return;
+	}
 
-				// send it to client
-				{
-					MessageData newMessage;
-					newMessage.commandID = asteroidPacket.id;
-					//newMessage.sessionID = newClient.sessionID;// sending to the current client's id which is i 
-					newMessage.data = asteroidPacket;
+	// everything else goes to the room the sender is playing in. a join from
+	// someone new gets put in a room, anything else from a stranger is dropped
+	Room* target = rooms.Find(addrKey);
+	if (target == nullptr && msgID == PLAYER_JOIN)
+	{
+		target = rooms.PickForJoin();
+	}
+	if (target == nullptr) return;
+	Room& room = *target;
 
-					std::lock_guard<std::mutex> lock(lockMutex);
-					messageQueue.push(newMessage);
-				}
+	// anything from a known address counts as proof of life
+	{
+		std::lock_guard<std::mutex> lock(room.data.clientMutex);
+		auto it = room.data.playerMap.find(addrKey);
+		if (it != room.data.playerMap.end())
+		{
+			room.data.totalClients[it->second].lastHeard = std::chrono::steady_clock::now();
+		}
+	}
+
+	// i only do this one for now
+	switch (msgID)
+	{
+	case PLAYER_DC:
+		ProcessPlayerDisconnect(room, buffer, recvLen);
+		break;
+	case PLAYER_JOIN:
+		ProcessPlayerJoin(room, recvAddr, buffer, recvLen);
+		break;
+	case SHIP_MOVE:
+		ProcessShipMovement(room, recvAddr, buffer, recvLen);
+		break;
+	case CLIENT_REQ_HIGHSCORE:
+		ClientHandleHighscoreRequest(room, recvAddr, buffer, recvLen);
+		break;
+	case KEEPALIVE:
+		ProcessKeepAlive(room, buffer, recvLen);
+		break;
+	case BULLET_CREATED:
+		ProcessBulletFired(room, recvAddr, buffer, recvLen);
+		break;
+	case LOCKSTEP_CHECKSUM:
+		ProcessLockstepChecksum(room, buffer, recvLen);
+		break;
+	case ASTEROID_DESTROYED:
+	case BULLET_COLLIDE:
+	case SHIP_COLLIDE:
+	case SHIP_SCORE:
+		// collisions and scores are decided by the simulation now, older clients
+		// still sending these dont get a say
+		break;
+	default:
+		ForwardPacket(room, recvAddr, buffer, recvLen);
+		break;
+	}
+}
+
+void FixedUpdate(Room& room)
+{
+	auto now = std::chrono::steady_clock::now();
+	room.accumulatedTime += std::chrono::duration<double>(now - room.lastUpdate).count();
+	room.lastUpdate = now;
+
+	if (!room.data.gameRunning)
+	{
+		room.accumulatedTime = 0.0;
+		return;
+	}
+
+	const double tickLength = 1.0 / serverSettings.tickRate;
+	int steps = 0;
+	while (room.accumulatedTime >= tickLength)
+	{
+		// if we fell way behind dont try to catch up all at once, just drop the backlog
+		if (++steps > MAX_TICKS_PER_UPDATE)
+		{
+			room.accumulatedTime = 0.0;
+			break;
+		}
+		room.accumulatedTime -= tickLength;
+
+		room.simEvents.Clear();
+		uint32_t checksum = 0;
+		{
+			if (!serverSettings.journalDir.empty() && !room.journal.IsOpen() && !room.journalFailed) StartJournal(room);
+			ReleaseInputs(room, tickLength);
+			if (RecordingOps()) BuildLockstepFrame(room, room.lockstepOps);
+			SimStep(room.data, (float)tickLength, room.simEvents, simJobs);
+			if (serverSettings.maxRewindMs > 0.0f)
+			{
+				room.data.history.Record(room.data.tick, GetServerTime(), room.data.ships, room.data.totalClients.Slots(),
+					[&room](int i) -> bool { return room.data.totalClients[i].inSim; }, room.data.asteroids);
 			}
+			if (RecordingOps())
+			{
+				checksum = StateChecksum(room.data, room.data.lockstep.checksum);
+				room.data.lockstep.checksum = checksum;
+				room.data.lockstep.Remember(room.data.tick, checksum);
+			}
+			if (room.journal.IsOpen())
+			{
+				room.journal.Frame(room.data.tick, room.lockstepOps, room.journalSkip, checksum);
+				room.journalSkip = 0;
+				if (room.journal.KeyframeDue(room.data.tick)) room.journal.Keyframe(room.data, checksum);
+			}
+		}
+		if (serverSettings.lockstep) QueueLockstepFrame(room, room.data.tick, checksum, room.lockstepOps);
+		BroadcastSimEvents(room, room.simEvents);
+	}
+
+	if (steps > 0)
+	{
+		// readers get the world exactly as the last tick left it, before any wave or
+		// command lands on top of it
+		room.view.Back().Capture(room.data);
+		room.view.Publish();
+	}
+
+	if (steps > 0 && serverSettings.interestRadius > 0.0f)
+	{
+		UpdateInterest(room);
+	}
+}
+
+// STATE_UPDATE with where every ship and asteroid is right now, tagged with the tick so
+// clients can drop one that arrives after a newer one. with interest on every client
+// gets its own with just what it can see. the shared chunks go in every outbox as one
+// payload, and are the first thing a backed up outbox drops for a newer one
+void SendSnapshot(Room& room)
+{
+	std::vector<int> targets;
+	std::vector<Packet> chunks;
+	std::vector<int> chunkTarget; // index into targets
+
+	{
+		// the world as the last tick left it. a lockstep peer starting from this applies
+		// the next frame's ops on top, which it couldnt if a wave had already landed
+		const WorldView& view = room.view.Published();
+		const uint64_t serverTime = GetServerTime();
+		const bool filtered = serverSettings.interestRadius > 0.0f;
+		// asteroids are sent where they are right now, part way into the next tick.
+		// ships only move on ticks. lockstep peers carry on stepping from this, so they
+		// get it exactly at the tick
+		const float tickDt = 1.0f / serverSettings.tickRate;
+		const float partTick = serverSettings.lockstep ? 0.0f
+			: static_cast<float>(room.accumulatedTime) * serverSettings.tickRate;
+
+		SnapshotContents contents;
+		auto pack = [&](int target)
+		{
+			PackSnapshot(view, contents, serverTime, partTick * tickDt, chunks);
+			chunkTarget.resize(chunks.size(), target);
+		};
+
+		if (!filtered) GatherSnapshot(view, nullptr, contents);
+
+		for (int c = 0; c < room.data.totalClients.Slots(); ++c)
+		{
+			const ClientInfo& client = room.data.totalClients[c];
+			if (!client.connected) continue;
+
+			targets.push_back(c);
+
+			if (filtered)
+			{
+				GatherSnapshot(view, &client.interest, contents);
+				pack((int)targets.size() - 1);
+			}
+		}
+
+		// shared chunks go to every target, marked with -1
+		if (!filtered && !targets.empty()) pack(-1);
+	}
+
+	// encoded before taking the lock, the receive thread queues into the same outboxes
+	std::vector<PayloadRef> payloads;
+	payloads.reserve(chunks.size());
+	for (const Packet& pck : chunks) payloads.push_back(MakePayload(pck));
+
+	std::lock_guard<std::mutex> lock(room.lockMutex);
+	// the worker flushes at the end of this same update, no one to wake
+	MarkOutboxPending(room);
+	for (size_t n = 0; n < payloads.size(); ++n)
+	{
+		if (chunkTarget[n] >= 0)
+		{
+			room.data.totalClients[targets[chunkTarget[n]]].outbox.Push(payloads[n], serverSettings.outboxSize);
+			continue;
+		}
+		for (int c : targets)
+		{
+			room.data.totalClients[c].outbox.Push(payloads[n], serverSettings.outboxSize);
 		}
+	}
+}
+
+// the ops are wanted by lockstep peers, the journal, or both
+bool RecordingOps()
+{
+	return serverSettings.lockstep || !serverSettings.journalDir.empty();
+}
+
+// anything that changes the world outside of SimStep goes through here so lockstep
+// peers make the same change before their next tick. room's worker only
+void RecordLockstep(Room& room, const LockstepOp& op)
+{
+	if (!RecordingOps()) return;
+
+	LockstepState& lockstep = room.data.lockstep;
+	if (op.op == LOCKSTEP_SHIP)
+	{
+		if ((int)lockstep.connected.size() <= op.id) lockstep.connected.resize(op.id + 1, 0);
+		lockstep.connected[op.id] = op.flag;
+	}
+	lockstep.pending.push_back(op);
+}
+
+// everything that goes into the coming tick: what was recorded since the last one,
+// ships whose inSim flag flipped without anything else being recorded, then the input
+// frames SimStep is about to use. right before SimStep
+void BuildLockstepFrame(Room& room, std::vector<LockstepOp>& ops)
+{
+	LockstepState& lockstep = room.data.lockstep;
+	ops.swap(lockstep.pending);
+	lockstep.pending.clear();
+
+	const int slots = room.data.totalClients.Slots();
+	if ((int)lockstep.connected.size() < slots) lockstep.connected.resize(slots, 0);
+	for (int i = 0; i < slots; ++i)
+	{
+		// the flag SimStep goes by, nothing outside the worker can change it before the step
+		uint8_t inSim = room.data.totalClients[i].inSim ? 1 : 0;
+		if (lockstep.connected[i] == inSim) continue;
+
+		lockstep.connected[i] = inSim;
+		ops.push_back(ShipLockstepOp(room.data, i));
+	}
+
+	for (int i = 0; i < slots; ++i)
+	{
+		const ClientInfo& client = room.data.totalClients[i];
+		if (!client.inSim) continue;
+
+		for (uint8_t input : client.pendingInputs)
+		{
+			LockstepOp op;
+			op.op = LOCKSTEP_INPUT;
+			op.id = i;
+			op.flag = input;
+			ops.push_back(op);
+		}
+	}
+}
+
+// a new journal for the match this room is starting, state as it is right now goes in
+// as the first keyframe. call before the tick's frame is built
+void StartJournal(Room& room)
+{
+	JournalHeader header;
+	header.tickRate = serverSettings.tickRate;
+	header.maxPlayers = static_cast<uint32_t>(room.data.totalClients.Capacity());
+	header.maxAsteroids = static_cast<uint32_t>(room.data.asteroids.Capacity());
+	header.room = static_cast<uint32_t>(room.id);
+	header.seed = room.seed;
+	header.keyframeTicks = static_cast<uint32_t>(serverSettings.journalKeyframeTicks);
+
+	std::filesystem::path path = std::filesystem::path(serverSettings.journalDir)
+		/ ("room" + std::to_string(room.id) + "_" + std::to_string(std::time(nullptr)) + ".journal");
+	if (!room.journal.Open(path.string(), header))
+	{
+		// once per match, not every tick
+		std::cerr << "Couldnt open journal " << path.string() << ", room " << room.id << " goes without one this match" << std::endl;
+		room.journalFailed = true;
+		return;
+	}
+
+	// the joins that started the match already happened, the keyframe has them
+	room.journal.Keyframe(room.data, room.data.lockstep.checksum);
+	room.journalSkip = room.data.lockstep.pending.size();
+	std::cout << "Room " << room.id << " journal " << path.string() << std::endl;
+}
+
+// one tick's ops to everyone, split over as many packets as it takes. an empty tick
+// still goes out, the peers need it to step and it carries the checksum
+void QueueLockstepFrame(Room& room, uint32_t tick, uint32_t checksum, const std::vector<LockstepOp>& ops)
+{
+	// [tick][checksum][last][count]. chunks stay small enough for fec to wrap
+	const size_t headerLen = 4 + 4 + 1 + 2;
+
+	size_t next = 0;
+	do
+	{
+		size_t end = next;
+		size_t len = headerLen;
+		while (end < ops.size() && len + ops[end].Size() <= FEC_MAX_BODY_LEN)
+		{
+			len += ops[end].Size();
+			++end;
+		}
+
+		Packet pck(LOCKSTEP_FRAME);
+		pck << tick << checksum << (uint8_t)(end == ops.size() ? 1 : 0) << (uint16_t)(end - next);
+		for (size_t i = next; i < end; ++i)
+		{
+			WriteLockstepOp(pck, ops[i]);
+		}
+		next = end;
+
+		QueueToAll(room, pck);
+	} while (next < ops.size());
+}
+
+// a peer telling us where it ended up after a tick. a mismatch means it went its own
+// way somewhere, so log it and send everyone a snapshot to start again from
+void ProcessLockstepChecksum(Room& room, const char* buffer, int recvLen)
+{
+	int offset = 1;
 
-		// so that I only send out every interval time 
-		// timer
-		// every 0.01 maybe, Clear the msg queue by sending the message to every client
-		if (currTime - lastSendTime >= interval)
-		{
-			// set to the curr time it is resolving all messages
-			lastSendTime = currTime;
-			std::queue<MessageData> messages;
-			{
-				std::lock_guard<std::mutex> lock(lockMutex);
-				// swap to the local queue of messages so I dont have to keep doing lock_guard shit
-				std::swap(messages, messageQueue);
-			}
+	uint32_t msgLength;
+	if (!ReadBodyLength(buffer, recvLen, msgLength)) return;
+	offset += sizeof(msgLength);
 
-			// loop through every message to send out
-			while (!messages.empty())
-			{
-				char buffer[MAX_STR_LEN];
-				int offset = 0;
-				std::memset(buffer, 0, sizeof(buffer));
+	Packet report(LOCKSTEP_CHECKSUM);
+	report.writePos += msgLength;
+	std::memcpy(report.body, buffer + offset, msgLength);
 
-				const MessageData &msg = messages.front();
-				char msgID = msg.data.id; // either msg.commandID or msg.data.id
+	SimCommand command;
+	command.type = SIM_CMD_CHECKSUM;
+	report >> command.id >> command.tick >> command.checksum;
+	PostCommand(room, command);
+}
 
-				//std::string messageBody = msg.data.substr(1); // get rid of the 1st char as it's the commandID
-				// ID of the message
-				buffer[0] = msgID;
-				offset++;
+// the worker's half of ProcessLockstepChecksum
+void CheckLockstepChecksum(Room& room, const SimCommand& command)
+{
+	uint32_t expected = 0;
+	// too old to check, it'll report a newer one soon enough
+	if (!room.data.lockstep.Lookup(command.tick, expected)) return;
+	if (command.checksum == expected) return;
+
+	std::cout << "Player " << command.id << " in room " << room.id << " desynced at tick " << command.tick
+		<< " (" << std::hex << command.checksum << " vs " << expected << std::dec << ")" << std::endl;
+	room.keyframeWanted = true;
+}
 
-				// Any other header stuff do here
+// look around every ship and tell its client what came into range and what left
+void UpdateInterest(Room& room)
+{
+	InterestChange& change = room.interestChange;
 
-				// add the length of the message
-				uint32_t messageLength = static_cast<uint32_t>(msg.data.writePos); // writePos represents how much was written
-				messageLength = htonl(messageLength);
-				std::memcpy(buffer + offset, &messageLength, sizeof(messageLength));
-				offset += sizeof(messageLength);
+	{
+		BuildInterestGrids(room.data);
 
-				switch (msgID)
-				{
-				//case CLIENT_REQ_HIGHSCORE:
-				case REPLY_PLAYER_JOIN:
-				{
-					// this only sends to 1 client
-
-					// START OF GETTING CLIENT SOCKET
-					sockaddr_in otherAddr;
-					memset(&otherAddr, 0, sizeof(otherAddr));
-					otherAddr.sin_family = AF_INET;
-					// get the port of the target client
-					otherAddr.sin_port = htons(serverData.totalClients[msg.sessionID].port);
-					// get the ip of the target client
-					inet_pton(AF_INET, serverData.totalClients[msg.sessionID].ip.c_str(), &otherAddr.sin_addr);
-					// END OF GETTING CLIENT SOCKET
-
-					// body of the message
-					std::memcpy(buffer + offset, msg.data.body, msg.data.writePos);
-					offset += (int)msg.data.writePos;
-					sendto(udpListenerSocket, buffer, offset, 0, (sockaddr*)&otherAddr, sizeof(otherAddr));
-					break;
-				}
-				case NEW_PLAYER_JOIN:
-				{
-					// this packet contains every player data
-					// create the message buffer ifrst
-					std::memcpy(buffer + offset, msg.data.body, msg.data.writePos);
-					offset += (int)msg.data.writePos;
+		const int shipSlots = room.data.totalClients.Slots();
+		const ShipStore& ships = room.data.ships;
+		const AsteroidStore& asteroids = room.data.asteroids;
+		for (int c = 0; c < shipSlots; ++c)
+		{
+			ClientInfo& client = room.data.totalClients[c];
+			if (!client.inSim) continue;
+
+			change.Clear();
+			ComputeInterest(client.interest, c, serverSettings.interestRadius, ships, room.data.interestShips, shipSlots,
+				asteroids, room.data.interestAsteroids, change);
+			if (change.Empty()) continue;
+
+			// ships first then asteroids, chunked like the join packets so a crowded area still fits
+			const int shipsIn = (int)change.shipsIn.size();
+			const int enters = shipsIn + (int)change.asteroidsIn.size();
+			for (int first = 0; first < enters; first += ENTITIES_PER_PACKET)
+			{
+				int count = std::min(enters - first, (int)ENTITIES_PER_PACKET);
 
-					// loop through every client to send this msg to them
-					for (int i = 0; i < MAX_CONNECTION; ++i)
-					{
-						ClientInfo& client = serverData.totalClients[i];
-						if (!client.connected) continue; // skip unconnected client slots
-
-						sockaddr_in clientAddr;
-						memset(&clientAddr, 0, sizeof(clientAddr));
-						clientAddr.sin_family = AF_INET;
-						clientAddr.sin_port = htons(client.port);
-
-						// convert IP string to binary format
-						if (inet_pton(AF_INET, client.ip.c_str(), &clientAddr.sin_addr) <= 0)
-						{
-							// invalid IP
-							continue;
-						}
-
-						// send it
-						sendto(udpListenerSocket, buffer, offset, 0, (sockaddr*)&clientAddr, sizeof(clientAddr));
-					}
-					break;
-				}
-				case SHIP_MOVE:
+				Packet enter(ENTITY_ENTER);
+				enter << count;
+				for (int e = first; e < first + count; ++e)
 				{
-					//msg.data << msg.sessionID;
-					std::memcpy(buffer + offset, msg.data.body, msg.data.writePos);
-					offset += (int)msg.data.writePos;
-					for (int i = 0; i < MAX_CONNECTION; ++i)
+					if (e < shipsIn)
 					{
-						ClientInfo& client = serverData.totalClients[i];
-						if (!client.connected) continue; // skip unconnected client slots
-						if (client.sessionID == msg.sessionID) continue; // dont update for hte client thats moving
-
-						sockaddr_in clientAddr;
-						memset(&clientAddr, 0, sizeof(clientAddr));
-						clientAddr.sin_family = AF_INET;
-						clientAddr.sin_port = htons(client.port);
-
-						// convert IP string to binary format
-						if (inet_pton(AF_INET, client.ip.c_str(), &clientAddr.sin_addr) <= 0)
-						{
-							// invalid IP
-							continue;
-						}
-
-						// send it
-						sendto(udpListenerSocket, buffer, offset, 0, (sockaddr*)&clientAddr, sizeof(clientAddr));
+						int id = change.shipsIn[e];
+						enter << (uint8_t)ENTITY_SHIP << id;
+						WriteShipState(room, enter, id);
 					}
-
-					break;
-				}
-				case ASTEROID_UPDATE:
-				case ASTEROID_CREATED:
-				{
-					std::memcpy(buffer + offset, msg.data.body, msg.data.writePos);
-					offset += (int)msg.data.writePos;
-					for (int i = 0; i < MAX_CONNECTION; ++i)
+					else
 					{
-						ClientInfo& client = serverData.totalClients[i];
-						if (!client.connected) continue; // skip unconnected client slots
-						//if (client.sessionID == msg.sessionID) continue; // dont update for hte client thats moving
-
-						sockaddr_in clientAddr;
-						memset(&clientAddr, 0, sizeof(clientAddr));
-						clientAddr.sin_family = AF_INET;
-						clientAddr.sin_port = htons(client.port);
-
-						// convert IP string to binary format
-						if (inet_pton(AF_INET, client.ip.c_str(), &clientAddr.sin_addr) <= 0)
-						{
-							// invalid IP
-							continue;
-						}
-
-						// send it
-						sendto(udpListenerSocket, buffer, offset, 0, (sockaddr*)&clientAddr, sizeof(clientAddr));
+						int i = change.asteroidsIn[e - shipsIn];
+						enter << (uint8_t)ENTITY_ASTEROID << (int)asteroids.HandleAt(i);
+						enter << asteroids.xPos[i] << asteroids.yPos[i];
+						enter << asteroids.velX[i] << asteroids.velY[i];
+						enter << asteroids.dir[i];
 					}
-
-					break;
 				}
-				case PLAYER_DC:
-					std::memcpy(buffer + offset, msg.data.body, msg.data.writePos);
-					offset += (int)msg.data.writePos;
-
-					for (int i = 0; i < MAX_CONNECTION; ++i)
-					{
-						ClientInfo &client = serverData.totalClients[i];
-						if (!client.connected) continue;
-
-						sockaddr_in clientAddr;
-						memset(&clientAddr, 0, sizeof(clientAddr));
-						clientAddr.sin_family = AF_INET;
-						clientAddr.sin_port = htons(client.port);
-						inet_pton(AF_INET, client.ip.c_str(), &clientAddr.sin_addr);
-
-						sendto(udpListenerSocket, buffer, offset, 0, (sockaddr *)&clientAddr, sizeof(clientAddr));
-					}
-					break;
-				case PLAYER_JOIN:
-					// This would be used when the server initiates a player join (not common)
-					// Typically player join is client-initiated and handled in UDPReceiveHandler
-					std::memcpy(buffer + offset, msg.data.body, msg.data.writePos);
-					offset += (int)msg.data.writePos;
-
-					for (int i = 0; i < MAX_CONNECTION; ++i)
-					{
-						ClientInfo &client = serverData.totalClients[i];
-						if (!client.connected) continue;
-
-						sockaddr_in clientAddr;
-						memset(&clientAddr, 0, sizeof(clientAddr));
-						clientAddr.sin_family = AF_INET;
-						clientAddr.sin_port = htons(client.port);
-						inet_pton(AF_INET, client.ip.c_str(), &clientAddr.sin_addr);
-
-						sendto(udpListenerSocket, buffer, offset, 0, (sockaddr *)&clientAddr, sizeof(clientAddr));
-					}
-					break;
-				case PACKET_ERROR:
-					// Send error response to specific client
-					/*sockaddr_in otherAddr;
-					memset(&otherAddr, 0, sizeof(otherAddr));
-					otherAddr.sin_family = AF_INET;
-					otherAddr.sin_port = htons(serverData.totalClients[msg.sessionID].port);
-					inet_pton(AF_INET, serverData.totalClients[msg.sessionID].ip.c_str(), &otherAddr.sin_addr);
-
-					std::memcpy(buffer + offset, msg.data.body, msg.data.writePos);
-					offset += msg.data.writePos;
-					sendto(udpListenerSocket, buffer, offset, 0, (sockaddr *)&otherAddr, sizeof(otherAddr));*/
-					break;
-				default:
-					std::memcpy(buffer + offset, msg.data.body, msg.data.writePos);
-					offset += (int)msg.data.writePos;
-
-					for (int i = 0; i < MAX_CONNECTION; ++i)
-					{
-						ClientInfo& client = serverData.totalClients[i];
-						if (!client.connected) continue;
-						if (i == msg.sessionID) continue;
+				QueueTo(room, c, enter);
+			}
 
-						sockaddr_in clientAddr;
-						memset(&clientAddr, 0, sizeof(clientAddr));
-						clientAddr.sin_family = AF_INET;
-						clientAddr.sin_port = htons(client.port);
-						inet_pton(AF_INET, client.ip.c_str(), &clientAddr.sin_addr);
+			const int shipsOut = (int)change.shipsOut.size();
+			const int leaves = shipsOut + (int)change.asteroidsOut.size();
+			for (int first = 0; first < leaves; first += ENTITIES_PER_PACKET)
+			{
+				int count = std::min(leaves - first, (int)ENTITIES_PER_PACKET);
 
-						sendto(udpListenerSocket, buffer, offset, 0, (sockaddr*)&clientAddr, sizeof(clientAddr));
-					}
-					break;
+				Packet leave(ENTITY_LEAVE);
+				leave << count;
+				for (int e = first; e < first + count; ++e)
+				{
+					if (e < shipsOut) leave << (uint8_t)ENTITY_SHIP << change.shipsOut[e];
+					else leave << (uint8_t)ENTITY_ASTEROID << (int)change.asteroidsOut[e - shipsOut];
 				}
-				// pop the message im using
-				messages.pop();
+				QueueTo(room, c, leave);
 			}
 		}
-
-		//Sleep(SLEEP_TIME);
 	}
-	// -------------------------------------------------------------------------
-	// Clean-up after Winsock.
-	//
-	// WSACleanup()
-	// -------------------------------------------------------------------------
-
-	WSACleanup();
 }
 
-
-bool SimulatePacketLost()
+// [pos x,y][vel x,y][dir][score], the layout every ship message uses. room's worker only
+void WriteShipState(Room& room, Packet& packet, int shipID)
 {
-	double rand = dis(generator);
-	//std::cout << rand << std::endl;
-	return rand < PACKET_LOSS_RATE;
+	const ShipStore& ships = room.data.ships;
+	packet << ships.xPos[shipID] << ships.yPos[shipID];
+	packet << ships.velX[shipID] << ships.velY[shipID];
+	packet << ships.dir[shipID] << ships.score[shipID];
 }
 
-void UDPReceiveHandler(SOCKET udpListenerSocket)
+// turn what happened in a tick into packets for everyone
+void BroadcastSimEvents(Room& room, const SimEvents& events)
 {
+	uint64_t serverTime = GetServerTime();
 
-	u_long enable = 1;
-	ioctlsocket(udpListenerSocket, FIONBIO, &enable);
-
-	while (true)
+	for (const SimBulletHit& hit : events.bulletHits)
 	{
-		char buffer[MAX_STR_LEN];
-		struct sockaddr_in recvAddr;
-		int recvAddrLen = sizeof(recvAddr);
-
-		// receive from client
-		int recvLen = recvfrom(udpListenerSocket, buffer, sizeof(buffer), 0, (struct sockaddr *)&recvAddr, &recvAddrLen);
-
-		if (recvLen == SOCKET_ERROR)
-		{
-			size_t errCode = WSAGetLastError();
-			if (errCode == WSAEWOULDBLOCK)
-			{
-				Sleep(50);
-				continue;
-			}
-		}
+		Packet pck(BULLET_COLLIDE);
+		pck << hit.shipID << serverTime << hit.bulletID << hit.asteroidID << hit.score;
+		// everyone, the shooter included
+		QueueToAll(room, pck);
+	}
 
-		if (recvLen == 0)
-		{
-			// mutex lock
-			std::cout << "Shutdown" << std::endl;
-			break;
-		}
+	for (const SimShipHit& hit : events.shipHits)
+	{
+		Packet pck(SHIP_COLLIDE);
+		pck << hit.shipID << serverTime << hit.asteroidID;
+		QueueToAll(room, pck);
+	}
+}
 
-		if (recvLen > 0)
-		{
-			char msgID = buffer[0];
+// the client spawns the bullet locally and tells us, we spawn our own copy from
+// where the server thinks the ship is so the client cant place it anywhere.
+// with maxRewindMs on the shot is replayed from when it was fired, see RewindHistory.h
+void ProcessBulletFired(Room& room, const sockaddr_in& clientAddr, const char* buffer, int recvLen)
+{
+	int offset = 1;
 
-			// i only do this one for now
-			switch (msgID)
-			{
-			case PLAYER_DC:
-				ProcessPlayerDisconnect(buffer, recvLen);
-				break;
-			case PLAYER_JOIN:
-				ProcessPlayerJoin(recvAddr, buffer, recvLen);
-				break;
-			case SHIP_MOVE:
-				ProcessShipMovement(recvAddr, buffer, recvLen);
-				break;
-			case CLIENT_REQ_HIGHSCORE:
-				ClientHandleHighscoreRequest(recvAddr, buffer, recvLen);
-				break;
-			case ASTEROID_DESTROYED:
-			{
-				int offset = 1;
-				// get rid of header data
-				uint32_t msgLength;
-				std::memcpy(&msgLength, buffer + offset, sizeof(msgLength));
-				msgLength = ntohl(msgLength);
-				offset += sizeof(msgLength);
+	// get rid of header data
+	uint32_t msgLength;
+	if (!ReadBodyLength(buffer, recvLen, msgLength)) return;
+	offset += sizeof(msgLength);
 
-				Packet asteroidPkt(ASTEROID_DESTROYED);
-				asteroidPkt.writePos += msgLength;
-				std::memcpy(asteroidPkt.body, buffer + offset, msgLength);
+	Packet bulletPacket(BULLET_CREATED);
+	bulletPacket.writePos += msgLength;
+	std::memcpy(bulletPacket.body, buffer + offset, msgLength);
 
-				int asteroidID;
-				asteroidPkt >> asteroidID;
+	int shipID;
+	uint64_t timeDiff;
+	int bulletID;
+	float claimX, claimY, claimVelX, claimVelY, claimDir;
+	bulletPacket >> shipID >> timeDiff >> bulletID;
+	bulletPacket >> claimX >> claimY >> claimVelX >> claimVelY >> claimDir;
+	if (shipID < 0 || shipID != SenderSlot(room, clientAddr) || !room.data.totalClients[shipID].connected) return;
+	// only its own range of ids, so it cant replace anyone else's bullet here or on the other clients
+	if (!BulletStore::OwnsNetID(shipID, bulletID)) return;
+
+	SimCommand command;
+	command.type = SIM_CMD_BULLET;
+	command.id = shipID;
+	command.extra = bulletID;
+	command.time = timeDiff;
+	command.x = claimX;
+	command.y = claimY;
+	command.dir = claimDir;
+	PostCommand(room, command);
+
+	// other clients still draw it from the packet. the worker gets to the command after
+	// this is queued, so nobody gets a rewound hit before the bullet
+	ForwardPacket(room, clientAddr, buffer, recvLen);
+}
 
-				if (asteroidID > MAX_ASTEROIDS) break; // not suppose to be more
+// the worker's half of ProcessBulletFired, spawns our copy of the bullet or works out what it hit
+void FireBullet(Room& room, const SimCommand& command)
+{
+	const int shipID = command.id;
+	const int bulletID = command.extra;
+	if (shipID < 0 || shipID >= room.data.totalClients.Slots() || !room.data.totalClients[shipID].inSim) return;
 
-				if (serverData.totalAsteroids[asteroidID].active)
+	SimBulletHit hit{ shipID, bulletID, -1, 0 };
+	{
+		ShipStore& ships = room.data.ships;
+		RewindHistory& history = room.data.history;
+
+		Bullet bullet{};
+		bullet.ownerID = shipID;
+		bullet.active = true;
+		bullet.xPos = ships.xPos[shipID];
+		bullet.yPos = ships.yPos[shipID];
+		bullet.vel_x = BULLET_SPEED * std::cos(ships.dir[shipID]);
+		bullet.vel_y = BULLET_SPEED * std::sin(ships.dir[shipID]);
+
+		if (serverSettings.maxRewindMs > 0.0f && history.Count() > 0)
+		{
+			// timeDiff is the shooter's synced clock, anything from the future is now and
+			// anything older than the window is the start of the window
+			uint64_t now = GetServerTime();
+			uint64_t window = static_cast<uint64_t>(serverSettings.maxRewindMs);
+			uint64_t shotTime = std::min(command.time, now);
+			if (now - shotTime > window) shotTime = now - window;
+
+			int frame = history.FindAt(shotTime);
+			const RewindFrame& past = history[frame];
+			if (shipID < (int)past.shipLive.size() && past.shipLive[shipID])
+			{
+				float x = past.shipX[shipID];
+				float y = past.shipY[shipID];
+				float dir = past.shipDir[shipID];
+
+				// the shooter predicts its own ship, its muzzle is fine if its close to where we had it
+				float dx = command.x - x;
+				float dy = command.y - y;
+				if (dx * dx + dy * dy <= REWIND_CLAIM_TOLERANCE * REWIND_CLAIM_TOLERANCE)
 				{
-					std::cout << "Destroying Asteroid " << asteroidID << std::endl;
-					serverData.totalAsteroids[asteroidID].active = false;
-					serverData.numOfAsteroids--;
+					x = command.x;
+					y = command.y;
+					dir = command.dir;
 				}
 
-				//std::cout << "Total Asteroid : " << serverData.activeAsteroids << std::endl;
+				float velX = BULLET_SPEED * std::cos(dir);
+				float velY = BULLET_SPEED * std::sin(dir);
+				RewindShot shot = TraceRewoundShot(history, frame, shotTime, x, y, velX, velY,
+					BULLET_SCALE_X * 0.5f, BULLET_SCALE_Y * 0.5f);
 
-				break;
-			}
-			case BULLET_COLLIDE:
-			{
-				int offset = 1;
-				// get rid of header data
-				uint32_t msgLength;
-				std::memcpy(&msgLength, buffer + offset, sizeof(msgLength));
-				msgLength = ntohl(msgLength);
-				offset += sizeof(msgLength);
-
-				Packet bulletCollide(BULLET_COLLIDE);
-				bulletCollide.writePos += msgLength;
-				std::memcpy(bulletCollide.body, buffer + offset, msgLength);
-				uint64_t timeDiff;
-				int shipID;
-				uint32_t score;
-				uint32_t j, i;
-
-				bulletCollide >> shipID >> timeDiff >> j >> i >> score;
-				serverData.totalClients[shipID].playerShip.score = score;
-
-				ForwardPacket(recvAddr, buffer, recvLen);
-				break;
-			}
-			case SHIP_SCORE:
-			{
-				int offset = 1;
-				// get rid of header data
-				uint32_t msgLength;
-				std::memcpy(&msgLength, buffer + offset, sizeof(msgLength));
-				msgLength = ntohl(msgLength);
-				offset += sizeof(msgLength);
-
-				Packet pck(SHIP_SCORE);
-				pck.writePos += msgLength;
-				std::memcpy(pck.body, buffer + offset, msgLength);
-
-				int shipID;
-				uint32_t score;
-				pck >> shipID >> score;
-				serverData.totalClients[shipID].playerShip.score = score;
-
-				ForwardPacket(recvAddr, buffer, recvLen);
-				break;
-			}
-			default:
-				ForwardPacket(recvAddr, buffer, recvLen);
-				break;
+				// someone else might have got that asteroid since, then the bullet flies on
+				int hitIndex = room.data.asteroids.ids.Find(shot.asteroid);
+				if (hitIndex >= 0)
+				{
+					room.data.asteroids.RemoveAt(hitIndex);
+					ships.score[shipID] += ASTEROID_SCORE;
+					hit.asteroidID = (int)shot.asteroid;
+					hit.score = ships.score[shipID];
+
+					LockstepOp removed;
+					removed.op = LOCKSTEP_REMOVE_ASTEROID;
+					removed.id = hit.asteroidID;
+					RecordLockstep(room, removed);
+					RecordLockstep(room, ShipLockstepOp(room.data, shipID));
+				}
+				else
+				{
+					// the rest of the way from the newest frame to now
+					float ahead = (now - std::min(now, history[history.Count() - 1].time)) * 0.001f;
+					bullet.xPos = shot.x + velX * ahead;
+					bullet.yPos = shot.y + velY * ahead;
+					bullet.vel_x = velX;
+					bullet.vel_y = velY;
+				}
 			}
 		}
+
+		if (hit.asteroidID < 0 && room.data.bullets.Add(bulletID, bullet) != SlotMap::INVALID)
+		{
+			LockstepOp fired;
+			fired.op = LOCKSTEP_BULLET;
+			fired.id = shipID;
+			fired.extra = bulletID;
+			fired.v[0] = bullet.xPos;
+			fired.v[1] = bullet.yPos;
+			fired.v[2] = bullet.vel_x;
+			fired.v[3] = bullet.vel_y;
+			RecordLockstep(room, fired);
+		}
 	}
-}
 
-//void FixedUpdate()
-//{
-//	accumulatedTime += 
-//}
+	if (hit.asteroidID < 0) return;
+
+	// same as a hit from the sim
+	Packet pck(BULLET_COLLIDE);
+	pck << hit.shipID << GetServerTime() << hit.bulletID << hit.asteroidID << hit.score;
+	QueueToAll(room, pck);
+}
 
 void HandleGetScores(SOCKET clientSocket)
 {
@@ -889,109 +1671,248 @@ void HandleGetScores(SOCKET clientSocket)
 	// Send high scores to client
 	send(clientSocket, message, messageSize, 0);
 }
-void ProcessPlayerDisconnect(const char *buffer, int recvLen)
+void ProcessPlayerDisconnect(Room& room, const char *buffer, int recvLen)
 {
-	if (recvLen < 5) return; // Ensure buffer contains at least 5 bytes (1 for msgID + 4 for playerID)
+	int offset = 1;
+
+	// get rid of header data
+	uint32_t msgLength;
+	if (!ReadBodyLength(buffer, recvLen, msgLength)) return;
+	offset += sizeof(msgLength);
 
-	uint32_t playerID;
-	std::memcpy(&playerID, buffer + 1, sizeof(uint32_t));
+	Packet dcPacket(PLAYER_DC);
+	dcPacket.writePos += msgLength;
+	std::memcpy(dcPacket.body, buffer + offset, msgLength);
+
+	int playerID = NO_SLOT;
+	uint32_t token = 0;
+	dcPacket >> playerID >> token;
 
 	// Check if player is valid
-	if (playerID >= MAX_CONNECTION || !serverData.totalClients[playerID].connected)
+	if (playerID < 0 || playerID >= room.data.totalClients.Slots() || !room.data.totalClients[playerID].connected)
 	{
 		std::cerr << "Invalid disconnect request for player " << playerID << std::endl;
 		return;
 	}
 
-	// Mark player as disconnected
-	serverData.totalClients[playerID].connected = false;
-	std::cout << "Player " << playerID << " has disconnected." << std::endl;
+	if (room.data.totalClients[playerID].sessionToken != token)
+	{
+		std::cerr << "Disconnect for player " << playerID << " has the wrong session token" << std::endl;
+		return;
+	}
+
+	DisconnectClient(room, playerID, "has disconnected");
+}
 
-	// Remove player's bullets
-	for (auto it = serverData.activeBullets.begin(); it != serverData.activeBullets.end();)
+void DisconnectClient(Room& room, int playerID, const char* reason)
+{
+	InputReceiverStats inputStats;
 	{
-		if (it->second.ownerID == playerID)
-		{
-			it = serverData.activeBullets.erase(it);
-		}
-		else
-		{
-			++it;
-		}
+		std::lock_guard<std::mutex> lock(room.data.clientMutex);
+		ClientInfo& client = room.data.totalClients[playerID];
+		if (!client.connected) return;
+
+		// Mark player as disconnected, fan-out skips it from here on
+		client.connected = false;
+		client.sessionToken = 0;
+		room.data.playerMap.erase(client.addrKey);
+		rooms.Unbind(client.addrKey);
+		room.data.freeSlots.push_back(playerID);
+		inputStats = client.inputs.GetStats();
+
+		// takes the ship out of the world and its bullets with it. posted before the lock
+		// goes so a join that reuses the slot always lands in the inbox after it
+		SimCommand command;
+		command.type = SIM_CMD_LEAVE;
+		command.id = playerID;
+		PostCommand(room, command);
 	}
+	std::cout << "Player " << playerID << " in room " << room.id << " " << reason << "." << std::endl;
+
+	std::cout << "  inputs applied " << inputStats.applied << ", saved by redundancy " << inputStats.recovered
+		<< ", duplicates " << inputStats.duplicates << std::endl;
 
 	// Send player disconnect message to all clients
 	Packet playerDCMsg(PLAYER_DC);
 	playerDCMsg << playerID;
+	QueueToAll(room, playerDCMsg);
+}
+
+void ProcessKeepAlive(Room& room, const char* buffer, int recvLen)
+{
+	int offset = 1;
+
+	// get rid of header data
+	uint32_t msgLength;
+	if (!ReadBodyLength(buffer, recvLen, msgLength)) return;
+	offset += sizeof(msgLength);
+
+	Packet keepAlive(KEEPALIVE);
+	keepAlive.writePos += msgLength;
+	std::memcpy(keepAlive.body, buffer + offset, msgLength);
 
-	MessageData msg;
-	msg.commandID = playerDCMsg.id;
-	msg.sessionID = -1; // Broadcast to all
-	msg.data = playerDCMsg;
+	int playerID = NO_SLOT;
+	uint32_t token = 0;
+	keepAlive >> playerID >> token;
+	if (playerID < 0 || playerID >= room.data.totalClients.Slots()) return;
+
+	// lastHeard is already bumped by address in ProcessDatagram,
+	// this just catches a client still pinging a slot it no longer owns
+	std::lock_guard<std::mutex> lock(room.data.clientMutex);
+	ClientInfo& client = room.data.totalClients[playerID];
+	if (!client.connected || client.sessionToken != token)
+	{
+		std::cerr << "Keepalive from stale session for slot " << playerID << std::endl;
+		return;
+	}
 
-	std::lock_guard<std::mutex> lock(lockMutex);
-	messageQueue.push(msg);
+	// the client tacks on how many fec packets it got/lost since the last keepalive
+	if (msgLength >= keepAlive.readPos + 2 * sizeof(uint32_t))
+	{
+		uint32_t fecReceived, fecLost;
+		keepAlive >> fecReceived >> fecLost;
+		client.fec.ReportLoss(fecReceived, fecLost);
+	}
 }
-void ProcessPlayerJoin(const sockaddr_in &clientAddr, const char *buffer, int recvLen)
+
+void CheckIdleClients(Room& room)
 {
-	int32_t availID = -1;
-	for (int i = 0; i < MAX_CONNECTION; ++i)
+	auto now = std::chrono::steady_clock::now();
+	auto timeout = std::chrono::duration<double>(serverSettings.clientTimeout);
+
+	for (int i = 0; i < room.data.totalClients.Slots(); ++i)
 	{
-		if (!serverData.totalClients[i].connected)
+		bool timedOut;
 		{
-			// this client is not connected
-			availID = i;
-			break;
+			std::lock_guard<std::mutex> lock(room.data.clientMutex);
+			const ClientInfo& client = room.data.totalClients[i];
+			timedOut = client.connected && (now - client.lastHeard) > timeout;
+		}
+
+		if (timedOut)
+		{
+			DisconnectClient(room, i, "timed out");
 		}
 	}
+}
 
-	//if (availID == -1)
-	//{
-	bool clientExist = false;
-	// check if the client connected before
-	std::string ip = inet_ntoa(clientAddr.sin_addr);
-	std::string port = std::to_string(ntohs(clientAddr.sin_port));
-	std::string mapKey = ip + ":" + port;
-	if (serverData.playerMap.count(mapKey) > 0)
+uint64_t GetAddressKey(const sockaddr_in& addr)
+{
+	return (static_cast<uint64_t>(ntohl(addr.sin_addr.s_addr)) << 16) | ntohs(addr.sin_port);
+}
+
+// the other way, where to send to for a client
+sockaddr_in AddressFromKey(uint64_t addrKey)
+{
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(static_cast<uint32_t>(addrKey >> 16));
+	addr.sin_port = htons(static_cast<uint16_t>(addrKey & 0xFFFF));
+	return addr;
+}
+
+// the slot whoever sent from addr joined as, NO_SLOT for a stranger. what a packet says
+// about which player it is only counts when it matches this
+int SenderSlot(Room& room, const sockaddr_in& addr)
+{
+	std::lock_guard<std::mutex> lock(room.data.clientMutex);
+	auto it = room.data.playerMap.find(GetAddressKey(addr));
+	return it != room.data.playerMap.end() ? it->second : NO_SLOT;
+}
+
+// room's worker, once per tick before anything reads pendingInputs. each input frame is
+// INPUT_STEP of play so a client only gets a tick's worth of them, plus a few to catch up
+// after a late packet. sending frames faster than that doesnt make the ship any faster
+void ReleaseInputs(Room& room, double tickLength)
+{
+	const float perTick = (float)(tickLength / INPUT_STEP);
+	for (int i = 0; i < room.data.totalClients.Slots(); ++i)
 	{
-		availID = serverData.playerMap[mapKey];
-		clientExist = true;
+		ClientInfo& client = room.data.totalClients[i];
+		client.inputCredit = std::min(client.inputCredit + perTick, perTick + INPUT_BURST);
+		while (client.inputCredit >= 1.0f && !client.queuedInputs.empty())
+		{
+			client.pendingInputs.push_back(client.queuedInputs.front());
+			client.queuedInputs.pop_front();
+			client.inputCredit -= 1.0f;
+		}
 	}
+}
 
-		// send a rej packet but i lazy do that now
-		//return;
-	//}
-
-	if (availID < 0) return; // shouldn't hit tho
+void ProcessPlayerJoin(Room& room, const sockaddr_in &clientAddr, const char *buffer, int recvLen)
+{
+	int32_t availID = NO_SLOT;
+	bool clientExist = false;
+	uint32_t sessionToken = 0;
+	uint64_t addrKey = GetAddressKey(clientAddr);
 
-	ClientInfo &newClient = serverData.totalClients[availID];
+	{
+		std::lock_guard<std::mutex> lock(room.data.clientMutex);
 
-	newClient.sessionID = availID;
-	newClient.ip = inet_ntoa(clientAddr.sin_addr);
-	newClient.port = ntohs(clientAddr.sin_port);
-	newClient.connected = true;
+		// check if the client connected before and still holds a slot
+		auto it = room.data.playerMap.find(addrKey);
+		if (it != room.data.playerMap.end())
+		{
+			availID = it->second;
+			clientExist = true;
+		}
+		else if (!room.data.freeSlots.empty())
+		{
+			availID = room.data.freeSlots.back();
+			room.data.freeSlots.pop_back();
+		}
+		else
+		{
+			availID = room.data.totalClients.Grow();
+		}
 
-	std::string key = newClient.ip + ":" + std::to_string(newClient.port);
+		if (availID == NO_SLOT)
+		{
+			// full, send a rej packet but i lazy do that now
+			return;
+		}
 
-	serverData.playerMap[key] = availID;
-	// the moment the first client joins, i set game running to true
-	serverData.gameRunning = true;
+		ClientInfo& joiningClient = room.data.totalClients[availID];
+		joiningClient.sessionID = availID;
+		joiningClient.addrKey = addrKey;
+		joiningClient.lastHeard = std::chrono::steady_clock::now();
+		if (!clientExist)
+		{
+			joiningClient.sessionToken = tokenGenerator();
+			joiningClient.inputs.Reset();
+		}
+		{
+			// anything still queued for whoever had the slot before
+			std::lock_guard<std::mutex> outboxLock(room.lockMutex);
+			joiningClient.outbox.Clear();
+		}
+		joiningClient.connected = true;
+		sessionToken = joiningClient.sessionToken;
+
+		room.data.playerMap[addrKey] = availID;
+		rooms.Bind(addrKey, room.id);
+
+		// the ship is the worker's, the reply doesnt need to wait for it. posted under the
+		// lock so it stays in order with a leave for the same slot
+		SimCommand command;
+		command.type = SIM_CMD_JOIN;
+		command.id = availID;
+		command.flag = clientExist ? 1 : 0;
+		PostCommand(room, command);
+	}
 
 	// default initialize ship data
 	// send back to the connecting player the reply
 	Packet replyPacket(REPLY_PLAYER_JOIN);
 	replyPacket << availID; // pack the ship's ID in 
+	replyPacket << sessionToken;
 	replyPacket << (uint8_t)clientExist;
 	if (clientExist)
 	{
-		ClientInfo& info = serverData.totalClients[availID];
 		//replyPacket << playerIDs[i];
-		replyPacket << info.playerShip.xPos;
-		replyPacket << info.playerShip.yPos;
-		replyPacket << info.playerShip.vel_x;
-		replyPacket << info.playerShip.vel_y;
-		replyPacket << info.playerShip.dirCur;
-		replyPacket << info.playerShip.score;
+		// the ship kept going while they were gone, the last published tick has it
+		WriteShipState(room.view.Read(), replyPacket, availID);
 	}
 	/*
 	
@@ -1005,100 +1926,48 @@ void ProcessPlayerJoin(const sockaddr_in &clientAddr, const char *buffer, int re
 
 	//std::string message = replyPacket.ToString(); 
 	// send to the client
-	{
-		MessageData newMessage;
-		newMessage.commandID = replyPacket.id;
-		newMessage.sessionID = newClient.sessionID;
-		newMessage.data = replyPacket;
-
-		std::lock_guard<std::mutex> lock(lockMutex);
-		messageQueue.push(newMessage);
-	}
-
-
-	Packet newPlayerPacket(NEW_PLAYER_JOIN);
-
-	std::vector<int> playerIDs;
-
-	for (int i = 0; i < MAX_CONNECTION; ++i)
-	{
-		//if (i == availID) continue;
-
-		if (!serverData.totalClients[i].connected) continue;
-
-		playerIDs.push_back(i);
-	}
-
-	//if (playerIDs.size() <= 1) return; // if onyl 1 player has been made then dont send anything
-
-	newPlayerPacket << (uint32_t)playerIDs.size(); // push back the number of active players
+	QueueTo(room, availID, replyPacket);
 
-	for (int i = 0; i < playerIDs.size(); ++i)
-	{
-		ClientInfo& info = serverData.totalClients[playerIDs[i]];
-		newPlayerPacket << playerIDs[i];
-		newPlayerPacket << info.playerShip.xPos;
-		newPlayerPacket << info.playerShip.yPos;
-		newPlayerPacket << info.playerShip.vel_x;
-		newPlayerPacket << info.playerShip.vel_y;
-		newPlayerPacket << info.playerShip.dirCur;
-		newPlayerPacket << info.playerShip.score;
-	}
-	//newPlayerPacket << 1; // only 1 new player 
-	//newPlayerPacket << newClient.sessionID; // i think i should be packing the ID of the new client??
-
-	//message = newPlayerPacket.ToString();
-
-	{
-		MessageData newMessage;
-		newMessage.commandID = newPlayerPacket.id;
-		newMessage.sessionID = newClient.sessionID;// sending to the current client's id which is i 
-		newMessage.data = newPlayerPacket;
-
-		std::lock_guard<std::mutex> lock(lockMutex);
-		messageQueue.push(newMessage);
-	}
-
-	Packet updateAsteroids(ASTEROID_UPDATE);
-
-	auto currTime = std::chrono::steady_clock::now();
-	for (int i = 0; i < MAX_ASTEROIDS; ++i)
-	{
-		if (serverData.totalAsteroids[i].active == false) continue;
-
-		auto elapsedTime = std::chrono::duration_cast<std::chrono::seconds>(currTime - serverData.totalAsteroids[i].creationTime).count();
-		serverData.totalAsteroids[i].xPos += serverData.totalAsteroids[i].vel_x * elapsedTime;
-		serverData.totalAsteroids[i].yPos += serverData.totalAsteroids[i].vel_y * elapsedTime;
-
-	}
+	// the other ships and the asteroids come with the next snapshot, same as for everyone else
+}
 
-	updateAsteroids << serverData.numOfAsteroids;
-	// send any asteroids that exist in the server
-	for (int i = 0; i < MAX_ASTEROIDS; ++i)
+// the worker's half of ProcessPlayerJoin
+void JoinShip(Room& room, const SimCommand& command)
+{
+	const int availID = command.id;
+	const bool clientExist = command.flag != 0;
+	ClientInfo &newClient = room.data.totalClients[availID];
+	// a leave for this slot drains after this even if the player is already gone, the inbox
+	// keeps the order they were posted in
+	newClient.inSim = true;
+
+	if (!clientExist)
 	{
-		if (serverData.totalAsteroids[i].active == false) continue;
-
-		updateAsteroids << i;
-		updateAsteroids << serverData.totalAsteroids[i].xPos;
-		updateAsteroids << serverData.totalAsteroids[i].yPos;
-		updateAsteroids << serverData.totalAsteroids[i].vel_x;
-		updateAsteroids << serverData.totalAsteroids[i].vel_y;
-		updateAsteroids << serverData.totalAsteroids[i].dirCur;
-
+		// fresh ship in the middle, nothing left over from whoever had the slot before
+		room.data.ships.ResetMotion(availID);
+		room.data.ships.score[availID] = 0;
+		newClient.pendingInputs.clear();
+		newClient.queuedInputs.clear();
+		newClient.inputCredit = 0.0f;
+		RecordLockstep(room, ShipLockstepOp(room.data, availID));
+
+		// anyone who saw the last ship in this slot gets this one as an enter
+		for (int i = 0; i < room.data.totalClients.Slots(); ++i)
+		{
+			room.data.totalClients[i].interest.ForgetShip(availID);
+		}
 	}
 
+	// a join (even a repeated one) starts from nothing, everything in range comes as an enter
+	newClient.interest.Clear();
 
-	{
-		MessageData newMessage;
-		newMessage.commandID = updateAsteroids.id;
-		//newMessage.sessionID = newClient.sessionID;// sending to the current client's id which is i 
-		newMessage.data = updateAsteroids;
-
-		std::lock_guard<std::mutex> lock(lockMutex);
-		messageQueue.push(newMessage);
-	}
+	// the moment the first client joins, the match starts
+	if (room.matchState == MATCH_LOBBY) SetMatchState(room, MATCH_RUNNING);
+	// a lockstep peer has to start from exactly our state before the frames mean anything
+	if (serverSettings.lockstep) room.keyframeWanted = true;
 }
-void ProcessShipMovement(const sockaddr_in& clientAddr, const char* buffer, int recvLen)
+
+void ProcessShipMovement(Room& room, const sockaddr_in& clientAddr, const char* buffer, int recvLen)
 {
 	//std::string ip = inet_ntoa(clientAddr.sin_addr);
 	// get the id of the ship thats moving
@@ -1106,8 +1975,7 @@ void ProcessShipMovement(const sockaddr_in& clientAddr, const char* buffer, int
 
 	// get rid of header data
 	uint32_t msgLength;
-	std::memcpy(&msgLength, buffer + offset, sizeof(msgLength));
-	msgLength = ntohl(msgLength);
+	if (!ReadBodyLength(buffer, recvLen, msgLength)) return;
 	offset += sizeof(msgLength);
 
 	Packet shipMovement(SHIP_MOVE);
@@ -1115,41 +1983,95 @@ void ProcessShipMovement(const sockaddr_in& clientAddr, const char* buffer, int
 	std::memcpy(shipMovement.body, buffer + offset, msgLength);
 
 	int sessionID;
-	int playerInput;
 	uint64_t timeDiff;
+	InputHistoryMsg history;
 
 	shipMovement >> sessionID;
-	ClientInfo& client = serverData.totalClients[sessionID];
+	// only ever the sender's own ship, whatever id it put in the packet
+	if (sessionID < 0 || sessionID != SenderSlot(room, clientAddr)) return;
+	ClientInfo& client = room.data.totalClients[sessionID];
 
 	shipMovement >> timeDiff;
-	shipMovement >> playerInput;
-	shipMovement >> client.playerShip.xPos;
-	shipMovement >> client.playerShip.yPos;
-	shipMovement >> client.playerShip.vel_x;
-	shipMovement >> client.playerShip.vel_y;
-	shipMovement >> client.playerShip.dirCur;
-	shipMovement >> client.playerShip.score;
+	if (!ReadInputHistory(shipMovement, history)) return;
 
+	// inputs is reset by a join and read by a disconnect on the worker, both under the lock
+	std::lock_guard<std::mutex> lock(room.data.clientMutex);
+	if (!client.connected) return;
 
-	{
-		MessageData newMessage;
-		newMessage.commandID = shipMovement.id;
-		newMessage.sessionID = client.sessionID;// sending to the current client's id which is i 
-		newMessage.data = shipMovement;
+	// the history repeats the last few frames, only frames newer than what we've seen count.
+	// position/velocity/score in the packet are only what the client predicted, the sim
+	// works out where the ship really is from the inputs
+	client.inputs.Accept(history, [&room, sessionID](uint32_t, uint8_t input)
+		{
+			SimCommand command;
+			command.type = SIM_CMD_INPUT;
+			command.id = sessionID;
+			command.flag = input;
+			PostCommand(room, command);
+		});
 
-		std::lock_guard<std::mutex> lock(lockMutex);
-		messageQueue.push(newMessage);
-	}
+}
+uint64_t GetServerTime()
+{
+	auto elapsed = std::chrono::steady_clock::now() - serverStartTime;
+	return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+// the length out of a datagram's [id][len] header. false when the body it claims is
+// longer than what actually came in or than a Packet holds, nothing should be copied then
+bool ReadBodyLength(const char* buffer, int recvLen, uint32_t& msgLength)
+{
+	const int offset = 1 + sizeof(uint32_t);
+	if (recvLen < offset) return false;
+
+	std::memcpy(&msgLength, buffer + 1, sizeof(msgLength));
+	msgLength = ntohl(msgLength);
+	return msgLength <= (uint32_t)(recvLen - offset) && msgLength <= MAX_BODY_LEN;
+}
+
+void ProcessTimeSync(const sockaddr_in& clientAddr, const char* buffer, int recvLen)
+{
+	// t1 as early as possible
+	uint64_t recvTime = GetServerTime();
+
+	int offset = 1;
 
+	// get rid of header data. this runs for anyone, before any session lookup
+	uint32_t msgLength;
+	if (!ReadBodyLength(buffer, recvLen, msgLength) || msgLength < sizeof(uint64_t)) return;
+	offset += sizeof(msgLength);
+
+	Packet syncRequest(TIME_SYNC);
+	syncRequest.writePos += msgLength;
+	std::memcpy(syncRequest.body, buffer + offset, msgLength);
+
+	uint64_t clientSendTime;
+	syncRequest >> clientSendTime;
+
+	// echo t0 back with our receive and send times
+	// this skips the outboxes on purpose, waiting for the worker would add to the error
+	Packet syncReply(TIME_SYNC);
+	syncReply << clientSendTime << recvTime << GetServerTime();
+
+	char replyBuffer[MAX_STR_LEN];
+	int replyLen = 0;
+	replyBuffer[replyLen++] = syncReply.id;
+	uint32_t replyLength = htonl(static_cast<uint32_t>(syncReply.writePos));
+	std::memcpy(replyBuffer + replyLen, &replyLength, sizeof(replyLength));
+	replyLen += sizeof(replyLength);
+	std::memcpy(replyBuffer + replyLen, syncReply.body, syncReply.writePos);
+	replyLen += (int)syncReply.writePos;
+
+	SendDatagram(replyBuffer, replyLen, clientAddr);
 }
-void ForwardPacket(const sockaddr_in& clientAddr, const char* buffer, int recvLen)
+
+void ForwardPacket(Room& room, const sockaddr_in& clientAddr, const char* buffer, int recvLen)
 {
 	int offset = 1;
 
 	// get rid of header data
 	uint32_t msgLength;
-	std::memcpy(&msgLength, buffer + offset, sizeof(msgLength));
-	msgLength = ntohl(msgLength);
+	if (!ReadBodyLength(buffer, recvLen, msgLength)) return;
 	offset += sizeof(msgLength);
 
 	Packet returnPacket(static_cast<CMDID>(buffer[0]));
@@ -1158,58 +2080,40 @@ void ForwardPacket(const sockaddr_in& clientAddr, const char* buffer, int recvLe
 
 	int sessionID;
 	returnPacket >> sessionID;
-	ClientInfo& client = serverData.totalClients[sessionID];
-
-	{
-		MessageData newMessage;
-		newMessage.commandID = returnPacket.id;
-		newMessage.sessionID = client.sessionID;// sending to the current client's id which is i 
-		newMessage.data = returnPacket;
+	// nobody gets to speak for another player
+	if (sessionID < 0 || sessionID != SenderSlot(room, clientAddr)) return;
 
-		std::lock_guard<std::mutex> lock(lockMutex);
-		messageQueue.push(newMessage);
-	}
+	// everyone but whoever sent it
+	QueueToAll(room, returnPacket, sessionID);
 }
-void RespawnShip(uint32_t playerID)
+// room's worker only, other threads post a SIM_CMD_RESPAWN
+void RespawnShip(Room& room, int playerID)
 {
-	if (playerID >= MAX_CONNECTION || !serverData.totalClients[playerID].connected)
+	if (playerID < 0 || playerID >= room.data.totalClients.Slots() || !room.data.totalClients[playerID].inSim)
 	{
 		return;
 	}
 
-	ClientInfo &player = serverData.totalClients[playerID];
-
-	// Reset ship properties
-	player.playerShip.xPos = 0.0f;  // Spawn in center
-	player.playerShip.yPos = 0.0f;
-	player.playerShip.vel_x = 0.0f;
-	player.playerShip.vel_y = 0.0f;
-	player.playerShip.vel_server_x = 0.0f;
-	player.playerShip.vel_server_y = 0.0f;
+	// Reset ship properties, spawns in center
+	room.data.ships.ResetMotion(playerID);
+	RecordLockstep(room, ShipLockstepOp(room.data, playerID));
 
 	// Create and broadcast ship respawn message
 	Packet respawnPacket(SHIP_RESPAWN);
 	respawnPacket << playerID;
-	respawnPacket << player.playerShip.xPos << player.playerShip.yPos;
+	respawnPacket << room.data.ships.xPos[playerID] << room.data.ships.yPos[playerID];
 
 	// Queue the message
-	MessageData respawnMsg;
-	respawnMsg.commandID = respawnPacket.id;
-	respawnMsg.sessionID = -1; // Broadcast to all
-	respawnMsg.data = respawnPacket;
-
-	std::lock_guard<std::mutex> lock(lockMutex);
-	messageQueue.push(respawnMsg);
+	QueueToAll(room, respawnPacket);
 }
-void ClientHandleHighscoreRequest(const sockaddr_in &clientAddr, const char *buffer, int recvLen)
+void ClientHandleHighscoreRequest(Room& room, const sockaddr_in &clientAddr, const char *buffer, int recvLen)
 {
 
 	int offset = 1;
 
 	// get rid of header data
 	uint32_t msgLength;
-	std::memcpy(&msgLength, buffer + offset, sizeof(msgLength));
-	msgLength = ntohl(msgLength);
+	if (!ReadBodyLength(buffer, recvLen, msgLength)) return;
 	offset += sizeof(msgLength);
 
 	Packet returnPacket(static_cast<CMDID>(buffer[0]));
@@ -1218,8 +2122,10 @@ void ClientHandleHighscoreRequest(const sockaddr_in &clientAddr, const char *buf
 
 	int sessionID;
 	returnPacket >> sessionID;
-	ClientInfo &client = serverData.totalClients[sessionID];
+	if (sessionID < 0 || sessionID >= room.data.totalClients.Slots()) return;
+	ClientInfo &client = room.data.totalClients[sessionID];
 
+	std::unique_lock<std::mutex> scoreLock(highScoreMutex);
 	LoadHighScores();
 
 	// Create response packet
@@ -1234,22 +2140,16 @@ void ClientHandleHighscoreRequest(const sockaddr_in &clientAddr, const char *buf
 	{
 		highscorePacket << score.playerName << score.score << score.time;
 	}
+	scoreLock.unlock();
 
-	{
-		MessageData highScoreMsg;
-		highScoreMsg.commandID = highscorePacket.id;
-		highScoreMsg.sessionID = client.sessionID; // Broadcast to all
-		highScoreMsg.data = highscorePacket;
-
-		std::lock_guard<std::mutex> lock(lockMutex);
-		messageQueue.push(highScoreMsg);
-	}
+	// everyone but the client that asked, the way it has always gone out
+	QueueToAll(room, highscorePacket, client.sessionID);
 	//// Send the response directly to the requesting client
 	//sendto(udpListenerSocket, highscorePacket.body, highscorePacket.writePos, 0,
 	//	(struct sockaddr *)&clientAddr, sizeof(clientAddr));
 }
 
-void HandleHighscoreRequest(const sockaddr_in &clientAddr)
+void HandleHighscoreRequest(Room& room, const sockaddr_in &clientAddr)
 {
 	// Create response packet
 	Packet highscorePacket(REQ_HIGHSCORE);
@@ -1264,21 +2164,14 @@ void HandleHighscoreRequest(const sockaddr_in &clientAddr)
 		highscorePacket << score.playerName << score.score;
 	}
 
-	// Prepare message for queue
-	MessageData newMessage;
-	newMessage.commandID = highscorePacket.id;
-	newMessage.sessionID = -1; // Specific response, not broadcast
-
-	// Create target address (respond to requester)
-	sockaddr_in targetAddr = clientAddr;
+	// respond to requester, found by their address
+	int requester = SenderSlot(room, clientAddr);
+	if (requester == NO_SLOT) return;
 
 	// Queue the message
-	{
-		std::lock_guard<std::mutex> lock(lockMutex);
-		messageQueue.push(newMessage);
-	}
+	QueueTo(room, requester, highscorePacket);
 }
-void BroadcastHighScores()
+void BroadcastHighScores(Room& room)
 {
 	Packet highscorePacket(REQ_HIGHSCORE);
 
@@ -1292,15 +2185,6 @@ void BroadcastHighScores()
 		highscorePacket << score.playerName << score.score;
 	}
 
-	// Prepare broadcast message
-	MessageData newMessage;
-	newMessage.commandID = highscorePacket.id;
-	newMessage.sessionID = -1; // Broadcast to all
-	newMessage.data = highscorePacket;
-
 	// Queue the message
-	{
-		std::lock_guard<std::mutex> lock(lockMutex);
-		messageQueue.push(newMessage);
-	}
+	QueueToAll(room, highscorePacket);
 }
@@ -0,0 +1,327 @@
+/*******************************************************************************
+ * FEC tests
+ *
+ * FecEncoder on one side, FecDecoder on the other, datagrams in between either
+ * handed straight across (with chosen ones left out) or run through a
+ * NetEmulator with seeded loss. Every datagram the decoder hands out has to be
+ * byte for byte one that was sent, and only once.
+ *
+ * Covers a clean round trip, rebuilding any single lost datagram of a group,
+ * giving up on two, the loss stats the decoder reports back, the encoder's
+ * group size following those reports, FecGroupSizeForLoss itself, and that the
+ * biggest thing that gets wrapped still fits in a body a receiver will take.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project FecTest.cpp -o fectest
+ ******************************************************************************/
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include "TestCommon.h"
+#include "Fec.h"
+#include "NetEmulator.h"
+#include "Random.h"
+
+const unsigned int TEST_SEED = 4321;
+
+typedef std::vector<char> Datagram;
+
+// an inner datagram the way the server builds one, [cmd][len][body] with the number in front
+static Datagram MakeMessage(int number, int bodyLen)
+{
+	Datagram datagram(FEC_HEADER_LEN + bodyLen);
+	FecWriteHeader(datagram.data(), ASTEROID_DESTROYED, (uint32_t)bodyLen);
+	for (int i = 0; i < bodyLen; ++i) datagram[FEC_HEADER_LEN + i] = (char)(number * 31 + i);
+	if (bodyLen >= (int)sizeof(int)) std::memcpy(datagram.data() + FEC_HEADER_LEN, &number, sizeof(number));
+	return datagram;
+}
+
+static int MessageNumber(const char* data)
+{
+	int number;
+	std::memcpy(&number, data + FEC_HEADER_LEN, sizeof(number));
+	return number;
+}
+
+static uint32_t BodyLength(const char* datagram)
+{
+	return ((uint32_t)(uint8_t)datagram[1] << 24) | ((uint32_t)(uint8_t)datagram[2] << 16) |
+		((uint32_t)(uint8_t)datagram[3] << 8) | (uint32_t)(uint8_t)datagram[4];
+}
+
+// what the client does with a datagram off the wire, the inner ones come out in fn
+template <typename TFn>
+static void Receive(FecDecoder& decoder, const char* datagram, int len, TFn&& fn)
+{
+	const char* body = datagram + FEC_HEADER_LEN;
+	int bodyLen = len - FEC_HEADER_LEN;
+	if (datagram[0] == FEC_DATA) decoder.OnData(body, bodyLen, fn);
+	else if (datagram[0] == FEC_PARITY) decoder.OnParity(body, bodyLen, fn);
+}
+
+// one group of messages, wrapped and closed, everything that would go on the wire
+static std::vector<Datagram> EncodeGroup(FecEncoder& encoder, const std::vector<Datagram>& messages)
+{
+	std::vector<Datagram> wire;
+	char out[MAX_STR_LEN];
+	for (const Datagram& message : messages)
+	{
+		int len = encoder.Wrap(message.data(), (int)message.size(), out);
+		CHECK(len > 0);
+		wire.emplace_back(out, out + len);
+	}
+	int len = encoder.Close(out);
+	CHECK(len > 0);
+	wire.emplace_back(out, out + len);
+	return wire;
+}
+
+static void TestRoundTrip()
+{
+	std::printf("round trip\n");
+	FecEncoder encoder;
+	FecDecoder decoder;
+
+	std::vector<Datagram> messages;
+	for (int i = 0; i < 6; ++i) messages.push_back(MakeMessage(i, 4 + i * 37));
+	std::vector<Datagram> wire = EncodeGroup(encoder, messages);
+	CHECK(wire.size() == messages.size() + 1);
+	CHECK(wire.back()[0] == FEC_PARITY);
+
+	std::vector<Datagram> out;
+	for (const Datagram& d : wire)
+	{
+		Receive(decoder, d.data(), (int)d.size(), [&](const char* data, int len) { out.emplace_back(data, data + len); });
+	}
+	CHECK(out == messages);
+	CHECK(decoder.Recovered() == 0);
+
+	uint32_t received, lost;
+	decoder.TakeStats(received, lost);
+	CHECK(received == wire.size());
+	CHECK(lost == 0);
+}
+
+// any one datagram of a group can go, the parity brings it back
+static void TestSingleLoss()
+{
+	std::printf("single loss\n");
+	const int groupSize = 5;
+	for (int missing = 0; missing <= groupSize; ++missing)
+	{
+		FecEncoder encoder;
+		FecDecoder decoder;
+		std::vector<Datagram> messages;
+		// different lengths, so a rebuilt one has to get its own length back too
+		for (int i = 0; i < groupSize; ++i) messages.push_back(MakeMessage(i, 8 + (i * 53) % 300));
+		std::vector<Datagram> wire = EncodeGroup(encoder, messages);
+
+		std::vector<Datagram> out;
+		for (int i = 0; i < (int)wire.size(); ++i)
+		{
+			if (i == missing) continue;
+			Receive(decoder, wire[i].data(), (int)wire[i].size(), [&](const char* data, int len) { out.emplace_back(data, data + len); });
+		}
+
+		// the parity itself going missing loses nothing
+		const bool parityLost = missing == groupSize;
+		CHECK(out.size() == messages.size());
+		CHECK(decoder.Recovered() == (parityLost ? 0u : 1u));
+		if (!parityLost && out.size() == messages.size())
+		{
+			CHECK(out.back() == messages[missing]);
+		}
+		for (const Datagram& d : out)
+		{
+			int n = MessageNumber(d.data());
+			CHECK(n >= 0 && n < groupSize && d == messages[n]);
+		}
+
+		// a group is counted when its parity comes in. without one it waits until it falls
+		// out of the decoder's window
+		uint32_t received, lost;
+		decoder.TakeStats(received, lost);
+		CHECK(received == (parityLost ? 0u : (uint32_t)groupSize));
+		CHECK(lost == (parityLost ? 0u : 1u));
+	}
+}
+
+static void TestDoubleLoss()
+{
+	std::printf("double loss\n");
+	FecEncoder encoder;
+	FecDecoder decoder;
+	std::vector<Datagram> messages;
+	for (int i = 0; i < 4; ++i) messages.push_back(MakeMessage(i, 40));
+	std::vector<Datagram> wire = EncodeGroup(encoder, messages);
+
+	int delivered = 0;
+	for (int i = 0; i < (int)wire.size(); ++i)
+	{
+		if (i == 1 || i == 2) continue;
+		Receive(decoder, wire[i].data(), (int)wire[i].size(), [&](const char*, int) { ++delivered; });
+	}
+	CHECK(delivered == 2);
+	CHECK(decoder.Recovered() == 0);
+
+	uint32_t received, lost;
+	decoder.TakeStats(received, lost);
+	CHECK(received == 3);
+	CHECK(lost == 2);
+}
+
+static void TestGroupSizeForLoss()
+{
+	std::printf("group size for loss\n");
+	CHECK(FecGroupSizeForLoss(0.0) == FEC_MAX_GROUP);
+	CHECK(FecGroupSizeForLoss(-1.0) == FEC_MAX_GROUP);
+	CHECK(FecGroupSizeForLoss(0.5) == FEC_MIN_GROUP);
+	CHECK(FecGroupSizeForLoss(1.0) == FEC_MIN_GROUP);
+
+	int last = FEC_MAX_GROUP;
+	for (int step = 0; step <= 100; ++step)
+	{
+		double loss = step * 0.002;
+		int n = FecGroupSizeForLoss(loss);
+		CHECK(n >= FEC_MIN_GROUP && n <= FEC_MAX_GROUP);
+		// more loss never means bigger groups
+		CHECK(n <= last);
+		last = n;
+
+		// whatever it picked keeps 2+ losses in a group under target, unless it is
+		// already at the smallest group and cant do any better
+		double ok = std::pow(1.0 - loss, n + 1) + (n + 1) * loss * std::pow(1.0 - loss, n);
+		CHECK(n == FEC_MIN_GROUP || 1.0 - ok <= FEC_TARGET_RESIDUAL);
+	}
+}
+
+// the longest inner datagram that gets wrapped, data and parity both have to come out
+// at MAX_BODY_LEN or under or the client throws them away
+static void TestSizeLimit()
+{
+	std::printf("size limit\n");
+	FecEncoder encoder;
+	char out[MAX_STR_LEN];
+
+	Datagram biggest = MakeMessage(1, FEC_MAX_BODY_LEN);
+	CHECK((int)biggest.size() == FEC_MAX_INNER_LEN);
+	int len = encoder.Wrap(biggest.data(), (int)biggest.size(), out);
+	CHECK(len > 0);
+	CHECK(BodyLength(out) <= MAX_BODY_LEN);
+	CHECK((int)BodyLength(out) == len - FEC_HEADER_LEN);
+
+	len = encoder.Close(out);
+	CHECK(len > 0);
+	CHECK(BodyLength(out) <= MAX_BODY_LEN);
+
+	// one more byte goes out plain instead
+	Datagram tooBig = MakeMessage(2, FEC_MAX_BODY_LEN + 1);
+	CHECK(encoder.Wrap(tooBig.data(), (int)tooBig.size(), out) == 0);
+	CHECK(!encoder.GroupOpen());
+
+	// a full Packet, what a LOCKSTEP_FRAME could be before chunks were capped, is too big
+	Datagram fullPacket = MakeMessage(3, MAX_BODY_LEN);
+	CHECK(encoder.Wrap(fullPacket.data(), (int)fullPacket.size(), out) == 0);
+}
+
+// groups sized for the configured loss, sent through the emulator. most single losses
+// come back, the stats match the loss, and reporting them resizes the encoder's groups
+static void TestThroughEmulator()
+{
+	std::printf("through the emulator\n");
+	const double lossRate = 0.05;
+	const int messageCount = 20000;
+
+	NetScenarioStep step;
+	step.dirs[NET_DIR_DOWN] = true;
+	step.key = "loss";
+	step.value = "0.05";
+	NetEmulator<int> emulator;
+	emulator.Start({ step }, TEST_SEED);
+
+	FecEncoder encoder;
+	FecDecoder decoder;
+	const int groupSize = FecGroupSizeForLoss(lossRate);
+	CHECK(groupSize < FEC_MAX_GROUP);
+
+	Pcg32 rng;
+	rng.Seed(TEST_SEED);
+	std::vector<Datagram> messages;
+	std::vector<int> seen(messageCount, 0);
+	int wrong = 0;
+	uint32_t received = 0, lost = 0;
+	char out[MAX_STR_LEN];
+
+	auto deliver = [&]
+	{
+		emulator.Deliver(NET_DIR_DOWN, [&](const int&, const char* datagram, int len)
+			{
+				Receive(decoder, datagram, len, [&](const char* data, int dataLen)
+					{
+						int n = MessageNumber(data);
+						if (n < 0 || n >= messageCount || Datagram(data, data + dataLen) != messages[n]) ++wrong;
+						else ++seen[n];
+					});
+			});
+	};
+
+	for (int i = 0; i < messageCount; ++i)
+	{
+		messages.push_back(MakeMessage(i, 4 + (int)(rng.Next() % 400)));
+		int len = encoder.Wrap(messages[i].data(), (int)messages[i].size(), out);
+		emulator.Submit(NET_DIR_DOWN, out, len, 0);
+		if (i % groupSize == groupSize - 1)
+		{
+			len = encoder.Close(out);
+			emulator.Submit(NET_DIR_DOWN, out, len, 0);
+			deliver();
+		}
+	}
+	if (encoder.GroupOpen())
+	{
+		int len = encoder.Close(out);
+		emulator.Submit(NET_DIR_DOWN, out, len, 0);
+	}
+	deliver();
+	// the last few groups that lost their parity are still waiting in the window, too
+	// few to matter here
+	decoder.TakeStats(received, lost);
+
+	int arrived = 0, twice = 0;
+	for (int count : seen)
+	{
+		if (count > 0) ++arrived;
+		if (count > 1) ++twice;
+	}
+	NetEmulatorStats wireStats = emulator.GetStats(NET_DIR_DOWN);
+
+	CHECK(wrong == 0);
+	CHECK(twice == 0);
+	// without fec about 95% would make it, with it only groups losing 2+ lose anything
+	CHECK((double)arrived / messageCount > 0.99);
+	CHECK(decoder.Recovered() > 0);
+	CHECK_NEAR((double)lost / (received + lost), lossRate, 0.01);
+	CHECK(received <= wireStats.delivered && received + 2 * FEC_WINDOW * groupSize >= wireStats.delivered);
+
+	// the report the client sends back pulls the encoder to the same group size
+	FecEncoder fresh;
+	for (int i = 0; i < 40; ++i) fresh.ReportLoss(received, lost);
+	CHECK_NEAR(fresh.LossEstimate(), lossRate, 0.01);
+	CHECK(fresh.GroupSize() == FecGroupSizeForLoss(fresh.LossEstimate()));
+	CHECK(fresh.GroupSize() == groupSize);
+
+	// and back up once the loss goes away
+	for (int i = 0; i < 40; ++i) fresh.ReportLoss(1000, 0);
+	CHECK(fresh.GroupSize() == FEC_MAX_GROUP);
+}
+
+int main()
+{
+	TestRoundTrip();
+	TestSingleLoss();
+	TestDoubleLoss();
+	TestGroupSizeForLoss();
+	TestSizeLimit();
+	TestThroughEmulator();
+	return TestResult("Fec");
+}
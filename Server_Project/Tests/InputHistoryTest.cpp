@@ -0,0 +1,213 @@
+/*******************************************************************************
+ * Input history tests
+ *
+ * InputHistory the way the client fills it, written into a SHIP_MOVE body and
+ * read back with ReadInputHistory, then handed to an InputReceiver the way
+ * ProcessShipMovement does. Every frame has to come out once, in order, with
+ * the input it was pushed with.
+ *
+ * Covers the ring wrapping past INPUT_HISTORY_LEN, HasActivity, histories the
+ * reader turns away, and the receiver's duplicate, stale and recovered counts,
+ * including that Reset starts them over for the next player in the slot.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project InputHistoryTest.cpp -o inputhistorytest
+ ******************************************************************************/
+
+#include <cstring>
+#include <vector>
+#include "TestCommon.h"
+#include "InputHistory.h"
+
+// anything that isnt the same for neighbouring frames
+static uint8_t InputFor(uint32_t frame)
+{
+	return static_cast<uint8_t>(frame * 37 + 1);
+}
+
+// the history as it goes on the wire and comes off it again
+static bool RoundTrip(const InputHistory& history, InputHistoryMsg& msg)
+{
+	Packet packet(SHIP_MOVE);
+	history.Write(packet);
+	return ReadInputHistory(packet, msg);
+}
+
+struct Applied
+{
+	uint32_t frame;
+	uint8_t input;
+};
+
+static bool Deliver(InputReceiver& receiver, const InputHistory& history, std::vector<Applied>& applied)
+{
+	InputHistoryMsg msg;
+	if (!RoundTrip(history, msg)) return false;
+	return receiver.Accept(msg, [&](uint32_t frame, uint8_t input) { applied.push_back({ frame, input }); });
+}
+
+static void TestRingWrap()
+{
+	std::printf("ring wrap\n");
+	InputHistory history;
+	history.Reset();
+
+	// a few laps of the ring, only the last INPUT_HISTORY_LEN frames are left
+	const uint32_t last = INPUT_HISTORY_LEN * 3 + 5;
+	for (uint32_t frame = 1; frame <= last; ++frame)
+	{
+		history.Push(frame, InputFor(frame));
+
+		InputHistoryMsg msg;
+		CHECK(RoundTrip(history, msg));
+		CHECK(msg.newest == frame);
+		uint32_t expected = frame < INPUT_HISTORY_LEN ? frame : INPUT_HISTORY_LEN;
+		CHECK(msg.count == expected);
+		for (uint8_t i = 0; i < msg.count; ++i)
+		{
+			CHECK(msg.inputs[i] == InputFor(frame - msg.count + 1 + i));
+		}
+	}
+	CHECK(history.Newest() == last);
+}
+
+static void TestActivity()
+{
+	std::printf("activity\n");
+	InputHistory history;
+	history.Reset();
+	CHECK(!history.HasActivity());
+
+	history.Push(1, 4);
+	CHECK(history.HasActivity());
+
+	// a key let go still counts until it has gone round the whole ring
+	for (uint32_t frame = 2; frame <= INPUT_HISTORY_LEN; ++frame)
+	{
+		history.Push(frame, 0);
+		CHECK(history.HasActivity());
+	}
+	history.Push(INPUT_HISTORY_LEN + 1, 0);
+	CHECK(!history.HasActivity());
+}
+
+static void TestBadHistories()
+{
+	std::printf("bad histories\n");
+	struct Case
+	{
+		uint32_t newest;
+		uint8_t count;
+	};
+	// nothing in it, more than the ring holds, frames from before frame 1
+	const Case cases[] = { { 5, 0 }, { 50, INPUT_HISTORY_LEN + 1 }, { 2, 3 } };
+	for (const Case& c : cases)
+	{
+		Packet packet(SHIP_MOVE);
+		packet << c.newest << c.count;
+		for (uint8_t i = 0; i < c.count; ++i) packet << (uint8_t)1;
+		InputHistoryMsg msg;
+		CHECK(!ReadInputHistory(packet, msg));
+	}
+}
+
+static void TestReceiver()
+{
+	std::printf("receiver\n");
+	InputHistory history;
+	history.Reset();
+	InputReceiver receiver;
+	std::vector<Applied> applied;
+
+	// three frames in one packet, two of them are backup copies
+	for (uint32_t frame = 1; frame <= 3; ++frame) history.Push(frame, InputFor(frame));
+	CHECK(Deliver(receiver, history, applied));
+	CHECK(applied.size() == 3);
+	CHECK(receiver.GetStats().applied == 3);
+	CHECK(receiver.GetStats().recovered == 2);
+	CHECK(receiver.GetStats().duplicates == 0);
+
+	// the same packet again is stale, every frame in it a duplicate
+	CHECK(!Deliver(receiver, history, applied));
+	CHECK(applied.size() == 3);
+	CHECK(receiver.GetStats().stale == 1);
+	CHECK(receiver.GetStats().duplicates == 3);
+
+	// the packets for 4 and 5 got lost, 6 brings them along
+	for (uint32_t frame = 4; frame <= 6; ++frame) history.Push(frame, InputFor(frame));
+	CHECK(Deliver(receiver, history, applied));
+	CHECK(applied.size() == 6);
+	CHECK(receiver.GetStats().applied == 6);
+	CHECK(receiver.GetStats().recovered == 4);
+	CHECK(receiver.GetStats().duplicates == 6);
+	CHECK(receiver.LastFrame() == 6);
+
+	// every frame once, in order, with its own input
+	for (size_t i = 0; i < applied.size(); ++i)
+	{
+		CHECK(applied[i].frame == i + 1);
+		CHECK(applied[i].input == InputFor(applied[i].frame));
+	}
+
+	// a packet that arrives late after a newer one has nothing left to give
+	InputHistory late;
+	late.Reset();
+	for (uint32_t frame = 1; frame <= 5; ++frame) late.Push(frame, InputFor(frame));
+	CHECK(!Deliver(receiver, late, applied));
+	CHECK(receiver.GetStats().stale == 2);
+
+	// the next player in the slot starts from frame 1 with clean counts
+	receiver.Reset();
+	CHECK(receiver.LastFrame() == 0);
+	CHECK(receiver.GetStats().applied == 0);
+	CHECK(receiver.GetStats().recovered == 0);
+	CHECK(receiver.GetStats().duplicates == 0);
+	CHECK(receiver.GetStats().stale == 0);
+
+	InputHistory next;
+	next.Reset();
+	next.Push(1, 9);
+	applied.clear();
+	CHECK(Deliver(receiver, next, applied));
+	CHECK(applied.size() == 1 && applied[0].frame == 1 && applied[0].input == 9);
+	CHECK(receiver.GetStats().applied == 1);
+	CHECK(receiver.GetStats().recovered == 0);
+}
+
+// a long run losing every third packet, the history covers every gap
+static void TestLossyRun()
+{
+	std::printf("lossy run\n");
+	InputHistory history;
+	history.Reset();
+	InputReceiver receiver;
+	std::vector<Applied> applied;
+
+	const uint32_t frames = INPUT_HISTORY_LEN * 50;
+	uint32_t lost = 0;
+	for (uint32_t frame = 1; frame <= frames; ++frame)
+	{
+		history.Push(frame, InputFor(frame));
+		if (frame % 3 == 0)
+		{
+			++lost;
+			continue;
+		}
+		CHECK(Deliver(receiver, history, applied));
+	}
+
+	// the last frame isnt one of the lost ones, so every lost frame has a later packet carrying it
+	CHECK(applied.size() == frames);
+	for (size_t i = 0; i < applied.size(); ++i) CHECK(applied[i].frame == i + 1);
+	CHECK(receiver.GetStats().recovered == lost);
+	CHECK(receiver.GetStats().stale == 0);
+}
+
+int main()
+{
+	TestRingWrap();
+	TestActivity();
+	TestBadHistories();
+	TestReceiver();
+	TestLossyRun();
+	return TestResult("InputHistory");
+}
@@ -0,0 +1,234 @@
+/*******************************************************************************
+ * Area of interest tests
+ *
+ * One client's ship sits still while another ship and some asteroids move
+ * around it, and ComputeInterest runs after each move the way UpdateInterest
+ * does, with grids built like BuildInterestGrids builds them.
+ *
+ * Covers the hysteresis (in at the radius, out only past the leave radius,
+ * nothing flapping on the edge), the client's own ship always being in,
+ * ForgetShip sending a reused slot as an enter, and asteroids: tracked by
+ * handle while the packed arrays shuffle, and no leave for one that was
+ * destroyed.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project InterestTest.cpp -o interesttest
+ ******************************************************************************/
+
+#include <vector>
+#include "TestCommon.h"
+#include "Interest.h"
+
+const float TEST_RADIUS = 200.0f;
+const float TEST_LEAVE = TEST_RADIUS * INTEREST_LEAVE_SCALE;
+const int TEST_SHIPS = 3;
+const int SELF = 0;
+const int OTHER = 1;
+
+struct TestWorld
+{
+	ShipStore ships;
+	AsteroidStore asteroids;
+	SpatialHash shipGrid, asteroidGrid;
+	InterestSet set;
+	InterestChange change;
+	std::vector<uint8_t> inSim;
+
+	TestWorld()
+	{
+		ships.Resize(TEST_SHIPS);
+		// everyone else well out of range until a test moves them
+		for (int i = 1; i < TEST_SHIPS; ++i) ships.xPos[i] = i % 2 ? 900.0f : -900.0f;
+		asteroids.Reset(64);
+		inSim.assign(TEST_SHIPS, 1);
+		shipGrid.Reset(-1000.0f, -1000.0f, 1000.0f, 1000.0f, 64.0f);
+		asteroidGrid.Reset(-1000.0f, -1000.0f, 1000.0f, 1000.0f, 64.0f);
+	}
+
+	SlotMap::Handle AddAsteroid(float x, float y)
+	{
+		Asteroid asteroid{};
+		asteroid.xPos = x;
+		asteroid.yPos = y;
+		asteroid.xScale = asteroid.yScale = 30.0f;
+		return asteroids.Add(asteroid, 0);
+	}
+
+	void MoveAsteroid(SlotMap::Handle handle, float x, float y)
+	{
+		int i = asteroids.ids.Find(handle);
+		asteroids.xPos[i] = x;
+		asteroids.yPos[i] = y;
+	}
+
+	// one interest pass, change holds what it found
+	void Pass()
+	{
+		shipGrid.Clear();
+		for (int i = 0; i < TEST_SHIPS; ++i)
+		{
+			if (inSim[i]) shipGrid.Insert(i, ships.xPos[i], ships.yPos[i], ships.xPos[i], ships.yPos[i]);
+		}
+		shipGrid.Build();
+		asteroidGrid.Clear();
+		for (int i = 0; i < asteroids.Count(); ++i)
+		{
+			asteroidGrid.Insert(i, asteroids.xPos[i], asteroids.yPos[i], asteroids.xPos[i], asteroids.yPos[i]);
+		}
+		asteroidGrid.Build();
+
+		change.Clear();
+		ComputeInterest(set, SELF, TEST_RADIUS, ships, shipGrid, TEST_SHIPS, asteroids, asteroidGrid, change);
+	}
+
+	bool ShipCameIn(int id) const { return change.shipsIn.size() == 1 && change.shipsIn[0] == id && change.shipsOut.empty(); }
+	bool ShipWentOut(int id) const { return change.shipsOut.size() == 1 && change.shipsOut[0] == id && change.shipsIn.empty(); }
+	bool NoShipChange() const { return change.shipsIn.empty() && change.shipsOut.empty(); }
+};
+
+static void TestShipHysteresis()
+{
+	std::printf("ship hysteresis\n");
+	TestWorld world;
+
+	// the first pass has the client's own ship and nothing else
+	world.Pass();
+	CHECK(world.ShipCameIn(SELF));
+	CHECK(world.set.SeesShip(SELF));
+	world.Pass();
+	CHECK(world.NoShipChange());
+
+	// between the two radii from outside, still out
+	world.ships.xPos[OTHER] = TEST_RADIUS + 10.0f;
+	world.Pass();
+	CHECK(world.NoShipChange());
+	CHECK(!world.set.SeesShip(OTHER));
+
+	// inside the radius, in
+	world.ships.xPos[OTHER] = TEST_RADIUS - 10.0f;
+	world.Pass();
+	CHECK(world.ShipCameIn(OTHER));
+
+	// back out between the two, stays in however long it sits there
+	world.ships.xPos[OTHER] = TEST_RADIUS + 10.0f;
+	for (int i = 0; i < 5; ++i)
+	{
+		world.Pass();
+		CHECK(world.NoShipChange());
+		CHECK(world.set.SeesShip(OTHER));
+	}
+
+	// wobbling across the radius doesnt flap either
+	for (int i = 0; i < 10; ++i)
+	{
+		world.ships.xPos[OTHER] = TEST_RADIUS + (i % 2 ? 5.0f : -5.0f);
+		world.Pass();
+		CHECK(world.NoShipChange());
+	}
+
+	// past the leave radius, out, once
+	world.ships.xPos[OTHER] = TEST_LEAVE + 10.0f;
+	world.Pass();
+	CHECK(world.ShipWentOut(OTHER));
+	world.Pass();
+	CHECK(world.NoShipChange());
+
+	// diagonal distances count the same as straight ones
+	world.ships.xPos[OTHER] = TEST_RADIUS * 0.7f;
+	world.ships.yPos[OTHER] = TEST_RADIUS * 0.7f;
+	world.Pass();
+	CHECK(world.ShipCameIn(OTHER));
+
+	// the client's own ship never leaves, wherever it goes
+	world.ships.xPos[SELF] = 800.0f;
+	world.Pass();
+	CHECK(world.set.SeesShip(SELF));
+	CHECK(world.ShipWentOut(OTHER));
+}
+
+static void TestShipSlotReuse()
+{
+	std::printf("ship slot reuse\n");
+	TestWorld world;
+	world.ships.xPos[OTHER] = 50.0f;
+	world.Pass();
+	CHECK(world.set.SeesShip(OTHER));
+
+	// left, the ship is gone from the grid and goes out
+	world.inSim[OTHER] = 0;
+	world.Pass();
+	CHECK(world.ShipWentOut(OTHER));
+
+	// someone new in the slot right where the old one was, an enter
+	world.inSim[OTHER] = 1;
+	world.Pass();
+	CHECK(world.ShipCameIn(OTHER));
+
+	// a join that reuses the slot without a pass in between still comes as an enter
+	world.set.ForgetShip(OTHER);
+	world.Pass();
+	CHECK(world.ShipCameIn(OTHER));
+	world.set.ForgetShip(-1);
+	world.set.ForgetShip(TEST_SHIPS + 5);
+}
+
+static void TestAsteroids()
+{
+	std::printf("asteroids\n");
+	TestWorld world;
+	SlotMap::Handle near = world.AddAsteroid(100.0f, 0.0f);
+	SlotMap::Handle edge = world.AddAsteroid(0.0f, TEST_RADIUS + 20.0f);
+	SlotMap::Handle far = world.AddAsteroid(-700.0f, 0.0f);
+
+	world.Pass();
+	CHECK(world.change.asteroidsIn.size() == 1);
+	CHECK(world.asteroids.HandleAt(world.change.asteroidsIn[0]) == near);
+	CHECK(world.set.SeesAsteroid(near) && !world.set.SeesAsteroid(edge) && !world.set.SeesAsteroid(far));
+
+	// the edge one comes in, then sits between the radii
+	world.MoveAsteroid(edge, 0.0f, TEST_RADIUS - 20.0f);
+	world.Pass();
+	CHECK(world.change.asteroidsIn.size() == 1 && world.asteroids.HandleAt(world.change.asteroidsIn[0]) == edge);
+	world.MoveAsteroid(edge, 0.0f, TEST_LEAVE - 20.0f);
+	world.Pass();
+	CHECK(world.change.Empty());
+	CHECK(world.set.SeesAsteroid(edge));
+
+	// the near one is removed, the far one moves into its dense index. only handles
+	// count so nothing changes for the client but the removal, and that goes as a
+	// collide elsewhere, not as a leave
+	world.asteroids.RemoveAt(world.asteroids.ids.Find(near));
+	world.Pass();
+	CHECK(world.change.Empty());
+	CHECK(!world.set.SeesAsteroid(near));
+	CHECK(world.set.SeesAsteroid(edge));
+
+	// out past the leave radius
+	world.MoveAsteroid(edge, 0.0f, TEST_LEAVE + 20.0f);
+	world.Pass();
+	CHECK(world.change.asteroidsOut.size() == 1 && world.change.asteroidsOut[0] == edge);
+	CHECK(world.change.asteroidsIn.empty());
+
+	// the far one flies in, then a brand new one in the removed one's slot spawns right on
+	// top of us, both come in and the set stays sorted
+	world.MoveAsteroid(far, -50.0f, 0.0f);
+	SlotMap::Handle fresh = world.AddAsteroid(10.0f, 10.0f);
+	CHECK((fresh & 0xFFFF) == (near & 0xFFFF));
+	world.Pass();
+	CHECK(world.change.asteroidsIn.size() == 2);
+	CHECK(world.set.SeesAsteroid(far) && world.set.SeesAsteroid(fresh) && !world.set.SeesAsteroid(near));
+	CHECK(std::is_sorted(world.set.asteroids.begin(), world.set.asteroids.end()));
+
+	// Clear, like a join does, sends everything in range again
+	world.set.Clear();
+	world.Pass();
+	CHECK(world.change.asteroidsIn.size() == 2);
+	CHECK(world.ShipCameIn(SELF));
+}
+
+int main()
+{
+	TestShipHysteresis();
+	TestShipSlotReuse();
+	TestAsteroids();
+	return TestResult("Interest");
+}
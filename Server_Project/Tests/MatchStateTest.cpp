@@ -0,0 +1,213 @@
+/*******************************************************************************
+ * Match state tests
+ *
+ * A room's match walked through lobby -> running -> ended -> resetting with
+ * NextMatchState and MatchAfterReset, the way UpdateMatch and SetMatchState
+ * move it, checking after every step whether the room takes a join.
+ *
+ * Covers a match ending when the world is cleared, staying ended until the
+ * rematch is due, resetting straight into a rematch with whoever stayed or
+ * back to lobby when they all left, a running match everyone left resetting
+ * instead of ending, lobby only leaving on a join, and HasSpace turning joins
+ * away while ENDED or RESETTING even with free slots, so PickForJoin opens
+ * another room for them.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project MatchStateTest.cpp -o matchstatetest
+ ******************************************************************************/
+
+#include <cfloat>
+#include <cstring>
+#include "TestCommon.h"
+#include "Room.h"
+
+const int TEST_PLAYERS = 2;
+const uint64_t TEST_SEED = 77;
+
+// what the room's worker sees when UpdateMatch runs
+struct Situation
+{
+	bool anyoneConnected;
+	bool worldCleared;
+	bool rematchDue;
+};
+
+// UpdateMatch then SetMatchState, without the packets and the world. resetting is
+// only ever passed through, sawReset says it was and whether it took joins meanwhile
+static void Update(Room& room, const Situation& now, bool* sawReset = nullptr, bool* spaceWhileResetting = nullptr)
+{
+	MATCH_STATE state = static_cast<MATCH_STATE>(room.matchState.load());
+	MATCH_STATE next = NextMatchState(state, now.anyoneConnected, now.worldCleared, now.rematchDue);
+	if (next == state) return;
+	room.matchState = next;
+	if (next != MATCH_RESETTING) return;
+
+	if (sawReset) *sawReset = true;
+	if (spaceWhileResetting) *spaceWhileResetting = room.HasSpace();
+	room.matchState = MatchAfterReset(now.anyoneConnected);
+}
+
+// what JoinShip does to the match
+static void Join(Room& room)
+{
+	if (room.matchState == MATCH_LOBBY) room.matchState = MATCH_RUNNING;
+}
+
+static void SetUpRoom(Room& room)
+{
+	room.data.totalClients.Reserve(TEST_PLAYERS);
+	std::lock_guard<std::mutex> lock(room.data.clientMutex);
+	room.data.totalClients.Grow();
+}
+
+static void TestTransitions()
+{
+	std::printf("transitions\n");
+	const Situation playing{ true, false, false };
+	const Situation cleared{ true, true, false };
+	const Situation rematch{ true, true, true };
+
+	Room room;
+	SetUpRoom(room);
+	CHECK(room.matchState == MATCH_LOBBY);
+	CHECK(room.HasSpace());
+
+	// lobby waits for a join whatever else is going on
+	Update(room, rematch);
+	CHECK(room.matchState == MATCH_LOBBY);
+	Join(room);
+	CHECK(room.matchState == MATCH_RUNNING);
+	CHECK(room.HasSpace());
+
+	// a join while running changes nothing
+	Join(room);
+	Update(room, playing);
+	CHECK(room.matchState == MATCH_RUNNING);
+
+	// the last asteroid goes, the results are up and no one new comes in
+	Update(room, cleared);
+	CHECK(room.matchState == MATCH_ENDED);
+	CHECK(!room.HasSpace());
+	for (int i = 0; i < 5; ++i) Update(room, cleared);
+	CHECK(room.matchState == MATCH_ENDED);
+	CHECK(!room.HasSpace());
+
+	// rematch: through resetting, which takes no joins either, and straight into running
+	bool sawReset = false;
+	bool spaceWhileResetting = true;
+	Update(room, rematch, &sawReset, &spaceWhileResetting);
+	CHECK(sawReset);
+	CHECK(!spaceWhileResetting);
+	CHECK(room.matchState == MATCH_RUNNING);
+	CHECK(room.HasSpace());
+
+	// ended again and everyone goes before the rematch, back to lobby for whoever is next
+	Update(room, cleared);
+	CHECK(room.matchState == MATCH_ENDED);
+	sawReset = false;
+	Update(room, Situation{ false, true, false }, &sawReset, &spaceWhileResetting);
+	CHECK(sawReset);
+	CHECK(!spaceWhileResetting);
+	CHECK(room.matchState == MATCH_LOBBY);
+	CHECK(room.HasSpace());
+
+	// running and everyone left, reset rather than end, even with the world cleared
+	Join(room);
+	sawReset = false;
+	Update(room, Situation{ false, true, true }, &sawReset);
+	CHECK(sawReset);
+	CHECK(room.matchState == MATCH_LOBBY);
+}
+
+static void TestNextMatchState()
+{
+	std::printf("next match state\n");
+	// every situation from every state
+	for (int bits = 0; bits < 8; ++bits)
+	{
+		const bool anyone = bits & 1;
+		const bool cleared = bits & 2;
+		const bool due = bits & 4;
+
+		CHECK(NextMatchState(MATCH_LOBBY, anyone, cleared, due) == MATCH_LOBBY);
+		CHECK(NextMatchState(MATCH_RESETTING, anyone, cleared, due) == MATCH_RESETTING);
+
+		MATCH_STATE running = NextMatchState(MATCH_RUNNING, anyone, cleared, due);
+		CHECK(running == (!anyone ? MATCH_RESETTING : cleared ? MATCH_ENDED : MATCH_RUNNING));
+
+		MATCH_STATE ended = NextMatchState(MATCH_ENDED, anyone, cleared, due);
+		CHECK(ended == (!anyone || due ? MATCH_RESETTING : MATCH_ENDED));
+	}
+	CHECK(MatchAfterReset(true) == MATCH_RUNNING);
+	CHECK(MatchAfterReset(false) == MATCH_LOBBY);
+}
+
+static void TestHasSpace()
+{
+	std::printf("has space\n");
+	Room room;
+	SetUpRoom(room);
+
+	// free slots or room to grow, only in lobby and running
+	const MATCH_STATE states[] = { MATCH_LOBBY, MATCH_RUNNING, MATCH_ENDED, MATCH_RESETTING };
+	for (MATCH_STATE state : states)
+	{
+		room.matchState = state;
+		CHECK(room.HasSpace() == (state == MATCH_LOBBY || state == MATCH_RUNNING));
+	}
+
+	// both slots taken, full whatever the state
+	{
+		std::lock_guard<std::mutex> lock(room.data.clientMutex);
+		room.data.totalClients.Grow();
+	}
+	for (MATCH_STATE state : states)
+	{
+		room.matchState = state;
+		CHECK(!room.HasSpace());
+	}
+
+	// someone left, their slot is free again
+	room.data.freeSlots.push_back(0);
+	for (MATCH_STATE state : states)
+	{
+		room.matchState = state;
+		CHECK(room.HasSpace() == (state == MATCH_LOBBY || state == MATCH_RUNNING));
+	}
+}
+
+// a join while the only room is showing results goes to a new room
+static void TestPickForJoin()
+{
+	std::printf("pick for join\n");
+	RoomManager manager;
+	manager.Reserve(2, TEST_PLAYERS, 16, 4, TEST_SEED);
+
+	Room* first = manager.PickForJoin();
+	CHECK(first != nullptr && first->id == 0);
+	CHECK(manager.PickForJoin() == first);
+
+	first->matchState = MATCH_ENDED;
+	Room* second = manager.PickForJoin();
+	CHECK(second != nullptr && second->id == 1);
+	CHECK(manager.Count() == 2);
+
+	first->matchState = MATCH_RESETTING;
+	CHECK(manager.PickForJoin() == second);
+
+	// both busy and no more rooms to open
+	second->matchState = MATCH_ENDED;
+	CHECK(manager.PickForJoin() == nullptr);
+
+	// the rematch starts, joins go back to the first room
+	first->matchState = MATCH_RUNNING;
+	CHECK(manager.PickForJoin() == first);
+}
+
+int main()
+{
+	TestTransitions();
+	TestNextMatchState();
+	TestHasSpace();
+	TestPickForJoin();
+	return TestResult("MatchState");
+}
@@ -0,0 +1,308 @@
+/*******************************************************************************
+ * NetEmulator tests
+ *
+ * Drives NetEmulator<int> directly, no sockets: submit a few thousand numbered
+ * datagrams under one set of conditions, let them come out and look at what
+ * arrived. Every emulator is started from a fixed seed so the rates are the
+ * same on every run, the tolerances only cover the gap between a seeded run
+ * and the configured rate.
+ *
+ * Covers loss, burst loss, duplication, reordering, latency, the bandwidth cap,
+ * scenario steps kicking in on time and per direction, and that the same seed
+ * gives the same run twice.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project NetEmulatorTest.cpp -o netemulatortest
+ ******************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TestCommon.h"
+#include "NetEmulator.h"
+
+typedef NetEmulator<int> Emulator;
+typedef std::chrono::steady_clock Clock;
+
+const unsigned int TEST_SEED = 1234;
+const int TEST_PACKETS = 20000;
+
+static NetScenarioStep Step(double at, const char* dir, const char* key, const char* value)
+{
+	NetScenarioStep step;
+	step.atSeconds = at;
+	step.dirs[NET_DIR_UP] = !std::strcmp(dir, "up") || !std::strcmp(dir, "both");
+	step.dirs[NET_DIR_DOWN] = !std::strcmp(dir, "down") || !std::strcmp(dir, "both");
+	step.key = key;
+	step.value = value;
+	return step;
+}
+
+static void SubmitNumbered(Emulator& emulator, NETDIR dir, int first, int count, int len = sizeof(int))
+{
+	std::vector<char> buffer(len > (int)sizeof(int) ? len : sizeof(int), 0);
+	for (int i = first; i < first + count; ++i)
+	{
+		std::memcpy(buffer.data(), &i, sizeof(i));
+		emulator.Submit(dir, buffer.data(), len, i);
+	}
+}
+
+// whatever is due right now, in the order it came out
+static std::vector<int> Drain(Emulator& emulator, NETDIR dir)
+{
+	std::vector<int> numbers;
+	emulator.Deliver(dir, [&](const int&, const char* data, int)
+		{
+			int n;
+			std::memcpy(&n, data, sizeof(n));
+			numbers.push_back(n);
+		});
+	return numbers;
+}
+
+static void TestLoss()
+{
+	std::printf("loss\n");
+	Emulator emulator;
+	emulator.Start({ Step(0, "up", "loss", "0.2") }, TEST_SEED);
+	SubmitNumbered(emulator, NET_DIR_UP, 0, TEST_PACKETS);
+	std::vector<int> arrived = Drain(emulator, NET_DIR_UP);
+
+	NetEmulatorStats stats = emulator.GetStats(NET_DIR_UP);
+	CHECK(stats.submitted == (uint64_t)TEST_PACKETS);
+	CHECK(stats.delivered == arrived.size());
+	CHECK(stats.dropped + stats.delivered == stats.submitted);
+	CHECK_NEAR((double)stats.dropped / TEST_PACKETS, 0.2, 0.015);
+	// nothing configured on the other direction
+	CHECK(!emulator.HasPending(NET_DIR_DOWN));
+	CHECK(emulator.GetStats(NET_DIR_DOWN).submitted == 0);
+}
+
+// gilbert-elliott with a bad state that loses everything: the long run loss is the
+// share of time spent in it, enter / (enter + exit), and losses come in runs
+// averaging 1 / exit
+static void TestBurstLoss()
+{
+	std::printf("burst loss\n");
+	Emulator emulator;
+	emulator.Start({ Step(0, "up", "burst_enter", "0.05"), Step(0, "up", "burst_exit", "0.25"),
+		Step(0, "up", "burst_loss", "1") }, TEST_SEED);
+	SubmitNumbered(emulator, NET_DIR_UP, 0, TEST_PACKETS);
+	std::vector<int> arrived = Drain(emulator, NET_DIR_UP);
+
+	NetEmulatorStats stats = emulator.GetStats(NET_DIR_UP);
+	CHECK_NEAR((double)stats.dropped / TEST_PACKETS, 0.05 / (0.05 + 0.25), 0.02);
+
+	int runs = 0;
+	int lost = 0;
+	int expected = 0;
+	for (int n : arrived)
+	{
+		if (n > expected)
+		{
+			++runs;
+			lost += n - expected;
+		}
+		expected = n + 1;
+	}
+	if (expected < TEST_PACKETS)
+	{
+		++runs;
+		lost += TEST_PACKETS - expected;
+	}
+	CHECK(lost == (int)stats.dropped);
+	CHECK(runs > 0);
+	if (runs > 0) CHECK_NEAR((double)lost / runs, 1.0 / 0.25, 0.5);
+}
+
+static void TestDuplication()
+{
+	std::printf("duplication\n");
+	Emulator emulator;
+	emulator.Start({ Step(0, "down", "duplicate", "0.1") }, TEST_SEED);
+	SubmitNumbered(emulator, NET_DIR_DOWN, 0, TEST_PACKETS);
+	std::vector<int> arrived = Drain(emulator, NET_DIR_DOWN);
+
+	NetEmulatorStats stats = emulator.GetStats(NET_DIR_DOWN);
+	CHECK(stats.dropped == 0);
+	CHECK(arrived.size() == (size_t)TEST_PACKETS + stats.duplicated);
+	CHECK_NEAR((double)stats.duplicated / TEST_PACKETS, 0.1, 0.01);
+
+	// every number shows up once or twice, never more
+	std::vector<int> seen(TEST_PACKETS, 0);
+	for (int n : arrived) ++seen[n];
+	int twice = 0;
+	bool inRange = true;
+	for (int count : seen)
+	{
+		if (count == 2) ++twice;
+		if (count < 1 || count > 2) inRange = false;
+	}
+	CHECK(inRange);
+	CHECK(twice == (int)stats.duplicated);
+}
+
+static void TestReordering()
+{
+	std::printf("reordering\n");
+	const int packets = 2000;
+	{
+		// no reorder, no jitter: straight fifo
+		Emulator emulator;
+		emulator.Start({ Step(0, "up", "latency", "5") }, TEST_SEED);
+		SubmitNumbered(emulator, NET_DIR_UP, 0, packets);
+		std::this_thread::sleep_for(std::chrono::milliseconds(30));
+		std::vector<int> arrived = Drain(emulator, NET_DIR_UP);
+		bool inOrder = arrived.size() == (size_t)packets;
+		for (size_t i = 0; inOrder && i < arrived.size(); ++i) inOrder = arrived[i] == (int)i;
+		CHECK(inOrder);
+	}
+
+	Emulator emulator;
+	emulator.Start({ Step(0, "up", "reorder", "0.2"), Step(0, "up", "reorder_delay", "20") }, TEST_SEED);
+	SubmitNumbered(emulator, NET_DIR_UP, 0, packets);
+
+	// the ones not held back are due at once, the held back ones 20ms later
+	std::vector<int> early = Drain(emulator, NET_DIR_UP);
+	CHECK(emulator.HasPending(NET_DIR_UP));
+	std::this_thread::sleep_for(std::chrono::milliseconds(40));
+	std::vector<int> late = Drain(emulator, NET_DIR_UP);
+
+	NetEmulatorStats stats = emulator.GetStats(NET_DIR_UP);
+	CHECK(early.size() + late.size() == (size_t)packets);
+	CHECK(late.size() == stats.reordered);
+	CHECK_NEAR((double)stats.reordered / packets, 0.2, 0.03);
+
+	// each part keeps its own order, and a held back packet comes after later ones
+	bool earlyOrdered = true, lateOrdered = true;
+	for (size_t i = 1; i < early.size(); ++i) earlyOrdered = earlyOrdered && early[i - 1] < early[i];
+	for (size_t i = 1; i < late.size(); ++i) lateOrdered = lateOrdered && late[i - 1] < late[i];
+	CHECK(earlyOrdered);
+	CHECK(lateOrdered);
+	CHECK(!late.empty() && !early.empty() && late.front() < early.back());
+}
+
+static void TestLatency()
+{
+	std::printf("latency and jitter\n");
+	Emulator emulator;
+	emulator.Start({ Step(0, "up", "latency", "40"), Step(0, "up", "jitter", "10") }, TEST_SEED);
+	auto start = Clock::now();
+	SubmitNumbered(emulator, NET_DIR_UP, 0, 200);
+
+	// nothing can be due before latency - jitter
+	std::vector<int> tooSoon = Drain(emulator, NET_DIR_UP);
+	bool stillEarly = Clock::now() - start < std::chrono::milliseconds(30);
+	CHECK(!stillEarly || tooSoon.empty());
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(80));
+	std::vector<int> arrived = Drain(emulator, NET_DIR_UP);
+	CHECK(tooSoon.size() + arrived.size() == 200);
+	CHECK(!emulator.HasPending(NET_DIR_UP));
+}
+
+// 1000 byte packets on a 800 kbps link are 10ms each on the wire, they queue up
+// behind each other even with no latency set
+static void TestBandwidth()
+{
+	std::printf("bandwidth\n");
+	const int packets = 10;
+	Emulator emulator;
+	emulator.Start({ Step(0, "down", "bandwidth", "800") }, TEST_SEED);
+	auto start = Clock::now();
+	SubmitNumbered(emulator, NET_DIR_DOWN, 0, packets, 1000);
+
+	std::vector<double> arrivedMs;
+	while (arrivedMs.size() < (size_t)packets && Clock::now() - start < std::chrono::seconds(2))
+	{
+		std::vector<int> arrived = Drain(emulator, NET_DIR_DOWN);
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		for (size_t i = 0; i < arrived.size(); ++i) arrivedMs.push_back(ms);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	CHECK(arrivedMs.size() == (size_t)packets);
+	// can come out late when the machine is busy, never early
+	for (size_t i = 0; i < arrivedMs.size(); ++i) CHECK(arrivedMs[i] >= (i + 1) * 10.0 - 0.5);
+}
+
+// steps kick in once the emulator has been running that long, only on their direction
+static void TestScenarioSteps()
+{
+	std::printf("scenario steps\n");
+	Emulator emulator;
+	emulator.Start({ Step(0, "both", "preset", "perfect"), Step(0.05, "up", "loss", "1") }, TEST_SEED);
+
+	SubmitNumbered(emulator, NET_DIR_UP, 0, 100);
+	CHECK(Drain(emulator, NET_DIR_UP).size() == 100);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(70));
+	SubmitNumbered(emulator, NET_DIR_UP, 100, 100);
+	SubmitNumbered(emulator, NET_DIR_DOWN, 100, 100);
+	CHECK(Drain(emulator, NET_DIR_UP).empty());
+	CHECK(Drain(emulator, NET_DIR_DOWN).size() == 100);
+	CHECK(emulator.GetStats(NET_DIR_UP).dropped == 100);
+
+	// the same thing from a script file
+	const char* path = "netemulatortest_scenario.txt";
+	{
+		std::ofstream file(path);
+		file << "# comment\n0 both preset mobile_3g\n\n0.5 down loss 0.5\nnot a step\n";
+	}
+	std::vector<NetScenarioStep> steps;
+	CHECK(LoadNetScenario(path, steps));
+	std::remove(path);
+	CHECK(steps.size() == 2);
+	if (steps.size() == 2)
+	{
+		CHECK(steps[0].dirs[NET_DIR_UP] && steps[0].dirs[NET_DIR_DOWN]);
+		CHECK(steps[1].atSeconds == 0.5 && !steps[1].dirs[NET_DIR_UP] && steps[1].dirs[NET_DIR_DOWN]);
+		CHECK(steps[1].key == "loss" && steps[1].value == "0.5");
+	}
+
+	NetConditions conditions;
+	CHECK(ApplyNetSetting(conditions, "preset", "mobile_3g"));
+	CHECK(conditions.latencyMs == 120.0f && conditions.bandwidthKbps == 750.0f);
+	CHECK(ApplyNetSetting(conditions, "jitter", "3"));
+	CHECK(conditions.jitterMs == 3.0f);
+	CHECK(!ApplyNetSetting(conditions, "preset", "carrier_pigeon"));
+	CHECK(!ApplyNetSetting(conditions, "nonsense", "1"));
+}
+
+// same seed and conditions, same packets lost and doubled
+static void TestSeeded()
+{
+	std::printf("seeded runs repeat\n");
+	std::vector<NetScenarioStep> steps = { Step(0, "up", "loss", "0.1"), Step(0, "up", "duplicate", "0.1"),
+		Step(0, "up", "burst_enter", "0.02"), Step(0, "up", "burst_exit", "0.3") };
+
+	Emulator a, b, c;
+	a.Start(steps, TEST_SEED);
+	b.Start(steps, TEST_SEED);
+	c.Start(steps, TEST_SEED + 100);
+	SubmitNumbered(a, NET_DIR_UP, 0, 5000);
+	SubmitNumbered(b, NET_DIR_UP, 0, 5000);
+	SubmitNumbered(c, NET_DIR_UP, 0, 5000);
+	std::vector<int> fromA = Drain(a, NET_DIR_UP);
+	std::vector<int> fromB = Drain(b, NET_DIR_UP);
+	std::vector<int> fromC = Drain(c, NET_DIR_UP);
+	CHECK(fromA == fromB);
+	CHECK(fromA != fromC);
+}
+
+int main()
+{
+	TestLoss();
+	TestBurstLoss();
+	TestDuplication();
+	TestReordering();
+	TestLatency();
+	TestBandwidth();
+	TestScenarioSteps();
+	TestSeeded();
+	return TestResult("NetEmulator");
+}
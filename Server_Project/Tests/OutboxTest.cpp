@@ -0,0 +1,232 @@
+/*******************************************************************************
+ * Outbox tests
+ *
+ * Outboxes filled with numbered payloads, some movement and some not, the way
+ * the worker and the receive thread queue into them, then taken the way a
+ * flush takes them.
+ *
+ * Covers the drop policy: under the limit everything goes in order, at the
+ * limit the oldest movement makes way, movement with none older to drop is
+ * the one dropped, anything else goes in over the limit and is counted. Then
+ * a long random run where nothing but movement is ever lost, what comes out
+ * keeps its order, and the outbox never holds more than the limit unless all
+ * of it is messages that cant be dropped. Also PutBack putting unsent
+ * messages in front and trimming back to the limit, TakeStats, one payload
+ * shared by several outboxes, and MakePayload's [id][len][body].
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project OutboxTest.cpp -o outboxtest
+ ******************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include "TestCommon.h"
+#include "Outbox.h"
+#include "Random.h"
+
+const unsigned int TEST_SEED = 1122;
+const size_t TEST_LIMIT = 8;
+
+// the number is the body, so whatever comes out can be told apart
+static PayloadRef Numbered(CMDID id, int number)
+{
+	Packet packet(id);
+	packet << number;
+	return MakePayload(packet);
+}
+
+static PayloadRef Move(int number) { return Numbered(STATE_UPDATE, number); }
+static PayloadRef Reliable(int number) { return Numbered(BULLET_COLLIDE, number); }
+
+static int NumberOf(const PayloadRef& payload)
+{
+	uint32_t net;
+	std::memcpy(&net, payload->bytes + 5, sizeof(net));
+	return static_cast<int>(ntohl(net));
+}
+
+static std::vector<int> TakeNumbers(Outbox& outbox)
+{
+	std::deque<PayloadRef> out;
+	outbox.Take(out);
+	std::vector<int> numbers;
+	for (const PayloadRef& payload : out) numbers.push_back(NumberOf(payload));
+	return numbers;
+}
+
+static void TestMakePayload()
+{
+	std::printf("make payload\n");
+	Packet packet(SHIP_MOVE);
+	packet << 7 << 2.5f;
+	PayloadRef payload = MakePayload(packet);
+	CHECK(payload->ID() == SHIP_MOVE);
+	CHECK(payload->len == 1 + 4 + 8);
+	uint32_t net;
+	std::memcpy(&net, payload->bytes + 1, sizeof(net));
+	CHECK(ntohl(net) == 8);
+	CHECK(std::memcmp(payload->bytes + 5, packet.body, 8) == 0);
+
+	CHECK(IsMovement(STATE_UPDATE) && IsMovement(SHIP_MOVE) && IsMovement(ASTEROID_UPDATE));
+	CHECK(!IsMovement(BULLET_COLLIDE) && !IsMovement(ENTITY_ENTER) && !IsMovement(GAME_OVER));
+}
+
+static void TestDropPolicy()
+{
+	std::printf("drop policy\n");
+	Outbox outbox;
+
+	// under the limit nothing goes
+	outbox.Push(Move(1), TEST_LIMIT);
+	outbox.Push(Reliable(2), TEST_LIMIT);
+	outbox.Push(Move(3), TEST_LIMIT);
+	for (int n = 4; n <= 8; ++n) outbox.Push(Reliable(n), TEST_LIMIT);
+	CHECK(outbox.Count() == TEST_LIMIT);
+
+	// full, a new snapshot pushes out the oldest movement
+	outbox.Push(Move(9), TEST_LIMIT);
+	CHECK(outbox.Count() == TEST_LIMIT);
+	// and a reliable one pushes out the next oldest
+	outbox.Push(Reliable(10), TEST_LIMIT);
+	CHECK(outbox.Count() == TEST_LIMIT);
+
+	// only 9 is movement now. full again, another reliable drops it
+	outbox.Push(Reliable(11), TEST_LIMIT);
+	CHECK(outbox.Count() == TEST_LIMIT);
+
+	// nothing left to drop: movement is turned away, reliable goes in over the limit
+	outbox.Push(Move(12), TEST_LIMIT);
+	CHECK(outbox.Count() == TEST_LIMIT);
+	outbox.Push(Reliable(13), TEST_LIMIT);
+	CHECK(outbox.Count() == TEST_LIMIT + 1);
+
+	OutboxStats stats = outbox.TakeStats();
+	CHECK(stats.dropped == 4);
+	CHECK(stats.overLimit == 1);
+	CHECK(stats.peak == TEST_LIMIT + 1);
+
+	CHECK(TakeNumbers(outbox) == std::vector<int>({ 2, 4, 5, 6, 7, 8, 10, 11, 13 }));
+	CHECK(outbox.Empty());
+
+	// the counts start over, the peak from how deep it was when they did
+	stats = outbox.TakeStats();
+	CHECK(stats.dropped == 0 && stats.overLimit == 0 && stats.peak == TEST_LIMIT + 1);
+	CHECK(outbox.TakeStats().peak == 0);
+}
+
+static void TestPutBack()
+{
+	std::printf("put back\n");
+	Outbox outbox;
+	for (int n = 1; n <= 4; ++n) outbox.Push(n % 2 ? Move(n) : Reliable(n), TEST_LIMIT);
+	std::deque<PayloadRef> unsent;
+	outbox.Take(unsent);
+
+	// queued while the flush was sending
+	for (int n = 5; n <= 10; ++n) outbox.Push(n % 2 ? Move(n) : Reliable(n), TEST_LIMIT);
+
+	// unsent goes in front, then the oldest movement goes until it fits again
+	outbox.PutBack(unsent, TEST_LIMIT);
+	CHECK(unsent.empty());
+	CHECK(outbox.Count() == TEST_LIMIT);
+	CHECK(TakeNumbers(outbox) == std::vector<int>({ 2, 4, 5, 6, 7, 8, 9, 10 }));
+
+	// all reliable, nothing can go
+	for (int n = 1; n <= 6; ++n) unsent.push_back(Reliable(n));
+	for (int n = 7; n <= 12; ++n) outbox.Push(Reliable(n), TEST_LIMIT);
+	outbox.PutBack(unsent, TEST_LIMIT);
+	CHECK(outbox.Count() == 12);
+	CHECK(TakeNumbers(outbox) == std::vector<int>({ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 }));
+}
+
+// a shared snapshot is one payload however many outboxes it is in
+static void TestShared()
+{
+	std::printf("shared payload\n");
+	PayloadRef snapshot = Move(1);
+	std::vector<Outbox> outboxes(16);
+	for (Outbox& outbox : outboxes) outbox.Push(snapshot, TEST_LIMIT);
+	CHECK(snapshot.use_count() == 17);
+
+	// dropping it from one leaves everyone else's
+	for (int n = 2; n < 2 + (int)TEST_LIMIT; ++n) outboxes[0].Push(Reliable(n), TEST_LIMIT);
+	CHECK(snapshot.use_count() == 16);
+	for (size_t i = 1; i < outboxes.size(); ++i) CHECK(TakeNumbers(outboxes[i]) == std::vector<int>({ 1 }));
+}
+
+static void TestRandomRun()
+{
+	std::printf("random run\n");
+	Pcg32 rng;
+	rng.Seed(TEST_SEED);
+	Outbox outbox;
+
+	std::vector<int> reliableIn, reliableOut, moveOut;
+	int next = 0;
+	uint64_t dropped = 0;
+	int overWithMovement = 0;
+	for (int round = 0; round < 2000; ++round)
+	{
+		// a burst of queueing, sometimes far more than the limit
+		int burst = (int)(rng.NextFloat() * 3 * TEST_LIMIT);
+		for (int n = 0; n < burst; ++n)
+		{
+			++next;
+			if (rng.NextFloat() < 0.8f) outbox.Push(Move(next), TEST_LIMIT);
+			else
+			{
+				outbox.Push(Reliable(next), TEST_LIMIT);
+				reliableIn.push_back(next);
+			}
+		}
+
+		// over the limit only ever when there is no movement left to drop
+		std::deque<PayloadRef> out;
+		outbox.Take(out);
+		if (out.size() > TEST_LIMIT)
+		{
+			for (const PayloadRef& payload : out)
+			{
+				if (IsMovement(payload->ID())) ++overWithMovement;
+			}
+		}
+
+		// a flush that gets some of it out and puts the rest back
+		size_t sent = (size_t)(rng.NextFloat() * (out.size() + 1)) % (out.size() + 1);
+		for (size_t i = 0; i < sent; ++i)
+		{
+			if (IsMovement(out[i]->ID())) moveOut.push_back(NumberOf(out[i]));
+			else reliableOut.push_back(NumberOf(out[i]));
+		}
+		std::deque<PayloadRef> unsent(out.begin() + sent, out.end());
+		outbox.PutBack(unsent, TEST_LIMIT);
+		dropped += outbox.TakeStats().dropped;
+	}
+
+	// whatever is still waiting goes out last
+	std::deque<PayloadRef> out;
+	outbox.Take(out);
+	for (const PayloadRef& payload : out)
+	{
+		if (IsMovement(payload->ID())) moveOut.push_back(NumberOf(payload));
+		else reliableOut.push_back(NumberOf(payload));
+	}
+
+	// every reliable message once, in the order it was queued, movement only ever dropped
+	CHECK(reliableOut == reliableIn);
+	CHECK(overWithMovement == 0);
+	CHECK(std::is_sorted(moveOut.begin(), moveOut.end()));
+	CHECK(moveOut.size() + reliableOut.size() + dropped == (size_t)next);
+	CHECK(dropped > 0);
+}
+
+int main()
+{
+	TestMakePayload();
+	TestDropPolicy();
+	TestPutBack();
+	TestShared();
+	TestRandomRun();
+	return TestResult("Outbox");
+}
@@ -0,0 +1,219 @@
+/*******************************************************************************
+ * Rewind history tests
+ *
+ * Records a field of moving asteroids into a RewindHistory tick by tick, with
+ * some going and new ones coming so slots get reused, then traces rewound
+ * shots through it. Every trace has to come out exactly like a brute force
+ * scan over every asteroid slot of each frame, same asteroid hit (or none)
+ * and the same end position.
+ *
+ * The frames' grids are built lazily and the ring reuses frames, so the same
+ * comparison runs again after the ring has gone round a few times: a frame
+ * that fell off the end must not hand its old grid to the frame recorded over
+ * it.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project RewindHistoryTest.cpp -o rewindhistorytest
+ ******************************************************************************/
+
+#include <vector>
+#include "TestCommon.h"
+#include "RewindHistory.h"
+#include "Random.h"
+
+const unsigned int TEST_SEED = 1357;
+const int TEST_FRAMES = 6;
+const int TEST_SHIPS = 4;
+const uint64_t TEST_TICK_MS = 16;
+const float TEST_BULLET_SPEED = 400.0f;
+const float TEST_BULLET_HALF_W = 10.0f;
+const float TEST_BULLET_HALF_H = 1.5f;
+
+// what TraceRewoundShot did before it had grids, every slot of every frame
+static RewindShot BruteTrace(const RewindHistory& history, int first, uint64_t fireTime, float x, float y,
+	float velX, float velY, float bulletHalfW, float bulletHalfH)
+{
+	RewindShot shot;
+	for (int f = first + 1; f < history.Count(); ++f)
+	{
+		const RewindFrame& frame = history[f];
+		uint64_t from = std::max(history[f - 1].time, fireTime);
+		float dt = frame.time > from ? (frame.time - from) * 0.001f : 0.0f;
+		x += velX * dt;
+		y += velY * dt;
+		if (dt <= 0.0f) continue;
+
+		SweptBox bullet{ x, y, bulletHalfW, bulletHalfH, velX, velY };
+		int hitSlot = -1;
+		for (int s = 0; s < (int)frame.asteroidHandle.size(); ++s)
+		{
+			if (frame.asteroidHandle[s] == SlotMap::INVALID) continue;
+			SweptBox asteroid{ frame.asteroidX[s], frame.asteroidY[s], frame.asteroidHalfW[s], frame.asteroidHalfH[s],
+				frame.asteroidVelX[s], frame.asteroidVelY[s] };
+			if (!SweptBoxHit(asteroid, bullet, dt)) continue;
+			if (hitSlot < 0 || frame.asteroidHandle[s] < frame.asteroidHandle[hitSlot]) hitSlot = s;
+		}
+
+		if (hitSlot >= 0)
+		{
+			shot.asteroid = frame.asteroidHandle[hitSlot];
+			shot.x = x;
+			shot.y = y;
+			return shot;
+		}
+	}
+	shot.x = x;
+	shot.y = y;
+	return shot;
+}
+
+struct TestWorld
+{
+	ShipStore ships;
+	AsteroidStore asteroids;
+	RewindHistory history;
+	uint32_t tick = 0;
+	Pcg32 rng;
+
+	TestWorld()
+	{
+		rng.Seed(TEST_SEED);
+		ships.Resize(TEST_SHIPS);
+		asteroids.Reset(4096);
+		history.Reset(TEST_FRAMES);
+	}
+
+	void AddAsteroid(float x, float y, float velX, float velY, float size)
+	{
+		Asteroid asteroid{};
+		asteroid.xPos = x;
+		asteroid.yPos = y;
+		asteroid.vel_x = velX;
+		asteroid.vel_y = velY;
+		asteroid.xScale = size;
+		asteroid.yScale = size * 0.8f;
+		asteroids.Add(asteroid, tick);
+	}
+
+	void AddRandomAsteroid()
+	{
+		AddAsteroid(rng.NextFloat(-640.0f, 640.0f), rng.NextFloat(-360.0f, 360.0f), rng.NextFloat(-60.0f, 60.0f),
+			rng.NextFloat(-60.0f, 60.0f), rng.NextFloat(15.0f, 90.0f));
+	}
+
+	uint64_t TimeOf(uint32_t t) const { return 1000 + t * TEST_TICK_MS; }
+
+	// one tick: everything moves, churn of them go and as many new ones come
+	void Step(int churn)
+	{
+		++tick;
+		const float dt = TEST_TICK_MS * 0.001f;
+		for (int i = 0; i < asteroids.Count(); ++i)
+		{
+			asteroids.xPos[i] += asteroids.velX[i] * dt;
+			asteroids.yPos[i] += asteroids.velY[i] * dt;
+		}
+		for (int n = 0; n < churn && asteroids.Count() > 0; ++n)
+		{
+			asteroids.RemoveAt((int)(rng.NextFloat() * asteroids.Count()) % asteroids.Count());
+		}
+		for (int n = 0; n < churn; ++n) AddRandomAsteroid();
+		history.Record(tick, TimeOf(tick), ships, TEST_SHIPS, [](int) { return true; }, asteroids);
+	}
+};
+
+static bool SameShot(const RewindShot& a, const RewindShot& b)
+{
+	return a.asteroid == b.asteroid && a.x == b.x && a.y == b.y;
+}
+
+// shots fired from anywhere at any time the history still covers, and a bit before
+static int CompareShots(TestWorld& world, int shots, int& hits)
+{
+	int mismatches = 0;
+	const uint64_t oldest = world.history[0].time;
+	const uint64_t newest = world.history[world.history.Count() - 1].time;
+	for (int s = 0; s < shots; ++s)
+	{
+		uint64_t fireTime = oldest - 2 * TEST_TICK_MS + (uint64_t)(world.rng.NextFloat() * (newest - oldest + 2 * TEST_TICK_MS));
+		float x = world.rng.NextFloat(-640.0f, 640.0f);
+		float y = world.rng.NextFloat(-360.0f, 360.0f);
+		float angle = world.rng.NextFloat(-3.14159265f, 3.14159265f);
+		float velX = TEST_BULLET_SPEED * std::cos(angle);
+		float velY = TEST_BULLET_SPEED * std::sin(angle);
+
+		int first = world.history.FindAt(fireTime);
+		RewindShot expected = BruteTrace(world.history, first, fireTime, x, y, velX, velY, TEST_BULLET_HALF_W, TEST_BULLET_HALF_H);
+		RewindShot shot = TraceRewoundShot(world.history, first, fireTime, x, y, velX, velY, TEST_BULLET_HALF_W, TEST_BULLET_HALF_H);
+		if (!SameShot(shot, expected)) ++mismatches;
+		if (expected.asteroid != SlotMap::INVALID) ++hits;
+	}
+	return mismatches;
+}
+
+static void TestMatchesBruteForce()
+{
+	std::printf("matches brute force\n");
+	TestWorld world;
+	for (int i = 0; i < 600; ++i) world.AddRandomAsteroid();
+	for (int t = 0; t < TEST_FRAMES; ++t) world.Step(5);
+	CHECK(world.history.Count() == TEST_FRAMES);
+
+	int hits = 0;
+	CHECK(CompareShots(world, 3000, hits) == 0);
+	// a dense field, most shots hit something, but not all of them
+	CHECK(hits > 300 && hits < 2900);
+
+	// the ring goes round several times, every frame gets recorded over after its grid
+	// was built. each lap has to trace like brute force on the new contents
+	for (int lap = 0; lap < 4 * TEST_FRAMES; ++lap)
+	{
+		world.Step(40);
+		hits = 0;
+		CHECK(CompareShots(world, 200, hits) == 0);
+	}
+}
+
+// one asteroid only in frames that have since fallen off, one only in the new ones
+static void TestFallenOffFrame()
+{
+	std::printf("fallen off frame\n");
+	TestWorld world;
+	world.AddAsteroid(500.0f, 300.0f, 0.0f, 0.0f, 40.0f);
+	SlotMap::Handle old = world.asteroids.HandleAt(0);
+	for (int t = 0; t < TEST_FRAMES; ++t) world.Step(0);
+
+	// shot along y = 300 from the left, fired at the oldest frame so every grid gets built
+	auto fire = [&world](float y)
+	{
+		uint64_t fireTime = world.history[0].time;
+		int first = world.history.FindAt(fireTime);
+		return TraceRewoundShot(world.history, first, fireTime, 480.0f, y, TEST_BULLET_SPEED, 0.0f,
+			TEST_BULLET_HALF_W, TEST_BULLET_HALF_H);
+	};
+	CHECK(fire(300.0f).asteroid == old);
+
+	// it goes and a new one takes its slot somewhere else, then the ring goes round
+	world.asteroids.RemoveAt(0);
+	world.AddAsteroid(-500.0f, -300.0f, 0.0f, 0.0f, 40.0f);
+	SlotMap::Handle replacement = world.asteroids.HandleAt(0);
+	CHECK((replacement & 0xFFFF) == (old & 0xFFFF));
+	for (int t = 0; t < TEST_FRAMES; ++t) world.Step(0);
+
+	// nothing left where the old one was, and the new one is found where it is now
+	CHECK(fire(300.0f).asteroid == SlotMap::INVALID);
+	uint64_t fireTime = world.history[0].time;
+	int first = world.history.FindAt(fireTime);
+	RewindShot shot = TraceRewoundShot(world.history, first, fireTime, -520.0f, -300.0f, TEST_BULLET_SPEED, 0.0f,
+		TEST_BULLET_HALF_W, TEST_BULLET_HALF_H);
+	CHECK(shot.asteroid == replacement);
+
+	// a shot from before anything we keep starts at the oldest frame
+	CHECK(world.history.FindAt(world.history[0].time - 500) == 0);
+}
+
+int main()
+{
+	TestMatchesBruteForce();
+	TestFallenOffFrame();
+	return TestResult("RewindHistory");
+}
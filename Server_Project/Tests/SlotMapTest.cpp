@@ -0,0 +1,269 @@
+/*******************************************************************************
+ * Slot map tests
+ *
+ * SlotMap on its own against a plain list of what should be alive, then the
+ * BulletStore on top of it with the net ids clients pick.
+ *
+ * Covers handles staying put while the packed array shuffles, an erased
+ * handle failing the lookup once its slot is taken again, the generation
+ * wrapping at 15 bits without ever making INVALID or a negative int, the free
+ * list handing slots back out, the slot limit, Reset, Save/Load, and the
+ * bullet store's net id table (owner ranges, a reused id replacing the old
+ * bullet).
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project SlotMapTest.cpp -o slotmaptest
+ ******************************************************************************/
+
+#include <algorithm>
+#include <vector>
+#include "TestCommon.h"
+#include "EntityStore.h"
+#include "Random.h"
+
+const unsigned int TEST_SEED = 2468;
+
+// what Save/Load want, a flat list of words
+struct WordStream
+{
+	std::vector<uint32_t> words;
+	size_t read = 0;
+
+	void Put(uint32_t v) { words.push_back(v); }
+	bool Get(uint32_t& v)
+	{
+		if (read >= words.size()) return false;
+		v = words[read++];
+		return true;
+	}
+};
+
+static uint32_t Generation(SlotMap::Handle handle) { return handle >> 16; }
+static uint32_t SlotOf(SlotMap::Handle handle) { return handle & 0xFFFF; }
+
+// random inserts and erases, every live handle has to find its own dense index
+static void TestChurn()
+{
+	std::printf("churn\n");
+	SlotMap map;
+	map.Reset(500);
+	Pcg32 rng;
+	rng.Seed(TEST_SEED);
+
+	// mirrors the dense array, what a store would keep next to the map
+	std::vector<SlotMap::Handle> dense;
+	std::vector<SlotMap::Handle> erased;
+	for (int step = 0; step < 20000; ++step)
+	{
+		if (dense.empty() || (rng.NextFloat() < 0.55f && !map.Full()))
+		{
+			SlotMap::Handle handle = map.Insert();
+			CHECK(handle != SlotMap::INVALID);
+			CHECK(map.Find(handle) == (int)dense.size());
+			dense.push_back(handle);
+		}
+		else
+		{
+			int i = (int)(rng.NextFloat() * dense.size()) % (int)dense.size();
+			erased.push_back(dense[i]);
+			map.EraseAt(i);
+			dense[i] = dense.back();
+			dense.pop_back();
+		}
+	}
+
+	CHECK(map.Size() == (int)dense.size());
+	for (int i = 0; i < (int)dense.size(); ++i)
+	{
+		CHECK(map.Find(dense[i]) == i);
+		CHECK(map.HandleAt(i) == dense[i]);
+	}
+
+	// nothing erased comes back, even though its slot has long been taken again
+	int stale = 0;
+	for (SlotMap::Handle handle : erased)
+	{
+		if (std::find(dense.begin(), dense.end(), handle) != dense.end()) continue;
+		CHECK(map.Find(handle) == -1);
+		++stale;
+	}
+	CHECK(stale > 1000);
+	CHECK(map.Find(SlotMap::INVALID) == -1);
+	CHECK(map.Find(0x7FFFFFFF) == -1);
+}
+
+// an erased handle stops working the moment its slot is reused, and the free list reuses it
+static void TestStaleAndFreeList()
+{
+	std::printf("stale handles and the free list\n");
+	SlotMap map;
+	map.Reset(16);
+
+	SlotMap::Handle a = map.Insert();
+	SlotMap::Handle b = map.Insert();
+	SlotMap::Handle c = map.Insert();
+	CHECK(Generation(a) == 1 && Generation(b) == 1 && Generation(c) == 1);
+
+	// b goes, c moves into its dense index but keeps its handle
+	map.EraseAt(map.Find(b));
+	CHECK(map.Find(b) == -1);
+	CHECK(map.Find(c) == 1);
+	CHECK(map.Find(a) == 0);
+
+	// the next insert takes b's slot with the next generation
+	SlotMap::Handle d = map.Insert();
+	CHECK(SlotOf(d) == SlotOf(b));
+	CHECK(Generation(d) == Generation(b) + 1);
+	CHECK(map.Find(b) == -1);
+	CHECK(map.Find(d) == 2);
+
+	// freed slots come back before any new one gets made, last freed first
+	map.EraseAt(map.Find(a));
+	map.EraseAt(map.Find(c));
+	SlotMap::Handle e = map.Insert();
+	SlotMap::Handle f = map.Insert();
+	CHECK(SlotOf(e) == SlotOf(c));
+	CHECK(SlotOf(f) == SlotOf(a));
+	SlotMap::Handle g = map.Insert();
+	CHECK(SlotOf(g) == 3);
+	CHECK(map.Find(a) == -1 && map.Find(c) == -1);
+
+	// Reset makes every handle stale but keeps the slots for reuse
+	map.Reset(16);
+	CHECK(map.Size() == 0);
+	for (SlotMap::Handle handle : { d, e, f, g }) CHECK(map.Find(handle) == -1);
+	SlotMap::Handle h = map.Insert();
+	CHECK(SlotOf(h) == 0);
+	CHECK(Generation(h) > 1);
+}
+
+// one slot erased and reused until its generation comes round again
+static void TestGenerationWrap()
+{
+	std::printf("generation wrap\n");
+	SlotMap map;
+	map.Reset(4);
+
+	SlotMap::Handle first = map.Insert();
+	SlotMap::Handle previous = first;
+	SlotMap::Handle last = first;
+	bool sawMax = false;
+	for (int lap = 0; lap < SLOT_MAP_MAX_GEN; ++lap)
+	{
+		map.EraseAt(0);
+		SlotMap::Handle handle = map.Insert();
+		CHECK(handle != SlotMap::INVALID);
+		CHECK(SlotOf(handle) == SlotOf(first));
+		// top bit stays clear, handles go on the wire as a positive int
+		CHECK((int)handle > 0);
+		CHECK(map.Find(previous) == -1);
+		if (Generation(handle) == SLOT_MAP_MAX_GEN) sawMax = true;
+		previous = handle;
+		last = handle;
+	}
+
+	// 0x7FFF generations, 1 through 0x7FFF, and the next one is 1 again never 0
+	CHECK(sawMax);
+	CHECK(Generation(last) == 1);
+	CHECK(last == first);
+	map.EraseAt(0);
+	CHECK(Generation(map.Insert()) == 2);
+}
+
+static void TestLimitAndSaveLoad()
+{
+	std::printf("limit and save/load\n");
+	SlotMap map;
+	map.Reset(3);
+	CHECK(map.Insert() != SlotMap::INVALID);
+	SlotMap::Handle b = map.Insert();
+	CHECK(map.Insert() != SlotMap::INVALID);
+	CHECK(map.Full());
+	CHECK(map.Insert() == SlotMap::INVALID);
+	map.EraseAt(map.Find(b));
+	CHECK(!map.Full());
+
+	// a loaded copy finds the same handles and hands out the same next one
+	WordStream stream;
+	map.Save(stream);
+	SlotMap copy;
+	CHECK(copy.Load(stream));
+	CHECK(copy.Size() == map.Size());
+	for (int i = 0; i < map.Size(); ++i) CHECK(copy.Find(map.HandleAt(i)) == i);
+	CHECK(copy.Find(b) == -1);
+	CHECK(copy.Insert() == map.Insert());
+
+	// cut short anywhere, the load fails instead of reading past the end
+	for (size_t cut = 0; cut < stream.words.size(); ++cut)
+	{
+		WordStream partial;
+		partial.words.assign(stream.words.begin(), stream.words.begin() + cut);
+		SlotMap broken;
+		CHECK(!broken.Load(partial));
+	}
+}
+
+static Bullet OwnedBullet(int owner, float x)
+{
+	Bullet bullet{};
+	bullet.ownerID = owner;
+	bullet.active = true;
+	bullet.xPos = x;
+	return bullet;
+}
+
+static void TestBulletNetIDs()
+{
+	std::printf("bullet net ids\n");
+	BulletStore bullets;
+
+	// player 2 owns 200 through 299 and nothing else
+	CHECK(BulletStore::OwnsNetID(2, 200));
+	CHECK(BulletStore::OwnsNetID(2, 299));
+	CHECK(!BulletStore::OwnsNetID(2, 199));
+	CHECK(!BulletStore::OwnsNetID(2, 300));
+	CHECK(!BulletStore::OwnsNetID(0, -1));
+	CHECK(!BulletStore::OwnsNetID(-1, 5));
+	CHECK(bullets.Add(5, OwnedBullet(2, 0.0f)) == SlotMap::INVALID);
+	CHECK(bullets.Add(-3, OwnedBullet(0, 0.0f)) == SlotMap::INVALID);
+	CHECK(bullets.Count() == 0);
+
+	SlotMap::Handle a = bullets.Add(200, OwnedBullet(2, 1.0f));
+	SlotMap::Handle b = bullets.Add(201, OwnedBullet(2, 2.0f));
+	SlotMap::Handle c = bullets.Add(7, OwnedBullet(0, 3.0f));
+	CHECK(a != SlotMap::INVALID && b != SlotMap::INVALID && c != SlotMap::INVALID);
+	CHECK(bullets.Count() == 3);
+	CHECK(bullets.byNetID[200] == a && bullets.byNetID[7] == c);
+
+	// the client came round to 200 again, the old bullet makes way
+	SlotMap::Handle a2 = bullets.Add(200, OwnedBullet(2, 4.0f));
+	CHECK(bullets.Count() == 3);
+	CHECK(bullets.ids.Find(a) == -1);
+	CHECK(bullets.byNetID[200] == a2);
+	int i = bullets.ids.Find(a2);
+	CHECK(i >= 0 && bullets.xPos[i] == 4.0f && bullets.netID[i] == 200);
+
+	// removing one clears its id and leaves the moved one findable by its own
+	bullets.RemoveAt(bullets.ids.Find(b));
+	CHECK(bullets.byNetID[201] == SlotMap::INVALID);
+	for (int n = 0; n < bullets.Count(); ++n) CHECK(bullets.byNetID[bullets.netID[n]] == bullets.ids.HandleAt(n));
+
+	// a player leaving takes only their own
+	bullets.RemoveOwner(2);
+	CHECK(bullets.Count() == 1);
+	CHECK(bullets.byNetID[200] == SlotMap::INVALID);
+	CHECK(bullets.byNetID[7] == c);
+
+	bullets.Clear();
+	CHECK(bullets.Count() == 0);
+	CHECK(bullets.byNetID[7] == SlotMap::INVALID);
+}
+
+int main()
+{
+	TestChurn();
+	TestStaleAndFreeList();
+	TestGenerationWrap();
+	TestLimitAndSaveLoad();
+	TestBulletNetIDs();
+	return TestResult("SlotMap");
+}
@@ -0,0 +1,246 @@
+/*******************************************************************************
+ * Snapshot tests
+ *
+ * WorldViews filled in by hand go through GatherSnapshot and PackSnapshot the
+ * way SendSnapshot sends them, and every chunk is read back the way the
+ * client's STATE_UPDATE handler reads it, after a trip through ToString and
+ * the Packet(string) the receive side builds.
+ *
+ * Covers every ship in the sim and every asteroid coming out exactly once
+ * however many chunks it takes, no chunk too big for the receive side or cut
+ * short by a write that didnt fit, every chunk tagged with the view's tick
+ * and the time, asteroids moved on by the lead, ships left out of the sim,
+ * an empty world still sending one chunk, and interest: only what the client
+ * has, and an asteroid it has that is already gone from the view skipped.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project SnapshotTest.cpp -o snapshottest
+ ******************************************************************************/
+
+#include <cstring>
+#include <vector>
+#include "TestCommon.h"
+#include "Snapshot.h"
+
+const uint32_t TEST_TICK = 4321;
+const uint64_t TEST_TIME = 987654321;
+const float TEST_LEAD = 0.25f;
+
+// a published world built by hand, Capture needs a whole ServerData
+struct TestView
+{
+	WorldView view;
+
+	TestView(int slots, int asteroidSlots)
+	{
+		view.tick = TEST_TICK;
+		view.slots = slots;
+		view.inSim.assign(slots, 0);
+		view.shipX.assign(slots, 0.0f);
+		view.shipY.assign(slots, 0.0f);
+		view.shipVelX.assign(slots, 0.0f);
+		view.shipVelY.assign(slots, 0.0f);
+		view.shipDir.assign(slots, 0.0f);
+		view.score.assign(slots, 0);
+		view.asteroidBySlot.assign(asteroidSlots, -1);
+	}
+
+	// everything about it derived from the slot so a read back can be checked
+	void AddShip(int id)
+	{
+		view.inSim[id] = 1;
+		view.shipX[id] = id * 3.0f;
+		view.shipY[id] = id * -2.0f;
+		view.shipVelX[id] = id + 0.5f;
+		view.shipVelY[id] = -id - 0.5f;
+		view.shipDir[id] = id * 0.01f;
+		view.score[id] = id * 10;
+	}
+
+	SlotMap::Handle AddAsteroid(int slot, int generation)
+	{
+		SlotMap::Handle handle = (static_cast<SlotMap::Handle>(generation) << 16) | static_cast<SlotMap::Handle>(slot);
+		view.asteroidBySlot[slot] = view.AsteroidCount();
+		view.asteroidHandle.push_back(handle);
+		view.asteroidX.push_back(slot * 1.5f);
+		view.asteroidY.push_back(slot * -1.5f);
+		view.asteroidVelX.push_back(slot * 4.0f);
+		view.asteroidVelY.push_back(-8.0f);
+		view.asteroidDir.push_back(slot * 0.02f);
+		return handle;
+	}
+};
+
+// what a client gets out of a set of chunks, by id
+struct Received
+{
+	std::vector<int> shipSeen;
+	std::vector<int> asteroidSeen; // by slot
+	int chunks = 0;
+	int badShips = 0;
+	int badAsteroids = 0;
+};
+
+static void Read(const TestView& test, const std::vector<Packet>& chunks, Received& received)
+{
+	const WorldView& view = test.view;
+	received.shipSeen.assign(view.slots, 0);
+	received.asteroidSeen.assign(view.asteroidBySlot.size(), 0);
+
+	for (Packet chunk : chunks)
+	{
+		++received.chunks;
+		// the receive side turns away anything that doesnt fit with the id in front
+		CHECK(chunk.writePos <= MAX_BODY_LEN - 1);
+		Packet msg(chunk.ToString());
+		CHECK(msg.id == STATE_UPDATE);
+
+		uint32_t tick = 0;
+		uint64_t serverTime = 0;
+		int shipCount = -1;
+		msg >> tick >> serverTime >> shipCount;
+		CHECK(tick == TEST_TICK);
+		CHECK(serverTime == TEST_TIME);
+		CHECK(shipCount >= 0);
+		for (int n = 0; n < shipCount; ++n)
+		{
+			int id = -1;
+			float x = 0.0f, y = 0.0f, velX = 0.0f, velY = 0.0f, dir = 0.0f;
+			int score = 0;
+			msg >> id >> x >> y >> velX >> velY >> dir >> score;
+			if (id < 0 || id >= view.slots)
+			{
+				++received.badShips;
+				continue;
+			}
+			++received.shipSeen[id];
+			if (x != view.shipX[id] || y != view.shipY[id] || velX != view.shipVelX[id] || velY != view.shipVelY[id]
+				|| dir != view.shipDir[id] || score != view.score[id]) ++received.badShips;
+		}
+
+		int asteroidCount = -1;
+		msg >> asteroidCount;
+		CHECK(asteroidCount >= 0);
+		for (int n = 0; n < asteroidCount; ++n)
+		{
+			int handle = 0;
+			float x = 0.0f, y = 0.0f, velX = 0.0f, velY = 0.0f, dir = 0.0f;
+			msg >> handle >> x >> y >> velX >> velY >> dir;
+			int i = view.FindAsteroid(static_cast<SlotMap::Handle>(handle));
+			if (i < 0)
+			{
+				++received.badAsteroids;
+				continue;
+			}
+			++received.asteroidSeen[handle & 0xFFFF];
+			if (x != view.asteroidX[i] + view.asteroidVelX[i] * TEST_LEAD || y != view.asteroidY[i] + view.asteroidVelY[i] * TEST_LEAD
+				|| velX != view.asteroidVelX[i] || velY != view.asteroidVelY[i] || dir != view.asteroidDir[i]) ++received.badAsteroids;
+		}
+
+		// nothing was dropped by a write that didnt fit, the counts cover the whole body
+		CHECK(msg.readPos == msg.writePos);
+		CHECK(msg.writePos == (size_t)(SNAPSHOT_HEADER_LEN + shipCount * SNAPSHOT_SHIP_LEN + asteroidCount * SNAPSHOT_ASTEROID_LEN));
+	}
+}
+
+static void TestEmptyWorld()
+{
+	std::printf("empty world\n");
+	TestView test(8, 16);
+	SnapshotContents contents;
+	GatherSnapshot(test.view, nullptr, contents);
+	CHECK(contents.shipIDs.empty() && contents.asteroidIndices.empty());
+
+	std::vector<Packet> chunks;
+	PackSnapshot(test.view, contents, TEST_TIME, TEST_LEAD, chunks);
+	CHECK(chunks.size() == 1);
+	Received received;
+	Read(test, chunks, received);
+	CHECK(received.badShips == 0 && received.badAsteroids == 0);
+}
+
+// more ships than one chunk holds and a lot more asteroids, some slots out of the sim
+static void TestEverythingOnce()
+{
+	std::printf("everything once\n");
+	const int slots = 200;
+	const int asteroids = 1000;
+	TestView test(slots, asteroids + 50);
+	for (int id = 0; id < slots; ++id)
+	{
+		if (id % 7 != 3) test.AddShip(id);
+	}
+	// packed out of slot order, like an AsteroidStore after some removals
+	for (int n = 0; n < asteroids; ++n) test.AddAsteroid((n * 389) % (asteroids + 50), 1 + n % 5);
+
+	SnapshotContents contents;
+	GatherSnapshot(test.view, nullptr, contents);
+	std::vector<Packet> chunks;
+	PackSnapshot(test.view, contents, TEST_TIME, TEST_LEAD, chunks);
+	CHECK(chunks.size() > 10);
+
+	Received received;
+	Read(test, chunks, received);
+	CHECK(received.badShips == 0 && received.badAsteroids == 0);
+	for (int id = 0; id < slots; ++id) CHECK(received.shipSeen[id] == (id % 7 != 3 ? 1 : 0));
+	for (int i = 0; i < test.view.AsteroidCount(); ++i) CHECK(received.asteroidSeen[test.view.asteroidHandle[i] & 0xFFFF] == 1);
+
+	// packing again after other chunks keeps what was there and adds the same again
+	size_t before = chunks.size();
+	PackSnapshot(test.view, contents, TEST_TIME, TEST_LEAD, chunks);
+	CHECK(chunks.size() == before * 2);
+}
+
+static void TestInterest()
+{
+	std::printf("interest\n");
+	TestView test(6, 32);
+	for (int id = 0; id < 6; ++id) test.AddShip(id);
+	test.view.inSim[4] = 0;
+	std::vector<SlotMap::Handle> handles;
+	for (int slot = 0; slot < 20; ++slot) handles.push_back(test.AddAsteroid(slot, 2));
+
+	InterestSet interest;
+	interest.ships.assign(6, 0);
+	interest.ships[0] = interest.ships[2] = 1;
+	// left the sim since the last interest pass, not sent even though it is in the set
+	interest.ships[4] = 1;
+	interest.asteroids = { handles[3], handles[11], handles[17] };
+	// one destroyed since, its slot now has something else and one never reused
+	SlotMap::Handle older = handles[5] - (1u << 16);
+	SlotMap::Handle gone = (2u << 16) | 25u;
+	interest.asteroids.push_back(older);
+	interest.asteroids.push_back(gone);
+	std::sort(interest.asteroids.begin(), interest.asteroids.end());
+
+	SnapshotContents contents;
+	GatherSnapshot(test.view, &interest, contents);
+	CHECK(contents.shipIDs == std::vector<int>({ 0, 2 }));
+	CHECK(contents.asteroidIndices.size() == 3);
+
+	std::vector<Packet> chunks;
+	PackSnapshot(test.view, contents, TEST_TIME, TEST_LEAD, chunks);
+	CHECK(chunks.size() == 1);
+	Received received;
+	Read(test, chunks, received);
+	CHECK(received.badShips == 0 && received.badAsteroids == 0);
+	for (int id = 0; id < 6; ++id) CHECK(received.shipSeen[id] == (id == 0 || id == 2 ? 1 : 0));
+	for (int slot = 0; slot < 32; ++slot) CHECK(received.asteroidSeen[slot] == (slot == 3 || slot == 11 || slot == 17 ? 1 : 0));
+
+	// nothing in the set, the client still hears the tick
+	interest.Clear();
+	GatherSnapshot(test.view, &interest, contents);
+	CHECK(contents.shipIDs.empty() && contents.asteroidIndices.empty());
+	chunks.clear();
+	PackSnapshot(test.view, contents, TEST_TIME, TEST_LEAD, chunks);
+	CHECK(chunks.size() == 1);
+	Read(test, chunks, received);
+	CHECK(received.chunks == 2);
+}
+
+int main()
+{
+	TestEmptyWorld();
+	TestEverythingOnce();
+	TestInterest();
+	return TestResult("Snapshot");
+}
@@ -0,0 +1,53 @@
+/*******************************************************************************
+ * Shared bits for the test programs in this folder
+ *
+ * No framework, each test is one .cpp that builds against the server's headers
+ * and exits non zero when any CHECK failed, so a script can just run them all:
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project NetEmulatorTest.cpp -o netemulatortest
+ * or an empty console project with ../Server_Project on the include path and
+ * ws2_32.lib linked.
+ *
+ * Anything random runs off a fixed seed so a failure happens again the same way.
+ ******************************************************************************/
+
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#include <cstdint>
+// winsock has these, Packet.h expects them
+inline uint64_t htonll(uint64_t v)
+{
+	return htonl(1) == 1 ? v : (static_cast<uint64_t>(htonl(static_cast<uint32_t>(v))) << 32) | htonl(static_cast<uint32_t>(v >> 32));
+}
+inline uint64_t ntohll(uint64_t v) { return htonll(v); }
+#endif
+
+#include <cmath>
+#include <cstdio>
+
+static int testFailures = 0;
+
+// keeps going after a failure so one run shows everything that is broken
+#define CHECK(cond) \
+	do { if (!(cond)) { ++testFailures; std::printf("  FAILED %s:%d  %s\n", __FILE__, __LINE__, #cond); } } while (0)
+
+// rates from a seeded run, tolerance is absolute
+#define CHECK_NEAR(value, expected, tolerance) \
+	do { double v_ = (value), e_ = (expected); if (std::fabs(v_ - e_) > (tolerance)) { ++testFailures; \
+		std::printf("  FAILED %s:%d  %s = %f, expected %f +- %f\n", __FILE__, __LINE__, #value, v_, e_, (double)(tolerance)); } } while (0)
+
+inline int TestResult(const char* name)
+{
+	if (testFailures == 0) std::printf("%s: all passed\n", name);
+	else std::printf("%s: %d failed\n", name, testFailures);
+	return testFailures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,148 @@
+/*******************************************************************************
+ * Triple buffer tests
+ *
+ * The TripleBuffer the room publishes its WorldView through, with a stand-in
+ * view that is one sequence number written over a lot of fields, so a reader
+ * that sees half of one publish and half of another can tell.
+ *
+ * Covers what a reader gets before anything was published, Read picking up
+ * only the newest of several publishes, Read giving the same buffer again when
+ * nothing new came, Published being the writer's last one, the back buffer
+ * never being one the reader or Published is on, and a writer and a reader on
+ * two threads going flat out: every read whole, never older than the one
+ * before it, and the reader seeing new ones while the writer runs.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project TripleBufferTest.cpp -o triplebuffertest
+ ******************************************************************************/
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include "TestCommon.h"
+#include "WorldView.h"
+
+const int TEST_FIELDS = 512;
+const uint32_t TEST_PUBLISHES = 2000000;
+
+struct TestView
+{
+	uint32_t seq;
+	uint32_t fields[TEST_FIELDS];
+
+	TestView() { Fill(0); }
+
+	void Fill(uint32_t s)
+	{
+		seq = s;
+		for (int i = 0; i < TEST_FIELDS; ++i) fields[i] = s * 31 + i;
+	}
+
+	bool Whole() const
+	{
+		for (int i = 0; i < TEST_FIELDS; ++i)
+		{
+			if (fields[i] != seq * 31 + i) return false;
+		}
+		return true;
+	}
+};
+
+static void TestSingleThread()
+{
+	std::printf("single thread\n");
+	TripleBuffer<TestView> buffer;
+
+	// nothing published yet, the reader gets an empty view
+	const TestView* front = &buffer.Read();
+	CHECK(front->seq == 0 && front->Whole());
+
+	buffer.Back().Fill(1);
+	buffer.Publish();
+	CHECK(buffer.Published().seq == 1);
+	CHECK(&buffer.Back() != &buffer.Published());
+
+	// several publishes before the reader looks, only the newest comes out
+	for (uint32_t s = 2; s <= 5; ++s)
+	{
+		buffer.Back().Fill(s);
+		buffer.Publish();
+		CHECK(buffer.Published().seq == s);
+	}
+	front = &buffer.Read();
+	CHECK(front->seq == 5 && front->Whole());
+
+	// nothing new, the same buffer again
+	CHECK(&buffer.Read() == front);
+
+	// the writer never gets handed what the reader holds or what it published
+	for (uint32_t s = 6; s <= 50; ++s)
+	{
+		CHECK(&buffer.Back() != front);
+		CHECK(&buffer.Back() != &buffer.Published());
+		buffer.Back().Fill(s);
+		buffer.Publish();
+		if (s % 3 == 0)
+		{
+			front = &buffer.Read();
+			CHECK(front->seq == s && front->Whole());
+		}
+		CHECK(&buffer.Published() != &buffer.Back());
+	}
+
+	// the one it published stays as it was while the next is written
+	buffer.Back().Fill(51);
+	CHECK(buffer.Published().seq == 50 && buffer.Published().Whole());
+}
+
+static void TestConcurrent()
+{
+	std::printf("concurrent\n");
+	TripleBuffer<TestView> buffer;
+	std::atomic<bool> done{ false };
+	int writerFailures = 0;
+
+	std::thread writer([&]()
+		{
+			for (uint32_t s = 1; s <= TEST_PUBLISHES; ++s)
+			{
+				buffer.Back().Fill(s);
+				buffer.Publish();
+				// the worker reads its own last publish while the reader has another
+				if (buffer.Published().seq != s || !buffer.Published().Whole()) ++writerFailures;
+			}
+			done.store(true, std::memory_order_release);
+		});
+
+	uint32_t last = 0;
+	uint64_t reads = 0;
+	uint64_t torn = 0;
+	uint64_t backwards = 0;
+	uint64_t changes = 0;
+	for (;;)
+	{
+		bool finished = done.load(std::memory_order_acquire);
+		const TestView& view = buffer.Read();
+		++reads;
+		if (!view.Whole()) ++torn;
+		if (view.seq < last) ++backwards;
+		if (view.seq != last) ++changes;
+		last = view.seq;
+		if (finished) break;
+	}
+	writer.join();
+
+	CHECK(writerFailures == 0);
+	CHECK(torn == 0);
+	CHECK(backwards == 0);
+	// once the writer is done the newest is the last one it published
+	CHECK(last == TEST_PUBLISHES);
+	CHECK(changes > 1);
+	std::printf("  %llu reads, %llu different publishes seen\n", (unsigned long long)reads, (unsigned long long)changes);
+}
+
+int main()
+{
+	TestSingleThread();
+	TestConcurrent();
+	return TestResult("TripleBuffer");
+}
@@ -0,0 +1,139 @@
+/*******************************************************************************
+ * Wake signal tests
+ *
+ * A WakeSignal used the way a room worker uses it: wait until the next thing
+ * is due, and another thread notifying when it has queued something.
+ *
+ * Covers a wait with nothing notified sleeping to its deadline, a deadline
+ * already past not sleeping, a notify that came while the worker was busy
+ * waking the next wait at once, several notifies being one wake up, a notify
+ * from another thread waking a long wait early, and a producer queueing
+ * flat out while the worker drains: every wait that ends by timing out must
+ * find nothing queued, so no notify was ever lost.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project WakeSignalTest.cpp -o wakesignaltest
+ ******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "TestCommon.h"
+#include "WakeSignal.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const int TEST_ITEMS = 200000;
+
+static long long MsSince(Clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+static void TestTimeouts()
+{
+	std::printf("timeouts\n");
+	WakeSignal signal;
+
+	// nothing notified, sleeps until it is due
+	Clock::time_point start = Clock::now();
+	CHECK(!signal.WaitUntil(start + std::chrono::milliseconds(30)));
+	CHECK(MsSince(start) >= 30);
+
+	// already due, doesnt sleep at all
+	start = Clock::now();
+	CHECK(!signal.WaitUntil(start - std::chrono::milliseconds(5)));
+	CHECK(MsSince(start) < 20);
+}
+
+static void TestRemembered()
+{
+	std::printf("remembered\n");
+	WakeSignal signal;
+
+	// notified while the worker was busy, the next wait is over at once
+	signal.Notify();
+	Clock::time_point start = Clock::now();
+	CHECK(signal.WaitUntil(start + std::chrono::seconds(5)));
+	CHECK(MsSince(start) < 1000);
+
+	// and only that one, the one after sleeps again
+	start = Clock::now();
+	CHECK(!signal.WaitUntil(start + std::chrono::milliseconds(20)));
+	CHECK(MsSince(start) >= 20);
+
+	// several before the worker gets to it are one wake up
+	for (int i = 0; i < 10; ++i) signal.Notify();
+	CHECK(signal.WaitUntil(Clock::now() + std::chrono::seconds(5)));
+	CHECK(!signal.WaitUntil(Clock::now() + std::chrono::milliseconds(20)));
+
+	// even a deadline that has passed reports the notify
+	signal.Notify();
+	CHECK(signal.WaitUntil(Clock::now() - std::chrono::milliseconds(5)));
+}
+
+static void TestOtherThread()
+{
+	std::printf("other thread\n");
+	WakeSignal signal;
+	Clock::time_point start = Clock::now();
+	std::thread notifier([&signal]()
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			signal.Notify();
+		});
+
+	// a long way off, woken early
+	CHECK(signal.WaitUntil(start + std::chrono::seconds(10)));
+	long long waited = MsSince(start);
+	CHECK(waited >= 15 && waited < 5000);
+	notifier.join();
+}
+
+// a producer queueing and notifying like QueueTo/PostCommand, a worker draining like UpdateRoom
+static void TestNoLostWakeups()
+{
+	std::printf("no lost wakeups\n");
+	WakeSignal signal;
+	std::atomic<int> queued{ 0 };
+	std::atomic<bool> done{ false };
+
+	std::thread producer([&]()
+		{
+			for (int i = 0; i < TEST_ITEMS; ++i)
+			{
+				queued.fetch_add(1, std::memory_order_release);
+				signal.Notify();
+				if (i % 1000 == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+			}
+			done.store(true, std::memory_order_release);
+			signal.Notify();
+		});
+
+	int taken = 0;
+	int wakes = 0;
+	int missed = 0;
+	while (!done.load(std::memory_order_acquire) || taken < TEST_ITEMS)
+	{
+		taken += queued.exchange(0, std::memory_order_acquire);
+		// long enough that a lost notify shows up as a timeout with work waiting
+		bool woken = signal.WaitUntil(Clock::now() + std::chrono::milliseconds(500));
+		if (woken) ++wakes;
+		else if (queued.load(std::memory_order_acquire) > 0) ++missed;
+	}
+	producer.join();
+
+	CHECK(taken == TEST_ITEMS);
+	CHECK(missed == 0);
+	// notifies while the worker was busy were folded together
+	CHECK(wakes > 0 && wakes < TEST_ITEMS);
+	std::printf("  %d items, %d wake ups\n", taken, wakes);
+}
+
+int main()
+{
+	TestTimeouts();
+	TestRemembered();
+	TestOtherThread();
+	TestNoLostWakeups();
+	return TestResult("WakeSignal");
+}
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ * Wave ring tests
+ *
+ * A room's rng feeding a WaveRing the way the worker does, filled ahead in
+ * spare moments and popped when a wave is due, against MakeWave called right
+ * when each wave is needed off another rng with the same seed.
+ *
+ * Covers waves coming out the same and in the same order however far ahead
+ * they were made, the ring going round many times, Fill stopping at
+ * WAVE_RING_SIZE without touching the rng, Pop on an empty ring, Clear then a
+ * reseed giving the new seed's waves, and every asteroid of a wave starting on
+ * its edge and moving at ASTEROID_ACCEL.
+ *
+ *   g++ -O2 -std=c++17 -pthread -I../Server_Project WaveRingTest.cpp -o waveringtest
+ ******************************************************************************/
+
+#include <cfloat>
+#include <cstring>
+#include "TestCommon.h"
+#include "Wave.h"
+
+const unsigned int TEST_SEED = 8642;
+const unsigned int TEST_RESEED = 9753;
+
+static bool SameAsteroid(const Asteroid& a, const Asteroid& b)
+{
+	return a.xPos == b.xPos && a.yPos == b.yPos && a.vel_x == b.vel_x && a.vel_y == b.vel_y
+		&& a.dirCur == b.dirCur && a.xScale == b.xScale && a.yScale == b.yScale && a.active == b.active && a.ID == b.ID;
+}
+
+static bool SameWave(const Wave& a, const Wave& b)
+{
+	for (int i = 0; i < WAVE_SIZE; ++i)
+	{
+		if (!SameAsteroid(a.asteroids[i], b.asteroids[i])) return false;
+	}
+	return true;
+}
+
+// how many the worker gets round to making between two waves, all over the place
+static int SpareFills(int wave)
+{
+	const int pattern[] = { 0, 1, 0, 5, 2, 0, 0, 3, 1, 9 };
+	return pattern[wave % 10];
+}
+
+static void TestSameWavesAnyFillPattern()
+{
+	std::printf("same waves any fill pattern\n");
+	Pcg32 roomRng, directRng;
+	roomRng.Seed(TEST_SEED);
+	directRng.Seed(TEST_SEED);
+	WaveRing ring;
+
+	int mismatches = 0;
+	for (int wave = 0; wave < 200; ++wave)
+	{
+		for (int n = 0; n < SpareFills(wave); ++n) ring.Fill(roomRng);
+		CHECK(ring.Count() <= WAVE_RING_SIZE);
+
+		// due, the same as UpdateRoom: only made now if nothing was made ahead
+		if (ring.Empty()) ring.Fill(roomRng);
+		Wave expected;
+		MakeWave(directRng, expected);
+		if (!SameWave(ring.Front(), expected)) ++mismatches;
+		ring.Pop();
+	}
+	CHECK(mismatches == 0);
+}
+
+static void TestFullAndEmpty()
+{
+	std::printf("full and empty\n");
+	Pcg32 rng;
+	rng.Seed(TEST_SEED);
+	WaveRing ring;
+	CHECK(ring.Empty() && ring.Count() == 0);
+
+	// popping nothing does nothing
+	ring.Pop();
+	CHECK(ring.Empty() && ring.Count() == 0);
+
+	for (int i = 0; i < WAVE_RING_SIZE; ++i) CHECK(ring.Fill(rng));
+	CHECK(ring.Full() && ring.Count() == WAVE_RING_SIZE);
+
+	// a full ring doesnt draw from the rng, or the next wave made would skip ahead
+	Pcg32 before = rng;
+	CHECK(!ring.Fill(rng));
+	CHECK(ring.Count() == WAVE_RING_SIZE);
+	CHECK(rng.Next() == before.Next());
+
+	// the oldest comes out first
+	Pcg32 check;
+	check.Seed(TEST_SEED);
+	for (int i = 0; i < WAVE_RING_SIZE; ++i)
+	{
+		Wave expected;
+		MakeWave(check, expected);
+		CHECK(SameWave(ring.Front(), expected));
+		ring.Pop();
+	}
+	CHECK(ring.Empty());
+}
+
+// what Room::Seed does, nothing made from the old seed comes out
+static void TestClearAndReseed()
+{
+	std::printf("clear and reseed\n");
+	Pcg32 rng;
+	rng.Seed(TEST_SEED);
+	WaveRing ring;
+	ring.Fill(rng);
+	ring.Fill(rng);
+	ring.Pop();
+	ring.Fill(rng);
+
+	ring.Clear();
+	CHECK(ring.Empty());
+	rng.Seed(TEST_RESEED);
+	ring.Fill(rng);
+	ring.Fill(rng);
+
+	Pcg32 check;
+	check.Seed(TEST_RESEED);
+	for (int i = 0; i < 2; ++i)
+	{
+		Wave expected;
+		MakeWave(check, expected);
+		CHECK(SameWave(ring.Front(), expected));
+		ring.Pop();
+	}
+}
+
+static void TestWaveShape()
+{
+	std::printf("wave shape\n");
+	Pcg32 rng;
+	rng.Seed(TEST_SEED);
+	for (int w = 0; w < 50; ++w)
+	{
+		Wave wave;
+		MakeWave(rng, wave);
+		for (int i = 0; i < WAVE_SIZE; ++i)
+		{
+			const Asteroid& asteroid = wave.asteroids[i];
+			// bottom, top, left, right, twice over
+			switch (i % 4)
+			{
+			case 0: CHECK(asteroid.yPos == -Y_SIZE); break;
+			case 1: CHECK(asteroid.yPos == Y_SIZE); break;
+			case 2: CHECK(asteroid.xPos == -X_SIZE); break;
+			case 3: CHECK(asteroid.xPos == X_SIZE); break;
+			}
+			CHECK(asteroid.xPos >= -X_SIZE && asteroid.xPos <= X_SIZE);
+			CHECK(asteroid.yPos >= -Y_SIZE && asteroid.yPos <= Y_SIZE);
+			CHECK_NEAR(std::sqrt(asteroid.vel_x * asteroid.vel_x + asteroid.vel_y * asteroid.vel_y), ASTEROID_ACCEL, 0.01);
+			CHECK(asteroid.active && asteroid.ID == -1);
+		}
+	}
+}
+
+int main()
+{
+	TestSameWavesAnyFillPattern();
+	TestFullAndEmpty();
+	TestClearAndReseed();
+	TestWaveShape();
+	return TestResult("WaveRing");
+}